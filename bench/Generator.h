@@ -0,0 +1,312 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// synthetic SysY programs for the compile-throughput benchmark; every
+// dimension scales on its own:
+//   functions    number of functions besides main
+//   statements   assignments in the innermost body of each function
+//   depth        nesting of if/else blocks around that body
+//   expr_depth   depth of the expression trees assigned
+//   rank         rank of the global arrays
+//   init_size    elements in the initializer of each global array
+//   loop_depth   nesting of while loops around the body
+// The programs are valid SysY and only depend on the options
+struct GenOptions
+{
+    int functions = 16;
+    int statements = 32;
+    int depth = 2;
+    int expr_depth = 4;
+    int rank = 2;
+    int init_size = 64;
+    int loop_depth = 1;
+    uint32_t seed = 1;
+};
+
+
+// the option names, for command lines and reports
+inline int *gen_option(GenOptions &options, const std::string &name)
+{
+    if (name == "functions")return &options.functions;
+    if (name == "statements")return &options.statements;
+    if (name == "depth")return &options.depth;
+    if (name == "expr_depth")return &options.expr_depth;
+    if (name == "rank")return &options.rank;
+    if (name == "init_size")return &options.init_size;
+    if (name == "loop_depth")return &options.loop_depth;
+    return nullptr;
+}
+
+
+inline const std::vector<std::string> &gen_option_names()
+{
+    static const std::vector<std::string> names = {"functions", "statements",
+        "depth", "expr_depth", "rank", "init_size", "loop_depth"};
+    return names;
+}
+
+
+class Generator
+{
+public:
+    // number of tokens in the last program generated
+    long tokens = 0;
+
+    explicit Generator(const GenOptions &options) : options(options) {}
+
+    std::string generate()
+    {
+        text.clear();
+        tokens = 0;
+        state = options.seed ? options.seed : 1;
+        // every dimension gets init_size ^ (1 / rank) elements
+        int rank = std::max(options.rank, 1);
+        int width = std::max(1, int(std::lround(std::pow(
+            std::max(options.init_size, 1), 1.0 / rank))));
+        dims.assign(rank, width);
+        globals();
+        for (int i = 0; i < options.functions; i++)function(i);
+        main_function();
+        return text;
+    }
+
+private:
+    const GenOptions &options;
+    std::string text;
+    std::vector<int> dims;
+    uint32_t state = 1;
+    int indent = 0;
+    // locals of the function being generated
+    static const int local_num = 4;
+
+    uint32_t random(uint32_t n)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % n;
+    }
+
+    void tok(const std::string &token)
+    {
+        if (!text.empty() && text.back() != '\n' && text.back() != ' ')
+            text += ' ';
+        text += token;
+        tokens++;
+    }
+
+    void line()
+    {
+        text += '\n';
+        text.append(indent * 2, ' ');
+    }
+
+    void array_type()
+    {
+        for (int dim : dims)
+        {
+            tok("[");
+            tok(std::to_string(dim));
+            tok("]");
+        }
+    }
+
+    // a braced initializer of dimension level, counting down elements
+    void initializer(size_t level, int &elements)
+    {
+        tok("{");
+        for (int i = 0; i < dims[level] && elements > 0; i++)
+        {
+            if (i)tok(",");
+            if (level + 1 == dims.size())
+            {
+                tok(std::to_string(random(100)));
+                elements--;
+            }
+            else initializer(level + 1, elements);
+        }
+        tok("}");
+    }
+
+    void globals()
+    {
+        tok("int"); tok("g"); tok(";"); line();
+        for (const char *name : {"ga", "gc"})
+        {
+            if (name[1] == 'c')tok("const");
+            tok("int"); tok(name);
+            array_type();
+            tok("=");
+            int elements = options.init_size;
+            initializer(0, elements);
+            tok(";"); line();
+        }
+    }
+
+    void element(const char *array)
+    {
+        tok(array);
+        for (int dim : dims)
+        {
+            tok("[");
+            tok(std::to_string(random(dim)));
+            tok("]");
+        }
+    }
+
+    void leaf()
+    {
+        switch (random(4))
+        {
+        case 0: tok(std::to_string(random(1000))); break;
+        case 1: element(random(2) ? "ga" : "gc"); break;
+        default: tok("v" + std::to_string(random(local_num))); break;
+        }
+    }
+
+    // a chain of depth binary operators, nested on the left
+    void expression(int depth)
+    {
+        if (depth == 0)
+        {
+            leaf();
+            return;
+        }
+        static const char *ops[] = {"+", "-", "*", "/", "%", "<", ">", "==",
+            "&&", "||"};
+        const char *op = ops[random(10)];
+        tok("(");
+        expression(depth - 1);
+        tok(")");
+        tok(op);
+        // no division by zero
+        if (op[0] == '/' || op[0] == '%')tok(std::to_string(random(9) + 1));
+        else leaf();
+    }
+
+    void statement(int index)
+    {
+        if (index > 0 && random(8) == 0)
+        {
+            // a call of an earlier function
+            tok("v" + std::to_string(random(local_num)));
+            tok("=");
+            tok("f" + std::to_string(random(index)));
+            tok("(");
+            leaf();
+            tok(",");
+            leaf();
+            tok(")");
+        }
+        else if (random(8) == 0)
+        {
+            element("ga");
+            tok("=");
+            expression(options.expr_depth);
+        }
+        else
+        {
+            tok("v" + std::to_string(random(local_num)));
+            tok("=");
+            expression(options.expr_depth);
+        }
+        tok(";");
+    }
+
+    void open(const std::string &word)
+    {
+        tok(word);
+        indent++;
+        line();
+    }
+
+    void close(const std::string &word = "}")
+    {
+        indent--;
+        text.resize(text.size() - 2);
+        tok(word);
+        line();
+    }
+
+    void body(int index, int depth, int loop_depth)
+    {
+        if (depth > 0)
+        {
+            tok("if"); tok("(");
+            tok("v" + std::to_string(random(local_num)));
+            tok("<"); tok(std::to_string(random(100)));
+            tok(")"); open("{");
+            body(index, depth - 1, loop_depth);
+            close();
+            tok("else"); open("{");
+            statement(index);
+            line();
+            close();
+            return;
+        }
+        if (loop_depth > 0)
+        {
+            std::string i = "i" + std::to_string(loop_depth);
+            tok("int"); tok(i); tok("="); tok("0"); tok(";"); line();
+            tok("while"); tok("("); tok(i); tok("<"); tok("4"); tok(")");
+            open("{");
+            body(index, 0, loop_depth - 1);
+            tok(i); tok("="); tok(i); tok("+"); tok("1"); tok(";");
+            line();
+            close();
+            return;
+        }
+        for (int i = 0; i < options.statements; i++)
+        {
+            statement(index);
+            line();
+        }
+    }
+
+    void function(int index)
+    {
+        tok("int"); tok("f" + std::to_string(index));
+        tok("("); tok("int"); tok("x"); tok(","); tok("int"); tok("y");
+        tok(")"); open("{");
+        for (int i = 0; i < local_num; i++)
+        {
+            tok("int"); tok("v" + std::to_string(i)); tok("=");
+            tok(i % 2 ? "y" : "x"); tok("+"); tok(std::to_string(i));
+            tok(";"); line();
+        }
+        body(index, options.depth, options.loop_depth);
+        tok("g"); tok("="); tok("g"); tok("+"); tok("v0"); tok(";"); line();
+        tok("return");
+        for (int i = 0; i < local_num; i++)
+        {
+            if (i)tok("+");
+            tok("v" + std::to_string(i));
+        }
+        tok(";");
+        line();
+        close();
+        line();
+    }
+
+    void main_function()
+    {
+        tok("int"); tok("main"); tok("("); tok(")"); open("{");
+        tok("int"); tok("s"); tok("="); tok("0"); tok(";"); line();
+        for (int i = 0; i < options.functions; i++)
+        {
+            tok("s"); tok("="); tok("s"); tok("+");
+            tok("f" + std::to_string(i));
+            tok("("); tok(std::to_string(i)); tok(",");
+            tok(std::to_string(random(10))); tok(")"); tok(";"); line();
+        }
+        tok("putint"); tok("("); tok("s"); tok("+"); tok("g"); tok(")");
+        tok(";"); line();
+        tok("return"); tok("0"); tok(";"); line();
+        close();
+    }
+};
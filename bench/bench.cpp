@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Compiler.h"
+#include "Generator.h"
+#include "Trace.h"
+using namespace std;
+
+
+// compile-throughput benchmark: compiles generated programs (see Generator.h)
+// while one dimension is swept and the others stay at their defaults, and
+// reports the time of each phase (from the time trace) and
+//   tokens/s        tokens over the time of parse (lexing included)
+//   AST nodes/s     AST nodes over the time of irgen
+//   instructions/s  instructions emitted over the time of codegen
+// "scaling" is the exponent of the total time in the number of tokens since
+// the previous point of the sweep (0 at the first), well above 1 means
+// superlinear behavior
+
+
+struct Result
+{
+    string sweep;
+    int value;
+    long tokens = 0, nodes = 0, insts = 0;
+    map<string, double> phases;  // seconds, the least of the repetitions
+    double total = 0, scaling = 0;
+};
+
+
+static const vector<pair<string, vector<int>>> default_sweeps = {
+    {"functions", {16, 32, 64, 128, 256}},
+    {"statements", {16, 32, 64, 128, 256}},
+    {"depth", {1, 2, 4, 8, 16}},
+    {"expr_depth", {2, 4, 8, 16, 32}},
+    {"rank", {1, 2, 3, 4}},
+    {"init_size", {64, 256, 1024, 4096, 16384}},
+    {"loop_depth", {1, 2, 4, 8}},
+};
+
+
+// lines of the assembly that are instructions
+static long count_insts(const string &code)
+{
+    long insts = 0;
+    istringstream lines(code);
+    for (string line; getline(lines, line);)
+        if (line.size() > 1 && line[0] == '\t' && line[1] != '.')insts++;
+    return insts;
+}
+
+
+static Result run(CompilerContext &context, const GenOptions &options,
+    int repeat)
+{
+    Result result;
+    Generator generator(options);
+    string source = generator.generate(), output;
+    result.tokens = generator.tokens;
+    bool ok = context.compile(source, output);
+    assert(ok);
+    result.nodes = context.ast_nodes;
+    result.insts = count_insts(output);
+    for (int i = 0; i < repeat; i++)
+    {
+        time_trace.take();
+        auto start = chrono::steady_clock::now();
+        context.compile(source, output);
+        double total = chrono::duration<double>(chrono::steady_clock::now() -
+            start).count();
+        map<string, double> phases;
+        for (auto &event : time_trace.take())
+            if (event.detail.empty())phases[event.name] += event.duration / 1e6;
+        if (i == 0 || total < result.total)result.total = total;
+        for (auto &phase : phases)
+            if (i == 0 || phase.second < result.phases[phase.first])
+                result.phases[phase.first] = phase.second;
+    }
+    return result;
+}
+
+
+static double rate(long count, const Result &result, const string &phase)
+{
+    auto time = result.phases.find(phase);
+    if (time == result.phases.end() || time->second <= 0)return 0;
+    return count / time->second;
+}
+
+
+static void write_csv(const string &path, const vector<Result> &results,
+    const vector<string> &phases)
+{
+    ofstream csv(path);
+    csv << "sweep,value,tokens,ast_nodes,instructions";
+    for (auto &phase : phases)csv << "," << phase << "_ms";
+    csv << ",total_ms,tokens_per_sec,ast_nodes_per_sec,instructions_per_sec,"
+        "scaling" << endl;
+    csv << fixed << setprecision(3);
+    for (auto &result : results)
+    {
+        csv << result.sweep << "," << result.value << "," << result.tokens <<
+            "," << result.nodes << "," << result.insts;
+        for (auto &phase : phases)
+        {
+            auto time = result.phases.find(phase);
+            csv << "," << (time == result.phases.end() ? 0 :
+                time->second * 1000);
+        }
+        csv << "," << result.total * 1000 << "," <<
+            rate(result.tokens, result, "parse") << "," <<
+            rate(result.nodes, result, "irgen") << "," <<
+            rate(result.insts, result, "codegen") << "," << result.scaling <<
+            endl;
+    }
+}
+
+
+static void write_json(const string &path, const vector<Result> &results)
+{
+    ofstream json(path);
+    json << fixed << setprecision(3);
+    json << "[";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        auto &result = results[i];
+        json << (i ? ",\n" : "\n") << "{\"sweep\":\"" << result.sweep <<
+            "\",\"value\":" << result.value << ",\"tokens\":" <<
+            result.tokens << ",\"ast_nodes\":" << result.nodes <<
+            ",\"instructions\":" << result.insts << ",\"phases_ms\":{";
+        bool first = true;
+        for (auto &phase : result.phases)
+        {
+            json << (first ? "" : ",") << "\"" << phase.first << "\":" <<
+                phase.second * 1000;
+            first = false;
+        }
+        json << "},\"total_ms\":" << result.total * 1000 <<
+            ",\"tokens_per_sec\":" << rate(result.tokens, result, "parse") <<
+            ",\"ast_nodes_per_sec\":" << rate(result.nodes, result, "irgen") <<
+            ",\"instructions_per_sec\":" <<
+            rate(result.insts, result, "codegen") << ",\"scaling\":" <<
+            result.scaling << "}";
+    }
+    json << "\n]" << endl;
+}
+
+
+// compiler-bench [-o=<prefix>] [-repeat=<n>] [-mode=<mode>] [-O<n>]
+//                [-sweep=<option>:<v1>,<v2>,...]... [-<option>=<value>]...
+// sweeps are the default ones unless given; -<option>=<value> changes the
+// value the other dimensions stay at. Results go to <prefix>.csv and
+// <prefix>.json (bench by default)
+int main(int argc, const char *argv[])
+{
+    string prefix = "bench", mode = "-riscv";
+    int repeat = 3, level = -1;
+    GenOptions base;
+    vector<pair<string, vector<int>>> sweeps;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        size_t equal = arg.find('=');
+        string name = arg.substr(1, equal == string::npos ? string::npos :
+            equal - 1), value = equal == string::npos ? "" :
+            arg.substr(equal + 1);
+        if (arg.size() == 3 && arg[1] == 'O')level = arg[2] - '0';
+        else if (name == "o")prefix = value;
+        else if (name == "repeat")repeat = max(atoi(value.c_str()), 1);
+        else if (name == "mode")mode = value;
+        else if (name == "sweep")
+        {
+            size_t colon = value.find(':');
+            assert(colon != string::npos);
+            sweeps.emplace_back(value.substr(0, colon), vector<int>());
+            stringstream list(value.substr(colon + 1));
+            for (string item; getline(list, item, ',');)
+                sweeps.back().second.push_back(atoi(item.c_str()));
+        }
+        else
+        {
+            int *option = gen_option(base, name);
+            assert(option && "unknown option");
+            *option = atoi(value.c_str());
+        }
+    }
+    if (sweeps.empty())sweeps = default_sweeps;
+
+    CompilerContext context(mode);
+    context.passes.level = level;
+    time_trace.enable();
+    vector<Result> results;
+    vector<string> phases;
+    cout << fixed << setprecision(3);
+    cout << left << setw(12) << "sweep" << right << setw(7) << "value" <<
+        setw(10) << "tokens" << setw(12) << "total (ms)" << setw(12) <<
+        "Mtok/s" << setw(12) << "Mnode/s" << setw(12) << "Minst/s" <<
+        setw(9) << "scaling" << endl;
+    for (auto &sweep : sweeps)
+    {
+        GenOptions options = base;
+        int *option = gen_option(options, sweep.first);
+        assert(option && "unknown option");
+        for (size_t i = 0; i < sweep.second.size(); i++)
+        {
+            *option = sweep.second[i];
+            Result result = run(context, options, repeat);
+            result.sweep = sweep.first;
+            result.value = sweep.second[i];
+            if (i > 0)
+            {
+                const Result &previous = results.back();
+                double tokens = double(result.tokens) / previous.tokens;
+                if (tokens > 1 && previous.total > 0)
+                    result.scaling = log(result.total / previous.total) /
+                        log(tokens);
+            }
+            for (auto &phase : result.phases)
+                if (find(phases.begin(), phases.end(), phase.first) ==
+                    phases.end())
+                    phases.push_back(phase.first);
+            cout << left << setw(12) << result.sweep << right << setw(7) <<
+                result.value << setw(10) << result.tokens << setw(12) <<
+                result.total * 1000 << setw(12) <<
+                rate(result.tokens, result, "parse") / 1e6 << setw(12) <<
+                rate(result.nodes, result, "irgen") / 1e6 << setw(12) <<
+                rate(result.insts, result, "codegen") / 1e6 << setw(9) <<
+                result.scaling << endl;
+            results.push_back(result);
+        }
+    }
+    write_csv(prefix + ".csv", results, phases);
+    write_json(prefix + ".json", results);
+    cerr << "results in " << prefix << ".csv and " << prefix << ".json" <<
+        endl;
+    return 0;
+}
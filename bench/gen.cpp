@@ -0,0 +1,33 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "Generator.h"
+using namespace std;
+
+
+// sysy-gen [-<option>=<value>]... [-seed=<n>]
+// prints a synthetic program, the options are those of GenOptions
+int main(int argc, const char *argv[])
+{
+    GenOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        size_t equal = arg.find('=');
+        assert(arg[0] == '-' && equal != string::npos);
+        string name = arg.substr(1, equal - 1);
+        int value = atoi(arg.c_str() + equal + 1);
+        if (name == "seed")options.seed = value;
+        else
+        {
+            int *option = gen_option(options, name);
+            assert(option && "unknown option");
+            *option = value;
+        }
+    }
+    Generator generator(options);
+    cout << generator.generate();
+    cerr << generator.tokens << " tokens" << endl;
+    return 0;
+}
@@ -2,43 +2,87 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <cassert>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <new>
 #include <variant>
+#include <sstream>
+#include "Memory.h"
+#include "Output.h"
+#include "Trace.h"
+#include "Type.h"
 
 
-static int symbol_num = 0;
-static int if_else_num = 0;
-static int while_num = 0;
-static int const_list_num = 0;
-static int var_list_num = 0;
-enum class FuncFParamType { var, list };
-enum class UnaryExpType { primary, unary, func_call };
-enum class PrimaryExpType { exp, number, lval, list };
-enum class StmtType { if_, ifelse, simple, while_ };
-enum class SimpleStmtType { lval, exp, block, ret, break_, continue_, list };
-enum class DeclType { const_decl, var_decl };
-enum class ConstInitValType { const_exp, list };
-enum class BlockItemType { decl, stmt };
-enum class InitValType { exp, list };
-static std::vector<std::map<std::string, std::variant<int, std::string>>>
-    symbol_tables;
-static std::map<std::string, int> var_num;
-static std::map<std::string, int> is_list;
-static std::map<std::string, int> is_func_param;
-static std::map<std::string, int> list_dim;
-static std::vector<int> while_stack;
-static std::map<std::string, std::string> function_table;
-static std::map<std::string, std::string> function_ret_type;
-static std::map<std::string, int> function_param_num;
-static std::map<std::string, std::vector<std::string>> function_param_idents;
-static std::map<std::string, std::vector<std::string>> function_param_names;
-static std::map<std::string, std::vector<std::string>> function_param_types;
-static std::string present_func_type;
-
-
-static std::variant<int, std::string> look_up_symbol_tables(std::string l_val)
+inline thread_local int symbol_num = 0;
+inline thread_local int if_else_num = 0;
+inline thread_local int while_num = 0;
+// symbol tables and initializer lists are counted by -mem-report
+template <class K, class V>
+using SymbolMap = std::map<K, V, std::less<K>,
+    MemAllocator<std::pair<const K, V>, MEM_SYMBOL_TABLES>>;
+using SymbolTable = SymbolMap<std::string, std::variant<int, std::string>>;
+using InitList = std::vector<int, MemAllocator<int, MEM_INITIALIZERS>>;
+inline thread_local std::vector<SymbolTable> symbol_tables;
+// the depth of the block of each table, see declare
+inline thread_local std::vector<int> symbol_table_depths;
+inline thread_local int block_depth = 0;
+inline thread_local SymbolMap<std::string, int> var_num;
+inline thread_local SymbolMap<std::string, int> is_list;
+inline thread_local SymbolMap<std::string, int> is_func_param;
+inline thread_local SymbolMap<std::string, int> list_dim;
+inline thread_local std::vector<int> while_stack;
+inline thread_local SymbolMap<std::string, std::string> function_table;
+inline thread_local SymbolMap<std::string, TypeId> function_ret_type;
+inline thread_local SymbolMap<std::string, int> function_param_num;
+inline thread_local SymbolMap<std::string, std::vector<std::string>>
+    function_param_idents;
+inline thread_local SymbolMap<std::string, std::vector<std::string>>
+    function_param_names;
+inline thread_local SymbolMap<std::string, std::vector<TypeId>>
+    function_param_types;
+inline thread_local TypeId present_func_type = TypeTable::unit;
+// -g: statements put "// line N" before their IR when the line changes, the
+// backend takes the lines out again (see Lines.h)
+inline thread_local bool mark_lines = false;
+inline thread_local int marked_line = 0;
+
+
+// state of the frontend is per thread, it has to be reset between programs
+inline void reset_frontend()
+{
+    symbol_num = if_else_num = while_num = 0;
+    symbol_tables.clear();
+    symbol_table_depths.clear();
+    block_depth = 0;
+    var_num.clear();
+    is_list.clear();
+    is_func_param.clear();
+    list_dim.clear();
+    while_stack.clear();
+    function_table.clear();
+    function_ret_type.clear();
+    function_param_num.clear();
+    function_param_idents.clear();
+    function_param_names.clear();
+    function_param_types.clear();
+    present_func_type = TypeTable::unit;
+    marked_line = 0;
+}
+
+
+inline void ir_mark_line(int line)
+{
+    if (!mark_lines || line == 0 || line == marked_line)return;
+    marked_line = line;
+    out << "// line " << line << std::endl;
+}
+
+
+inline std::variant<int, std::string> look_up_symbol_tables(std::string l_val)
 {
     for (auto it = symbol_tables.rbegin(); it != symbol_tables.rend(); it++)
         if (it->count(l_val))
@@ -48,1541 +92,1366 @@ static std::variant<int, std::string> look_up_symbol_tables(std::string l_val)
 }
 
 
-class BaseAST
+// binds ident in the innermost block; a block only gets a symbol table when
+// it declares something, so lookups from deep nesting pass only those
+inline void declare(const std::string &ident,
+    std::variant<int, std::string> value)
 {
-public:
-    virtual ~BaseAST() = default;
-    virtual void dump() const = 0;
-    virtual std::string dumpIR() const = 0;
-    virtual int dumpExp() const { assert(false); return -1; }
-    virtual std::string get_ident() const { assert(false); return ""; }
-    virtual std::string get_type() const { assert(false); return ""; }
-    virtual int get_dim() const { assert(false); return -1; }
-    virtual std::vector<int> dumpList(std::vector<int>) const { exit(1); }
-};
+    if (symbol_table_depths.empty() ||
+        symbol_table_depths.back() != block_depth)
+    {
+        symbol_tables.emplace_back();
+        symbol_table_depths.push_back(block_depth);
+    }
+    symbol_tables.back()[ident] = std::move(value);
+}
+
 
+inline void enter_block() { block_depth++; }
 
-class CompUnitAST : public BaseAST
+
+inline void leave_block()
 {
-public:
-    std::vector<std::unique_ptr<BaseAST>> func_def_list;
-    std::vector<std::unique_ptr<BaseAST>> decl_list;
-    void dump() const override
-    {
-        std::cout << "CompUnitAST { ";
-        for (auto&& func_def : func_def_list)
-            func_def->dump();
-        std::cout << " } ";
-    }
-    std::string dumpIR() const override
+    if (!symbol_table_depths.empty() &&
+        symbol_table_depths.back() == block_depth)
     {
-        std::cout << "decl @getint(): i32" << std::endl;
-        std::cout << "decl @getch(): i32" << std::endl;
-        std::cout << "decl @getarray(*i32): i32" << std::endl;
-        std::cout << "decl @putint(i32)" << std::endl;
-        std::cout << "decl @putch(i32)" << std::endl;
-        std::cout << "decl @putarray(i32, *i32)" << std::endl;
-        std::cout << "decl @starttime()" << std::endl;
-        std::cout << "decl @stoptime()" << std::endl << std::endl;
-        function_table["getint"] = "@getint";
-        function_table["getch"] = "@getch";
-        function_table["getarray"] = "@getarray";
-        function_table["putint"] = "@putint";
-        function_table["putch"] = "@putch";
-        function_table["putarray"] = "@putarray";
-        function_table["starttime"] = "@starttime";
-        function_table["stoptime"] = "@stoptime";
-        function_ret_type["getint"] = "int";
-        function_ret_type["getch"] = "int";
-        function_ret_type["getarray"] = "int";
-        function_ret_type["putint"] = "void";
-        function_ret_type["putch"] = "void";
-        function_ret_type["putarray"] = "void";
-        function_ret_type["starttime"] = "void";
-        function_ret_type["stoptime"] = "void";
-        function_param_num["getint"] = 0;
-        function_param_num["getch"] = 0;
-        function_param_num["getarray"] = 1;
-        function_param_num["putint"] = 1;
-        function_param_num["putch"] = 1;
-        function_param_num["putarray"] = 2;
-        function_param_num["starttime"] = 0;
-        function_param_num["stoptime"] = 0;
-        std::map<std::string, std::variant<int, std::string>> global_syms;
-        symbol_tables.push_back(global_syms);
-        for (auto&& decl : decl_list)decl->dumpExp();
-        std::cout << std::endl;
-        for (auto&& func_def : func_def_list)func_def->dumpIR();
         symbol_tables.pop_back();
-        return "";
+        symbol_table_depths.pop_back();
     }
+    block_depth--;
+}
+
+
+// the AST is made of Nodes of one layout, allocated one after another in the
+// arena of their AST and freed with it. The chains of single rules of the
+// grammar (LOrExp -> LAndExp -> ... -> PrimaryExp, Decl, BlockItem, ConstExp)
+// get no nodes of their own, an expression is the node of its operator. What
+// the fields of a node hold depends on its kind:
+//   comp_unit     list: the declarations and functions, in order
+//   func_def      type, ident, list: params, a: the block
+//   func_fparam   type, ident, value: 1 if an array, list: its dimensions
+//                 after the first
+//   block         list: the items; ident: the function, if the block is the
+//                 body of one with params
+//   stmt          a: a statement of the ones below, if_ to while_ excluded
+//   if_, if_else  a: the condition, b: then, c: else
+//   while_        a: the condition, b: the body
+//   ret           a: the value or null
+//   assign        ident, a: the value
+//   assign_list   ident, list: the indices, a: the value
+//   block_stmt    a: the block
+//   exp_stmt      a: the expression or null
+//   break_, continue_
+//   exp           a: the expression (Exp of the grammar, -test shows it)
+//   binary        op, a, b
+//   unary         op, a
+//   call          ident, list: the arguments
+//   number        value
+//   lval          ident
+//   index         ident, list: the indices
+//   const_decl, var_decl
+//                 type, list: the definitions
+//   const_def     ident, list: the dimensions, a: the initializer
+//   var_def       ident, list: the dimensions, a: the initializer or null
+//   init_list     list: the elements ({...} of initializers)
+enum class NodeKind : uint8_t
+{
+    comp_unit, func_def, func_fparam, block, stmt, if_, if_else, while_, ret,
+    assign, assign_list, block_stmt, exp_stmt, break_, continue_, exp, binary,
+    unary, call, number, lval, index, const_decl, var_decl, const_def,
+    var_def, init_list
+};
+enum class Op : uint8_t
+{
+    none, add, sub, mul, div, mod, lt, gt, le, ge, eq, ne, and_, or_, not_
+};
+inline const char *op_texts[] = {"", "+", "-", "*", "/", "%", "<", ">", "<=",
+    ">=", "==", "!=", "&&", "||", "!"};
+// of binary operators in the IR
+inline const char *op_insts[] = {"", "add", "sub", "mul", "div", "mod", "lt",
+    "gt", "le", "ge", "eq", "ne", "", "", ""};
+enum class BType : uint8_t { int_, void_ };
+inline const char *btype_names[] = {"int", "void"};
+
+
+struct Node;
+
+
+// the children of a node, in the arena
+struct NodeList
+{
+    Node **items = nullptr;
+    uint32_t size = 0;
+    Node *const *begin() const { return items; }
+    Node *const *end() const { return items + size; }
+    bool empty() const { return size == 0; }
+    Node *operator[](size_t i) const { return items[i]; }
+};
+
+
+struct Node
+{
+    NodeKind kind;
+    Op op = Op::none;
+    BType type = BType::int_;
+    int line = 0;  // in the source, of statements, definitions and functions
+    int value = 0;
+    std::string_view ident;  // in the source
+    Node *a = nullptr, *b = nullptr, *c = nullptr;
+    NodeList list;
+};
+
+
+// a list while the parser collects it, see AST::list
+struct NodeChain
+{
+    struct Link { Node *node; Link *next; } *head, *tail;
+    uint32_t size;
 };
 
 
-class FuncFParamAST : public BaseAST
+// a parsed program, all of it goes with the AST. With on_item set, each
+// function and global declaration is handed to it as soon as it is parsed
+// and its nodes go right after (-stream), root is then left empty
+class AST
 {
 public:
-    FuncFParamType type;
-    std::string b_type;
-    std::string ident;
-    std::vector<std::unique_ptr<BaseAST>> const_exp_list;
-    void dump() const override { std::cout << get_type() << " " << ident; }
-    std::string dumpIR() const override
+    Node *root = nullptr;
+    size_t nodes = 0;
+    std::function<void(Node *)> on_item;
+
+    AST() = default;
+    AST(const AST &) = delete;
+    AST &operator=(const AST &) = delete;
+    ~AST()
     {
-        assert(b_type == "int");
-        std::string param_name = "@" + ident;
-        std::string name = param_name + "_" +
-            std::to_string(var_num[param_name]++);
-        std::cout << name;
-        return name;
+        for (void *block : blocks)mem_free(block, MEM_AST_NODES);
     }
-    std::string get_ident() const override { return ident; }
-    std::string dumpListType(std::vector<int> widths) const
+
+    Node *node(NodeKind kind, int line = 0)
     {
-        if (widths.size() == 0)return "i32";
-        std::vector<int> rec = std::vector<int>(widths.begin() + 1,
-            widths.end());
-        return "[" + dumpListType(rec) + ", " + std::to_string(widths.front())
-            + "]";
+        Node *node = new (alloc(sizeof(Node))) Node();
+        node->kind = kind;
+        node->line = line;
+        nodes++;
+        return node;
     }
-    std::string get_type() const override
-    {
-        if (type == FuncFParamType::var)return "i32";
-        std::vector<int> widths;
-        for (auto&& const_exp : const_exp_list)
-            widths.push_back(std::stoi(const_exp->dumpIR()));
-        return "*" + dumpListType(widths);
+
+    NodeChain chain() { return {nullptr, nullptr, 0}; }
+    NodeChain chain(Node *node) { return append(chain(), node); }
+    NodeChain append(NodeChain chain, Node *node)
+    {
+        auto link = new (alloc(sizeof(NodeChain::Link))) NodeChain::Link{node,
+            nullptr};
+        if (chain.tail)chain.tail->next = link;
+        else chain.head = link;
+        chain.tail = link;
+        chain.size++;
+        return chain;
     }
-    int get_dim() const override { return const_exp_list.size() + 1; }
-};
 
+    // adds a function or declaration to the program
+    NodeChain item(NodeChain chain, Node *node)
+    {
+        if (!on_item)return append(chain, node);
+        on_item(node);
+        // the parser holds nothing else from the arena between items, the
+        // last block is kept for the next one
+        if (blocks.empty())return chain;
+        for (size_t i = 0; i + 1 < blocks.size(); i++)
+            mem_free(blocks[i], MEM_AST_NODES);
+        blocks.erase(blocks.begin(), blocks.end() - 1);
+        used = 0;
+        return chain;
+    }
 
-class FuncDefAST : public BaseAST
-{
-public:
-    std::string func_type;
-    std::string ident;
-    std::vector<std::unique_ptr<BaseAST>> params;
-    std::unique_ptr<BaseAST> block;
-    void dump() const override
+    // the nodes of chain as a slice
+    NodeList list(const NodeChain &chain)
     {
-        std::cout << "FuncDefAST { " << func_type << ", " << ident << ", ";
-        for (int i = 0; i < params.size(); i++)
-        {
-            params[i]->dump();
-            if (i != params.size() - 1)std::cout << ", ";
-        }
-        block->dump();
-        std::cout << " } ";
+        NodeList list;
+        list.size = chain.size;
+        list.items = static_cast<Node **>(alloc(chain.size * sizeof(Node *)));
+        size_t i = 0;
+        for (auto link = chain.head; link; link = link->next)
+            list.items[i++] = link->node;
+        return list;
     }
-    std::string dumpIR() const override
+
+private:
+    std::vector<void *> blocks;
+    size_t used = 0, capacity = 0;
+
+    void *alloc(size_t size)
     {
-        std::string name = "@" + ident;
-        assert(!symbol_tables[0].count(ident));
-        assert(!function_table.count(ident));
-        function_table[ident] = name;
-        function_ret_type[ident] = func_type;
-        function_param_num[ident] = params.size();
-        present_func_type = func_type;
-        std::vector<std::string> idents, names, types;
-        std::cout << "fun " << name << "(";
-        for (int i = 0; i < params.size(); i++)
-        {
-            idents.push_back(params[i]->get_ident());
-            names.push_back(params[i]->dumpIR());
-            types.push_back(params[i]->get_type());
-            if (types.back() != "i32")
-            {
-                std::string tmp = names.back(); tmp[0] = '%';
-                list_dim[tmp] = params[i]->get_dim();
-            }
-            std::cout << ": " << params[i]->get_type();
-            if (i != params.size() - 1)std::cout << ", ";
-        }
-        function_param_idents[ident] = move(idents);
-        function_param_names[ident] = move(names);
-        function_param_types[ident] = move(types);
-        std::cout << ")";
-        if (func_type == "int")std::cout << ": i32";
-        else if (func_type != "void")assert(false);
-        std::cout << " {" << std::endl << "\%entry_" << ident << ":" <<
-            std::endl;
-        std::string block_type = block->dumpIR();
-        if (block_type != "ret")
+        size = (size + 7) & ~size_t(7);
+        if (blocks.empty() || used + size > capacity)
         {
-            if (func_type == "int")std::cout << "\tret 0" << std::endl;
-            else if (func_type == "void")std::cout << "\tret" << std::endl;
-            else assert(false);
+            capacity = std::max<size_t>(size, 64 * 1024);
+            blocks.push_back(mem_alloc(capacity, MEM_AST_NODES));
+            used = 0;
         }
-        std::cout << "}" << std::endl << std::endl;
-        return block_type;
+        void *ptr = static_cast<char *>(blocks.back()) + used;
+        used += size;
+        return ptr;
     }
 };
 
 
-class BlockAST : public BaseAST
+void dump(const Node *node);
+std::string dump_ir(const Node *node);
+std::vector<std::string> dump_ir_parts(const Node *comp_unit);
+int dump_exp(const Node *node);
+void dump_global(const Node *decl);
+InitList dump_list(const Node *init, const std::vector<int> &widths,
+    int &count);
+
+
+inline bool ends_block(const std::string &type)
 {
-public:
-    std::vector<std::unique_ptr<BaseAST>> block_item_list;
-    std::string func = "";
-    void dump() const override
+    return type == "ret" || type == "break" || type == "cont";
+}
+
+
+// stores the elements of a local array after prev, depth dimensions in
+inline void dump_list_init(const std::string &prev,
+    const std::vector<int> &widths, size_t depth, const InitList &init_list,
+    int &count)
+{
+    if (depth >= widths.size())
     {
-        std::cout << "BlockAST { ";
-        for (auto&& block_item : block_item_list)block_item->dump();
-        std::cout << " } ";
+        out << "\tstore " << init_list[count++] << ", " << prev << std::endl;
+        return;
     }
-    std::string dumpIR() const override
+    for (int i = 0; i < widths[depth]; i++)
     {
-        std::string block_type = "";
-        std::map<std::string, std::variant<int, std::string>> symbol_table;
-        if (func != "")
-        {
-            std::vector<std::string> idents = function_param_idents[func];
-            std::vector<std::string> names = function_param_names[func];
-            std::vector<std::string> types = function_param_types[func];
-            for (int i = 0; i < names.size(); i++)
-            {
-                std::string ident = idents[i];
-                std::string name = names[i]; name[0] = '%';
-                symbol_table[ident] = name;
-                is_func_param[name] = 1;
-                std::cout << '\t' << name << " = alloc ";
-                std::cout << types[i] << std::endl;
-                std::cout << "\tstore " << names[i] << ", " << name <<
-                    std::endl;
-            }
-        }
-        symbol_tables.push_back(symbol_table);
-        for (auto&& block_item : block_item_list)
-        {
-            block_type = block_item->dumpIR();
-            if (block_type == "ret" || block_type == "break" ||
-                block_type == "cont")break;
-        }
-        symbol_tables.pop_back();
-        return block_type;
+        std::string result_var = "%" + std::to_string(symbol_num++);
+        out << '\t' << result_var << " = getelemptr " << prev << ", " << i <<
+            std::endl;
+        dump_list_init(result_var, widths, depth + 1, init_list, count);
     }
-};
+}
 
 
-class StmtAST : public BaseAST
+inline void print_init_list(const std::vector<int> &widths, size_t depth,
+    const InitList &init_list, int &count)
 {
-public:
-    StmtType type;
-    std::unique_ptr<BaseAST> exp_simple;
-    std::unique_ptr<BaseAST> if_stmt;
-    std::unique_ptr<BaseAST> else_stmt;
-    std::unique_ptr<BaseAST> while_stmt;
-    void dump() const override
+    if (depth >= widths.size())
     {
-        if (type == StmtType::simple)
-        {
-            std::cout << "StmtAST { ";
-            exp_simple->dump();
-            std::cout << " } ";
-        }
-        else if (type == StmtType::if_)
-        {
-            std::cout << "IF { ";
-            exp_simple->dump();
-            std::cout << " } THEN { ";
-            if_stmt->dump();
-            std::cout << " } ";
-        }
-        else if (type == StmtType::ifelse)
-        {
-            std::cout << "IF { ";
-            exp_simple->dump();
-            std::cout << " } THEN { ";
-            if_stmt->dump();
-            std::cout << " } ELSE { ";
-            else_stmt->dump();
-            std::cout << " } ";
-        }
-        else if (type == StmtType::while_)
-        {
-            std::cout << "WHILE { ";
-            exp_simple->dump();
-            std::cout << " } DO { ";
-            while_stmt->dump();
-            std::cout << " } ";
-        }
-        else assert(false);
+        out << init_list[count++];
+        return;
     }
-    std::string dumpIR() const override
+    out << "{";
+    for (int i = 0; i < widths[depth]; i++)
     {
-        if (type == StmtType::simple)return exp_simple->dumpIR();
-        else if (type == StmtType::if_)
-        {
-            std::string if_result = exp_simple->dumpIR();
-            std::string then_label = "\%then__" + std::to_string(if_else_num);
-            std::string end_label = "\%end__" + std::to_string(if_else_num++);
-            std::cout << "\tbr " << if_result << ", " << then_label << ", " <<
-                end_label << std::endl;
-            std::cout << then_label << ":" << std::endl;
-            std::string if_stmt_type = if_stmt->dumpIR();
-            if (if_stmt_type != "ret" && if_stmt_type != "break" &&
-                if_stmt_type != "cont")
-                std::cout << "\tjump " << end_label << std::endl;
-            std::cout << end_label << ":" << std::endl;
-        }
-        else if (type == StmtType::ifelse)
-        {
-            std::string if_result = exp_simple->dumpIR();
-            std::string then_label = "\%then__" + std::to_string(if_else_num);
-            std::string else_label = "\%else__" + std::to_string(if_else_num);
-            std::string end_label = "\%end__" + std::to_string(if_else_num++);
-            std::cout << "\tbr " << if_result << ", " << then_label << ", " <<
-                else_label << std::endl;
-            std::cout << then_label << ":" << std::endl;
-            std::string if_stmt_type = if_stmt->dumpIR();
-            if (if_stmt_type != "ret" && if_stmt_type != "break" &&
-                if_stmt_type != "cont")
-                std::cout << "\tjump " << end_label << std::endl;
-            std::cout << else_label << ":" << std::endl;
-            std::string else_stmt_type = else_stmt->dumpIR();
-            if (else_stmt_type != "ret" && else_stmt_type != "break" &&
-                else_stmt_type != "cont")
-                std::cout << "\tjump " << end_label << std::endl;
-            if ((if_stmt_type == "ret" || if_stmt_type == "break" ||
-                if_stmt_type == "cont") && (else_stmt_type == "ret" ||
-                else_stmt_type == "break" || else_stmt_type == "cont"))
-                return "ret";
-            else std::cout << end_label << ":" << std::endl;
-        }
-        else if (type == StmtType::while_)
-        {
-            std::string entry_label = "\%while__" + std::to_string(while_num);
-            std::string body_label = "\%do__" + std::to_string(while_num);
-            std::string end_label = "\%while_end__" + std::to_string(while_num);
-            while_stack.push_back(while_num++);
-            std::cout << "\tjump " << entry_label << std::endl;
-            std::cout << entry_label << ":" << std::endl;
-            std::string while_result = exp_simple->dumpIR();
-            std::cout << "\tbr " << while_result << ", " << body_label << ", "
-                << end_label << std::endl;
-            std::cout << body_label << ":" << std::endl;
-            std::string while_stmt_type = while_stmt->dumpIR();
-            if (while_stmt_type != "ret" && while_stmt_type != "break" &&
-                while_stmt_type != "cont")
-                std::cout << "\tjump " << entry_label << std::endl;
-            std::cout << end_label << ":" << std::endl;
-            while_stack.pop_back();
-        }
-        else assert(false);
-        return "";
+        print_init_list(widths, depth + 1, init_list, count);
+        if (i != widths[depth] - 1)out << ", ";
     }
+    out << "}";
+}
+
+
+inline std::vector<int> dimensions(const NodeList &list)
+{
+    std::vector<int> widths;
+    for (auto exp : list)widths.push_back(dump_exp(exp));
+    return widths;
+}
+
+
+// the type of a param, i32 or *[[i32, 3], 4]
+inline TypeId param_type(const Node *param)
+{
+    if (param->value == 0)return TypeTable::i32;
+    return type_table.pointer(type_table.array(dimensions(param->list)));
+}
+
+
+// a part of the -test dump, a node or text if node is null
+struct DumpItem
+{
+    const Node *node;
+    std::string text;
 };
 
 
-class SimpleStmtAST : public BaseAST
+// -test; the parts of a node are pushed on a stack in reverse, so nesting
+// takes heap rather than stack
+inline void dump(const Node *root)
 {
-public:
-    SimpleStmtType type;
-    std::string lval;
-    std::vector<std::unique_ptr<BaseAST>> exp_list;
-    std::unique_ptr<BaseAST> block_exp;
-    void dump() const override
-    {
-        if (type == SimpleStmtType::ret)
-        {
-            std::cout << "RETURN { ";
-            block_exp->dump();
-            std::cout << " } ";
-        }
-        else if (type == SimpleStmtType::lval)
-        {
-            std::cout << "LVAL { " << lval << " = ";
-            block_exp->dump();
-            std::cout << " } ";
-        }
-        else if (type == SimpleStmtType::list)
-        {
-            std::cout << "LVAL { " << lval;
-            for (auto&& exp : exp_list)
+    std::vector<DumpItem> items{{root, ""}}, parts;
+    while (!items.empty())
+    {
+        DumpItem item = std::move(items.back());
+        items.pop_back();
+        const Node *node = item.node;
+        if (node == nullptr)
+        {
+            out << item.text;
+            continue;
+        }
+        parts.clear();
+        auto text = [&](std::string text)
+        {
+            parts.push_back({nullptr, std::move(text)});
+        };
+        auto child = [&](const Node *child) { parts.push_back({child, ""}); };
+        switch (node->kind)
+        {
+        case NodeKind::comp_unit:
+            text("CompUnitAST { ");
+            for (auto item : node->list)
+                if (item->kind == NodeKind::func_def)child(item);
+            text(" } ");
+            break;
+        case NodeKind::func_def:
+            text("FuncDefAST { " + std::string(btype_names[int(node->type)]) +
+                ", " + std::string(node->ident) + ", ");
+            for (size_t i = 0; i < node->list.size; i++)
             {
-                std::cout << '['; exp->dump(); std::cout << ']';
+                child(node->list[i]);
+                if (i != node->list.size - 1)text(", ");
             }
-            std::cout << " = ";
-            block_exp->dump();
-            std::cout << " } ";
-        }
-        else if (type == SimpleStmtType::exp)
-        {
-            if (block_exp != nullptr)
+            child(node->a);
+            text(" } ");
+            break;
+        case NodeKind::func_fparam:
+            text(type_table[param_type(node)].text + " " +
+                std::string(node->ident));
+            break;
+        case NodeKind::block:
+            text("BlockAST { ");
+            for (auto item : node->list)child(item);
+            text(" } ");
+            break;
+        case NodeKind::stmt:
+            text("StmtAST { "); child(node->a); text(" } ");
+            break;
+        case NodeKind::if_:
+            text("IF { "); child(node->a); text(" } THEN { ");
+            child(node->b); text(" } ");
+            break;
+        case NodeKind::if_else:
+            text("IF { "); child(node->a); text(" } THEN { ");
+            child(node->b); text(" } ELSE { "); child(node->c); text(" } ");
+            break;
+        case NodeKind::while_:
+            text("WHILE { "); child(node->a); text(" } DO { ");
+            child(node->b); text(" } ");
+            break;
+        case NodeKind::ret:
+            text("RETURN { "); child(node->a); text(" } ");
+            break;
+        case NodeKind::assign:
+            text("LVAL { " + std::string(node->ident) + " = ");
+            child(node->a);
+            text(" } ");
+            break;
+        case NodeKind::assign_list:
+            text("LVAL { " + std::string(node->ident));
+            for (auto exp : node->list)
             {
-                std::cout << "EXP { ";
-                block_exp->dump();
-                std::cout << " } ";
+                text("["); child(exp); text("]");
             }
-        }
-        else if (type == SimpleStmtType::block)
-        {
-            std::cout << "BLOCK { ";
-            block_exp->dump();
-            std::cout << " } ";
-        }
-        else if (type == SimpleStmtType::break_)std::cout << "BREAK ";
-        else if (type == SimpleStmtType::continue_)std::cout << "CONTINUE ";
-        else assert(false);
-    }
-    std::string dumpIR() const override
-    {
-        if (type == SimpleStmtType::ret)
-        {
-            if (block_exp == nullptr)
+            text(" = ");
+            child(node->a);
+            text(" } ");
+            break;
+        case NodeKind::block_stmt:
+            text("BLOCK { "); child(node->a); text(" } ");
+            break;
+        case NodeKind::exp_stmt:
+            if (node->a != nullptr)
             {
-                if (present_func_type == "int")
-                    std::cout << "\tret 0" << std::endl;
-                else std::cout << "\tret" << std::endl;
+                text("EXP { "); child(node->a); text(" } ");
             }
-            else
+            break;
+        case NodeKind::break_: text("BREAK "); break;
+        case NodeKind::continue_: text("CONTINUE "); break;
+        case NodeKind::exp:
+            text("ExpAST { "); child(node->a); text(" } ");
+            break;
+        case NodeKind::binary:
+            child(node->a); text(op_texts[int(node->op)]); child(node->b);
+            break;
+        case NodeKind::unary:
+            text(op_texts[int(node->op)]); child(node->a);
+            break;
+        case NodeKind::call:
+            text(std::string(node->ident) + "(");
+            for (size_t i = 0; i < node->list.size; i++)
             {
-                std::string result_var = block_exp->dumpIR();
-                std::cout << "\tret " << result_var << std::endl;
+                child(node->list[i]);
+                if (i != node->list.size - 1)text(", ");
             }
-            return "ret";
-        }
-        else if (type == SimpleStmtType::lval)
-        {
-            std::string result_var = block_exp->dumpIR();
-            std::variant<int, std::string> value = look_up_symbol_tables(lval);
-            assert(value.index() == 1);
-            std::cout << "\tstore " << result_var << ", " <<
-                std::get<std::string>(value) << std::endl;
-        }
-        else if (type == SimpleStmtType::list)
-        {
-            std::variant<int, std::string> value = look_up_symbol_tables(lval);
-            assert(value.index() == 1);
-            std::string result_var, name, prev = std::get<std::string>(value);
-            assert(list_dim[prev] == exp_list.size());
-            for (auto&& exp : exp_list)
+            break;
+        case NodeKind::number: text(std::to_string(node->value)); break;
+        case NodeKind::lval: text(std::string(node->ident)); break;
+        case NodeKind::index:
+            text(std::string(node->ident));
+            for (auto exp : node->list)
             {
-                result_var = exp->dumpIR();
-                name = "%" + std::to_string(symbol_num++);
-                if (is_func_param[prev])
-                {
-                    std::cout << '\t' << name << " = load " << prev <<
-                        std::endl;
-                    std::string tmp = "%" + std::to_string(symbol_num++);
-                    std::cout << '\t' << tmp << " = getptr " << name << ", "
-                        << result_var << std::endl;
-                    name = tmp;
-                }
-                else
-                    std::cout << '\t' << name << " = getelemptr " << prev <<
-                        ", " << result_var << std::endl;
-                prev = name;
+                text("["); child(exp); text("]");
             }
-            result_var = block_exp->dumpIR();
-            std::cout << "\tstore " << result_var << ", " << prev << std::endl;
-        }
-        else if (type == SimpleStmtType::exp)
-        {
-            if (block_exp != nullptr)block_exp->dumpIR();
-        }
-        else if (type == SimpleStmtType::block)return block_exp->dumpIR();
-        else if (type == SimpleStmtType::break_)
-        {
-            assert(!while_stack.empty());
-            int while_no = while_stack.back();
-            std::string end_label = "\%while_end__" + std::to_string(while_no);
-            std::cout << "\tjump " << end_label << std::endl;
-            return "break";
-        }
-        else if (type == SimpleStmtType::continue_)
-        {
-            assert(!while_stack.empty());
-            int while_no = while_stack.back();
-            std::string entry_label = "\%while__" + std::to_string(while_no);
-            std::cout << "\tjump " << entry_label << std::endl;
-            return "cont";
+            break;
+        case NodeKind::const_decl:
+        case NodeKind::var_decl:
+            assert(node->type == BType::int_);
+            for (auto def : node->list)child(def);
+            break;
+        case NodeKind::const_def:
+            text("ConstDefAST{" + std::string(node->ident) + "=");
+            if (node->a->kind != NodeKind::init_list)
+                text(std::to_string(dump_exp(node->a)));
+            else child(node->a);
+            text("} ");
+            break;
+        case NodeKind::var_def:
+            text("VarDefAST{" + std::string(node->ident));
+            if (node->a)
+            {
+                text("="); child(node->a);
+            }
+            text("} ");
+            break;
+        case NodeKind::init_list:
+            // the elements of constant ones are shown by value
+            text("{");
+            for (size_t i = 0; i < node->list.size; i++)
+            {
+                const Node *item = node->list[i];
+                if (node->value && item->kind != NodeKind::init_list)
+                    text(std::to_string(dump_exp(item)));
+                else child(item);
+                if (i != node->list.size - 1)text(",");
+            }
+            text("} ");
+            break;
         }
-        else assert(false);
-        return "";
+        for (auto it = parts.rbegin(); it != parts.rend(); it++)
+            items.push_back(std::move(*it));
     }
-};
+}
 
 
-class ExpAST : public BaseAST
+// IR of the declarations of the library, which goes before everything else,
+// and its functions in the tables
+inline void dump_ir_begin()
 {
-public:
-    std::unique_ptr<BaseAST> l_or_exp;
-    void dump() const override
-    {
-        std::cout << "ExpAST { ";
-        l_or_exp->dump();
-        std::cout << " } ";
-    }
-    std::string dumpIR() const override
-    {
-        return l_or_exp->dumpIR();
-    }
-    virtual int dumpExp() const override
-    {
-        return l_or_exp->dumpExp();
-    }
-};
+    out << "decl @getint(): i32" << std::endl;
+    out << "decl @getch(): i32" << std::endl;
+    out << "decl @getarray(*i32): i32" << std::endl;
+    out << "decl @putint(i32)" << std::endl;
+    out << "decl @putch(i32)" << std::endl;
+    out << "decl @putarray(i32, *i32)" << std::endl;
+    out << "decl @starttime()" << std::endl;
+    out << "decl @stoptime()" << std::endl << std::endl;
+    function_table["getint"] = "@getint";
+    function_table["getch"] = "@getch";
+    function_table["getarray"] = "@getarray";
+    function_table["putint"] = "@putint";
+    function_table["putch"] = "@putch";
+    function_table["putarray"] = "@putarray";
+    function_table["starttime"] = "@starttime";
+    function_table["stoptime"] = "@stoptime";
+    function_ret_type["getint"] = TypeTable::i32;
+    function_ret_type["getch"] = TypeTable::i32;
+    function_ret_type["getarray"] = TypeTable::i32;
+    function_ret_type["putint"] = TypeTable::unit;
+    function_ret_type["putch"] = TypeTable::unit;
+    function_ret_type["putarray"] = TypeTable::unit;
+    function_ret_type["starttime"] = TypeTable::unit;
+    function_ret_type["stoptime"] = TypeTable::unit;
+    function_param_num["getint"] = 0;
+    function_param_num["getch"] = 0;
+    function_param_num["getarray"] = 1;
+    function_param_num["putint"] = 1;
+    function_param_num["putch"] = 1;
+    function_param_num["putarray"] = 2;
+    function_param_num["starttime"] = 0;
+    function_param_num["stoptime"] = 0;
+    symbol_tables.emplace_back();
+    symbol_table_depths.push_back(0);
+}
 
 
-class LOrExpAST : public BaseAST
+inline void dump_ir_end()
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> l_and_exp;
-    std::unique_ptr<BaseAST> l_or_exp;
-    void dump() const override
-    {
-        if (op == "")l_and_exp->dump();
-        else
-        {
-            l_or_exp->dump();
-            std::cout << op;
-            l_and_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (op == "")result_var = l_and_exp->dumpIR();
-        else if (op == "||")
-        {
-            std::string left_result = l_or_exp->dumpIR();
-            std::string then_label = "\%then__" + std::to_string(if_else_num);
-            std::string else_label = "\%else__" + std::to_string(if_else_num);
-            std::string end_label = "\%end__" + std::to_string(if_else_num++);
-            std::string result_var_ptr = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var_ptr << " = alloc i32" << std::endl;
-            std::cout << "\tbr " << left_result << ", " << then_label << ", "
-                << else_label << std::endl;
-            std::cout << then_label << ":" << std::endl;
-            std::cout << "\tstore 1, " << result_var_ptr << std::endl;
-            std::cout << "\tjump " << end_label << std::endl;
-            std::cout << else_label << ":" << std::endl;
-            std::string tmp_result_var = "%" + std::to_string(symbol_num++);
-            std::string right_result = l_and_exp->dumpIR();
-            std::cout << '\t' << tmp_result_var << " = ne " << right_result
-                << ", 0" << std::endl;
-            std::cout << "\tstore " << tmp_result_var << ", " << result_var_ptr
-                << std::endl;
-            std::cout << "\tjump " << end_label << std::endl;
-            std::cout << end_label << ":" << std::endl;
-            result_var = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var << " = load " << result_var_ptr
-                << std::endl;
-        }
-        else assert(false);
-        return result_var;
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 1;
-        if (op == "")result = l_and_exp->dumpExp();
-        else if (op == "||")
-        {
-            int left_result = l_or_exp->dumpExp();
-            if (left_result)return 1;
-            result = l_and_exp->dumpExp() != 0;
-        }
-        else assert(false);
-        return result;
-    }
-};
+    symbol_tables.pop_back();
+    symbol_table_depths.pop_back();
+}
 
 
-class LAndExpAST : public BaseAST
+// IR of a function or global declaration on its own, as soon as it is parsed
+// (-stream); it only sees what is declared before it. Locals and globals are
+// numbered on from those of the items before, so that their names don't meet
+inline void dump_ir_item(const Node *item)
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> eq_exp;
-    std::unique_ptr<BaseAST> l_and_exp;
-    void dump() const override
-    {
-        if (op == "")eq_exp->dump();
-        else
-        {
-            l_and_exp->dump();
-            std::cout << op;
-            eq_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (op == "")result_var = eq_exp->dumpIR();
-        else if (op == "&&")
-        {
-            std::string left_result = l_and_exp->dumpIR();
-            std::string then_label = "\%then__" + std::to_string(if_else_num);
-            std::string else_label = "\%else__" + std::to_string(if_else_num);
-            std::string end_label = "\%end__" + std::to_string(if_else_num++);
-            std::string result_var_ptr = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var_ptr << " = alloc i32" << std::endl;
-            std::cout << "\tbr " << left_result << ", " << then_label << ", "
-                << else_label << std::endl;
-            std::cout << then_label << ":" << std::endl;
-            std::string tmp_result_var = "%" + std::to_string(symbol_num++);
-            std::string right_result = eq_exp->dumpIR();
-            std::cout << '\t' << tmp_result_var << " = ne " << right_result
-                << ", 0" << std::endl;
-            std::cout << "\tstore " << tmp_result_var << ", " << result_var_ptr
-                << std::endl;
-            std::cout << "\tjump " << end_label << std::endl;
-            std::cout << else_label << ":" << std::endl;
-            std::cout << "\tstore 0, " << result_var_ptr << std::endl;
-            std::cout << "\tjump " << end_label << std::endl;
-            std::cout << end_label << ":" << std::endl;
-            result_var = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var << " = load " << result_var_ptr
-                << std::endl;
-        }
-        else assert(false);
-        return result_var;
-    }
-    virtual int dumpExp() const override
+    if (item->kind != NodeKind::func_def)
     {
-        int result = 0;
-        if (op == "")result = eq_exp->dumpExp();
-        else if (op == "&&")
-        {
-            int left_result = l_and_exp->dumpExp();
-            if (left_result == 0)return 0;
-            result = eq_exp->dumpExp() != 0;
-        }
-        else assert(false);
-        return result;
+        dump_global(item);
+        return;
     }
-};
+    symbol_num = if_else_num = while_num = 0;
+    dump_ir(item);
+}
 
 
-class EqExpAST : public BaseAST
+// IR of the declarations and globals, then of each function on its own;
+// temporaries, labels and locals are numbered from zero in every function,
+// so its IR only depends on the function and what it uses
+inline std::vector<std::string> dump_ir_parts(const Node *comp_unit)
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> rel_exp;
-    std::unique_ptr<BaseAST> eq_exp;
-    void dump() const override
-    {
-        if (op == "")rel_exp->dump();
-        else
-        {
-            eq_exp->dump();
-            std::cout << op;
-            rel_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (op == "")result_var = rel_exp->dumpIR();
-        else
-        {
-            std::string left_result = eq_exp->dumpIR();
-            std::string right_result = rel_exp->dumpIR();
-            result_var = "%" + std::to_string(symbol_num++);
-            if (op == "==")
-                std::cout << '\t' << result_var << " = eq " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == "!=")
-                std::cout << '\t' << result_var << " = ne " << left_result <<
-                    ", " << right_result << std::endl;
-            else assert(false);
-        }
-        return result_var;
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (op == "")result = rel_exp->dumpExp();
-        else
-        {
-            int left_result = eq_exp->dumpExp();
-            int right_result = rel_exp->dumpExp();
-            if (op == "==")result = left_result == right_result;
-            else if (op == "!=")result = left_result != right_result;
-            else assert(false);
-        }
-        return result;
-    }
-};
+    std::vector<std::string> parts;
+    std::stringstream part;
+    std::streambuf *out_buf = out.rdbuf(part.rdbuf());
+    dump_ir_begin();
+    // all globals come first, functions may use those declared after them
+    for (auto item : comp_unit->list)
+        if (item->kind != NodeKind::func_def)dump_global(item);
+    out << std::endl;
+    auto global_var_num = var_num, global_is_list = is_list,
+        global_is_func_param = is_func_param, global_list_dim = list_dim;
+    for (auto item : comp_unit->list)
+    {
+        if (item->kind != NodeKind::func_def)continue;
+        parts.push_back(part.str());
+        part.str("");
+        symbol_num = if_else_num = while_num = 0;
+        var_num = global_var_num;
+        is_list = global_is_list;
+        is_func_param = global_is_func_param;
+        list_dim = global_list_dim;
+        dump_ir(item);
+    }
+    parts.push_back(part.str());
+    out.rdbuf(out_buf);
+    dump_ir_end();
+    return parts;
+}
 
 
-class RelExpAST : public BaseAST
+// IR of a local array, its initializer (if any) stored element by element
+inline void dump_local_list(const std::string &name,
+    const std::vector<int> &widths, const InitList *init_list)
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> add_exp;
-    std::unique_ptr<BaseAST> rel_exp;
-    void dump() const override
-    {
-        if (op == "")add_exp->dump();
-        else
-        {
-            rel_exp->dump();
-            std::cout << op;
-            add_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (op == "")result_var = add_exp->dumpIR();
-        else
-        {
-            std::string left_result = rel_exp->dumpIR();
-            std::string right_result = add_exp->dumpIR();
-            result_var = "%" + std::to_string(symbol_num++);
-            if (op == "<")
-                std::cout << '\t' << result_var << " = lt " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == ">")
-                std::cout << '\t' << result_var << " = gt " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == "<=")
-                std::cout << '\t' << result_var << " = le " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == ">=")
-                std::cout << '\t' << result_var << " = ge " << left_result <<
-                    ", " << right_result << std::endl;
-            else assert(false);
-        }
-        return result_var;
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (op == "")result = add_exp->dumpExp();
-        else
-        {
-            int left_result = rel_exp->dumpExp();
-            int right_result = add_exp->dumpExp();
-            if (op == ">")result = left_result > right_result;
-            else if (op == ">=")result = left_result >= right_result;
-            else if (op == "<")result = left_result < right_result;
-            else if (op == "<=")result = left_result <= right_result;
-            else assert(false);
-        }
-        return result;
+    is_list[name] = 1;
+    list_dim[name] = widths.size();
+    out << '\t' << name << " = alloc " <<
+        type_table[type_table.array(widths)].text << std::endl;
+    if (init_list == nullptr)return;
+    int count = 0;
+    for (int i = 0; i < widths[0]; i++)
+    {
+        std::string result_var = "%" + std::to_string(symbol_num++);
+        out << '\t' << result_var << " = getelemptr " << name << ", " << i <<
+            std::endl;
+        dump_list_init(result_var, widths, 1, *init_list, count);
     }
-};
+}
 
 
-class AddExpAST : public BaseAST
+// the name of a new variable ident, "@x_0", "@x_1" ...
+inline std::string new_var_name(std::string_view ident)
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> mul_exp;
-    std::unique_ptr<BaseAST> add_exp;
-    void dump() const override
-    {
-        if (op == "")mul_exp->dump();
-        else
-        {
-            add_exp->dump();
-            std::cout << op;
-            mul_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (op == "")result_var = mul_exp->dumpIR();
-        else
-        {
-            std::string left_result = add_exp->dumpIR();
-            std::string right_result = mul_exp->dumpIR();
-            result_var = "%" + std::to_string(symbol_num++);
-            if (op == "+")
-                std::cout << '\t' << result_var << " = add " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == "-")
-                std::cout << '\t' << result_var << " = sub " << left_result <<
-                    ", " << right_result << std::endl;
-            else assert(false);
-        }
-        return result_var;
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (op == "")result = mul_exp->dumpExp();
-        else
-        {
-            int left_result = add_exp->dumpExp();
-            int right_result = mul_exp->dumpExp();
-            if (op == "+")result = left_result + right_result;
-            else if (op == "-")result = left_result - right_result;
-            else assert(false);
-        }
-        return result;
-    }
+    std::string var_name = "@" + std::string(ident);
+    return var_name + "_" + std::to_string(var_num[var_name]++);
+}
+
+
+// the IR of a function
+inline std::string dump_func(const Node *node)
+{
+    std::string ident(node->ident);
+    TypeId func_type = node->type == BType::int_ ? TypeTable::i32 :
+        TypeTable::unit;
+    TraceScope scope("irgen function", ident);
+    std::string name = "@" + ident;
+    assert(!symbol_tables[0].count(ident));
+    assert(!function_table.count(ident));
+    function_table[ident] = name;
+    function_ret_type[ident] = func_type;
+    function_param_num[ident] = node->list.size;
+    present_func_type = func_type;
+    std::vector<std::string> idents, names;
+    std::vector<TypeId> types;
+    out << "fun " << name << "(";
+    for (size_t i = 0; i < node->list.size; i++)
+    {
+        const Node *param = node->list[i];
+        assert(param->type == BType::int_);
+        idents.emplace_back(param->ident);
+        names.push_back(new_var_name(param->ident));
+        out << names.back();
+        types.push_back(param_type(param));
+        if (types.back() != TypeTable::i32)
+        {
+            std::string tmp = names.back(); tmp[0] = '%';
+            list_dim[tmp] = type_table[types.back()].dims;
+        }
+        out << ": " << type_table[types.back()].text;
+        if (i != node->list.size - 1)out << ", ";
+    }
+    function_param_idents[ident] = move(idents);
+    function_param_names[ident] = move(names);
+    function_param_types[ident] = move(types);
+    out << ")";
+    if (node->type == BType::int_)out << ": i32";
+    out << " {" << std::endl;
+    ir_mark_line(node->line);
+    out << "\%entry_" << ident << ":" << std::endl;
+    std::string block_type = dump_ir(node->a);
+    if (block_type != "ret")
+    {
+        if (node->type == BType::int_)out << "\tret 0" << std::endl;
+        else out << "\tret" << std::endl;
+    }
+    out << "}" << std::endl << std::endl;
+    return block_type;
+}
+
+
+// a node dump_ir is in the middle of
+struct IRFrame
+{
+    const Node *node;
+    int step = 0;
+    uint32_t index = 0;  // of the next child in the list
+    int num = 0;  // of the labels of if and while, the dimensions of an index
+    bool flag = false;
+    std::string var, tmp;
 };
 
 
-class MulExpAST : public BaseAST
+// prints the IR of node; returns the value of expressions, and of statements
+// "ret", "break" or "cont" if they end their block that way. Nodes are
+// visited off a stack of frames: a node that needs the value of a child
+// pushes it and goes on from its next step when the child has left its
+// value on values, so generated chains of operators and deep nesting take
+// heap rather than stack
+inline std::string dump_ir(const Node *root)
 {
-public:
-    std::string op;
-    std::unique_ptr<BaseAST> unary_exp;
-    std::unique_ptr<BaseAST> mul_exp;
-    void dump() const override
-    {
-        if (op == "")unary_exp->dump();
-        else
-        {
-            mul_exp->dump();
-            std::cout << op;
-            unary_exp->dump();
-        }
-    }
-    std::string dumpIR() const override
+    if (root->kind == NodeKind::comp_unit)
     {
-        std::string result_var = "";
-        if (op == "")result_var = unary_exp->dumpIR();
-        else
-        {
-            std::string left_result = mul_exp->dumpIR();
-            std::string right_result = unary_exp->dumpIR();
-            result_var = "%" + std::to_string(symbol_num++);
-            if (op == "*")
-                std::cout << '\t' << result_var << " = mul " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == "/")
-                std::cout << '\t' << result_var << " = div " << left_result <<
-                    ", " << right_result << std::endl;
-            else if (op == "%")
-                std::cout << '\t' << result_var << " = mod " << left_result <<
-                    ", " << right_result << std::endl;
-            else assert(false);
-        }
-        return result_var;
+        for (auto &part : dump_ir_parts(root))out << part;
+        return "";
     }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (op == "")result = unary_exp->dumpExp();
-        else
-        {
-            int left_result = mul_exp->dumpExp();
-            int right_result = unary_exp->dumpExp();
-            if (op == "*")result = left_result * right_result;
-            else if (op == "/")result = left_result / right_result;
-            else if (op == "%")result = left_result % right_result;
-            else assert(false);
-        }
-        return result;
-    }
-};
-
-
-class UnaryExpAST : public BaseAST
-{
-public:
-    UnaryExpType type;
-    std::string op;
-    std::unique_ptr<BaseAST> exp;
-    std::string ident;
-    std::vector<std::unique_ptr<BaseAST>> params;
-    void dump() const override
-    {
-        if (type == UnaryExpType::func_call)
-        {
-            std::cout << ident << "(";
-            for (int i = 0; i < params.size(); i++)
+    if (root->kind == NodeKind::func_def)return dump_func(root);
+    std::vector<IRFrame> frames;
+    std::vector<std::string> values;
+    frames.push_back(IRFrame{root});
+    // the frame is not to be used after visit or finish
+    auto visit = [&](const Node *child) { frames.push_back(IRFrame{child}); };
+    auto finish = [&](std::string value)
+    {
+        frames.pop_back();
+        values.push_back(std::move(value));
+    };
+    auto take = [&]()
+    {
+        std::string value = std::move(values.back());
+        values.pop_back();
+        return value;
+    };
+    while (!frames.empty())
+    {
+        IRFrame &frame = frames.back();
+        const Node *node = frame.node;
+        switch (node->kind)
+        {
+        case NodeKind::block:
+            if (frame.step == 0)
             {
-                params[i]->dump();
-                if (i != params.size() - 1)std::cout << ", ";
+                enter_block();
+                if (!node->ident.empty())
+                {
+                    std::string func(node->ident);
+                    auto &idents = function_param_idents[func];
+                    auto &names = function_param_names[func];
+                    auto &types = function_param_types[func];
+                    for (size_t i = 0; i < names.size(); i++)
+                    {
+                        std::string name = names[i]; name[0] = '%';
+                        declare(idents[i], name);
+                        is_func_param[name] = 1;
+                        out << '\t' << name << " = alloc " <<
+                            type_table[types[i]].text << std::endl;
+                        out << "\tstore " << names[i] << ", " << name <<
+                            std::endl;
+                    }
+                }
+                frame.step = 1;
             }
-            return;
-        }
-        if (type == UnaryExpType::unary)std::cout << op;
-        exp->dump();
-    }
-    std::string dumpIR() const override
-    {
-        if (type == UnaryExpType::primary)return exp->dumpIR();
-        else if (type == UnaryExpType::unary)
-        {
-            std::string result_var = exp->dumpIR();
-            std::string next_var = "%" + std::to_string(symbol_num);
-            if (op == "+")return result_var;
-            else if (op == "-")std::cout << '\t' << next_var << " = sub 0, " <<
-                result_var << std::endl;
-            else if (op == "!")std::cout << '\t' << next_var << " = eq " <<
-                result_var << ", 0" << std::endl;
-            else assert(false);
-            symbol_num++;
-            return next_var;
-        }
-        else if (type == UnaryExpType::func_call)
-        {
-            std::vector<std::string> param_vars;
-            for (auto&& param : params)
-                param_vars.push_back(param->dumpIR());
-            assert(function_table.count(ident));
-            assert(function_param_num[ident] == params.size());
-            std::string result_var = "";
-            if (function_ret_type[ident] == "int")
-                result_var = "%" + std::to_string(symbol_num++);
-            std::string name = function_table[ident];
-            std::cout << '\t';
-            if (function_ret_type[ident] == "int")
-                std::cout << result_var << " = ";
-            std::cout << "call " << name << "(";
-            for (int i = 0; i < param_vars.size(); i++)
+            else frame.var = take();
+            if (ends_block(frame.var) || frame.index == node->list.size)
             {
-                std::cout << param_vars[i];
-                if (i != param_vars.size() - 1)std::cout << ", ";
+                leave_block();
+                finish(std::move(frame.var));
             }
-            std::cout << ")" << std::endl;
-            return result_var;
-        }
-        else assert(false);
-        return "";
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (type == UnaryExpType::primary)result = exp->dumpExp();
-        else if (type == UnaryExpType::unary)
-        {
-            int tmp = exp->dumpExp();
-            if (op == "+")result = tmp;
-            else if (op == "-")result = -tmp;
-            else if (op == "!")result = !tmp;
-            else assert(false);
-        }
-        else assert(false);
-        return result;
-    }
-};
-
-
-class PrimaryExpAST : public BaseAST
-{
-public:
-    PrimaryExpType type;
-    std::unique_ptr<BaseAST> exp;
-    std::string lval;
-    std::vector<std::unique_ptr<BaseAST>> exp_list;
-    int number;
-    void dump() const override
-    {
-        if (type == PrimaryExpType::exp)exp->dump();
-        else if (type == PrimaryExpType::number)std::cout << number;
-        else if (type == PrimaryExpType::lval)std::cout << lval;
-        else if (type == PrimaryExpType::list)
+            else visit(node->list[frame.index++]);
+            break;
+        case NodeKind::stmt:
+        case NodeKind::block_stmt:
+            ir_mark_line(node->line);
+            frame = IRFrame{node->a};
+            break;
+        case NodeKind::exp:
+            frame = IRFrame{node->a};
+            break;
+        case NodeKind::if_:
+            if (frame.step == 0)
+            {
+                ir_mark_line(node->line);
+                frame.step = 1;
+                visit(node->a);
+            }
+            else if (frame.step == 1)
+            {
+                std::string if_result = take();
+                frame.num = if_else_num++;
+                std::string num = std::to_string(frame.num);
+                out << "\tbr " << if_result << ", \%then__" << num <<
+                    ", \%end__" << num << std::endl;
+                out << "\%then__" << num << ":" << std::endl;
+                frame.step = 2;
+                visit(node->b);
+            }
+            else
+            {
+                std::string end_label = "\%end__" + std::to_string(frame.num);
+                if (!ends_block(take()))
+                    out << "\tjump " << end_label << std::endl;
+                out << end_label << ":" << std::endl;
+                finish("");
+            }
+            break;
+        case NodeKind::if_else:
+            if (frame.step == 0)
+            {
+                ir_mark_line(node->line);
+                frame.step = 1;
+                visit(node->a);
+            }
+            else if (frame.step == 1)
+            {
+                std::string if_result = take();
+                frame.num = if_else_num++;
+                std::string num = std::to_string(frame.num);
+                out << "\tbr " << if_result << ", \%then__" << num <<
+                    ", \%else__" << num << std::endl;
+                out << "\%then__" << num << ":" << std::endl;
+                frame.step = 2;
+                visit(node->b);
+            }
+            else if (frame.step == 2)
+            {
+                std::string num = std::to_string(frame.num);
+                frame.flag = ends_block(take());
+                if (!frame.flag)out << "\tjump \%end__" << num << std::endl;
+                out << "\%else__" << num << ":" << std::endl;
+                frame.step = 3;
+                visit(node->c);
+            }
+            else
+            {
+                std::string end_label = "\%end__" + std::to_string(frame.num);
+                bool else_ends = ends_block(take());
+                if (!else_ends)out << "\tjump " << end_label << std::endl;
+                if (frame.flag && else_ends)
+                {
+                    finish("ret");
+                    break;
+                }
+                out << end_label << ":" << std::endl;
+                finish("");
+            }
+            break;
+        case NodeKind::while_:
         {
-            std::cout << lval;
-            for (auto&& exp : exp_list)
+            std::string num = std::to_string(frame.num);
+            if (frame.step == 0)
+            {
+                ir_mark_line(node->line);
+                frame.num = while_num;
+                num = std::to_string(frame.num);
+                while_stack.push_back(while_num++);
+                out << "\tjump \%while__" << num << std::endl;
+                out << "\%while__" << num << ":" << std::endl;
+                frame.step = 1;
+                visit(node->a);
+            }
+            else if (frame.step == 1)
+            {
+                out << "\tbr " << take() << ", \%do__" << num <<
+                    ", \%while_end__" << num << std::endl;
+                out << "\%do__" << num << ":" << std::endl;
+                frame.step = 2;
+                visit(node->b);
+            }
+            else
             {
-                std::cout << '['; exp->dump(); std::cout << ']';
+                if (!ends_block(take()))
+                    out << "\tjump \%while__" << num << std::endl;
+                out << "\%while_end__" << num << ":" << std::endl;
+                while_stack.pop_back();
+                finish("");
             }
+            break;
         }
-        else assert(false);
-    }
-    std::string dumpIR() const override
-    {
-        std::string result_var = "";
-        if (type == PrimaryExpType::exp)result_var = exp->dumpIR();
-        else if (type == PrimaryExpType::number)
-            result_var = std::to_string(number);
-        else if (type == PrimaryExpType::lval)
-        {
-            std::variant<int, std::string> value = look_up_symbol_tables(lval);
-            if (value.index() == 0)
-                result_var = std::to_string(std::get<int>(value));
-            else if (is_list[std::get<std::string>(value)])
+        case NodeKind::ret:
+            if (frame.step == 0)
             {
-                result_var = "%" + std::to_string(symbol_num++);
-                std::cout << '\t' << result_var << " = getelemptr " <<
-                    std::get<std::string>(value) << ", 0" << std::endl;
+                ir_mark_line(node->line);
+                if (node->a == nullptr)
+                {
+                    if (present_func_type == TypeTable::i32)
+                        out << "\tret 0" << std::endl;
+                    else out << "\tret" << std::endl;
+                    finish("ret");
+                    break;
+                }
+                frame.step = 1;
+                visit(node->a);
             }
             else
             {
-                result_var = "%" + std::to_string(symbol_num++);
-                std::cout << '\t' << result_var << " = load " <<
+                out << "\tret " << take() << std::endl;
+                finish("ret");
+            }
+            break;
+        case NodeKind::assign:
+            if (frame.step == 0)
+            {
+                ir_mark_line(node->line);
+                frame.step = 1;
+                visit(node->a);
+            }
+            else
+            {
+                std::string result_var = take();
+                std::variant<int, std::string> value =
+                    look_up_symbol_tables(std::string(node->ident));
+                assert(value.index() == 1);
+                out << "\tstore " << result_var << ", " <<
                     std::get<std::string>(value) << std::endl;
+                finish("");
             }
-        }
-        else if (type == PrimaryExpType::list)
+            break;
+        case NodeKind::assign_list:
+        case NodeKind::index:
         {
-            std::variant<int, std::string> value = look_up_symbol_tables(lval);
-            assert(value.index() == 1);
-            std::string name, prev = std::get<std::string>(value);
-            int dim = list_dim[prev];
-            bool list = is_list[prev], func_param = is_func_param[prev];
-            for (auto&& exp : exp_list)
+            // frame.var is the pointer, indexed by one index at a time
+            bool assign = node->kind == NodeKind::assign_list;
+            if (frame.step == 0)
+            {
+                if (assign)ir_mark_line(node->line);
+                std::variant<int, std::string> value =
+                    look_up_symbol_tables(std::string(node->ident));
+                assert(value.index() == 1);
+                frame.var = std::get<std::string>(value);
+                frame.num = list_dim[frame.var];
+                if (assign)assert(frame.num == int(node->list.size));
+                frame.flag = is_list[frame.var] || is_func_param[frame.var];
+                frame.step = 1;
+            }
+            else if (frame.step == 1)
             {
-                result_var = exp->dumpIR();
-                name = "%" + std::to_string(symbol_num++);
-                if (is_func_param[prev])
+                std::string result_var = take();
+                std::string name = "%" + std::to_string(symbol_num++);
+                if (is_func_param[frame.var])
                 {
-                    std::cout << '\t' << name << " = load " << prev <<
+                    out << '\t' << name << " = load " << frame.var <<
                         std::endl;
                     std::string tmp = "%" + std::to_string(symbol_num++);
-                    std::cout << '\t' << tmp << " = getptr " << name <<
-                        ", " << result_var << std::endl;
+                    out << '\t' << tmp << " = getptr " << name << ", " <<
+                        result_var << std::endl;
                     name = tmp;
                 }
                 else
-                    std::cout << '\t' << name << " = getelemptr " << prev <<
+                    out << '\t' << name << " = getelemptr " << frame.var <<
                         ", " << result_var << std::endl;
-                prev = name;
+                frame.var = name;
+            }
+            else
+            {
+                out << "\tstore " << take() << ", " << frame.var << std::endl;
+                finish("");
+                break;
             }
-            if (exp_list.size() == dim)
+            if (frame.index < node->list.size)
+            {
+                visit(node->list[frame.index++]);
+                break;
+            }
+            if (assign)
+            {
+                frame.step = 2;
+                visit(node->a);
+                break;
+            }
+            std::string result_var = frame.var;
+            if (int(node->list.size) == frame.num)
             {
                 result_var = "%" + std::to_string(symbol_num++);
-                std::cout << '\t' << result_var << " = load " << prev <<
+                out << '\t' << result_var << " = load " << frame.var <<
                     std::endl;
             }
-            else if (list || func_param)
+            else if (frame.flag)
             {
                 result_var = "%" + std::to_string(symbol_num++);
-                std::cout << '\t' << result_var << " = getelemptr " << prev <<
+                out << '\t' << result_var << " = getelemptr " << frame.var <<
                     ", 0" << std::endl;
             }
-            else result_var = name;
-        }
-        else assert(false);
-        return result_var;
-    }
-    virtual int dumpExp() const override
-    {
-        int result = 0;
-        if (type == PrimaryExpType::exp)result = exp->dumpExp();
-        else if (type == PrimaryExpType::number)result = number;
-        else if (type == PrimaryExpType::lval)
-        {
-            std::variant<int, std::string> value = look_up_symbol_tables(lval);
-            assert(value.index() == 0);
-            result = std::get<int>(value);
-        }
-        else assert(false);
-        return result;
-    }
-};
-
-
-class DeclAST : public BaseAST
-{
-public:
-    DeclType type;
-    std::unique_ptr<BaseAST> decl;
-    void dump() const override { decl->dump(); }
-    std::string dumpIR() const override { return decl->dumpIR(); }
-    int dumpExp() const override { return decl->dumpExp(); }
-};
-
-
-class ConstDeclAST : public BaseAST
-{
-public:
-    std::string b_type;
-    std::vector<std::unique_ptr<BaseAST>> const_def_list;
-    void dump() const override
-    {
-        assert(b_type == "int");
-        for (auto&& const_def : const_def_list)const_def->dump();
-    }
-    std::string dumpIR() const override
-    {
-        assert(b_type == "int");
-        for (auto&& const_def : const_def_list)const_def->dumpIR();
-        return "";
-    }
-    int dumpExp() const override
-    {
-        assert(b_type == "int");
-        for (auto&& const_def : const_def_list)const_def->dumpExp();
-        return 0;
-    }
-};
-
-
-class ConstDefAST : public BaseAST
-{
-public:
-    std::string ident;
-    std::vector<std::unique_ptr<BaseAST>> const_exp_list;
-    std::unique_ptr<BaseAST> const_init_val;
-    void dump() const override
-    {
-        std::cout << "ConstDefAST{" << ident << "=";
-        const_init_val->dump();
-        std::cout << "} ";
-    }
-    void dumpListType(std::vector<int> widths) const
-    {
-        if (widths.size() == 1)
-        {
-            std::cout << "[i32, " << widths[0] << "]"; return;
-        }
-        std::vector<int> rec = std::vector<int>(widths.begin() + 1,
-            widths.end());
-        std::cout << "["; dumpListType(rec);
-        std::cout << ", " << widths.front() << "]";
-    }
-    void dumpListInit(std::string prev, std::vector<int> widths, int depth,
-        std::vector<int> init_list) const
-    {
-        if (depth >= widths.size())
-        {
-            std::cout << "\tstore " << init_list[const_list_num++] << ", " <<
-                prev << std::endl;
-            return;
+            finish(result_var);
+            break;
         }
-        for (int i = 0; i < widths[depth]; i++)
-        {
-            std::string result_var = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var << " = getelemptr " << prev << ", "
-                << i << std::endl;
-            dumpListInit(result_var, widths, depth + 1, init_list);
-        }
-    }
-    void printInitList(std::vector<int> widths, int depth,
-        std::vector<int> init_list) const
-    {
-        if (depth >= widths.size())
-        {
-            std::cout << init_list[const_list_num++]; return;
-        }
-        std::cout << "{";
-        for (int i = 0; i < widths[depth]; i++)
-        {
-            printInitList(widths, depth + 1, init_list);
-            if (i != widths[depth] - 1)std::cout << ", ";
-        }
-        std::cout << "}";
-    }
-    std::string dumpIR() const override
-    {
-        if (const_exp_list.empty())
-            symbol_tables.back()[ident] = std::stoi(const_init_val->dumpIR());
-        else
-        {
-            std::vector<int> widths, init_list;
-            for (auto&& const_exp : const_exp_list)
-                widths.push_back(std::stoi(const_exp->dumpIR()));
-            const_list_num = 0;
-            init_list = const_init_val->dumpList(widths);
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            symbol_tables.back()[ident] = name;
-            is_list[name] = 1;
-            list_dim[name] = widths.size();
-            std::cout << '\t' << name << " = alloc ";
-            dumpListType(widths);
-            std::cout << std::endl;
-            const_list_num = 0;
-            for (int i = 0; i < widths[0]; i++)
+        case NodeKind::exp_stmt:
+            if (frame.step == 0)
             {
+                ir_mark_line(node->line);
+                if (node->a == nullptr)
+                {
+                    finish("");
+                    break;
+                }
+                frame.step = 1;
+                visit(node->a);
+            }
+            else
+            {
+                take();
+                finish("");
+            }
+            break;
+        case NodeKind::break_:
+            ir_mark_line(node->line);
+            assert(!while_stack.empty());
+            out << "\tjump \%while_end__" << while_stack.back() << std::endl;
+            finish("break");
+            break;
+        case NodeKind::continue_:
+            ir_mark_line(node->line);
+            assert(!while_stack.empty());
+            out << "\tjump \%while__" << while_stack.back() << std::endl;
+            finish("cont");
+            break;
+        case NodeKind::binary:
+            if (frame.step == 0)
+            {
+                frame.step = 1;
+                visit(node->a);
+            }
+            else if (node->op == Op::or_ || node->op == Op::and_)
+            {
+                // short circuit through a slot, which the left side decides
+                bool is_or = node->op == Op::or_;
+                if (frame.step == 1)
+                {
+                    std::string left_result = take();
+                    frame.num = if_else_num++;
+                    std::string num = std::to_string(frame.num);
+                    frame.var = "%" + std::to_string(symbol_num++);
+                    out << '\t' << frame.var << " = alloc i32" << std::endl;
+                    out << "\tbr " << left_result << ", \%then__" << num <<
+                        ", \%else__" << num << std::endl;
+                    out << "\%then__" << num << ":" << std::endl;
+                    if (is_or)
+                    {
+                        out << "\tstore 1, " << frame.var << std::endl;
+                        out << "\tjump \%end__" << num << std::endl;
+                        out << "\%else__" << num << ":" << std::endl;
+                    }
+                    frame.tmp = "%" + std::to_string(symbol_num++);
+                    frame.step = 2;
+                    visit(node->b);
+                    break;
+                }
+                std::string num = std::to_string(frame.num);
+                out << '\t' << frame.tmp << " = ne " << take() << ", 0" <<
+                    std::endl;
+                out << "\tstore " << frame.tmp << ", " << frame.var <<
+                    std::endl;
+                out << "\tjump \%end__" << num << std::endl;
+                if (!is_or)
+                {
+                    out << "\%else__" << num << ":" << std::endl;
+                    out << "\tstore 0, " << frame.var << std::endl;
+                    out << "\tjump \%end__" << num << std::endl;
+                }
+                out << "\%end__" << num << ":" << std::endl;
                 std::string result_var = "%" + std::to_string(symbol_num++);
-                std::cout << '\t' << result_var << " = getelemptr " << name <<
-                    ", " << i << std::endl;
-                dumpListInit(result_var, widths, 1, init_list);
+                out << '\t' << result_var << " = load " << frame.var <<
+                    std::endl;
+                finish(result_var);
             }
-        }
-        return "";
-    }
-    int dumpExp() const override
-    {
-        if (const_exp_list.empty())
-            symbol_tables.back()[ident] = std::stoi(const_init_val->dumpIR());
-        else
-        {
-            std::vector<int> widths, init_list;
-            for (auto&& const_exp : const_exp_list)
-                widths.push_back(std::stoi(const_exp->dumpIR()));
-            const_list_num = 0;
-            init_list = const_init_val->dumpList(widths);
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            symbol_tables.back()[ident] = name;
-            is_list[name] = 1;
-            list_dim[name] = widths.size();
-            std::cout << "global " << name << " = alloc ";
-            dumpListType(widths);
-            std::cout << ", ";
-            const_list_num = 0;
-            printInitList(widths, 0, init_list);
-            std::cout << std::endl;
-        }
-        return 0;
-    }
-};
-
-
-class ConstInitValAST : public BaseAST
-{
-public:
-    ConstInitValType type;
-    std::unique_ptr<BaseAST> const_exp;
-    std::vector<std::unique_ptr<BaseAST>> const_init_val_list;
-    void dump() const override
-    {
-        if (type == ConstInitValType::const_exp)
-            std::cout << const_exp->dumpExp();
-        else if (type == ConstInitValType::list)
-        {
-            std::cout << "{";
-            for (int i = 0; i < const_init_val_list.size(); i++)
+            else if (frame.step == 1)
             {
-                const_init_val_list[i]->dump();
-                if (i != const_init_val_list.size() - 1)std::cout << ",";
+                frame.step = 2;
+                visit(node->b);
             }
-            std::cout << "} ";
-        }
-        else assert(false);
-    }
-    std::string dumpIR() const override
-    {
-        assert(type == ConstInitValType::const_exp);
-        return std::to_string(const_exp->dumpExp());
-    }
-    std::vector<int> dumpList(std::vector<int> widths) const override
-    {
-        std::vector<int> ret;
-        if (widths.size() == 1)
+            else
+            {
+                std::string right_result = take(), left_result = take();
+                std::string result_var = "%" + std::to_string(symbol_num++);
+                out << '\t' << result_var << " = " <<
+                    op_insts[int(node->op)] << " " << left_result << ", " <<
+                    right_result << std::endl;
+                finish(result_var);
+            }
+            break;
+        case NodeKind::unary:
+            if (frame.step == 0)
+            {
+                frame.step = 1;
+                visit(node->a);
+            }
+            else
+            {
+                std::string result_var = take();
+                std::string next_var = "%" + std::to_string(symbol_num);
+                if (node->op == Op::add)
+                {
+                    finish(result_var);
+                    break;
+                }
+                else if (node->op == Op::sub)out << '\t' << next_var <<
+                    " = sub 0, " << result_var << std::endl;
+                else if (node->op == Op::not_)out << '\t' << next_var <<
+                    " = eq " << result_var << ", 0" << std::endl;
+                else assert(false);
+                symbol_num++;
+                finish(next_var);
+            }
+            break;
+        case NodeKind::call:
         {
-            for (auto&& const_init_val : const_init_val_list)
+            // the values of the arguments pile up on values
+            if (frame.index < node->list.size)
+            {
+                visit(node->list[frame.index++]);
+                break;
+            }
+            std::string ident(node->ident);
+            std::vector<std::string> param_vars(
+                std::make_move_iterator(values.end() - node->list.size),
+                std::make_move_iterator(values.end()));
+            values.resize(values.size() - node->list.size);
+            assert(function_table.count(ident));
+            assert(function_param_num[ident] == int(node->list.size));
+            std::string result_var = "";
+            bool returns = function_ret_type[ident] == TypeTable::i32;
+            if (returns)result_var = "%" + std::to_string(symbol_num++);
+            out << '\t';
+            if (returns)out << result_var << " = ";
+            out << "call " << function_table[ident] << "(";
+            for (size_t i = 0; i < param_vars.size(); i++)
+            {
+                out << param_vars[i];
+                if (i != param_vars.size() - 1)out << ", ";
+            }
+            out << ")" << std::endl;
+            finish(result_var);
+            break;
+        }
+        case NodeKind::number:
+            finish(std::to_string(node->value));
+            break;
+        case NodeKind::lval:
+        {
+            std::string result_var;
+            std::variant<int, std::string> value =
+                look_up_symbol_tables(std::string(node->ident));
+            if (value.index() == 0)
+                result_var = std::to_string(std::get<int>(value));
+            else if (is_list[std::get<std::string>(value)])
             {
-                assert(const_init_val->get_ident() == "const_exp");
-                ret.push_back(std::stoi(const_init_val->dumpIR()));
-                const_list_num++;
+                result_var = "%" + std::to_string(symbol_num++);
+                out << '\t' << result_var << " = getelemptr " <<
+                    std::get<std::string>(value) << ", 0" << std::endl;
             }
-            int num_zeros = widths[0] - ret.size();
-            for (int i = 0; i < num_zeros; i++)
+            else
             {
-                ret.push_back(0); const_list_num++;
+                result_var = "%" + std::to_string(symbol_num++);
+                out << '\t' << result_var << " = load " <<
+                    std::get<std::string>(value) << std::endl;
             }
-            return ret;
+            finish(result_var);
+            break;
         }
-        std::vector<int> products = widths;
-        for (int i = products.size() - 2; i >= 0; i--)
-            products[i] *= products[i + 1];
-        int total_size = products[0];
-        for (auto&& const_init_val : const_init_val_list)
-            if (const_init_val->get_ident() == "const_exp")
+        case NodeKind::const_decl:
+        case NodeKind::var_decl:
+            if (frame.step == 0)
             {
-                ret.push_back(std::stoi(const_init_val->dumpIR()));
-                const_list_num++; continue;
+                assert(node->type == BType::int_);
+                frame.step = 1;
             }
-            else if (const_init_val->get_ident() == "list")
+            else take();
+            if (frame.index < node->list.size)
+                visit(node->list[frame.index++]);
+            else finish("");
+            break;
+        case NodeKind::const_def:
+        {
+            ir_mark_line(node->line);
+            std::string ident(node->ident);
+            if (node->list.empty())
             {
-                int init_num;
-                for (init_num = 1; init_num < widths.size(); init_num++)
-                    if (const_list_num % products[init_num] == 0)break;
-                    else if (init_num == widths.size() - 1)assert(false);
-                std::vector<int> rec = std::vector<int>(widths.begin() +
-                    init_num, widths.end());
-                std::vector<int> tmp = const_init_val->dumpList(rec);
-                ret.insert(ret.end(), tmp.begin(), tmp.end());
+                declare(ident, dump_exp(node->a));
+                finish("");
+                break;
             }
-            else assert(false);
-        int num_zeros = total_size - ret.size();
-        for (int i = 0; i < num_zeros; i++)
-        {
-            ret.push_back(0); const_list_num++;
+            // the initializer is evaluated before the array is declared
+            std::vector<int> widths = dimensions(node->list);
+            int count = 0;
+            InitList init_list = dump_list(node->a, widths, count);
+            std::string name = new_var_name(node->ident);
+            declare(ident, name);
+            dump_local_list(name, widths, &init_list);
+            finish("");
+            break;
+        }
+        case NodeKind::var_def:
+        {
+            if (frame.step == 1)
+            {
+                out << "\tstore " << take() << ", " << frame.var << std::endl;
+                finish("");
+                break;
+            }
+            ir_mark_line(node->line);
+            std::string ident(node->ident);
+            if (node->list.empty())
+            {
+                std::string name = new_var_name(node->ident);
+                out << '\t' << name << " = alloc i32" << std::endl;
+                declare(ident, name);
+                if (node->a)
+                {
+                    frame.var = name;
+                    frame.step = 1;
+                    visit(node->a);
+                }
+                else finish("");
+                break;
+            }
+            std::vector<int> widths = dimensions(node->list);
+            std::string name = new_var_name(node->ident);
+            declare(ident, name);
+            if (node->a == nullptr)dump_local_list(name, widths, nullptr);
+            else
+            {
+                int count = 0;
+                InitList init_list = dump_list(node->a, widths, count);
+                dump_local_list(name, widths, &init_list);
+            }
+            finish("");
+            break;
+        }
+        default:
+            assert(false);
+            finish("");
+            break;
         }
-        return ret;
-    }
-    std::string get_ident() const override
-    {
-        if (type == ConstInitValType::const_exp)return "const_exp";
-        else if (type == ConstInitValType::list)return "list";
-        else assert(false);
     }
-};
+    return values.back();
+}
 
 
-class BlockItemAST : public BaseAST
+// a node dump_exp is in the middle of
+struct ExpFrame
 {
-public:
-    BlockItemType type;
-    std::unique_ptr<BaseAST> content;
-    void dump() const override { content->dump(); }
-    std::string dumpIR() const override { return content->dumpIR(); }
+    const Node *node;
+    int step;
+    int left;  // the value of the left side of a binary operator
 };
 
 
-class ConstExpAST : public BaseAST
+// the value of a constant expression, on a stack of frames like dump_ir
+inline int dump_exp(const Node *root)
 {
-public:
-    std::unique_ptr<BaseAST> exp;
-    void dump() const override { std::cout << exp->dumpExp(); }
-    std::string dumpIR() const override
-    {
-        return std::to_string(exp->dumpExp());
-    }
-    virtual int dumpExp() const override { return exp->dumpExp(); }
-};
-
-
-class VarDeclAST : public BaseAST
-{
-public:
-    std::string b_type;
-    std::vector<std::unique_ptr<BaseAST>> var_def_list;
-    void dump() const override
-    {
-        assert(b_type == "int");
-        for (auto&& var_def : var_def_list)var_def->dump();
-    }
-    std::string dumpIR() const override
-    {
-        assert(b_type == "int");
-        for (auto&& var_def : var_def_list)var_def->dumpIR();
-        return "";
-    }
-    int dumpExp() const override
-    {
-        assert(b_type == "int");
-        for (auto&& var_def : var_def_list)var_def->dumpExp();
-        return 0;
-    }
-};
-
-
-class VarDefAST : public BaseAST
-{
-public:
-    std::string ident;
-    bool has_init_val;
-    std::vector<std::unique_ptr<BaseAST>> exp_list;
-    std::unique_ptr<BaseAST> init_val;
-    void dump() const override
-    {
-        std::cout << "VarDefAST{" << ident;
-        if (has_init_val)
-        {
-            std::cout << "=";
-            init_val->dump();
-        }
-        std::cout << "} ";
-    }
-    void dumpListType(std::vector<int> widths) const
-    {
-        if (widths.size() == 1)
-        {
-            std::cout << "[i32, " << widths[0] << "]"; return;
-        }
-        std::vector<int> rec = std::vector<int>(widths.begin() + 1,
-            widths.end());
-        std::cout << "["; dumpListType(rec);
-        std::cout << ", " << widths.front() << "]";
-    }
-    void dumpListInit(std::string prev, std::vector<int> widths, int depth,
-        std::vector<int> init_list) const
-    {
-        if (depth >= widths.size())
-        {
-            std::cout << "\tstore " << init_list[var_list_num++] << ", " <<
-                prev << std::endl;
-            return;
-        }
-        for (int i = 0; i < widths[depth]; i++)
-        {
-            std::string result_var = "%" + std::to_string(symbol_num++);
-            std::cout << '\t' << result_var << " = getelemptr " << prev << ", "
-                << i << std::endl;
-            dumpListInit(result_var, widths, depth + 1, init_list);
-        }
-    }
-    void printInitList(std::vector<int> widths, int depth,
-        std::vector<int> init_list) const
-    {
-        if (depth >= widths.size())
-        {
-            std::cout << init_list[var_list_num++]; return;
-        }
-        std::cout << "{";
-        for (int i = 0; i < widths[depth]; i++)
-        {
-            printInitList(widths, depth + 1, init_list);
-            if (i != widths[depth] - 1)std::cout << ", ";
-        }
-        std::cout << "}";
-    }
-    std::string dumpIR() const override
-    {
-        if (exp_list.empty())
-        {
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            std::cout << '\t' << name << " = alloc i32" << std::endl;
-            symbol_tables.back()[ident] = name;
-            if (has_init_val)
+    std::vector<ExpFrame> frames{{root, 0, 0}};
+    int value = 0;  // of the node last done
+    while (!frames.empty())
+    {
+        ExpFrame &frame = frames.back();
+        const Node *node = frame.node;
+        switch (node->kind)
+        {
+        case NodeKind::exp:
+            frame = {node->a, 0, 0};
+            continue;
+        case NodeKind::number:
+            value = node->value;
+            break;
+        case NodeKind::lval:
+        {
+            std::variant<int, std::string> symbol =
+                look_up_symbol_tables(std::string(node->ident));
+            assert(symbol.index() == 0);
+            value = std::get<int>(symbol);
+            break;
+        }
+        case NodeKind::unary:
+            if (frame.step == 0)
             {
-                std::string val_var = init_val->dumpIR();
-                std::cout << "\tstore " << val_var << ", " << name <<
-                    std::endl;
+                frame.step = 1;
+                frames.push_back({node->a, 0, 0});
+                continue;
             }
-        }
-        else
-        {
-            std::vector<int> widths, init_list;
-            for (auto&& exp : exp_list)
-                widths.push_back(std::stoi(exp->dumpIR()));
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            symbol_tables.back()[ident] = name;
-            is_list[name] = 1;
-            list_dim[name] = widths.size();
-            std::cout << '\t' << name << " = alloc ";
-            dumpListType(widths);
-            std::cout << std::endl;
-            if (has_init_val)
+            if (node->op == Op::sub)value = -value;
+            else if (node->op == Op::not_)value = !value;
+            else assert(node->op == Op::add);
+            break;
+        case NodeKind::binary:
+            if (frame.step == 0)
             {
-                var_list_num = 0;
-                init_list = init_val->dumpList(widths);
-                var_list_num = 0;
-                for (int i = 0; i < widths[0]; i++)
-                {
-                    std::string result_var = "%" +
-                        std::to_string(symbol_num++);
-                    std::cout << '\t' << result_var << " = getelemptr " << name
-                        << ", " << i << std::endl;
-                    dumpListInit(result_var, widths, 1, init_list);
-                }
+                frame.step = 1;
+                frames.push_back({node->a, 0, 0});
+                continue;
             }
-        }
-        return "";
-    }
-    int dumpExp() const override
-    {
-        if (exp_list.empty())
-        {
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            symbol_tables.back()[ident] = name;
-            std::cout << "global " << name << " = alloc i32, ";
-            if (has_init_val)
+            if (frame.step == 1)
             {
-                std::string val_var = init_val->dumpIR();
-                if (val_var[0] == '@' || val_var[0] == '%')assert(false);
-                else if (val_var != "0")std::cout << val_var << std::endl;
-                else std::cout << "zeroinit" << std::endl;
+                // the right side of || and && only counts if the left
+                // doesn't decide
+                if (node->op == Op::or_ && value)
+                {
+                    value = 1;
+                    break;
+                }
+                if (node->op == Op::and_ && value == 0)break;
+                frame.left = value;
+                frame.step = 2;
+                frames.push_back({node->b, 0, 0});
+                continue;
             }
-            else std::cout << "zeroinit" << std::endl;
-        }
-        else
-        {
-            std::vector<int> widths, init_list;
-            for (auto&& exp : exp_list)
-                widths.push_back(std::stoi(exp->dumpIR()));
-            std::string var_name = "@" + ident;
-            std::string name = var_name + "_" +
-                std::to_string(var_num[var_name]++);
-            symbol_tables.back()[ident] = name;
-            is_list[name] = 1;
-            list_dim[name] = widths.size();
-            std::cout << "global " << name << " = alloc ";
-            dumpListType(widths);
-            if (has_init_val)
+            switch (node->op)
             {
-                var_list_num = 0;
-                init_list = init_val->dumpList(widths);
-                var_list_num = 0;
-                std::cout << ", ";
-                printInitList(widths, 0, init_list);
-                std::cout << std::endl;
+            case Op::add: value = frame.left + value; break;
+            case Op::sub: value = frame.left - value; break;
+            case Op::mul: value = frame.left * value; break;
+            case Op::div: value = frame.left / value; break;
+            case Op::mod: value = frame.left % value; break;
+            case Op::lt: value = frame.left < value; break;
+            case Op::gt: value = frame.left > value; break;
+            case Op::le: value = frame.left <= value; break;
+            case Op::ge: value = frame.left >= value; break;
+            case Op::eq: value = frame.left == value; break;
+            case Op::ne: value = frame.left != value; break;
+            case Op::and_:
+            case Op::or_: value = value != 0; break;
+            default: assert(false);
             }
-            else std::cout << ", zeroinit" << std::endl;
+            break;
+        default:
+            assert(false);
+            break;
         }
-        return 0;
+        frames.pop_back();
     }
-};
+    return value;
+}
 
 
-class InitValAST : public BaseAST
+// the IR of a global declaration
+inline void dump_global(const Node *decl)
 {
-public:
-    InitValType type;
-    std::unique_ptr<BaseAST> exp;
-    std::vector<std::unique_ptr<BaseAST>> init_val_list;
-    void dump() const override
+    assert(decl->type == BType::int_);
+    for (auto def : decl->list)
     {
-        if (type == InitValType::exp)exp->dump();
-        else if (type == InitValType::list)
+        std::string ident(def->ident);
+        if (def->list.empty())
         {
-            std::cout << "{";
-            for (int i = 0; i < init_val_list.size(); i++)
+            if (def->kind == NodeKind::const_def)
             {
-                init_val_list[i]->dump();
-                if (i != init_val_list.size() - 1)std::cout << ",";
+                declare(ident, dump_exp(def->a));
+                continue;
             }
-            std::cout << "} ";
-        }
-        else assert(false);
-    }
-    std::string dumpIR() const override
-    {
-        assert(type == InitValType::exp);
-        return exp->dumpIR();
-    }
-    int dumpExp() const override
-    {
-        assert(type == InitValType::exp);
-        return exp->dumpExp();
+            std::string name = new_var_name(def->ident);
+            declare(ident, name);
+            out << "global " << name << " = alloc i32, ";
+            if (def->a)
+            {
+                std::string val_var = dump_ir(def->a);
+                if (val_var[0] == '@' || val_var[0] == '%')assert(false);
+                else if (val_var != "0")out << val_var << std::endl;
+                else out << "zeroinit" << std::endl;
+            }
+            else out << "zeroinit" << std::endl;
+            continue;
+        }
+        // constants evaluate their initializer before they are declared
+        std::vector<int> widths = dimensions(def->list);
+        int count = 0;
+        InitList init_list;
+        if (def->kind == NodeKind::const_def)
+            init_list = dump_list(def->a, widths, count);
+        std::string name = new_var_name(def->ident);
+        declare(ident, name);
+        is_list[name] = 1;
+        list_dim[name] = widths.size();
+        out << "global " << name << " = alloc " <<
+            type_table[type_table.array(widths)].text;
+        if (def->a)
+        {
+            if (def->kind == NodeKind::var_def)
+                init_list = dump_list(def->a, widths, count);
+            count = 0;
+            out << ", ";
+            print_init_list(widths, 0, init_list, count);
+            out << std::endl;
+        }
+        else out << ", zeroinit" << std::endl;
     }
-    std::vector<int> dumpList(std::vector<int> widths) const override
+}
+
+
+// the elements of an array of widths given by init, zeros where it gives
+// none; count is the number of elements before init
+inline InitList dump_list(const Node *init, const std::vector<int> &widths,
+    int &count)
+{
+    InitList ret;
+    NodeList items;
+    if (init->kind == NodeKind::init_list)items = init->list;
+    if (widths.size() == 1)
     {
-        std::vector<int> ret;
-        if (widths.size() == 1)
+        for (auto item : items)
         {
-            for (auto&& init_val : init_val_list)
-            {
-                assert(init_val->get_ident() == "exp");
-                ret.push_back(init_val->dumpExp());
-                var_list_num++;
-            }
-            int num_zeros = widths[0] - ret.size();
-            for (int i = 0; i < num_zeros; i++)
-            {
-                ret.push_back(0); var_list_num++;
-            }
-            return ret;
+            assert(item->kind != NodeKind::init_list);
+            ret.push_back(dump_exp(item));
+            count++;
         }
-        std::vector<int> products = widths;
-        for (int i = products.size() - 2; i >= 0; i--)
-            products[i] *= products[i + 1];
-        int total_size = products[0];
-        for (auto&& init_val : init_val_list)
-            if (init_val->get_ident() == "exp")
-            {
-                ret.push_back(init_val->dumpExp());
-                var_list_num++; continue;
-            }
-            else if (init_val->get_ident() == "list")
-            {
-                int init_num;
-                for (init_num = 1; init_num < widths.size(); init_num++)
-                    if (var_list_num % products[init_num] == 0)break;
-                    else if (init_num == widths.size() - 1)assert(false);
-                std::vector<int> rec = std::vector<int>(widths.begin() +
-                    init_num, widths.end());
-                std::vector<int> tmp = init_val->dumpList(rec);
-                ret.insert(ret.end(), tmp.begin(), tmp.end());
-            }
-            else assert(false);
-        int num_zeros = total_size - ret.size();
+        int num_zeros = widths[0] - ret.size();
         for (int i = 0; i < num_zeros; i++)
         {
-            ret.push_back(0); var_list_num++;
+            ret.push_back(0); count++;
         }
         return ret;
     }
-    std::string get_ident() const override
+    std::vector<int> products = widths;
+    for (int i = products.size() - 2; i >= 0; i--)
+        products[i] *= products[i + 1];
+    int total_size = products[0];
+    for (auto item : items)
+        if (item->kind != NodeKind::init_list)
+        {
+            ret.push_back(dump_exp(item));
+            count++;
+        }
+        else
+        {
+            // a sublist fills the largest dimension it is aligned to
+            size_t init_num;
+            for (init_num = 1; init_num < widths.size(); init_num++)
+                if (count % products[init_num] == 0)break;
+                else if (init_num == widths.size() - 1)assert(false);
+            std::vector<int> rec(widths.begin() + init_num, widths.end());
+            InitList tmp = dump_list(item, rec, count);
+            ret.insert(ret.end(), tmp.begin(), tmp.end());
+        }
+    int num_zeros = total_size - ret.size();
+    for (int i = 0; i < num_zeros; i++)
     {
-        if (type == InitValType::exp)return "exp";
-        else if (type == InitValType::list)return "list";
-        else assert(false);
+        ret.push_back(0); count++;
     }
-};
+    return ret;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+
+// on-disk cache of the IR and code of single functions. An entry is named by
+// a hash of everything the function's code depends on, so entries are never
+// updated in place; they are written to a temporary file and renamed into
+// place, and compilers sharing a directory only ever see complete entries
+
+
+// 128-bit FNV-1a, as 32 hex digits
+inline std::string cache_hash(const std::string &data)
+{
+    unsigned __int128 hash = ((unsigned __int128)0x6c62272e07bb0142ULL << 64) |
+        0x62b821756295c58dULL;
+    const unsigned __int128 prime = ((unsigned __int128)1 << 88) | 0x13b;
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= prime;
+    }
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx",
+        (unsigned long long)(hash >> 64), (unsigned long long)hash);
+    return hex;
+}
+
+
+inline std::string cache_path(const std::string &dir, const std::string &key)
+{
+    return dir + "/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+
+inline bool cache_load(const std::string &dir, const std::string &key,
+    std::string &ir, std::string &code)
+{
+    std::ifstream file(cache_path(dir, key), std::ios::binary);
+    size_t ir_size, code_size;
+    if (!(file >> ir_size >> code_size) || file.get() != '\n')return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string content = ss.str();
+    if (content.size() != ir_size + code_size)return false;
+    ir = content.substr(0, ir_size);
+    code = content.substr(ir_size);
+    return true;
+}
+
+
+inline void cache_store(const std::string &dir, const std::string &key,
+    const std::string &ir, const std::string &code)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string path = cache_path(dir, key);
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    std::string tmp = path + ".tmp" + std::to_string(getpid()) + "_" +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::ofstream file(tmp, std::ios::binary);
+    file << ir.size() << " " << code.size() << "\n" << ir << code;
+    file.close();
+    if (file)fs::rename(tmp, path, ec);
+    if (!file || ec)fs::remove(tmp, ec);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Lines.h"
+#include "Profile.h"
+#include "Stats.h"
+
+
+struct Node;
+
+
+// the optimization pipeline (see Pass.h)
+struct PassOptions
+{
+    int level = -1;  // -O0 ~ -O2, -1 for the default of the mode
+    std::vector<std::string> enable, disable, print_after;
+    bool print_all = false;  // print the IR after every pass
+    bool time = false;  // time the passes
+};
+
+
+// compiles one SysY program held in memory; mode is one of the command line
+// modes (-koopa, -kir, -riscv, -perf, -obj, -run-koopa, -sim, -test). The
+// context only holds the options and results; the state of the frontend,
+// passes and backend is thread_local and reset by each compile, so compiles
+// on different threads don't share it, but a thread runs one compile at a
+// time. Only the -mem-report counts and the -time-trace are process-wide
+class CompilerContext
+{
+public:
+    std::string mode;
+    // if set, the code of single functions is cached there (see Cache.h)
+    std::string cache_dir;
+    PassOptions passes;
+    // costs of the -sim model, "load_use=1,branch=2,..." (see Simulator.h)
+    std::string sim_model;
+    // -fprofile-generate: the code counts its calls, edges and call sites
+    // and appends the counts to profile_file when main returns; under -sim
+    // they are left in profile instead. -fprofile-use: counts of earlier
+    // runs, which decide the block layout and the loops globals are promoted
+    // in (see Profile.h)
+    bool profile_generate = false;
+    std::string profile_file = "sysy.profile";
+    Profile profile_use;
+    std::string profile;
+    // -finstrument-functions: the code times its functions and main prints
+    // them to stderr (see instrument_entry in RISCV.h)
+    bool instrument_functions = false;
+    // -stats: counts of the code of each function by the last compilation of
+    // a backend mode, for stats_json (see Stats.h)
+    bool report_stats = false;
+    std::vector<FunctionStats> stats;
+    // -g: .file and .loc directives, -fverbose-asm: "# line N" comments, of
+    // the lines of the SysY source named by source (see Lines.h)
+    bool debug_lines = false, line_comments = false;
+    std::string source;
+    // -stream: compile each function as soon as it is parsed, see
+    // compile_stream in compiler.cpp. With stream_out, the code of the text
+    // modes goes there as it is made and output is left empty
+    bool stream = false;
+    std::ostream *stream_out = nullptr;
+    explicit CompilerContext(const std::string &mode) : mode(mode) {}
+    // returns false if the program could not be parsed or the passes found
+    // the IR broken (log says why); the source may also be a binary IR file
+    // (see IRFile.h), which only goes through the backend
+    bool compile(const char *source, size_t size, std::string &output);
+    bool compile(const std::string &input, std::string &output)
+    {
+        return compile(input.data(), input.size(), output);
+    }
+    // compiles binary IR, e.g. a mapped file; only the backend modes apply
+    bool compile_ir(const char *data, size_t size, std::string &output);
+    // compiles Koopa IR text (-from-koopa) with the backend modes, or turns it
+    // into binary IR with -kir; false if it doesn't parse or is broken
+    bool compile_koopa(const char *ir, std::string &output);
+    // -sim on assembly text printed before; false if it doesn't link
+    bool compile_asm(const std::string &code, std::string &output);
+    // seconds taken by each phase of the last backend only compilation
+    std::vector<std::pair<std::string, double>> timings;
+    // messages of the last compilation for stderr (IR printed after passes,
+    // pass timings, counts of -run-koopa and -sim)
+    std::string log;
+    // nodes of the AST of the last compilation
+    long ast_nodes = 0;
+    // -run-koopa and -sim run the program instead, reading std::cin; output
+    // is what it prints and this what its main returned
+    int exit_code = 0;
+
+private:
+    bool emit_cached(const Node *comp_unit);
+    bool compile_stream(const char *source, size_t size, std::string &output);
+    void backend_options();
+    bool simulate(const std::string &code, std::string &output);
+    bool run_code(std::string &output);
+};
@@ -0,0 +1,624 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// assembles the code printed by the backend into a relocatable RV32IM ELF
+// object (-obj), so that no external assembler is needed. It covers what the
+// backend prints: RV32IM instructions and the common pseudo instructions,
+// labels, .text / .data / .bss, .globl, .word, .zero, .align and .asciz (of
+// strings without escapes or '#'). Branches and jumps to local labels are
+// resolved here (a conditional branch out of range becomes an inverted branch
+// over a jal); calls, %hi / %lo and la go through relocations, so the object
+// links against the runtime library
+
+
+enum { SEC_TEXT, SEC_DATA, SEC_BSS, SEC_NUM };
+enum
+{
+    R_RISCV_32 = 1, R_RISCV_BRANCH = 16, R_RISCV_JAL = 17,
+    R_RISCV_CALL_PLT = 19, R_RISCV_HI20 = 26, R_RISCV_LO12_I = 27,
+    R_RISCV_LO12_S = 28
+};
+
+
+struct AsmLine
+{
+    int section;
+    std::string op;
+    std::vector<std::string> args;
+    uint32_t offset;
+    int size;
+    bool far;  // conditional branch that needs a jal
+    std::string comment;  // what followed '#' on the line
+};
+
+
+struct AsmSymbol
+{
+    int section = -1;  // -1: undefined
+    uint32_t offset = 0;
+    bool global = false;
+    int index = 0;
+};
+
+
+struct AsmReloc { uint32_t offset; std::string symbol; int type; int addend; };
+
+
+inline int asm_reg(const std::string &name)
+{
+    static const std::map<std::string, int> regs = []()
+    {
+        std::map<std::string, int> regs;
+        const char *abi[32] = {"zero", "ra", "sp", "gp", "tp", "t0", "t1",
+            "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+            "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3",
+            "t4", "t5", "t6"};
+        for (int i = 0; i < 32; i++)
+        {
+            regs[abi[i]] = i;
+            regs["x" + std::to_string(i)] = i;
+        }
+        regs["fp"] = 8;
+        return regs;
+    }();
+    auto reg = regs.find(name);
+    assert(reg != regs.end());
+    return reg->second;
+}
+
+
+inline bool asm_is_int(const std::string &s)
+{
+    if (s.empty())return false;
+    char *end;
+    strtol(s.c_str(), &end, 0);
+    return *end == 0;
+}
+
+
+// "%hi(sym)" or "%lo(sym)" -> sym; plain integers give an empty symbol
+inline std::string asm_imm(const std::string &s, int &value)
+{
+    value = 0;
+    if (s.compare(0, 4, "%hi(") == 0 || s.compare(0, 4, "%lo(") == 0)
+        return s.substr(4, s.size() - 5);
+    assert(asm_is_int(s));
+    value = strtol(s.c_str(), nullptr, 0);
+    return "";
+}
+
+
+// "imm(reg)" -> imm, reg
+inline int asm_mem(const std::string &s, std::string &imm)
+{
+    size_t open = s.rfind('(');
+    assert(open != std::string::npos && s.back() == ')');
+    imm = open == 0 ? "0" : s.substr(0, open);
+    return asm_reg(s.substr(open + 1, s.size() - open - 2));
+}
+
+
+inline uint32_t enc_r(int f7, int rs2, int rs1, int f3, int rd, int op)
+{
+    return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+
+inline uint32_t enc_i(int imm, int rs1, int f3, int rd, int op)
+{
+    return (uint32_t)(imm & 0xfff) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+
+inline uint32_t enc_s(int imm, int rs2, int rs1, int f3)
+{
+    return (uint32_t)(imm >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 |
+        f3 << 12 | (imm & 0x1f) << 7 | 0x23;
+}
+
+
+inline uint32_t enc_b(int imm, int rs2, int rs1, int f3)
+{
+    return (uint32_t)(imm >> 12 & 1) << 31 | (imm >> 5 & 0x3f) << 25 |
+        rs2 << 20 | rs1 << 15 | f3 << 12 | (imm >> 1 & 0xf) << 8 |
+        (imm >> 11 & 1) << 7 | 0x63;
+}
+
+
+inline uint32_t enc_j(int imm, int rd)
+{
+    return (uint32_t)(imm >> 20 & 1) << 31 | (imm >> 1 & 0x3ff) << 21 |
+        (imm >> 11 & 1) << 20 | (imm >> 12 & 0xff) << 12 | rd << 7 | 0x6f;
+}
+
+
+// conditional branches (pseudo ones included) as funct3, rs1, rs2
+inline bool asm_branch(const AsmLine &line, int &f3, int &rs1, int &rs2)
+{
+    static const std::map<std::string, std::pair<int, int>> branches = {
+        // funct3, operand form: 0: rs1, rs2; 1: rs2, rs1; 2: rs, x0; 3: x0, rs
+        {"beq", {0, 0}}, {"bne", {1, 0}}, {"blt", {4, 0}}, {"bge", {5, 0}},
+        {"bltu", {6, 0}}, {"bgeu", {7, 0}}, {"bgt", {4, 1}}, {"ble", {5, 1}},
+        {"bgtu", {6, 1}}, {"bleu", {7, 1}}, {"beqz", {0, 2}}, {"bnez", {1, 2}},
+        {"bltz", {4, 2}}, {"bgez", {5, 2}}, {"bgtz", {4, 3}}, {"blez", {5, 3}}};
+    auto branch = branches.find(line.op);
+    if (branch == branches.end())return false;
+    f3 = branch->second.first;
+    int a = asm_reg(line.args[0]);
+    int b = branch->second.second < 2 ? asm_reg(line.args[1]) : 0;
+    switch (branch->second.second)
+    {
+    case 0: rs1 = a; rs2 = b; break;
+    case 1: rs1 = b; rs2 = a; break;
+    case 2: rs1 = a; rs2 = 0; break;
+    default: rs1 = 0; rs2 = a; break;
+    }
+    return true;
+}
+
+
+inline int asm_size(const AsmLine &line)
+{
+    if (line.op == "la" || line.op == "call" || line.op == "tail")return 8;
+    if (line.op == "li")
+    {
+        int value = strtol(line.args[1].c_str(), nullptr, 0);
+        if (value >= -2048 && value < 2048)return 4;
+        return (value & 0xfff) == 0 ? 4 : 8;
+    }
+    int f3, rs1, rs2;
+    if (asm_branch(line, f3, rs1, rs2) && line.far)return 8;
+    return 4;
+}
+
+
+inline void asm_encode(const AsmLine &line,
+    const std::map<std::string, AsmSymbol> &symbols,
+    std::vector<uint32_t> &code, std::vector<AsmReloc> &relocs)
+{
+    static const std::map<std::string, std::pair<int, int>> r_type = {
+        {"add", {0, 0}}, {"sub", {0x20, 0}}, {"sll", {0, 1}}, {"slt", {0, 2}},
+        {"sltu", {0, 3}}, {"xor", {0, 4}}, {"srl", {0, 5}}, {"sra", {0x20, 5}},
+        {"or", {0, 6}}, {"and", {0, 7}}, {"mul", {1, 0}}, {"mulh", {1, 1}},
+        {"mulhsu", {1, 2}}, {"mulhu", {1, 3}}, {"div", {1, 4}},
+        {"divu", {1, 5}}, {"rem", {1, 6}}, {"remu", {1, 7}}};
+    static const std::map<std::string, int> i_type = {
+        {"addi", 0}, {"slti", 2}, {"sltiu", 3}, {"xori", 4}, {"ori", 6},
+        {"andi", 7}};
+    static const std::map<std::string, int> shifts = {
+        {"slli", 1}, {"srli", 5}, {"srai", 0x405}};
+    static const std::map<std::string, int> loads = {
+        {"lb", 0}, {"lh", 1}, {"lw", 2}, {"lbu", 4}, {"lhu", 5}};
+    static const std::map<std::string, int> stores = {
+        {"sb", 0}, {"sh", 1}, {"sw", 2}};
+    const std::string &op = line.op;
+    const std::vector<std::string> &args = line.args;
+    code.clear();
+    auto here = [&]() { return line.offset + (uint32_t)code.size() * 4; };
+    auto reloc = [&](const std::string &symbol, int type)
+    {
+        relocs.push_back({here(), symbol, type, 0});
+    };
+    // pc relative offset of a label, or a relocation if it is not local
+    auto target = [&](const std::string &label, int type)
+    {
+        auto symbol = symbols.find(label);
+        if (symbol != symbols.end() && symbol->second.section == SEC_TEXT)
+            return (int)(symbol->second.offset - here());
+        reloc(label, type);
+        return 0;
+    };
+    int f3, rs1, rs2, value;
+    std::string imm;
+    if (r_type.count(op))
+        code.push_back(enc_r(r_type.at(op).first, asm_reg(args[2]),
+            asm_reg(args[1]), r_type.at(op).second, asm_reg(args[0]), 0x33));
+    else if (i_type.count(op))
+    {
+        std::string symbol = asm_imm(args[2], value);
+        if (!symbol.empty())reloc(symbol, R_RISCV_LO12_I);
+        code.push_back(enc_i(value, asm_reg(args[1]), i_type.at(op),
+            asm_reg(args[0]), 0x13));
+    }
+    else if (shifts.count(op))
+        code.push_back(enc_i((shifts.at(op) >> 10 << 10) | (strtol(
+            args[2].c_str(), nullptr, 0) & 31), asm_reg(args[1]),
+            shifts.at(op) & 7, asm_reg(args[0]), 0x13));
+    else if (loads.count(op))
+    {
+        int base = asm_mem(args[1], imm);
+        std::string symbol = asm_imm(imm, value);
+        if (!symbol.empty())reloc(symbol, R_RISCV_LO12_I);
+        code.push_back(enc_i(value, base, loads.at(op), asm_reg(args[0]),
+            0x03));
+    }
+    else if (stores.count(op))
+    {
+        int base = asm_mem(args[1], imm);
+        std::string symbol = asm_imm(imm, value);
+        if (!symbol.empty())reloc(symbol, R_RISCV_LO12_S);
+        code.push_back(enc_s(value, asm_reg(args[0]), base, stores.at(op)));
+    }
+    else if (asm_branch(line, f3, rs1, rs2))
+    {
+        if (!line.far)
+            code.push_back(enc_b(target(args.back(), R_RISCV_BRANCH), rs2,
+                rs1, f3));
+        else
+        {
+            code.push_back(enc_b(8, rs2, rs1, f3 ^ 1));
+            code.push_back(enc_j(target(args.back(), R_RISCV_JAL), 0));
+        }
+    }
+    else if (op == "lui" || op == "auipc")
+    {
+        std::string symbol = asm_imm(args[1], value);
+        if (!symbol.empty())reloc(symbol, R_RISCV_HI20);
+        code.push_back((uint32_t)value << 12 | asm_reg(args[0]) << 7 |
+            (op == "lui" ? 0x37 : 0x17));
+    }
+    else if (op == "li")
+    {
+        int rd = asm_reg(args[0]);
+        value = strtol(args[1].c_str(), nullptr, 0);
+        int lo = (value << 20) >> 20;
+        if (value >= -2048 && value < 2048)
+            code.push_back(enc_i(value, 0, 0, rd, 0x13));
+        else
+        {
+            code.push_back((uint32_t)(value - lo) | rd << 7 | 0x37);
+            if (lo != 0)code.push_back(enc_i(lo, rd, 0, rd, 0x13));
+        }
+    }
+    else if (op == "la")
+    {
+        int rd = asm_reg(args[0]);
+        reloc(args[1], R_RISCV_HI20);
+        code.push_back(rd << 7 | 0x37);
+        reloc(args[1], R_RISCV_LO12_I);
+        code.push_back(enc_i(0, rd, 0, rd, 0x13));
+    }
+    else if (op == "call" || op == "tail")
+    {
+        int rd = op == "call" ? 1 : 6;  // tail calls go through t1
+        reloc(args[0], R_RISCV_CALL_PLT);
+        code.push_back(rd << 7 | 0x17);
+        code.push_back(enc_i(0, rd, 0, op == "call" ? 1 : 0, 0x67));
+    }
+    else if (op == "mv")
+        code.push_back(enc_i(0, asm_reg(args[1]), 0, asm_reg(args[0]), 0x13));
+    else if (op == "not")
+        code.push_back(enc_i(-1, asm_reg(args[1]), 4, asm_reg(args[0]), 0x13));
+    else if (op == "neg")
+        code.push_back(enc_r(0x20, asm_reg(args[1]), 0, 0, asm_reg(args[0]),
+            0x33));
+    else if (op == "seqz")
+        code.push_back(enc_i(1, asm_reg(args[1]), 3, asm_reg(args[0]), 0x13));
+    else if (op == "snez")
+        code.push_back(enc_r(0, asm_reg(args[1]), 0, 3, asm_reg(args[0]),
+            0x33));
+    else if (op == "sltz")
+        code.push_back(enc_r(0, 0, asm_reg(args[1]), 2, asm_reg(args[0]),
+            0x33));
+    else if (op == "sgtz")
+        code.push_back(enc_r(0, asm_reg(args[1]), 0, 2, asm_reg(args[0]),
+            0x33));
+    else if (op == "sgt" || op == "sgtu")
+        code.push_back(enc_r(0, asm_reg(args[1]), asm_reg(args[2]),
+            op == "sgt" ? 2 : 3, asm_reg(args[0]), 0x33));
+    else if (op == "j" || op == "jal")
+    {
+        int rd = op == "j" ? 0 : args.size() == 1 ? 1 : asm_reg(args[0]);
+        code.push_back(enc_j(target(args.back(), R_RISCV_JAL), rd));
+    }
+    else if (op == "jalr" || op == "jr" || op == "ret")
+    {
+        int rd = op == "jalr" && args.size() > 1 ? asm_reg(args[0]) :
+            op == "jalr" ? 1 : 0;
+        int rs = 1, offset = 0;
+        if (op != "ret")
+        {
+            const std::string &arg = args.back();
+            if (arg.find('(') == std::string::npos)rs = asm_reg(arg);
+            else
+            {
+                rs = asm_mem(arg, imm);
+                offset = strtol(imm.c_str(), nullptr, 0);
+            }
+        }
+        code.push_back(enc_i(offset, rs, 0, rd, 0x67));
+    }
+    else if (op == "nop")code.push_back(enc_i(0, 0, 0, 0, 0x13));
+    else if (op == "ecall")code.push_back(0x73);
+    else if (op == "rdcycle" || op == "rdinstret" || op == "rdtime")
+    {
+        int csr = op == "rdcycle" ? 0xc00 : op == "rdtime" ? 0xc01 : 0xc02;
+        code.push_back(enc_i(csr, 0, 2, asm_reg(args[0]), 0x73));
+    }
+    else assert(false);
+}
+
+
+inline void put32(std::string &buf, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)buf += (char)(v >> (8 * i));
+}
+
+
+inline void put16(std::string &buf, uint16_t v)
+{
+    buf += (char)v;
+    buf += (char)(v >> 8);
+}
+
+
+// the instructions, data directives and labels (op ":") of text, in order
+inline void asm_parse(const std::string &text, std::vector<AsmLine> &lines,
+    std::map<std::string, AsmSymbol> &symbols)
+{
+    int section = SEC_TEXT;
+    std::istringstream in(text);
+    for (std::string s; std::getline(in, s);)
+    {
+        size_t comment = s.find('#');
+        std::string note;
+        if (comment != std::string::npos)
+        {
+            note = s.substr(comment + 1);
+            s.resize(comment);
+        }
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)continue;
+        s = s.substr(begin, s.find_last_not_of(" \t\r") + 1 - begin);
+        if (s.back() == ':')
+        {
+            lines.push_back({section, ":", {s.substr(0, s.size() - 1)}, 0, 0,
+                false});
+            continue;
+        }
+        AsmLine line = {section, "", {}, 0, 0, false, note};
+        size_t space = s.find_first_of(" \t");
+        line.op = s.substr(0, space);
+        if (line.op == ".asciz")
+        {
+            size_t open = s.find('"'), close = s.rfind('"');
+            assert(open != close);
+            line.args.push_back(s.substr(open + 1, close - open - 1));
+        }
+        else if (space != std::string::npos)
+        {
+            std::stringstream args(s.substr(space));
+            for (std::string arg; std::getline(args, arg, ',');)
+            {
+                size_t b = arg.find_first_not_of(" \t");
+                size_t e = arg.find_last_not_of(" \t");
+                line.args.push_back(arg.substr(b, e + 1 - b));
+            }
+        }
+        if (line.op == ".text")section = SEC_TEXT;
+        else if (line.op == ".data")section = SEC_DATA;
+        else if (line.op == ".bss")section = SEC_BSS;
+        else if (line.op == ".globl" || line.op == ".global")
+            symbols[line.args[0]].global = true;
+        else if (line.op == ".word" || line.op == ".zero" ||
+            line.op == ".asciz" || line.op == ".align" ||
+            line.op == ".p2align" || line.op[0] != '.')
+            lines.push_back(line);
+        // other directives (.file, .loc, .type, .size) carry no code
+    }
+}
+
+
+// gives lines their offsets in their sections and labels theirs, until no
+// branch needs to grow any more
+inline void asm_layout(std::vector<AsmLine> &lines,
+    std::map<std::string, AsmSymbol> &symbols)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        uint32_t offsets[SEC_NUM] = {0};
+        for (auto &line : lines)
+        {
+            uint32_t &offset = offsets[line.section];
+            if (line.op == ":")
+            {
+                symbols[line.args[0]].section = line.section;
+                symbols[line.args[0]].offset = offset;
+                line.size = 0;
+            }
+            else if (line.op == ".align" || line.op == ".p2align")
+            {
+                uint32_t align = 1u << atoi(line.args[0].c_str());
+                line.size = (align - offset % align) % align;
+            }
+            else if (line.op == ".word")line.size = 4 * line.args.size();
+            else if (line.op == ".zero")line.size = atoi(line.args[0].c_str());
+            else if (line.op == ".asciz")line.size = line.args[0].size() + 1;
+            else line.size = asm_size(line);
+            line.offset = offset;
+            offset += line.size;
+        }
+        int f3, rs1, rs2;
+        for (auto &line : lines)
+            if (!line.far && asm_branch(line, f3, rs1, rs2) &&
+                symbols.count(line.args.back()))
+            {
+                const AsmSymbol &symbol = symbols[line.args.back()];
+                int distance = (int)symbol.offset - (int)line.offset;
+                if (symbol.section == SEC_TEXT &&
+                    (distance < -4096 || distance > 4094))
+                    line.far = changed = true;
+            }
+    }
+}
+
+
+inline std::string assemble(const std::string &text)
+{
+    std::vector<AsmLine> lines;
+    std::map<std::string, AsmSymbol> symbols;
+    asm_parse(text, lines, symbols);
+    asm_layout(lines, symbols);
+    std::string sections[SEC_NUM];
+    uint32_t bss_size = 0;
+    std::vector<AsmReloc> relocs[2];  // .rela.text, .rela.data
+    std::vector<uint32_t> code;
+    for (auto &line : lines)
+    {
+        std::string &data = sections[line.section];
+        if (line.op == ":")continue;
+        if (line.section == SEC_BSS)
+        {
+            assert(line.op == ".zero" || line.op == ".align" ||
+                line.op == ".p2align");
+            bss_size = line.offset + line.size;
+        }
+        else if (line.op == ".word")
+            for (auto &word : line.args)
+                if (asm_is_int(word))put32(data, strtol(word.c_str(),
+                    nullptr, 0));
+                else
+                {
+                    relocs[line.section == SEC_DATA].push_back(
+                        {(uint32_t)data.size(), word, R_RISCV_32, 0});
+                    put32(data, 0);
+                }
+        else if (line.op == ".asciz")data += line.args[0] + '\0';
+        else if (line.op[0] == '.')data.append(line.size, 0);
+        else
+        {
+            assert(line.section == SEC_TEXT);
+            asm_encode(line, symbols, code, relocs[0]);
+            for (auto word : code)put32(data, word);
+        }
+    }
+    // symbols: null, sections, locals, then globals
+    std::string strtab(1, '\0');
+    std::string symtab(16, '\0');
+    std::vector<std::string> order;
+    for (auto &reloc : relocs[0])
+        if (!symbols.count(reloc.symbol))symbols[reloc.symbol].global = true;
+    for (auto &reloc : relocs[1])
+        if (!symbols.count(reloc.symbol))symbols[reloc.symbol].global = true;
+    for (int global = 0; global < 2; global++)
+        for (auto &symbol : symbols)
+            if (symbol.second.global == (bool)global &&
+                (global || symbol.first.compare(0, 2, ".L") != 0))
+                order.push_back(symbol.first);
+    for (int i = 0; i < SEC_NUM; i++)
+    {
+        put32(symtab, 0);
+        put32(symtab, 0);
+        put32(symtab, 0);
+        symtab += (char)3;  // STB_LOCAL, STT_SECTION
+        symtab += (char)0;
+        put16(symtab, i + 1);
+    }
+    int first_global = 1 + SEC_NUM;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        AsmSymbol &symbol = symbols[order[i]];
+        symbol.index = 1 + SEC_NUM + i;
+        if (!symbol.global)first_global = symbol.index + 1;
+        int type = symbol.section == SEC_TEXT ? 2 :  // STT_FUNC
+            symbol.section >= 0 ? 1 : 0;  // STT_OBJECT, STT_NOTYPE
+        put32(symtab, strtab.size());
+        strtab += order[i] + '\0';
+        put32(symtab, symbol.section >= 0 ? symbol.offset : 0);
+        put32(symtab, 0);
+        symtab += (char)((symbol.global ? 1 : 0) << 4 | type);
+        symtab += (char)0;
+        put16(symtab, symbol.section >= 0 ? symbol.section + 1 : 0);
+    }
+    std::string rela[2];
+    for (int i = 0; i < 2; i++)
+        for (auto &reloc : relocs[i])
+        {
+            const AsmSymbol &symbol = symbols[reloc.symbol];
+            assert(symbol.index > 0);  // .L labels are resolved locally
+            put32(rela[i], reloc.offset);
+            put32(rela[i], symbol.index << 8 | reloc.type);
+            put32(rela[i], reloc.addend);
+        }
+    // file: header, section contents, section headers
+    const char *names[] = {"", ".text", ".data", ".bss", ".rela.text",
+        ".rela.data", ".symtab", ".strtab", ".shstrtab"};
+    const int section_num = 9;
+    std::string shstrtab;
+    std::vector<uint32_t> name_offsets;
+    for (auto name : names)
+    {
+        name_offsets.push_back(shstrtab.size());
+        shstrtab += std::string(name) + '\0';
+    }
+    std::string contents[section_num] = {"", sections[SEC_TEXT],
+        sections[SEC_DATA], "", rela[0], rela[1], symtab, strtab, shstrtab};
+    std::string elf;
+    uint32_t offsets[section_num];
+    uint32_t offset = 52;
+    for (int i = 0; i < section_num; i++)
+    {
+        offset = (offset + 3) & ~3u;
+        offsets[i] = offset;
+        offset += contents[i].size();
+    }
+    uint32_t shoff = (offset + 3) & ~3u;
+    elf += "\x7f" "ELF";
+    elf += (char)1;  // ELFCLASS32
+    elf += (char)1;  // ELFDATA2LSB
+    elf += (char)1;  // EV_CURRENT
+    elf.append(9, 0);
+    put16(elf, 1);    // ET_REL
+    put16(elf, 243);  // EM_RISCV
+    put32(elf, 1);
+    put32(elf, 0);    // entry
+    put32(elf, 0);    // phoff
+    put32(elf, shoff);
+    put32(elf, 0);    // flags: soft float, no compressed instructions
+    put16(elf, 52);
+    put16(elf, 0);
+    put16(elf, 0);
+    put16(elf, 40);
+    put16(elf, section_num);
+    put16(elf, section_num - 1);
+    for (int i = 0; i < section_num; i++)
+    {
+        elf.resize(offsets[i], 0);
+        elf += contents[i];
+    }
+    elf.resize(shoff, 0);
+    // type, flags, size, link, info, align, entsize
+    const uint32_t headers[section_num][7] = {
+        {0, 0, 0, 0, 0, 0, 0},
+        {1, 6, (uint32_t)contents[1].size(), 0, 0, 4, 0},   // PROGBITS, AX
+        {1, 3, (uint32_t)contents[2].size(), 0, 0, 4, 0},   // PROGBITS, WA
+        {8, 3, bss_size, 0, 0, 4, 0},                       // NOBITS, WA
+        {4, 0x40, (uint32_t)rela[0].size(), 6, 1, 4, 12},   // RELA, INFO_LINK
+        {4, 0x40, (uint32_t)rela[1].size(), 6, 2, 4, 12},
+        {2, 0, (uint32_t)symtab.size(), 7, (uint32_t)first_global, 4, 16},
+        {3, 0, (uint32_t)strtab.size(), 0, 0, 1, 0},        // STRTAB
+        {3, 0, (uint32_t)shstrtab.size(), 0, 0, 1, 0}};
+    for (int i = 0; i < section_num; i++)
+    {
+        put32(elf, name_offsets[i]);
+        put32(elf, headers[i][0]);
+        put32(elf, headers[i][1]);
+        put32(elf, 0);  // addr
+        put32(elf, i == 0 ? 0 : offsets[i]);
+        put32(elf, headers[i][2]);
+        put32(elf, headers[i][3]);
+        put32(elf, headers[i][4]);
+        put32(elf, headers[i][5]);
+        put32(elf, headers[i][6]);
+    }
+    return elf;
+}
@@ -0,0 +1,711 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "koopa.h"
+
+
+// binary form of a raw Koopa program (-kir), read back without a text parse.
+// Layout, all integers are LEB128 varints (operands and constants zigzag):
+//   "KIRB" version
+//   strings    count, (length, bytes, '\0') ...   names, id 0 is no name
+//   types      count, (tag, fields) ...           children come first
+//   globals    count, (name, type, init) ...
+//   functions  count, (name, type, body size) ...
+//   bodies     one section per function, in the same order
+// A body numbers the function's params, then the block params, then all
+// instructions in block order; an operand is (index << 2 | kind) with kind 0
+// for such a local value, 1 for a global, 2 for an integer (the value) and 3
+// for another constant, which follows. Bodies are only decoded when asked for,
+// so a mapped file costs nothing but its headers until a function is needed.
+// used_by is not stored, the backend doesn't use it
+
+
+const char ir_magic[4] = {'K', 'I', 'R', 'B'};
+const int ir_version = 1;
+
+
+inline bool ir_is_binary(const char *data, size_t size)
+{
+    return size > sizeof(ir_magic) && memcmp(data, ir_magic, 4) == 0;
+}
+
+
+inline void ir_put(std::string &buf, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buf += char(value | 0x80);
+        value >>= 7;
+    }
+    buf += char(value);
+}
+
+
+inline uint64_t ir_zigzag(int32_t value)
+{
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+
+class IRWriter
+{
+public:
+    std::string write(const koopa_raw_program_t &program)
+    {
+        for (size_t i = 0; i < program.values.len; i++)
+            globals[(koopa_raw_value_t)program.values.buffer[i]] = i;
+        for (size_t i = 0; i < program.funcs.len; i++)
+            funcs[(koopa_raw_function_t)program.funcs.buffer[i]] = i;
+        std::string bodies, index, global_table;
+        ir_put(index, program.funcs.len);
+        for (size_t i = 0; i < program.funcs.len; i++)
+        {
+            auto func = (koopa_raw_function_t)program.funcs.buffer[i];
+            std::string body = function(func);
+            ir_put(index, string_id(func->name));
+            ir_put(index, type_id(func->ty));
+            ir_put(index, body.size());
+            bodies += body;
+        }
+        ir_put(global_table, program.values.len);
+        for (size_t i = 0; i < program.values.len; i++)
+        {
+            auto value = (koopa_raw_value_t)program.values.buffer[i];
+            assert(value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC);
+            ir_put(global_table, string_id(value->name));
+            ir_put(global_table, type_id(value->ty));
+            constant(global_table, value->kind.data.global_alloc.init);
+        }
+        std::string file(ir_magic, 4);
+        ir_put(file, ir_version);
+        ir_put(file, string_list.size());
+        for (auto &s : string_list)
+        {
+            ir_put(file, s.size());
+            file.append(s.c_str(), s.size() + 1);
+        }
+        ir_put(file, type_num);
+        return file + types + global_table + index + bodies;
+    }
+
+private:
+    std::map<std::string, uint64_t> strings;
+    std::vector<std::string> string_list;
+    // types are compared by their encoding, so equal types share an id
+    std::map<std::string, uint64_t> type_ids;
+    std::string types;
+    uint64_t type_num = 0;
+    std::map<koopa_raw_value_t, uint64_t> globals, locals;
+    std::map<koopa_raw_function_t, uint64_t> funcs;
+    std::map<koopa_raw_basic_block_t, uint64_t> bbs;
+
+    uint64_t string_id(const char *s)
+    {
+        if (!s)return 0;
+        auto it = strings.find(s);
+        if (it != strings.end())return it->second;
+        string_list.push_back(s);
+        return strings[s] = string_list.size();
+    }
+
+    uint64_t type_id(koopa_raw_type_t ty)
+    {
+        std::string code;
+        ir_put(code, ty->tag);
+        switch (ty->tag)
+        {
+        case KOOPA_RTT_ARRAY:
+            ir_put(code, type_id(ty->data.array.base));
+            ir_put(code, ty->data.array.len);
+            break;
+        case KOOPA_RTT_POINTER:
+            ir_put(code, type_id(ty->data.pointer.base));
+            break;
+        case KOOPA_RTT_FUNCTION:
+        {
+            auto &params = ty->data.function.params;
+            ir_put(code, params.len);
+            for (size_t i = 0; i < params.len; i++)
+                ir_put(code, type_id((koopa_raw_type_t)params.buffer[i]));
+            ir_put(code, type_id(ty->data.function.ret));
+            break;
+        }
+        default:
+            break;
+        }
+        auto it = type_ids.find(code);
+        if (it != type_ids.end())return it->second;
+        types += code;
+        return type_ids[code] = type_num++;
+    }
+
+    void constant(std::string &buf, koopa_raw_value_t value)
+    {
+        ir_put(buf, value->kind.tag);
+        switch (value->kind.tag)
+        {
+        case KOOPA_RVT_INTEGER:
+            ir_put(buf, ir_zigzag(value->kind.data.integer.value));
+            break;
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+            ir_put(buf, type_id(value->ty));
+            break;
+        case KOOPA_RVT_AGGREGATE:
+        {
+            auto &elems = value->kind.data.aggregate.elems;
+            ir_put(buf, type_id(value->ty));
+            ir_put(buf, elems.len);
+            for (size_t i = 0; i < elems.len; i++)
+                constant(buf, (koopa_raw_value_t)elems.buffer[i]);
+            break;
+        }
+        default:
+            assert(false);
+        }
+    }
+
+    void operand(std::string &buf, koopa_raw_value_t value)
+    {
+        auto local = locals.find(value);
+        auto global = globals.find(value);
+        if (local != locals.end())ir_put(buf, local->second << 2);
+        else if (global != globals.end())ir_put(buf, global->second << 2 | 1);
+        else if (value->kind.tag == KOOPA_RVT_INTEGER)
+            ir_put(buf, ir_zigzag(value->kind.data.integer.value) << 2 | 2);
+        else
+        {
+            ir_put(buf, 3);
+            constant(buf, value);
+        }
+    }
+
+    void operands(std::string &buf, const koopa_raw_slice_t &slice)
+    {
+        ir_put(buf, slice.len);
+        for (size_t i = 0; i < slice.len; i++)
+            operand(buf, (koopa_raw_value_t)slice.buffer[i]);
+    }
+
+    std::string function(koopa_raw_function_t func)
+    {
+        std::string body;
+        locals.clear();
+        bbs.clear();
+        ir_put(body, func->params.len);
+        for (size_t i = 0; i < func->params.len; i++)
+        {
+            auto param = (koopa_raw_value_t)func->params.buffer[i];
+            locals[param] = locals.size();
+            ir_put(body, string_id(param->name));
+        }
+        ir_put(body, func->bbs.len);
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+            bbs[bb] = i;
+            ir_put(body, string_id(bb->name));
+            ir_put(body, bb->params.len);
+            for (size_t j = 0; j < bb->params.len; j++)
+            {
+                auto param = (koopa_raw_value_t)bb->params.buffer[j];
+                locals[param] = locals.size();
+                ir_put(body, type_id(param->ty));
+                ir_put(body, string_id(param->name));
+            }
+            ir_put(body, bb->insts.len);
+        }
+        // instructions may be used before they are defined in block order
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+            for (size_t j = 0; j < bb->insts.len; j++)
+                locals[(koopa_raw_value_t)bb->insts.buffer[j]] = locals.size();
+        }
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = (koopa_raw_basic_block_t)func->bbs.buffer[i];
+            for (size_t j = 0; j < bb->insts.len; j++)
+                instruction(body, (koopa_raw_value_t)bb->insts.buffer[j]);
+        }
+        return body;
+    }
+
+    void instruction(std::string &buf, koopa_raw_value_t inst)
+    {
+        auto &kind = inst->kind;
+        ir_put(buf, kind.tag);
+        ir_put(buf, type_id(inst->ty));
+        ir_put(buf, string_id(inst->name));
+        switch (kind.tag)
+        {
+        case KOOPA_RVT_ALLOC:
+            break;
+        case KOOPA_RVT_LOAD:
+            operand(buf, kind.data.load.src);
+            break;
+        case KOOPA_RVT_STORE:
+            operand(buf, kind.data.store.value);
+            operand(buf, kind.data.store.dest);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            operand(buf, kind.data.get_ptr.src);
+            operand(buf, kind.data.get_ptr.index);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            operand(buf, kind.data.get_elem_ptr.src);
+            operand(buf, kind.data.get_elem_ptr.index);
+            break;
+        case KOOPA_RVT_BINARY:
+            ir_put(buf, kind.data.binary.op);
+            operand(buf, kind.data.binary.lhs);
+            operand(buf, kind.data.binary.rhs);
+            break;
+        case KOOPA_RVT_BRANCH:
+            operand(buf, kind.data.branch.cond);
+            ir_put(buf, bbs.at(kind.data.branch.true_bb));
+            ir_put(buf, bbs.at(kind.data.branch.false_bb));
+            operands(buf, kind.data.branch.true_args);
+            operands(buf, kind.data.branch.false_args);
+            break;
+        case KOOPA_RVT_JUMP:
+            ir_put(buf, bbs.at(kind.data.jump.target));
+            operands(buf, kind.data.jump.args);
+            break;
+        case KOOPA_RVT_CALL:
+            ir_put(buf, funcs.at(kind.data.call.callee));
+            operands(buf, kind.data.call.args);
+            break;
+        case KOOPA_RVT_RETURN:
+            ir_put(buf, kind.data.ret.value != nullptr);
+            if (kind.data.ret.value)operand(buf, kind.data.ret.value);
+            break;
+        default:
+            assert(false);
+        }
+    }
+};
+
+
+inline std::string ir_write(const koopa_raw_program_t &program)
+{
+    return IRWriter().write(program);
+}
+
+
+// a read only mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)return;
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            length = st.st_size;
+            valid = true;
+            if (length > 0)
+            {
+                void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+                if (addr == MAP_FAILED)valid = false;
+                else start = static_cast<const char *>(addr);
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile()
+    {
+        if (start)munmap(const_cast<char *>(start), length);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    bool ok() const { return valid; }
+    const char *data() const { return start ? start : ""; }
+    size_t size() const { return start ? length : 0; }
+
+private:
+    const char *start = nullptr;
+    size_t length = 0;
+    bool valid = false;
+};
+
+
+// bump allocator for the decoded program, which is only freed as a whole
+class IRArena
+{
+public:
+    template <typename T> T *alloc(size_t n = 1)
+    {
+        size_t bytes = (n * sizeof(T) + 7) & ~size_t(7);
+        if (blocks.empty() || used + bytes > capacity)
+        {
+            capacity = std::max<size_t>(bytes, 64 * 1024);
+            blocks.emplace_back(new char[capacity]);
+            used = 0;
+        }
+        T *p = reinterpret_cast<T *>(blocks.back().get() + used);
+        used += bytes;
+        return p;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t used = 0, capacity = 0;
+};
+
+
+struct IRCursor
+{
+    const char *pos, *end;
+    uint64_t get()
+    {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            assert(pos < end && shift < 64);
+            unsigned char c = *pos++;
+            value |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80))return value;
+        }
+    }
+    int32_t get_int(uint64_t zigzag)
+    {
+        return int32_t(uint32_t(zigzag >> 1) ^ -uint32_t(zigzag & 1));
+    }
+};
+
+
+// decodes a binary program in place: names point into the data, which must
+// stay alive (and mapped) as long as the program is used. The headers are read
+// by the constructor, program() has all globals and functions but no function
+// bodies until load() is called for them. Different functions may be loaded
+// at the same time from different threads
+class IRReader
+{
+public:
+    IRReader(const char *data, size_t size)
+    {
+        assert(ir_is_binary(data, size));
+        IRCursor in = {data + 4, data + size};
+        assert(in.get() == ir_version);
+        strings.push_back(nullptr);
+        for (uint64_t n = in.get(); n > 0; n--)
+        {
+            uint64_t len = in.get();
+            assert(len < uint64_t(in.end - in.pos) && in.pos[len] == '\0');
+            strings.push_back(in.pos);
+            in.pos += len + 1;
+        }
+        for (uint64_t n = in.get(); n > 0; n--)types.push_back(read_type(in));
+        raw.values = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+        for (uint32_t i = 0; i < raw.values.len; i++)
+        {
+            auto global = arena.alloc<koopa_raw_value_data_t>();
+            global->name = string(in);
+            global->ty = type(in);
+            global->used_by = slice(arena, 0, KOOPA_RSIK_VALUE);
+            global->kind.tag = KOOPA_RVT_GLOBAL_ALLOC;
+            global->kind.data.global_alloc.init = constant(in, arena, in.get());
+            raw.values.buffer[i] = global;
+        }
+        raw.funcs = slice(arena, in.get(), KOOPA_RSIK_FUNCTION);
+        std::vector<uint64_t> sizes;
+        for (uint32_t i = 0; i < raw.funcs.len; i++)
+        {
+            auto func = arena.alloc<koopa_raw_function_data_t>();
+            func->name = string(in);
+            func->ty = type(in);
+            func->params = slice(arena, 0, KOOPA_RSIK_VALUE);
+            func->bbs = slice(arena, 0, KOOPA_RSIK_BASIC_BLOCK);
+            funcs.push_back(func);
+            raw.funcs.buffer[i] = func;
+            sizes.push_back(in.get());
+        }
+        for (auto size : sizes)
+        {
+            assert(size <= uint64_t(in.end - in.pos));
+            bodies.push_back({in.pos, in.pos + size});
+            in.pos += size;
+        }
+        assert(in.pos == in.end);
+        func_arenas.resize(funcs.size());
+        loaded.resize(funcs.size(), false);
+    }
+    IRReader(const IRReader &) = delete;
+    IRReader &operator=(const IRReader &) = delete;
+
+    const koopa_raw_program_t &program() const { return raw; }
+
+    // decodes the body of program().funcs[index]
+    void load(size_t index)
+    {
+        if (loaded[index])return;
+        loaded[index] = true;
+        IRArena &arena = func_arenas[index];
+        IRCursor in = bodies[index];
+        koopa_raw_function_data_t *func = funcs[index];
+        std::vector<koopa_raw_value_data_t *> locals;
+        auto &param_types = func->ty->data.function.params;
+        func->params = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+        // declarations have no param values
+        assert(func->params.len <= param_types.len);
+        for (uint32_t i = 0; i < func->params.len; i++)
+        {
+            auto param = new_value(arena,
+                (koopa_raw_type_t)param_types.buffer[i], string(in));
+            param->kind.tag = KOOPA_RVT_FUNC_ARG_REF;
+            param->kind.data.func_arg_ref.index = i;
+            func->params.buffer[i] = param;
+            locals.push_back(param);
+        }
+        func->bbs = slice(arena, in.get(), KOOPA_RSIK_BASIC_BLOCK);
+        std::vector<koopa_raw_basic_block_data_t *> bbs;
+        for (uint32_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = arena.alloc<koopa_raw_basic_block_data_t>();
+            bb->name = string(in);
+            bb->params = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+            for (uint32_t j = 0; j < bb->params.len; j++)
+            {
+                auto ty = type(in);
+                auto param = new_value(arena, ty, string(in));
+                param->kind.tag = KOOPA_RVT_BLOCK_ARG_REF;
+                param->kind.data.block_arg_ref.index = j;
+                bb->params.buffer[j] = param;
+                locals.push_back(param);
+            }
+            bb->used_by = slice(arena, 0, KOOPA_RSIK_VALUE);
+            bb->insts = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+            func->bbs.buffer[i] = bb;
+            bbs.push_back(bb);
+        }
+        size_t first_inst = locals.size();
+        for (auto bb : bbs)
+            for (uint32_t j = 0; j < bb->insts.len; j++)
+            {
+                auto inst = new_value(arena, nullptr, nullptr);
+                bb->insts.buffer[j] = inst;
+                locals.push_back(inst);
+            }
+        for (size_t i = first_inst; i < locals.size(); i++)
+            read_instruction(in, arena, locals[i], locals, bbs);
+        assert(in.pos == in.end);
+    }
+
+private:
+    koopa_raw_program_t raw;
+    IRArena arena;
+    std::vector<const char *> strings;
+    std::vector<koopa_raw_type_t> types;
+    std::vector<koopa_raw_function_data_t *> funcs;
+    std::vector<IRCursor> bodies;
+    std::vector<IRArena> func_arenas;
+    std::vector<char> loaded;
+    const koopa_raw_type_kind_t i32 = {KOOPA_RTT_INT32, {}};
+
+    static koopa_raw_slice_t slice(IRArena &arena, uint64_t len,
+        koopa_raw_slice_item_kind_t kind)
+    {
+        assert(len < (uint64_t(1) << 32));
+        return {arena.alloc<const void *>(len), uint32_t(len), kind};
+    }
+
+    const char *string(IRCursor &in)
+    {
+        uint64_t id = in.get();
+        assert(id < strings.size());
+        return strings[id];
+    }
+
+    koopa_raw_type_t type(IRCursor &in)
+    {
+        uint64_t id = in.get();
+        assert(id < types.size());
+        return types[id];
+    }
+
+    koopa_raw_type_t read_type(IRCursor &in)
+    {
+        auto ty = arena.alloc<koopa_raw_type_kind_t>();
+        ty->tag = koopa_raw_type_tag_t(in.get());
+        switch (ty->tag)
+        {
+        case KOOPA_RTT_INT32:
+        case KOOPA_RTT_UNIT:
+            break;
+        case KOOPA_RTT_ARRAY:
+            ty->data.array.base = type(in);
+            ty->data.array.len = in.get();
+            break;
+        case KOOPA_RTT_POINTER:
+            ty->data.pointer.base = type(in);
+            break;
+        case KOOPA_RTT_FUNCTION:
+        {
+            auto &params = ty->data.function.params;
+            params = slice(arena, in.get(), KOOPA_RSIK_TYPE);
+            for (uint32_t i = 0; i < params.len; i++)
+                params.buffer[i] = type(in);
+            ty->data.function.ret = type(in);
+            break;
+        }
+        default:
+            assert(false);
+        }
+        return ty;
+    }
+
+    static koopa_raw_value_data_t *new_value(IRArena &arena,
+        koopa_raw_type_t ty, const char *name)
+    {
+        auto value = arena.alloc<koopa_raw_value_data_t>();
+        value->ty = ty;
+        value->name = name;
+        value->used_by = slice(arena, 0, KOOPA_RSIK_VALUE);
+        return value;
+    }
+
+    koopa_raw_value_t constant(IRCursor &in, IRArena &arena, uint64_t tag)
+    {
+        koopa_raw_value_data_t *value;
+        switch (tag)
+        {
+        case KOOPA_RVT_INTEGER:
+            value = new_value(arena, &i32, nullptr);
+            value->kind.data.integer.value = in.get_int(in.get());
+            break;
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+            value = new_value(arena, type(in), nullptr);
+            break;
+        case KOOPA_RVT_AGGREGATE:
+        {
+            value = new_value(arena, type(in), nullptr);
+            auto &elems = value->kind.data.aggregate.elems;
+            elems = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+            for (uint32_t i = 0; i < elems.len; i++)
+                elems.buffer[i] = constant(in, arena, in.get());
+            break;
+        }
+        default:
+            assert(false);
+        }
+        value->kind.tag = koopa_raw_value_tag_t(tag);
+        return value;
+    }
+
+    koopa_raw_value_t operand(IRCursor &in, IRArena &arena,
+        const std::vector<koopa_raw_value_data_t *> &locals)
+    {
+        uint64_t code = in.get(), index = code >> 2;
+        switch (code & 3)
+        {
+        case 0:
+            assert(index < locals.size());
+            return locals[index];
+        case 1:
+            assert(index < raw.values.len);
+            return (koopa_raw_value_t)raw.values.buffer[index];
+        case 2:
+        {
+            auto value = new_value(arena, &i32, nullptr);
+            value->kind.tag = KOOPA_RVT_INTEGER;
+            value->kind.data.integer.value = in.get_int(index);
+            return value;
+        }
+        default:
+            return constant(in, arena, in.get());
+        }
+    }
+
+    koopa_raw_slice_t operands(IRCursor &in, IRArena &arena,
+        const std::vector<koopa_raw_value_data_t *> &locals)
+    {
+        koopa_raw_slice_t values = slice(arena, in.get(), KOOPA_RSIK_VALUE);
+        for (uint32_t i = 0; i < values.len; i++)
+            values.buffer[i] = operand(in, arena, locals);
+        return values;
+    }
+
+    static koopa_raw_basic_block_t block(IRCursor &in,
+        const std::vector<koopa_raw_basic_block_data_t *> &bbs)
+    {
+        uint64_t index = in.get();
+        assert(index < bbs.size());
+        return bbs[index];
+    }
+
+    void read_instruction(IRCursor &in, IRArena &arena,
+        koopa_raw_value_data_t *inst,
+        const std::vector<koopa_raw_value_data_t *> &locals,
+        const std::vector<koopa_raw_basic_block_data_t *> &bbs)
+    {
+        auto &kind = inst->kind;
+        kind.tag = koopa_raw_value_tag_t(in.get());
+        inst->ty = type(in);
+        inst->name = string(in);
+        switch (kind.tag)
+        {
+        case KOOPA_RVT_ALLOC:
+            break;
+        case KOOPA_RVT_LOAD:
+            kind.data.load.src = operand(in, arena, locals);
+            break;
+        case KOOPA_RVT_STORE:
+            kind.data.store.value = operand(in, arena, locals);
+            kind.data.store.dest = operand(in, arena, locals);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            kind.data.get_ptr.src = operand(in, arena, locals);
+            kind.data.get_ptr.index = operand(in, arena, locals);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            kind.data.get_elem_ptr.src = operand(in, arena, locals);
+            kind.data.get_elem_ptr.index = operand(in, arena, locals);
+            break;
+        case KOOPA_RVT_BINARY:
+            kind.data.binary.op = koopa_raw_binary_op_t(in.get());
+            kind.data.binary.lhs = operand(in, arena, locals);
+            kind.data.binary.rhs = operand(in, arena, locals);
+            break;
+        case KOOPA_RVT_BRANCH:
+            kind.data.branch.cond = operand(in, arena, locals);
+            kind.data.branch.true_bb = block(in, bbs);
+            kind.data.branch.false_bb = block(in, bbs);
+            kind.data.branch.true_args = operands(in, arena, locals);
+            kind.data.branch.false_args = operands(in, arena, locals);
+            break;
+        case KOOPA_RVT_JUMP:
+            kind.data.jump.target = block(in, bbs);
+            kind.data.jump.args = operands(in, arena, locals);
+            break;
+        case KOOPA_RVT_CALL:
+        {
+            uint64_t callee = in.get();
+            assert(callee < funcs.size());
+            kind.data.call.callee = funcs[callee];
+            kind.data.call.args = operands(in, arena, locals);
+            break;
+        }
+        case KOOPA_RVT_RETURN:
+            kind.data.ret.value = in.get() ? operand(in, arena, locals) :
+                nullptr;
+            break;
+        default:
+            assert(false);
+        }
+    }
+};
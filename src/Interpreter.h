@@ -0,0 +1,532 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Runtime.h"
+#include "koopa.h"
+
+
+// -run-koopa: runs a raw program with the SysY runtime built in. The program
+// is first translated into a compact form, operands become registers of the
+// frame or constants (integers, addresses of globals), and blocks and
+// functions are referred to by index. Memory is an array of words, a pointer
+// is the index of a word, so every type is a whole number of words. Calls
+// don't recurse on the host, frames live on an explicit stack. Only the
+// blocks entered are counted while running, the counts of the instructions
+// follow from those of their blocks. Division by zero and overflow behave
+// like on RV32IM
+class Interpreter
+{
+public:
+    // why run() failed
+    std::string error;
+
+    Interpreter(const koopa_raw_program_t &program, std::istream &in,
+        std::ostream &out) : runtime(in, out)
+    {
+        memory.push_back(0);  // address 0 is null
+        for (size_t i = 0; i < program.funcs.len; i++)
+        {
+            auto func = reinterpret_cast<koopa_raw_function_t>(
+                program.funcs.buffer[i]);
+            func_index[func] = i;
+            funcs.emplace_back();
+            funcs.back().name = func->name;
+            funcs.back().runtime = runtime_function(func->name + 1);
+        }
+        for (size_t i = 0; i < program.values.len; i++)
+        {
+            auto global = reinterpret_cast<koopa_raw_value_t>(
+                program.values.buffer[i]);
+            assert(global->kind.tag == KOOPA_RVT_GLOBAL_ALLOC);
+            int32_t address = memory.size();
+            global_address[global] = address;
+            memory.resize(address + words(global->ty->data.pointer.base));
+            initialize(address, global->kind.data.global_alloc.init);
+        }
+        for (size_t i = 0; i < program.funcs.len; i++)
+            translate(reinterpret_cast<koopa_raw_function_t>(
+                program.funcs.buffer[i]), funcs[i]);
+    }
+
+    // runs @main, false on errors like accesses out of memory
+    bool run(int32_t &exit_code)
+    {
+        auto main = std::find_if(funcs.begin(), funcs.end(),
+            [](const Function &func) { return func.name == "@main"; });
+        if (main == funcs.end() || main->blocks.empty())
+        {
+            error = "no @main";
+            return false;
+        }
+        Memory access{memory, stack_top, error};
+        try
+        {
+            exit_code = execute(main - funcs.begin(), access);
+        }
+        catch (const Failure &)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // the dynamic counts of each function, then of each block by the number of
+    // instructions it ran
+    std::string report() const
+    {
+        std::ostringstream os;
+        os << std::left << std::setw(20) << "function" << std::right <<
+            std::setw(10) << "called" << std::setw(14) << "insts" <<
+            std::setw(12) << "loads" << std::setw(12) << "stores" <<
+            std::setw(12) << "calls" << std::setw(12) << "branches" <<
+            std::endl;
+        Counts total;
+        struct Hot { const Function *func; const Block *block; long insts; };
+        std::vector<Hot> blocks;
+        for (auto &func : funcs)
+        {
+            if (func.blocks.empty())continue;
+            Counts counts;
+            for (auto &block : func.blocks)
+            {
+                counts.add(block.counts, block.entered);
+                if (block.entered)
+                    blocks.push_back({&func, &block,
+                        block.entered * long(block.insts.size())});
+            }
+            total.add(counts, 1);
+            print_counts(os, func.name, func.called, counts);
+        }
+        print_counts(os, "total", 0, total);
+        std::stable_sort(blocks.begin(), blocks.end(),
+            [](const Hot &a, const Hot &b) { return a.insts > b.insts; });
+        os << std::left << std::setw(20) << "block" << std::setw(20) <<
+            "function" << std::right << std::setw(12) << "entered" <<
+            std::setw(14) << "insts" << std::endl;
+        for (auto &hot : blocks)
+            os << std::left << std::setw(20) << hot.block->name <<
+                std::setw(20) << hot.func->name << std::right <<
+                std::setw(12) << hot.block->entered << std::setw(14) <<
+                hot.insts << std::endl;
+        if (runtime.timer_calls)
+            os << "timer: " << std::chrono::duration<double, std::milli>(
+                runtime.timer).count() << " ms in " << runtime.timer_calls <<
+                " intervals" << std::endl;
+        return os.str();
+    }
+
+private:
+    enum Op
+    {
+        OP_ALLOC, OP_LOAD, OP_STORE, OP_OFFSET, OP_BINARY, OP_BRANCH, OP_JUMP,
+        OP_CALL, OP_RETURN
+    };
+
+    // a register of the frame, or a constant
+    struct Operand
+    {
+        bool reg;
+        int32_t value;
+    };
+
+    struct Inst
+    {
+        Op op;
+        koopa_raw_binary_op_t binary;
+        Operand a, b;       // operands; for OP_OFFSET, pointer and index
+        int dest = -1;      // register of the result
+        int32_t size = 0;   // words per index of OP_OFFSET, frame offset of
+                            // OP_ALLOC
+        int target[2];      // blocks of OP_BRANCH (true, false) and OP_JUMP
+        int callee;
+        std::vector<Operand> args;
+    };
+
+    struct Counts
+    {
+        long insts = 0, loads = 0, stores = 0, calls = 0, branches = 0;
+
+        void add(const Counts &counts, long times)
+        {
+            insts += counts.insts * times;
+            loads += counts.loads * times;
+            stores += counts.stores * times;
+            calls += counts.calls * times;
+            branches += counts.branches * times;
+        }
+    };
+
+    struct Block
+    {
+        std::string name;
+        std::vector<Inst> insts;
+        Counts counts;  // of one run of the block
+        long entered = 0;
+    };
+
+    struct Function
+    {
+        std::string name;
+        RuntimeFunction runtime;
+        int regs = 0;       // parameters, then results of instructions
+        int32_t frame = 0;  // words of the allocs
+        std::vector<Block> blocks;
+        long called = 0;
+    };
+
+    struct Frame
+    {
+        int func;
+        Block *block;
+        size_t pc;
+        size_t regs;        // first register in the register stack
+        int32_t stack;      // first word of the frame in memory
+        int dest;           // register of the caller getting the result
+    };
+
+    struct Failure {};
+
+    // memory of the program for the runtime, every access is checked
+    struct Memory
+    {
+        std::vector<int32_t> &words;
+        int32_t &top;
+        std::string &error;
+
+        int32_t &at(int32_t address)
+        {
+            if (address <= 0 || address >= top)
+            {
+                error = "access out of memory at word " +
+                    std::to_string(address);
+                throw Failure();
+            }
+            return words[address];
+        }
+        int32_t load(int32_t array, int32_t i) { return at(array + i); }
+        void store(int32_t array, int32_t i, int32_t value)
+        {
+            at(array + i) = value;
+        }
+    };
+
+    // stack of words beyond which calls fail, 256 MiB of memory
+    static const int32_t memory_limit = 1 << 26;
+
+    Runtime runtime;
+    std::vector<int32_t> memory, regs;
+    int32_t stack_top = 0;
+    std::vector<Function> funcs;
+    std::map<koopa_raw_function_t, int> func_index;
+    std::map<koopa_raw_value_t, int32_t> global_address;
+
+    static int32_t words(koopa_raw_type_t ty)
+    {
+        switch (ty->tag)
+        {
+        case KOOPA_RTT_INT32: case KOOPA_RTT_POINTER: return 1;
+        case KOOPA_RTT_ARRAY:
+            return ty->data.array.len * words(ty->data.array.base);
+        default: return 0;
+        }
+    }
+
+    void initialize(int32_t address, koopa_raw_value_t init)
+    {
+        if (init->kind.tag == KOOPA_RVT_INTEGER)
+            memory[address] = init->kind.data.integer.value;
+        else if (init->kind.tag == KOOPA_RVT_AGGREGATE)
+        {
+            auto &elems = init->kind.data.aggregate.elems;
+            for (size_t i = 0; i < elems.len; i++)
+            {
+                auto elem = reinterpret_cast<koopa_raw_value_t>(
+                    elems.buffer[i]);
+                initialize(address, elem);
+                address += words(elem->ty);
+            }
+        }
+        // zeroinit and undef leave the zeros of resize
+    }
+
+    void translate(koopa_raw_function_t func, Function &function)
+    {
+        std::map<koopa_raw_value_t, int> reg;
+        std::map<koopa_raw_basic_block_t, int> block_index;
+        function.regs = func->params.len;
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+                func->bbs.buffer[i]);
+            assert(bb->params.len == 0 && "block arguments");
+            block_index[bb] = i;
+            for (size_t j = 0; j < bb->insts.len; j++)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(
+                    bb->insts.buffer[j]);
+                if (inst->ty->tag != KOOPA_RTT_UNIT)
+                    reg[inst] = function.regs++;
+            }
+        }
+        auto operand = [&](koopa_raw_value_t value) -> Operand
+        {
+            switch (value->kind.tag)
+            {
+            case KOOPA_RVT_INTEGER:
+                return {false, value->kind.data.integer.value};
+            case KOOPA_RVT_FUNC_ARG_REF:
+                return {true, int32_t(value->kind.data.func_arg_ref.index)};
+            case KOOPA_RVT_GLOBAL_ALLOC:
+                return {false, global_address.at(value)};
+            case KOOPA_RVT_UNDEF: case KOOPA_RVT_ZERO_INIT:
+                return {false, 0};
+            default:
+                return {true, reg.at(value)};
+            }
+        };
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+                func->bbs.buffer[i]);
+            function.blocks.emplace_back();
+            Block &block = function.blocks.back();
+            block.name = bb->name ? bb->name : "%" + std::to_string(i);
+            for (size_t j = 0; j < bb->insts.len; j++)
+            {
+                auto value = reinterpret_cast<koopa_raw_value_t>(
+                    bb->insts.buffer[j]);
+                auto &kind = value->kind;
+                Inst inst;
+                if (reg.count(value))inst.dest = reg[value];
+                switch (kind.tag)
+                {
+                case KOOPA_RVT_ALLOC:
+                    inst.op = OP_ALLOC;
+                    inst.size = function.frame;
+                    function.frame += words(value->ty->data.pointer.base);
+                    break;
+                case KOOPA_RVT_LOAD:
+                    inst.op = OP_LOAD;
+                    inst.a = operand(kind.data.load.src);
+                    block.counts.loads++;
+                    break;
+                case KOOPA_RVT_STORE:
+                    inst.op = OP_STORE;
+                    inst.a = operand(kind.data.store.value);
+                    inst.b = operand(kind.data.store.dest);
+                    block.counts.stores++;
+                    break;
+                case KOOPA_RVT_GET_PTR:
+                    inst.op = OP_OFFSET;
+                    inst.a = operand(kind.data.get_ptr.src);
+                    inst.b = operand(kind.data.get_ptr.index);
+                    inst.size = words(
+                        kind.data.get_ptr.src->ty->data.pointer.base);
+                    break;
+                case KOOPA_RVT_GET_ELEM_PTR:
+                    inst.op = OP_OFFSET;
+                    inst.a = operand(kind.data.get_elem_ptr.src);
+                    inst.b = operand(kind.data.get_elem_ptr.index);
+                    inst.size = words(kind.data.get_elem_ptr.src->ty->data.
+                        pointer.base->data.array.base);
+                    break;
+                case KOOPA_RVT_BINARY:
+                    inst.op = OP_BINARY;
+                    inst.binary = kind.data.binary.op;
+                    inst.a = operand(kind.data.binary.lhs);
+                    inst.b = operand(kind.data.binary.rhs);
+                    break;
+                case KOOPA_RVT_BRANCH:
+                    inst.op = OP_BRANCH;
+                    inst.a = operand(kind.data.branch.cond);
+                    inst.target[0] = block_index.at(kind.data.branch.true_bb);
+                    inst.target[1] = block_index.at(kind.data.branch.false_bb);
+                    block.counts.branches++;
+                    break;
+                case KOOPA_RVT_JUMP:
+                    inst.op = OP_JUMP;
+                    inst.target[0] = block_index.at(kind.data.jump.target);
+                    block.counts.branches++;
+                    break;
+                case KOOPA_RVT_CALL:
+                    inst.op = OP_CALL;
+                    inst.callee = func_index.at(kind.data.call.callee);
+                    for (size_t k = 0; k < kind.data.call.args.len; k++)
+                        inst.args.push_back(operand(
+                            reinterpret_cast<koopa_raw_value_t>(
+                            kind.data.call.args.buffer[k])));
+                    block.counts.calls++;
+                    break;
+                case KOOPA_RVT_RETURN:
+                    inst.op = OP_RETURN;
+                    inst.a = kind.data.ret.value ?
+                        operand(kind.data.ret.value) : Operand{false, 0};
+                    break;
+                default:
+                    assert(false);
+                }
+                block.insts.push_back(inst);
+            }
+            block.counts.insts = block.insts.size();
+        }
+    }
+
+    static int32_t binary(koopa_raw_binary_op_t op, int32_t a, int32_t b)
+    {
+        uint32_t ua = a, ub = b;
+        switch (op)
+        {
+        case KOOPA_RBO_NOT_EQ: return a != b;
+        case KOOPA_RBO_EQ: return a == b;
+        case KOOPA_RBO_GT: return a > b;
+        case KOOPA_RBO_LT: return a < b;
+        case KOOPA_RBO_GE: return a >= b;
+        case KOOPA_RBO_LE: return a <= b;
+        case KOOPA_RBO_ADD: return int32_t(ua + ub);
+        case KOOPA_RBO_SUB: return int32_t(ua - ub);
+        case KOOPA_RBO_MUL: return int32_t(ua * ub);
+        case KOOPA_RBO_DIV:
+            if (b == 0)return -1;
+            if (a == INT32_MIN && b == -1)return a;
+            return a / b;
+        case KOOPA_RBO_MOD:
+            if (b == 0)return a;
+            if (a == INT32_MIN && b == -1)return 0;
+            return a % b;
+        case KOOPA_RBO_AND: return a & b;
+        case KOOPA_RBO_OR: return a | b;
+        case KOOPA_RBO_XOR: return a ^ b;
+        case KOOPA_RBO_SHL: return int32_t(ua << (ub & 31));
+        case KOOPA_RBO_SHR: return int32_t(ua >> (ub & 31));
+        case KOOPA_RBO_SAR: return a >> (ub & 31);
+        default: assert(false); return 0;
+        }
+    }
+
+    // sets up frame to run func from its entry
+    void enter(Frame &frame, int func, Memory &access)
+    {
+        Function &function = funcs[func];
+        function.called++;
+        frame.func = func;
+        frame.block = &function.blocks[0];
+        frame.pc = 0;
+        frame.stack = stack_top;
+        if (stack_top + int64_t(function.frame) > memory_limit)
+        {
+            access.error = "stack overflow in " + function.name;
+            throw Failure();
+        }
+        stack_top += function.frame;
+        if (size_t(stack_top) > memory.size())
+            memory.resize(std::max<size_t>(stack_top, memory.size() * 2));
+        regs.resize(std::max(regs.size(), frame.regs + function.regs));
+        frame.block->entered++;
+    }
+
+    int32_t execute(int main, Memory &access)
+    {
+        stack_top = memory.size();
+        std::vector<Frame> frames(1);
+        frames[0].regs = 0;
+        frames[0].dest = -1;
+        enter(frames[0], main, access);
+        int32_t args[8];
+        while (true)
+        {
+            Frame &frame = frames.back();
+            const Inst &inst = frame.block->insts[frame.pc++];
+            int32_t *r = regs.data() + frame.regs;
+            auto value = [&](const Operand &operand)
+            {
+                return operand.reg ? r[operand.value] : operand.value;
+            };
+            switch (inst.op)
+            {
+            case OP_ALLOC:
+                r[inst.dest] = frame.stack + inst.size;
+                break;
+            case OP_LOAD:
+                r[inst.dest] = access.at(value(inst.a));
+                break;
+            case OP_STORE:
+                access.at(value(inst.b)) = value(inst.a);
+                break;
+            case OP_OFFSET:
+                r[inst.dest] = value(inst.a) + value(inst.b) * inst.size;
+                break;
+            case OP_BINARY:
+                r[inst.dest] = binary(inst.binary, value(inst.a),
+                    value(inst.b));
+                break;
+            case OP_BRANCH: case OP_JUMP:
+            {
+                int target = inst.op == OP_JUMP || value(inst.a) ?
+                    inst.target[0] : inst.target[1];
+                Block &block = funcs[frame.func].blocks[target];
+                block.entered++;
+                frame.block = &block;
+                frame.pc = 0;
+                break;
+            }
+            case OP_CALL:
+            {
+                Function &callee = funcs[inst.callee];
+                if (callee.runtime != RT_NONE)
+                {
+                    callee.called++;
+                    for (size_t i = 0; i < inst.args.size() && i < 8; i++)
+                        args[i] = value(inst.args[i]);
+                    int32_t result = runtime.call(callee.runtime, args,
+                        access);
+                    if (inst.dest >= 0)r[inst.dest] = result;
+                    break;
+                }
+                if (callee.blocks.empty())
+                {
+                    access.error = "call of undefined " + callee.name;
+                    throw Failure();
+                }
+                Frame next;
+                next.regs = frame.regs + funcs[frame.func].regs;
+                next.dest = inst.dest;
+                enter(next, inst.callee, access);
+                // enter may have moved the registers
+                r = regs.data() + frame.regs;
+                for (size_t i = 0; i < inst.args.size(); i++)
+                    regs[next.regs + i] = value(inst.args[i]);
+                frames.push_back(next);
+                break;
+            }
+            case OP_RETURN:
+            {
+                int32_t result = value(inst.a);
+                stack_top = frame.stack;
+                int dest = frame.dest;
+                frames.pop_back();
+                if (frames.empty())return result;
+                if (dest >= 0)regs[frames.back().regs + dest] = result;
+                break;
+            }
+            }
+        }
+    }
+
+    void print_counts(std::ostream &os, const std::string &name, long called,
+        const Counts &counts) const
+    {
+        os << std::left << std::setw(20) << name << std::right <<
+            std::setw(10) << called << std::setw(14) << counts.insts <<
+            std::setw(12) << counts.loads << std::setw(12) << counts.stores <<
+            std::setw(12) << counts.calls << std::setw(12) <<
+            counts.branches << std::endl;
+    }
+};
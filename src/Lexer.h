@@ -0,0 +1,343 @@
+#pragma once
+#include <cctype>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// the lexer of SysY, over the source in memory (main maps the file). Spaces,
+// comments and identifiers are scanned a vector at a time with AVX2 or SSE2,
+// whichever the build targets, and byte by byte without either and at the end
+// of the source, so nothing is read past it. Identifiers are interned: a
+// token refers to its text in the source, and the names of the string table
+// are views of the source as well, so the source must outlive both
+enum TokenKind
+{
+    TOK_END, TOK_INT, TOK_VOID, TOK_RETURN, TOK_CONST, TOK_IF, TOK_ELSE,
+    TOK_WHILE, TOK_BREAK, TOK_CONTINUE, TOK_IDENT, TOK_INT_CONST, TOK_LE,
+    TOK_GE, TOK_EQ, TOK_NE, TOK_AND, TOK_OR,
+    TOK_CHAR  // any other character, in value
+};
+
+
+struct Token
+{
+    TokenKind kind;
+    int line;
+    const char *begin;  // the text in the source
+    uint32_t size;
+    int value;  // of TOK_INT_CONST and TOK_CHAR, the id of TOK_IDENT
+};
+
+
+// names by id, the same name always gets the same id
+class StringTable
+{
+public:
+    int intern(std::string_view name)
+    {
+        auto it = ids.find(name);
+        if (it != ids.end())return it->second;
+        names.push_back(name);
+        ids.emplace(name, names.size() - 1);
+        return names.size() - 1;
+    }
+    // stays where it is as long as the table lives
+    const std::string_view &name(int id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+private:
+    std::deque<std::string_view> names;
+    std::unordered_map<std::string_view, int> ids;
+};
+
+
+namespace lex_simd
+{
+#if defined(__AVX2__)
+constexpr size_t width = 32;
+typedef __m256i vec;
+inline vec load(const char *p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+inline vec splat(char c) { return _mm256_set1_epi8(c); }
+inline uint32_t mask(vec v) { return _mm256_movemask_epi8(v); }
+inline vec eq(vec v, char c) { return _mm256_cmpeq_epi8(v, splat(c)); }
+inline vec gt(vec a, vec b) { return _mm256_cmpgt_epi8(a, b); }
+inline vec both(vec a, vec b) { return _mm256_and_si256(a, b); }
+inline vec either(vec a, vec b) { return _mm256_or_si256(a, b); }
+#elif defined(__SSE2__)
+constexpr size_t width = 16;
+typedef __m128i vec;
+inline vec load(const char *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+inline vec splat(char c) { return _mm_set1_epi8(c); }
+inline uint32_t mask(vec v) { return _mm_movemask_epi8(v); }
+inline vec eq(vec v, char c) { return _mm_cmpeq_epi8(v, splat(c)); }
+inline vec gt(vec a, vec b) { return _mm_cmpgt_epi8(a, b); }
+inline vec both(vec a, vec b) { return _mm_and_si128(a, b); }
+inline vec either(vec a, vec b) { return _mm_or_si128(a, b); }
+#else
+constexpr size_t width = 0;
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// lo <= c <= hi, compared as signed bytes: non-ASCII bytes are below all
+inline vec in_range(vec v, char lo, char hi)
+{
+    return both(gt(v, splat(lo - 1)), gt(splat(hi + 1), v));
+}
+
+inline uint32_t space_mask(vec v)
+{
+    return mask(either(either(eq(v, ' '), eq(v, '\t')),
+        either(eq(v, '\n'), eq(v, '\r'))));
+}
+
+inline uint32_t ident_mask(vec v)
+{
+    return mask(either(either(in_range(v, 'a', 'z'), in_range(v, 'A', 'Z')),
+        either(in_range(v, '0', '9'), eq(v, '_'))));
+}
+#endif
+
+// the low n bits
+inline uint32_t low_bits(int n)
+{
+    return n >= 32 ? ~0u : (1u << n) - 1;
+}
+}  // namespace lex_simd
+
+
+inline bool lex_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+inline bool lex_is_ident(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '_';
+}
+
+
+class Lexer
+{
+public:
+    StringTable names;
+
+    Lexer(const char *source, size_t size) :
+        pos(source), end(source + size) {}
+
+    Token next()
+    {
+        skip();
+        Token token = {TOK_END, line, pos, 0, 0};
+        if (pos == end)return token;
+        char c = *pos;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+        {
+            const char *p = scan_ident(pos + 1);
+            token.kind = keyword(pos, p - pos);
+            if (token.kind == TOK_IDENT)
+                token.value = names.intern(std::string_view(pos, p - pos));
+            pos = p;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            token.kind = TOK_INT_CONST;
+            token.value = number();
+        }
+        else
+        {
+            token.kind = TOK_CHAR;
+            token.value = c;
+            char d = pos + 1 < end ? pos[1] : 0;
+            if (c == '<' && d == '=')token.kind = TOK_LE;
+            else if (c == '>' && d == '=')token.kind = TOK_GE;
+            else if (c == '=' && d == '=')token.kind = TOK_EQ;
+            else if (c == '!' && d == '=')token.kind = TOK_NE;
+            else if (c == '&' && d == '&')token.kind = TOK_AND;
+            else if (c == '|' && d == '|')token.kind = TOK_OR;
+            pos += token.kind == TOK_CHAR ? 1 : 2;
+        }
+        token.size = pos - token.begin;
+        last = token;
+        return token;
+    }
+
+    // the text of the last token, for errors
+    std::string_view text() const
+    {
+        return std::string_view(last.begin, last.size);
+    }
+
+private:
+    const char *pos, *end;
+    int line = 1;
+    Token last = {TOK_END, 1, "", 0, 0};
+
+    // past spaces and comments; a "/*" without its "*/" is left to be a '/'
+    void skip()
+    {
+        while (true)
+        {
+            pos = skip_space(pos);
+            if (end - pos < 2 || pos[0] != '/')return;
+            if (pos[1] == '/')
+            {
+                const char *eol = static_cast<const char *>(
+                    memchr(pos + 2, '\n', end - pos - 2));
+                pos = eol ? eol : end;
+            }
+            else if (pos[1] == '*')
+            {
+                int lines = 0;
+                const char *close = comment_end(pos + 2, lines);
+                if (!close)return;
+                line += lines;
+                pos = close + 2;
+            }
+            else return;
+        }
+    }
+
+    const char *skip_space(const char *p)
+    {
+#if defined(__AVX2__) || defined(__SSE2__)
+        using namespace lex_simd;
+        for (; end - p >= static_cast<ptrdiff_t>(width); p += width)
+        {
+            vec v = load(p);
+            uint32_t other = ~space_mask(v) & low_bits(width);
+            uint32_t newlines = mask(eq(v, '\n'));
+            if (other)
+            {
+                int n = __builtin_ctz(other);
+                line += __builtin_popcount(newlines & low_bits(n));
+                return p + n;
+            }
+            line += __builtin_popcount(newlines);
+        }
+#endif
+        for (; p < end && lex_is_space(*p); p++)
+            if (*p == '\n')line++;
+        return p;
+    }
+
+    const char *scan_ident(const char *p) const
+    {
+#if defined(__AVX2__) || defined(__SSE2__)
+        using namespace lex_simd;
+        for (; end - p >= static_cast<ptrdiff_t>(width); p += width)
+        {
+            uint32_t other = ~ident_mask(load(p)) & low_bits(width);
+            if (other)return p + __builtin_ctz(other);
+        }
+#endif
+        while (p < end && lex_is_ident(*p))p++;
+        return p;
+    }
+
+    // the "*/" closing a comment whose text starts at p, null if none does;
+    // lines gets the newlines before it
+    const char *comment_end(const char *p, int &lines) const
+    {
+#if defined(__AVX2__) || defined(__SSE2__)
+        using namespace lex_simd;
+        for (; end - p > static_cast<ptrdiff_t>(width); p += width)
+        {
+            vec v = load(p);
+            uint32_t close = mask(eq(v, '*')) & mask(eq(load(p + 1), '/'));
+            uint32_t newlines = mask(eq(v, '\n'));
+            if (close)
+            {
+                int n = __builtin_ctz(close);
+                lines += __builtin_popcount(newlines & low_bits(n));
+                return p + n;
+            }
+            lines += __builtin_popcount(newlines);
+        }
+#endif
+        for (; end - p >= 2; p++)
+        {
+            if (p[0] == '*' && p[1] == '/')return p;
+            lines += *p == '\n';
+        }
+        return nullptr;
+    }
+
+    static TokenKind keyword(const char *p, size_t size)
+    {
+        switch (size)
+        {
+        case 2:
+            if (memcmp(p, "if", 2) == 0)return TOK_IF;
+            break;
+        case 3:
+            if (memcmp(p, "int", 3) == 0)return TOK_INT;
+            break;
+        case 4:
+            if (memcmp(p, "void", 4) == 0)return TOK_VOID;
+            if (memcmp(p, "else", 4) == 0)return TOK_ELSE;
+            break;
+        case 5:
+            if (memcmp(p, "const", 5) == 0)return TOK_CONST;
+            if (memcmp(p, "while", 5) == 0)return TOK_WHILE;
+            if (memcmp(p, "break", 5) == 0)return TOK_BREAK;
+            break;
+        case 6:
+            if (memcmp(p, "return", 6) == 0)return TOK_RETURN;
+            break;
+        case 8:
+            if (memcmp(p, "continue", 8) == 0)return TOK_CONTINUE;
+            break;
+        }
+        return TOK_IDENT;
+    }
+
+    // decimal, 0 octal and 0x hexadecimal, wrapping to int like strtol and a
+    // cast did; "0x" without digits is a 0 and an identifier
+    int number()
+    {
+        int base = 10;
+        if (*pos == '0')
+        {
+            base = 8;
+            if (end - pos > 2 && (pos[1] == 'x' || pos[1] == 'X') &&
+                isxdigit(static_cast<unsigned char>(pos[2])))
+            {
+                base = 16;
+                pos += 2;
+            }
+        }
+        unsigned long value = 0;
+        bool overflow = false;
+        for (; pos < end; pos++)
+        {
+            int digit;
+            char c = *pos;
+            if (c >= '0' && c <= '9' && c - '0' < base)digit = c - '0';
+            else if (base == 16 && c >= 'a' && c <= 'f')digit = c - 'a' + 10;
+            else if (base == 16 && c >= 'A' && c <= 'F')digit = c - 'A' + 10;
+            else break;
+            if (value > (static_cast<unsigned long>(LONG_MAX) - digit) / base)
+                overflow = true;
+            else value = value * base + digit;
+        }
+        return static_cast<int>(overflow ? LONG_MAX : value);
+    }
+};
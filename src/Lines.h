@@ -0,0 +1,65 @@
+#pragma once
+#include <map>
+#include <sstream>
+#include <string>
+
+
+// -g and -fverbose-asm: the source lines of the IR. The frontend marks the IR
+// of each statement, definition and function with a "// line N" comment when
+// the line changes (see ir_mark_line in AST.h), ir_take_lines takes them out
+// again before the IR is parsed and keeps, per function, the line of each
+// label and value named from then on. Unnamed instructions (stores, branches,
+// returns) get theirs from the backend, off their operands
+struct SourceLines
+{
+    std::string file;  // for .file, empty if not known
+    // "@f" -> "%3", "%while__0", "@x_0" ... -> line
+    std::map<std::string, std::map<std::string, int>> values;
+
+    // 0 if unknown
+    int line(const std::string &func, const std::string &value) const
+    {
+        auto it = values.find(func);
+        if (it == values.end())return 0;
+        auto jt = it->second.find(value);
+        return jt == it->second.end() ? 0 : jt->second;
+    }
+};
+
+
+// the IR without the markers
+inline std::string ir_take_lines(const std::string &ir, SourceLines &lines)
+{
+    std::istringstream in(ir);
+    std::ostringstream os;
+    std::map<std::string, int> *func = nullptr;
+    int line = 0;
+    for (std::string text; std::getline(in, text);)
+    {
+        if (text.compare(0, 8, "// line ") == 0)
+        {
+            line = std::stoi(text.substr(8));
+            continue;
+        }
+        os << text << "\n";
+        if (text.compare(0, 5, "fun @") == 0)
+        {
+            size_t end = text.find('(');
+            func = &lines.values[text.substr(4, end - 4)];
+            line = 0;
+        }
+        else if (text == "}")func = nullptr;
+        if (func == nullptr || line == 0)continue;
+        size_t begin = text.find_first_not_of(" \t");
+        if (begin == std::string::npos)continue;
+        if (text.back() == ':')
+            (*func)[text.substr(begin, text.size() - 1 - begin)] = line;
+        else
+        {
+            size_t assign = text.find(" = ", begin);
+            if (assign != std::string::npos)
+                (*func)[text.substr(begin, assign - begin)] = line;
+        }
+    }
+    return os.str();
+}
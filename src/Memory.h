@@ -0,0 +1,239 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+
+// -mem-report: the global operator new and delete (memory.cpp) count the
+// allocations made in each phase, the phase of a thread being the innermost
+// TraceScope it is in; the data that dominates at the peak (AST nodes, symbol
+// tables, initializer lists, IR text) is allocated through MemAllocator or
+// mem_alloc (the arena of the AST), which also count it by category. RSS is sampled
+// when a phase ends. libkoopa allocates with malloc, so its programs only show
+// up in the RSS. Sizes are the usable sizes of the blocks, the counters are
+// only updated after mem_enable()
+
+
+enum MemCategory
+{
+    MEM_OTHER, MEM_AST_NODES, MEM_SYMBOL_TABLES, MEM_INITIALIZERS, MEM_IR_TEXT,
+    MEM_CATEGORY_NUM
+};
+inline const char *mem_category_names[MEM_CATEGORY_NUM] = {"other",
+    "AST nodes", "symbol tables", "initializer lists", "IR text"};
+
+
+inline void mem_raise(std::atomic<long> &max, long value)
+{
+    long now = max.load(std::memory_order_relaxed);
+    while (value > now && !max.compare_exchange_weak(now, value));
+}
+
+
+struct MemCounter
+{
+    std::atomic<long> allocs{0}, bytes{0}, live{0}, peak{0};
+
+    void alloc(long size)
+    {
+        allocs++;
+        bytes += size;
+        mem_raise(peak, live += size);
+    }
+
+    void free(long size) { live -= size; }
+};
+
+
+struct MemPhase
+{
+    const char *name = nullptr;
+    MemCounter counter;
+    // KiB when the phase last ended
+    std::atomic<long> rss{0}, peak_rss{0};
+};
+
+
+inline std::atomic<bool> mem_on{false};
+inline const int mem_phase_max = 64;
+// phase 0 is everything outside a phase
+inline MemPhase mem_phases[mem_phase_max];
+inline std::atomic<int> mem_phase_num{1};
+inline std::mutex mem_phase_mutex;
+inline MemCounter mem_total, mem_categories[MEM_CATEGORY_NUM];
+inline thread_local int mem_phase = 0;
+
+
+inline bool mem_enabled() { return mem_on.load(std::memory_order_relaxed); }
+inline void mem_enable(bool on = true) { mem_on = on; }
+
+
+inline void mem_count_alloc(void *ptr, MemCategory category)
+{
+    if (!ptr || !mem_enabled())return;
+    long size = malloc_usable_size(ptr);
+    mem_total.alloc(size);
+    mem_phases[mem_phase].counter.alloc(size);
+    if (category != MEM_OTHER)mem_categories[category].alloc(size);
+}
+
+
+inline void mem_count_free(void *ptr, MemCategory category)
+{
+    if (!ptr || !mem_enabled())return;
+    long size = malloc_usable_size(ptr);
+    mem_total.free(size);
+    if (category != MEM_OTHER)mem_categories[category].free(size);
+}
+
+
+// malloc with the counting of operator new, for allocators and class specific
+// operator new
+inline void *mem_alloc(size_t size, MemCategory category)
+{
+    void *ptr = std::malloc(size ? size : 1);
+    if (!ptr)throw std::bad_alloc();
+    mem_count_alloc(ptr, category);
+    return ptr;
+}
+
+
+inline void mem_free(void *ptr, MemCategory category)
+{
+    mem_count_free(ptr, category);
+    std::free(ptr);
+}
+
+
+// allocates for containers of one category
+template <class T, MemCategory category>
+struct MemAllocator
+{
+    using value_type = T;
+    template <class U>
+    struct rebind { using other = MemAllocator<U, category>; };
+
+    MemAllocator() = default;
+    template <class U>
+    MemAllocator(const MemAllocator<U, category> &) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(mem_alloc(n * sizeof(T), category));
+    }
+    void deallocate(T *ptr, size_t) { mem_free(ptr, category); }
+
+    template <class U>
+    bool operator==(const MemAllocator<U, category> &) const { return true; }
+    template <class U>
+    bool operator!=(const MemAllocator<U, category> &) const { return false; }
+};
+
+
+// the phase named name, added the first time it is entered
+inline int mem_phase_index(const char *name)
+{
+    std::lock_guard<std::mutex> lock(mem_phase_mutex);
+    int num = mem_phase_num;
+    for (int i = 1; i < num; i++)
+        if (std::strcmp(mem_phases[i].name, name) == 0)return i;
+    if (num == mem_phase_max)return 0;
+    mem_phases[num].name = name;
+    mem_phase_num = num + 1;
+    return num;
+}
+
+
+// resident and peak resident set size in KiB
+inline void mem_rss(long &rss, long &peak_rss)
+{
+    rss = 0;
+    if (FILE *statm = std::fopen("/proc/self/statm", "r"))
+    {
+        long size, resident;
+        if (std::fscanf(statm, "%ld %ld", &size, &resident) == 2)
+            rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+        std::fclose(statm);
+    }
+    // the kernel updates the high-water mark lazily
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    peak_rss = std::max<long>(usage.ru_maxrss, rss);
+}
+
+
+// makes name the phase of this thread, returns the phase to go back to
+inline int mem_enter(const char *name)
+{
+    int previous = mem_phase;
+    mem_phase = mem_phase_index(name);
+    return previous;
+}
+
+
+inline void mem_leave(int previous)
+{
+    long rss, peak_rss;
+    mem_rss(rss, peak_rss);
+    MemPhase &phase = mem_phases[mem_phase];
+    phase.rss = rss;
+    mem_raise(phase.peak_rss, peak_rss);
+    mem_phase = previous;
+}
+
+
+// allocations and RSS of each phase, then the categories by their peak
+inline std::string mem_report()
+{
+    auto mib = [](long bytes) { return bytes / 1048576.0; };
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3);
+    os << std::left << std::setw(20) << "phase" << std::right <<
+        std::setw(10) << "allocs" << std::setw(12) << "alloc MiB" <<
+        std::setw(10) << "RSS MiB" << std::setw(10) << "peak MiB" << std::endl;
+    for (int i = 0; i < mem_phase_num; i++)
+    {
+        MemPhase &phase = mem_phases[i];
+        if (phase.counter.allocs == 0 && phase.peak_rss == 0)continue;
+        os << std::left << std::setw(20) << (i ? phase.name : "(none)") <<
+            std::right << std::setw(10) << phase.counter.allocs <<
+            std::setw(12) << mib(phase.counter.bytes) << std::setw(10);
+        if (phase.peak_rss)
+            os << phase.rss / 1024.0 << std::setw(10) <<
+                phase.peak_rss / 1024.0 << std::endl;
+        else os << "-" << std::setw(10) << "-" << std::endl;
+    }
+    long rss, peak_rss;
+    mem_rss(rss, peak_rss);
+    os << "heap: " << mem_total.allocs << " allocations, " <<
+        mib(mem_total.bytes) << " MiB allocated, peak " <<
+        mib(mem_total.peak) << " MiB live; peak RSS " << peak_rss / 1024.0 <<
+        " MiB" << std::endl;
+    int order[MEM_CATEGORY_NUM];
+    for (int i = 0; i < MEM_CATEGORY_NUM; i++)order[i] = i;
+    std::stable_sort(order + 1, order + MEM_CATEGORY_NUM, [](int a, int b)
+        { return mem_categories[a].peak > mem_categories[b].peak; });
+    os << std::left << std::setw(20) << "largest consumers" << std::right <<
+        std::setw(10) << "allocs" << std::setw(12) << "alloc MiB" <<
+        std::setw(10) << "peak MiB" << std::endl;
+    for (int i = 1; i < MEM_CATEGORY_NUM; i++)
+    {
+        MemCounter &counter = mem_categories[order[i]];
+        os << std::left << std::setw(20) << mem_category_names[order[i]] <<
+            std::right << std::setw(10) << counter.allocs << std::setw(12) <<
+            mib(counter.bytes) << std::setw(10) << mib(counter.peak) <<
+            std::endl;
+    }
+    return os.str();
+}
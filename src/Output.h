@@ -0,0 +1,8 @@
+#pragma once
+#include <iostream>
+
+
+// IR and assembly are printed to out instead of std::cout; it is per thread,
+// so that several programs (and several functions of one program) can be
+// compiled at the same time, each into its own buffer
+inline thread_local std::ostream out(std::cout.rdbuf());
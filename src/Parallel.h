@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// number of worker threads, SYSY_JOBS overrides the number of cores
+inline int worker_num()
+{
+    const char *jobs = std::getenv("SYSY_JOBS");
+    int num = jobs ? std::atoi(jobs) : std::thread::hardware_concurrency();
+    return num > 0 ? num : 1;
+}
+
+
+// set on threads running tasks, nested loops there don't start more threads
+inline thread_local bool in_worker = false;
+
+
+// worker threads started once and kept until the process exits; run() queues
+// a loop for them and works on it itself as well. Indices are claimed under
+// the lock, tasks (whole functions, whole files) are long enough for that
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int num)
+    {
+        for (int i = 1; i < num; i++)threads.emplace_back([this]() { work(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads)thread.join();
+    }
+
+    void run(size_t n, const std::function<void(size_t)> &task)
+    {
+        Loop loop = {n, &task};
+        std::unique_lock<std::mutex> lock(mutex);
+        loops.push_back(&loop);
+        wake.notify_all();
+        in_worker = true;
+        while (loop.next < loop.n)run_one(&loop, lock);
+        in_worker = false;
+        finished.wait(lock, [&]() { return loop.done == loop.n; });
+    }
+
+private:
+    struct Loop
+    {
+        size_t n;
+        const std::function<void(size_t)> *task;
+        size_t next = 0, done = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::deque<Loop *> loops;  // loops with indices left
+    bool stopping = false;
+
+    // claims the next index of loop and runs it unlocked; the loop is only
+    // touched under the lock, its caller returns once all tasks are done
+    void run_one(Loop *loop, std::unique_lock<std::mutex> &lock)
+    {
+        size_t i = loop->next++;
+        if (loop->next == loop->n)
+            loops.erase(std::find(loops.begin(), loops.end(), loop));
+        lock.unlock();
+        (*loop->task)(i);
+        lock.lock();
+        if (++loop->done == loop->n)finished.notify_all();
+    }
+
+    void work()
+    {
+        in_worker = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return stopping || !loops.empty(); });
+            if (stopping)return;
+            run_one(loops.front(), lock);
+        }
+    }
+};
+
+
+// the pool of parallel_for, started on first use with worker_num() threads
+inline WorkerPool &worker_pool()
+{
+    static WorkerPool pool(worker_num());
+    return pool;
+}
+
+
+// runs task(0) ~ task(n - 1) on the worker pool; every idle worker takes the
+// next unclaimed index, so long tasks don't hold up the short ones behind them
+inline void parallel_for(size_t n, const std::function<void(size_t)> &task)
+{
+    if (n <= 1 || in_worker || worker_num() <= 1)
+    {
+        for (size_t i = 0; i < n; i++)task(i);
+        return;
+    }
+    worker_pool().run(n, task);
+}
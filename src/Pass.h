@@ -0,0 +1,1292 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Compiler.h"
+#include "IRFile.h"
+#include "Trace.h"
+#include "koopa.h"
+
+
+// optimization passes over the raw program, run between IR generation and the
+// backend. The program is edited in place: operands and terminators are
+// rewritten and slices only ever shrink, so nothing the raw program builder
+// owns is reallocated; new constants come from the pass manager's arena.
+// The passes keep to what the backend relies on: an instruction is only used
+// in its own block, params are only read once, and a value loaded from a
+// variable is not used after the variable is stored to again, nor one loaded
+// from a global after a call (the backend keeps such a value in the
+// variable's register)
+
+
+enum
+{
+    ANALYSIS_NONE = 0, ANALYSIS_CFG = 1, ANALYSIS_DOMINATORS = 2,
+    ANALYSIS_LIVENESS = 4, ANALYSIS_ALL = 7
+};
+
+
+inline const koopa_raw_type_kind_t pass_i32 = {KOOPA_RTT_INT32, {}};
+
+
+inline koopa_raw_value_data_t *mut(koopa_raw_value_t value)
+{
+    return const_cast<koopa_raw_value_data_t *>(value);
+}
+
+
+inline koopa_raw_basic_block_data_t *mut(koopa_raw_basic_block_t bb)
+{
+    return const_cast<koopa_raw_basic_block_data_t *>(bb);
+}
+
+
+inline koopa_raw_function_data_t *mut(koopa_raw_function_t func)
+{
+    return const_cast<koopa_raw_function_data_t *>(func);
+}
+
+
+inline koopa_raw_basic_block_t block_at(koopa_raw_function_t func, size_t i)
+{
+    return reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+}
+
+
+inline koopa_raw_value_t inst_at(koopa_raw_basic_block_t bb, size_t i)
+{
+    return reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+}
+
+
+inline koopa_raw_value_t make_integer(IRArena &arena, int32_t value)
+{
+    auto integer = arena.alloc<koopa_raw_value_data_t>();
+    integer->ty = &pass_i32;
+    integer->name = nullptr;
+    integer->used_by = {arena.alloc<const void *>(0), 0, KOOPA_RSIK_VALUE};
+    integer->kind.tag = KOOPA_RVT_INTEGER;
+    integer->kind.data.integer.value = value;
+    return integer;
+}
+
+
+inline bool is_integer(koopa_raw_value_t value)
+{
+    return value->kind.tag == KOOPA_RVT_INTEGER;
+}
+
+
+// calls f on every value operand of inst, f may replace it
+inline void for_each_operand(koopa_raw_value_t inst,
+    const std::function<void(koopa_raw_value_t &)> &f)
+{
+    auto &kind = mut(inst)->kind;
+    auto each = [&](koopa_raw_slice_t &slice)
+    {
+        for (size_t i = 0; i < slice.len; i++)
+        {
+            auto value = reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+            f(value);
+            slice.buffer[i] = value;
+        }
+    };
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+        f(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        f(kind.data.store.value);
+        f(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        f(kind.data.get_ptr.src);
+        f(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        f(kind.data.get_elem_ptr.src);
+        f(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        f(kind.data.binary.lhs);
+        f(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        f(kind.data.branch.cond);
+        each(kind.data.branch.true_args);
+        each(kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        each(kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        each(kind.data.call.args);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)f(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+}
+
+
+// calls f on every successor of bb, f may replace it
+inline void for_each_successor(koopa_raw_basic_block_t bb,
+    const std::function<void(koopa_raw_basic_block_t &)> &f)
+{
+    if (bb->insts.len == 0)return;
+    auto &kind = mut(inst_at(bb, bb->insts.len - 1))->kind;
+    if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        f(kind.data.branch.true_bb);
+        f(kind.data.branch.false_bb);
+    }
+    else if (kind.tag == KOOPA_RVT_JUMP)f(kind.data.jump.target);
+}
+
+
+// removes the elements of slice for which remove(element) holds, in place
+template <typename T>
+bool remove_from(koopa_raw_slice_t &slice, const std::function<bool(T)> &remove)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < slice.len; i++)
+    {
+        auto element = reinterpret_cast<T>(slice.buffer[i]);
+        if (!remove(element))slice.buffer[kept++] = element;
+    }
+    bool changed = kept != slice.len;
+    slice.len = kept;
+    return changed;
+}
+
+
+inline void replace_uses(koopa_raw_function_t func,
+    const std::map<koopa_raw_value_t, koopa_raw_value_t> &replaced)
+{
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        for (size_t j = 0; j < bb->insts.len; j++)
+            for_each_operand(inst_at(bb, j), [&](koopa_raw_value_t &value)
+            {
+                for (auto it = replaced.find(value); it != replaced.end();
+                    it = replaced.find(value))
+                    value = it->second;
+            });
+    }
+}
+
+
+inline void remove_insts(koopa_raw_function_t func,
+    const std::set<koopa_raw_value_t> &removed)
+{
+    for (size_t i = 0; i < func->bbs.len; i++)
+        remove_from<koopa_raw_value_t>(mut(block_at(func, i))->insts,
+            [&](koopa_raw_value_t inst) { return removed.count(inst) > 0; });
+}
+
+
+inline std::map<koopa_raw_value_t, int> count_uses(koopa_raw_function_t func)
+{
+    std::map<koopa_raw_value_t, int> uses;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        for (size_t j = 0; j < bb->insts.len; j++)
+            for_each_operand(inst_at(bb, j),
+                [&](koopa_raw_value_t &value) { uses[value]++; });
+    }
+    return uses;
+}
+
+
+// scalar local variables whose address is only used to load and store them
+inline std::set<koopa_raw_value_t> local_slots(koopa_raw_function_t func)
+{
+    std::set<koopa_raw_value_t> slots, escaped;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = inst_at(bb, j);
+            if (inst->kind.tag == KOOPA_RVT_ALLOC &&
+                inst->ty->data.pointer.base->tag == KOOPA_RTT_INT32)
+                slots.insert(inst);
+            else if (inst->kind.tag == KOOPA_RVT_STORE)
+                escaped.insert(inst->kind.data.store.value);
+            else if (inst->kind.tag != KOOPA_RVT_LOAD)
+                for_each_operand(inst,
+                    [&](koopa_raw_value_t &value) { escaped.insert(value); });
+        }
+    }
+    for (auto value : escaped)slots.erase(value);
+    return slots;
+}
+
+
+struct CFGInfo
+{
+    std::vector<koopa_raw_basic_block_t> blocks;
+    std::map<koopa_raw_basic_block_t, int> index;
+    std::vector<std::vector<int>> preds, succs;
+    std::vector<bool> reachable;
+    std::vector<int> rpo;  // reachable blocks in reverse post order
+};
+
+
+struct DominatorInfo
+{
+    std::vector<int> idom;  // -1 for unreachable blocks, the entry is its own
+
+    bool dominates(int a, int b) const
+    {
+        if (idom[a] < 0 || idom[b] < 0)return false;
+        while (b != a && idom[b] != b)b = idom[b];
+        return b == a;
+    }
+};
+
+
+// per block sets of the local_slots that may be read before they are written,
+// 64 slots a word
+struct LivenessInfo
+{
+    std::map<koopa_raw_value_t, int> slots;
+    std::vector<std::vector<uint64_t>> live_in, live_out;
+
+    static bool has(const std::vector<uint64_t> &set, int slot)
+    {
+        return set[slot / 64] >> (slot % 64) & 1;
+    }
+};
+
+
+inline CFGInfo compute_cfg(koopa_raw_function_t func)
+{
+    CFGInfo cfg;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        cfg.index[block_at(func, i)] = i;
+        cfg.blocks.push_back(block_at(func, i));
+    }
+    size_t n = cfg.blocks.size();
+    cfg.preds.resize(n);
+    cfg.succs.resize(n);
+    cfg.reachable.resize(n, false);
+    for (size_t i = 0; i < n; i++)
+        for_each_successor(cfg.blocks[i], [&](koopa_raw_basic_block_t &succ)
+        {
+            cfg.succs[i].push_back(cfg.index.at(succ));
+            cfg.preds[cfg.index.at(succ)].push_back(i);
+        });
+    if (n == 0)return cfg;
+    // iterative depth first search, post order reversed
+    std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+    cfg.reachable[0] = true;
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        if (top.second < cfg.succs[top.first].size())
+        {
+            int succ = cfg.succs[top.first][top.second++];
+            if (!cfg.reachable[succ])
+            {
+                cfg.reachable[succ] = true;
+                stack.push_back({succ, 0});
+            }
+        }
+        else
+        {
+            cfg.rpo.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::reverse(cfg.rpo.begin(), cfg.rpo.end());
+    return cfg;
+}
+
+
+// Cooper, Harvey and Kennedy's iterative algorithm
+inline DominatorInfo compute_dominators(const CFGInfo &cfg)
+{
+    DominatorInfo dom;
+    dom.idom.assign(cfg.blocks.size(), -1);
+    if (cfg.rpo.empty())return dom;
+    std::vector<int> order(cfg.blocks.size());
+    for (size_t i = 0; i < cfg.rpo.size(); i++)order[cfg.rpo[i]] = i;
+    dom.idom[cfg.rpo[0]] = cfg.rpo[0];
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t i = 1; i < cfg.rpo.size(); i++)
+        {
+            int b = cfg.rpo[i], idom = -1;
+            for (int pred : cfg.preds[b])
+            {
+                if (dom.idom[pred] < 0)continue;
+                if (idom < 0) { idom = pred; continue; }
+                int x = pred, y = idom;
+                while (x != y)
+                {
+                    while (order[x] > order[y])x = dom.idom[x];
+                    while (order[y] > order[x])y = dom.idom[y];
+                }
+                idom = x;
+            }
+            if (dom.idom[b] != idom)
+            {
+                dom.idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+    return dom;
+}
+
+
+inline LivenessInfo compute_liveness(koopa_raw_function_t func,
+    const CFGInfo &cfg)
+{
+    LivenessInfo live;
+    for (auto slot : local_slots(func))live.slots[slot] = live.slots.size();
+    size_t n = cfg.blocks.size(), words = (live.slots.size() + 63) / 64;
+    std::vector<std::vector<uint64_t>> use(n, std::vector<uint64_t>(words)),
+        def = use;
+    auto add = [](std::vector<uint64_t> &set, int slot)
+    {
+        set[slot / 64] |= uint64_t(1) << (slot % 64);
+    };
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < cfg.blocks[i]->insts.len; j++)
+        {
+            auto inst = inst_at(cfg.blocks[i], j);
+            if (inst->kind.tag == KOOPA_RVT_LOAD &&
+                live.slots.count(inst->kind.data.load.src))
+            {
+                int slot = live.slots[inst->kind.data.load.src];
+                if (!LivenessInfo::has(def[i], slot))add(use[i], slot);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_STORE &&
+                live.slots.count(inst->kind.data.store.dest))
+                add(def[i], live.slots[inst->kind.data.store.dest]);
+        }
+    // blocks are visited against the edges, unreachable ones stay empty
+    live.live_in.assign(n, std::vector<uint64_t>(words));
+    live.live_out = live.live_in;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t r = cfg.rpo.size(); r-- > 0;)
+        {
+            int i = cfg.rpo[r];
+            for (size_t w = 0; w < words; w++)
+            {
+                uint64_t out = 0;
+                for (int succ : cfg.succs[i])out |= live.live_in[succ][w];
+                uint64_t in = use[i][w] | (out & ~def[i][w]);
+                if (out != live.live_out[i][w] || in != live.live_in[i][w])
+                {
+                    live.live_out[i][w] = out;
+                    live.live_in[i][w] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return live;
+}
+
+
+// analyses of one function, computed on first use and kept until a pass
+// changes what they depend on
+class FunctionAnalyses
+{
+public:
+    int computed = 0, reused = 0;
+    // what a checking pass found wrong with the function, empty if nothing
+    std::string error;
+
+    explicit FunctionAnalyses(koopa_raw_function_t func) : func(func) {}
+
+    const CFGInfo &cfg()
+    {
+        return get(cfg_info, [&]() { return compute_cfg(func); });
+    }
+
+    const DominatorInfo &dominators()
+    {
+        return get(dom_info, [&]() { return compute_dominators(cfg()); });
+    }
+
+    const LivenessInfo &liveness()
+    {
+        return get(live_info, [&]() { return compute_liveness(func, cfg()); });
+    }
+
+    // everything built on the CFG goes with it
+    void invalidate(int preserved)
+    {
+        if (!(preserved & ANALYSIS_CFG))cfg_info.reset();
+        if (!(preserved & ANALYSIS_DOMINATORS) || !cfg_info)dom_info.reset();
+        if (!(preserved & ANALYSIS_LIVENESS) || !cfg_info)live_info.reset();
+    }
+
+private:
+    koopa_raw_function_t func;
+    std::unique_ptr<CFGInfo> cfg_info;
+    std::unique_ptr<DominatorInfo> dom_info;
+    std::unique_ptr<LivenessInfo> live_info;
+
+    template <typename T, typename F>
+    const T &get(std::unique_ptr<T> &info, F compute)
+    {
+        if (info)reused++;
+        else
+        {
+            info.reset(new T(compute()));
+            computed++;
+        }
+        return *info;
+    }
+};
+
+
+// constant conditions become jumps, jumps to blocks that only jump on go to
+// the final target, and unreachable blocks are removed
+inline int pass_simplify_cfg(koopa_raw_function_t func,
+    FunctionAnalyses &analyses, IRArena &)
+{
+    bool changed = false;
+    std::map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> forward;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        if (bb->insts.len == 0)continue;
+        auto &kind = mut(inst_at(bb, bb->insts.len - 1))->kind;
+        if (kind.tag == KOOPA_RVT_BRANCH)
+        {
+            auto branch = kind.data.branch;
+            bool same = branch.true_bb == branch.false_bb &&
+                branch.true_args.len == 0 && branch.false_args.len == 0;
+            if (!same && !is_integer(branch.cond))continue;
+            bool taken = same || branch.cond->kind.data.integer.value != 0;
+            kind.tag = KOOPA_RVT_JUMP;
+            kind.data.jump.target = taken ? branch.true_bb : branch.false_bb;
+            kind.data.jump.args = taken ? branch.true_args : branch.false_args;
+            changed = true;
+        }
+        if (kind.tag == KOOPA_RVT_JUMP && bb->insts.len == 1 &&
+            bb->params.len == 0 && kind.data.jump.args.len == 0)
+            forward[bb] = kind.data.jump.target;
+    }
+    // the chains walked are cut short to their end, so a long chain of
+    // blocks that only jump on is walked once and not once per edge into it
+    for (size_t i = 0; i < func->bbs.len; i++)
+        for_each_successor(block_at(func, i), [&](koopa_raw_basic_block_t &bb)
+        {
+            std::set<koopa_raw_basic_block_t> seen;
+            auto target = bb;
+            while (forward.count(target) && seen.insert(target).second)
+                target = forward[target];
+            for (auto walked : seen)forward[walked] = target;
+            if (target != bb)
+            {
+                bb = target;
+                changed = true;
+            }
+        });
+    if (changed)analyses.invalidate(ANALYSIS_NONE);
+    const CFGInfo &cfg = analyses.cfg();
+    std::set<koopa_raw_value_t> dead;
+    for (size_t i = 0; i < cfg.blocks.size(); i++)
+        if (!cfg.reachable[i])
+            for (size_t j = 0; j < cfg.blocks[i]->insts.len; j++)
+                dead.insert(inst_at(cfg.blocks[i], j));
+    // values of unreachable blocks can't be used elsewhere in valid IR
+    bool used = false;
+    for (size_t i = 0; i < cfg.blocks.size(); i++)
+        for (size_t j = 0; cfg.reachable[i] && j < cfg.blocks[i]->insts.len;
+            j++)
+            for_each_operand(inst_at(cfg.blocks[i], j),
+                [&](koopa_raw_value_t &value) { used |= dead.count(value); });
+    if (!dead.empty() && !used)
+    {
+        std::set<koopa_raw_basic_block_t> live;
+        for (size_t i = 0; i < cfg.blocks.size(); i++)
+            if (cfg.reachable[i])live.insert(cfg.blocks[i]);
+        changed |= remove_from<koopa_raw_basic_block_t>(mut(func)->bbs,
+            [&](koopa_raw_basic_block_t bb) { return !live.count(bb); });
+    }
+    return changed ? ANALYSIS_NONE : ANALYSIS_ALL;
+}
+
+
+// a value that may be used for longer than the value it replaces: loaded
+// variables, local or global, are not (see the top of the file), params
+// neither
+inline bool can_extend(koopa_raw_value_t value)
+{
+    if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF ||
+        value->kind.tag == KOOPA_RVT_BLOCK_ARG_REF)
+        return false;
+    if (value->kind.tag != KOOPA_RVT_LOAD)return true;
+    auto tag = value->kind.data.load.src->kind.tag;
+    return tag != KOOPA_RVT_ALLOC && tag != KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+
+inline bool fold_binary(koopa_raw_binary_op_t op, int32_t lhs, int32_t rhs,
+    int32_t &result)
+{
+    uint32_t l = lhs, r = rhs;
+    switch (op)
+    {
+    case KOOPA_RBO_NOT_EQ: result = lhs != rhs; break;
+    case KOOPA_RBO_EQ: result = lhs == rhs; break;
+    case KOOPA_RBO_GT: result = lhs > rhs; break;
+    case KOOPA_RBO_LT: result = lhs < rhs; break;
+    case KOOPA_RBO_GE: result = lhs >= rhs; break;
+    case KOOPA_RBO_LE: result = lhs <= rhs; break;
+    case KOOPA_RBO_ADD: result = int32_t(l + r); break;
+    case KOOPA_RBO_SUB: result = int32_t(l - r); break;
+    case KOOPA_RBO_MUL: result = int32_t(l * r); break;
+    case KOOPA_RBO_DIV:
+    case KOOPA_RBO_MOD:
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))return false;
+        result = op == KOOPA_RBO_DIV ? lhs / rhs : lhs % rhs;
+        break;
+    case KOOPA_RBO_AND: result = lhs & rhs; break;
+    case KOOPA_RBO_OR: result = lhs | rhs; break;
+    case KOOPA_RBO_XOR: result = lhs ^ rhs; break;
+    case KOOPA_RBO_SHL:
+    case KOOPA_RBO_SHR:
+    case KOOPA_RBO_SAR:
+        if (rhs < 0 || rhs > 31)return false;
+        result = op == KOOPA_RBO_SHL ? int32_t(l << rhs) :
+            op == KOOPA_RBO_SHR ? int32_t(l >> rhs) : lhs >> rhs;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+
+// x + 0, x * 1, x * 0 and the like; nullptr if there is nothing to simplify
+inline koopa_raw_value_t simplify_binary(const koopa_raw_binary_t &binary,
+    IRArena &arena)
+{
+    auto constant = [](koopa_raw_value_t value, int32_t c)
+    {
+        return is_integer(value) && value->kind.data.integer.value == c;
+    };
+    koopa_raw_value_t lhs = binary.lhs, rhs = binary.rhs;
+    switch (binary.op)
+    {
+    case KOOPA_RBO_MUL:
+    case KOOPA_RBO_AND:
+        if (constant(lhs, 0) || constant(rhs, 0))return make_integer(arena, 0);
+        if (binary.op == KOOPA_RBO_AND)break;
+        if (constant(lhs, 1) && can_extend(rhs))return rhs;
+        if (constant(rhs, 1) && can_extend(lhs))return lhs;
+        break;
+    case KOOPA_RBO_ADD:
+    case KOOPA_RBO_OR:
+    case KOOPA_RBO_XOR:
+        if (constant(lhs, 0) && can_extend(rhs))return rhs;
+        if (constant(rhs, 0) && can_extend(lhs))return lhs;
+        break;
+    case KOOPA_RBO_SUB:
+    case KOOPA_RBO_SHL:
+    case KOOPA_RBO_SHR:
+    case KOOPA_RBO_SAR:
+        if (constant(rhs, 0) && can_extend(lhs))return lhs;
+        break;
+    case KOOPA_RBO_DIV:
+        if (constant(rhs, 1) && can_extend(lhs))return lhs;
+        break;
+    case KOOPA_RBO_MOD:
+        if (constant(rhs, 1))return make_integer(arena, 0);
+        break;
+    default:
+        break;
+    }
+    return nullptr;
+}
+
+
+inline int pass_const_fold(koopa_raw_function_t func, FunctionAnalyses &,
+    IRArena &arena)
+{
+    std::map<koopa_raw_value_t, koopa_raw_value_t> replaced;
+    std::set<koopa_raw_value_t> removed;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = inst_at(bb, j);
+            for_each_operand(inst, [&](koopa_raw_value_t &value)
+            {
+                auto it = replaced.find(value);
+                if (it != replaced.end())value = it->second;
+            });
+            if (inst->kind.tag != KOOPA_RVT_BINARY)continue;
+            auto &binary = inst->kind.data.binary;
+            koopa_raw_value_t to = nullptr;
+            int32_t result;
+            if (is_integer(binary.lhs) && is_integer(binary.rhs) &&
+                fold_binary(binary.op, binary.lhs->kind.data.integer.value,
+                binary.rhs->kind.data.integer.value, result))
+                to = make_integer(arena, result);
+            else to = simplify_binary(binary, arena);
+            if (!to)continue;
+            replaced[inst] = to;
+            removed.insert(inst);
+        }
+    }
+    if (removed.empty())return ANALYSIS_ALL;
+    replace_uses(func, replaced);
+    remove_insts(func, removed);
+    return ANALYSIS_ALL;
+}
+
+
+// within a block, a load of a local variable whose value is known (stored or
+// loaded before) is replaced by that value
+inline int pass_load_forward(koopa_raw_function_t func, FunctionAnalyses &,
+    IRArena &)
+{
+    std::set<koopa_raw_value_t> slots = local_slots(func), removed;
+    std::map<koopa_raw_value_t, koopa_raw_value_t> replaced;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        std::map<koopa_raw_value_t, size_t> position, last_use;
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            position[inst_at(bb, j)] = j;
+            for_each_operand(inst_at(bb, j),
+                [&](koopa_raw_value_t &value) { last_use[value] = j; });
+        }
+        // a loaded value is only good until its variable is stored to, and
+        // one of a global until any call, which may store to it as well
+        auto killed_at = [&](koopa_raw_value_t value) -> size_t
+        {
+            if (value->kind.tag != KOOPA_RVT_LOAD)return bb->insts.len;
+            auto src = value->kind.data.load.src;
+            bool global = src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+            if (!global && !slots.count(src))return bb->insts.len;
+            for (size_t j = position[value] + 1; j < bb->insts.len; j++)
+            {
+                auto inst = inst_at(bb, j);
+                if (inst->kind.tag == KOOPA_RVT_STORE &&
+                    inst->kind.data.store.dest == src)
+                    return j;
+                if (global && inst->kind.tag == KOOPA_RVT_CALL)return j;
+            }
+            return bb->insts.len;
+        };
+        std::map<koopa_raw_value_t, koopa_raw_value_t> known;
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = inst_at(bb, j);
+            for_each_operand(inst, [&](koopa_raw_value_t &value)
+            {
+                auto it = replaced.find(value);
+                if (it != replaced.end())value = it->second;
+            });
+            if (inst->kind.tag == KOOPA_RVT_STORE &&
+                slots.count(inst->kind.data.store.dest))
+            {
+                // params are not instructions of the block, so they are
+                // never forwarded
+                auto value = inst->kind.data.store.value;
+                if (is_integer(value) || position.count(value))
+                    known[inst->kind.data.store.dest] = value;
+                else known.erase(inst->kind.data.store.dest);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_LOAD &&
+                slots.count(inst->kind.data.load.src))
+            {
+                auto src = inst->kind.data.load.src;
+                auto it = known.find(src);
+                size_t end = last_use.count(inst) ? last_use[inst] : j;
+                if (it != known.end() && killed_at(it->second) > end)
+                {
+                    replaced[inst] = it->second;
+                    removed.insert(inst);
+                    if (position.count(it->second))
+                        last_use[it->second] = std::max(
+                            last_use[it->second], end);
+                }
+                else known[src] = inst;
+            }
+        }
+    }
+    if (removed.empty())return ANALYSIS_ALL;
+    replace_uses(func, replaced);
+    remove_insts(func, removed);
+    return ANALYSIS_CFG | ANALYSIS_DOMINATORS;
+}
+
+
+// stores to local variables that are never read afterwards
+inline int pass_dse(koopa_raw_function_t func, FunctionAnalyses &analyses,
+    IRArena &)
+{
+    const CFGInfo &cfg = analyses.cfg();
+    const LivenessInfo &live = analyses.liveness();
+    std::set<koopa_raw_value_t> removed;
+    for (size_t i = 0; i < cfg.blocks.size(); i++)
+    {
+        std::vector<uint64_t> now = live.live_out[i];
+        auto bb = cfg.blocks[i];
+        for (size_t j = bb->insts.len; j-- > 0;)
+        {
+            auto inst = inst_at(bb, j);
+            if (inst->kind.tag == KOOPA_RVT_LOAD &&
+                live.slots.count(inst->kind.data.load.src))
+            {
+                int slot = live.slots.at(inst->kind.data.load.src);
+                now[slot / 64] |= uint64_t(1) << (slot % 64);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_STORE &&
+                live.slots.count(inst->kind.data.store.dest))
+            {
+                int slot = live.slots.at(inst->kind.data.store.dest);
+                if (!LivenessInfo::has(now, slot))removed.insert(inst);
+                now[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+            }
+        }
+    }
+    if (removed.empty())return ANALYSIS_ALL;
+    remove_insts(func, removed);
+    return ANALYSIS_CFG | ANALYSIS_DOMINATORS;
+}
+
+
+// instructions without side effects whose results are unused. Uses are
+// counted once; removing an instruction drops the counts of its operands and
+// queues those it leaves unused, so long dead chains go in one sweep
+inline int pass_dce(koopa_raw_function_t func, FunctionAnalyses &, IRArena &)
+{
+    auto pure = [](koopa_raw_value_t value)
+    {
+        switch (value->kind.tag)
+        {
+        case KOOPA_RVT_ALLOC:
+        case KOOPA_RVT_LOAD:
+        case KOOPA_RVT_GET_PTR:
+        case KOOPA_RVT_GET_ELEM_PTR:
+        case KOOPA_RVT_BINARY:
+            return true;
+        default:
+            return false;
+        }
+    };
+    auto uses = count_uses(func);
+    std::vector<koopa_raw_value_t> work;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = block_at(func, i);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = inst_at(bb, j);
+            if (pure(inst) && !uses.count(inst))work.push_back(inst);
+        }
+    }
+    std::set<koopa_raw_value_t> removed;
+    while (!work.empty())
+    {
+        auto inst = work.back();
+        work.pop_back();
+        if (!removed.insert(inst).second)continue;
+        for_each_operand(inst, [&](koopa_raw_value_t &value)
+        {
+            auto it = uses.find(value);
+            if (--it->second == 0 && pure(value))work.push_back(value);
+        });
+    }
+    if (removed.empty())return ANALYSIS_ALL;
+    remove_insts(func, removed);
+    return ANALYSIS_CFG | ANALYSIS_DOMINATORS;
+}
+
+
+// every operand is defined before it is used: earlier in its block or in a
+// dominating block
+inline int pass_verify(koopa_raw_function_t func, FunctionAnalyses &analyses,
+    IRArena &)
+{
+    const CFGInfo &cfg = analyses.cfg();
+    const DominatorInfo &dom = analyses.dominators();
+    std::map<koopa_raw_value_t, std::pair<int, size_t>> defs;
+    for (size_t i = 0; i < cfg.blocks.size(); i++)
+        for (size_t j = 0; j < cfg.blocks[i]->insts.len; j++)
+            defs[inst_at(cfg.blocks[i], j)] = {i, j};
+    for (size_t i = 0; i < cfg.blocks.size(); i++)
+    {
+        if (!cfg.reachable[i])continue;
+        for (size_t j = 0; j < cfg.blocks[i]->insts.len; j++)
+            for_each_operand(inst_at(cfg.blocks[i], j),
+                [&](koopa_raw_value_t &value)
+            {
+                switch (value->kind.tag)
+                {
+                case KOOPA_RVT_INTEGER:
+                case KOOPA_RVT_ZERO_INIT:
+                case KOOPA_RVT_UNDEF:
+                case KOOPA_RVT_AGGREGATE:
+                case KOOPA_RVT_FUNC_ARG_REF:
+                case KOOPA_RVT_BLOCK_ARG_REF:
+                case KOOPA_RVT_GLOBAL_ALLOC:
+                    return;
+                default:
+                    break;
+                }
+                if (!analyses.error.empty())return;
+                auto def = defs.find(value);
+                if (def == defs.end())
+                    analyses.error = "use of a removed value";
+                else if (def->second.first == int(i) ?
+                    def->second.second >= j :
+                    !dom.dominates(def->second.first, i))
+                    analyses.error = "use not dominated by its definition";
+                if (!analyses.error.empty())
+                    analyses.error += std::string(" in ") +
+                        (cfg.blocks[i]->name ? cfg.blocks[i]->name : "a block");
+            });
+    }
+    return ANALYSIS_ALL;
+}
+
+
+// functions not reachable from main through calls
+inline bool pass_dead_func(koopa_raw_program_t &program)
+{
+    std::map<std::string, koopa_raw_function_t> by_name;
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(
+            program.funcs.buffer[i]);
+        by_name[func->name] = func;
+    }
+    if (!by_name.count("@main"))return false;
+    std::set<koopa_raw_function_t> live = {by_name["@main"]};
+    std::vector<koopa_raw_function_t> work = {by_name["@main"]};
+    while (!work.empty())
+    {
+        auto func = work.back();
+        work.pop_back();
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = block_at(func, i);
+            for (size_t j = 0; j < bb->insts.len; j++)
+            {
+                auto inst = inst_at(bb, j);
+                if (inst->kind.tag != KOOPA_RVT_CALL)continue;
+                auto callee = inst->kind.data.call.callee;
+                if (live.insert(callee).second)work.push_back(callee);
+            }
+        }
+    }
+    return remove_from<koopa_raw_function_t>(program.funcs,
+        [&](koopa_raw_function_t func)
+        { return func->bbs.len > 0 && !live.count(func); });
+}
+
+
+struct PassInfo
+{
+    const char *name;
+    int (*run_function)(koopa_raw_function_t, FunctionAnalyses &, IRArena &);
+    bool (*run_module)(koopa_raw_program_t &);
+    // it needs all functions of the program, see PassManager::run
+    bool whole_program;
+};
+
+
+inline const std::vector<PassInfo> &pass_registry()
+{
+    static const std::vector<PassInfo> passes = {
+        {"dead-func", nullptr, pass_dead_func, true},
+        {"simplify-cfg", pass_simplify_cfg, nullptr, false},
+        {"const-fold", pass_const_fold, nullptr, false},
+        {"load-forward", pass_load_forward, nullptr, false},
+        {"dse", pass_dse, nullptr, false},
+        {"dce", pass_dce, nullptr, false},
+        {"verify", pass_verify, nullptr, false},
+    };
+    return passes;
+}
+
+
+// the passes run for options, in order; -perf defaults to the highest level,
+// and so does -sim, which measures its code
+inline std::vector<std::string> pass_pipeline(const PassOptions &options,
+    const std::string &mode)
+{
+    bool perf = mode == "-perf" || mode == "-sim";
+    int level = options.level >= 0 ? options.level : perf ? 2 : 0;
+    std::vector<std::string> names;
+    if (level == 1)names = {"simplify-cfg", "const-fold", "dce", "verify"};
+    else if (level >= 2)
+        names = {"dead-func", "simplify-cfg", "const-fold", "load-forward",
+            "const-fold", "dse", "dce", "simplify-cfg", "verify"};
+    for (auto &name : options.enable)
+        if (std::find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+    for (auto &name : options.disable)
+        names.erase(std::remove(names.begin(), names.end(), name),
+            names.end());
+    return names;
+}
+
+
+inline size_t ir_size(const koopa_raw_program_t &program)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(
+            program.funcs.buffer[i]);
+        for (size_t j = 0; j < func->bbs.len; j++)
+            size += block_at(func, j)->insts.len;
+    }
+    return size;
+}
+
+
+inline void print_type(std::ostream &os, koopa_raw_type_t ty)
+{
+    switch (ty->tag)
+    {
+    case KOOPA_RTT_INT32: os << "i32"; break;
+    case KOOPA_RTT_UNIT: os << "unit"; break;
+    case KOOPA_RTT_ARRAY:
+        os << "[";
+        print_type(os, ty->data.array.base);
+        os << ", " << ty->data.array.len << "]";
+        break;
+    case KOOPA_RTT_POINTER:
+        os << "*";
+        print_type(os, ty->data.pointer.base);
+        break;
+    default:
+        assert(false);
+    }
+}
+
+
+// prints program as Koopa IR text, unnamed values get fresh names
+inline void print_ir(std::ostream &os, const koopa_raw_program_t &program)
+{
+    static const char *ops[] = {"ne", "eq", "gt", "lt", "ge", "le", "add",
+        "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "sar"};
+    std::map<const void *, std::string> names;
+    auto name = [&](const void *ptr, const char *given)
+    {
+        if (given)return std::string(given);
+        auto it = names.find(ptr);
+        if (it != names.end())return it->second;
+        return names[ptr] = "%_" + std::to_string(names.size());
+    };
+    std::function<void(koopa_raw_value_t)> value = [&](koopa_raw_value_t v)
+    {
+        switch (v->kind.tag)
+        {
+        case KOOPA_RVT_INTEGER: os << v->kind.data.integer.value; break;
+        case KOOPA_RVT_ZERO_INIT: os << "zeroinit"; break;
+        case KOOPA_RVT_UNDEF: os << "undef"; break;
+        case KOOPA_RVT_AGGREGATE:
+        {
+            auto &elems = v->kind.data.aggregate.elems;
+            os << "{";
+            for (size_t i = 0; i < elems.len; i++)
+            {
+                if (i)os << ", ";
+                value(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]));
+            }
+            os << "}";
+            break;
+        }
+        default:
+            os << name(v, v->name);
+        }
+    };
+    auto values = [&](const koopa_raw_slice_t &slice)
+    {
+        for (size_t i = 0; i < slice.len; i++)
+        {
+            if (i)os << ", ";
+            value(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+        }
+    };
+    auto target = [&](koopa_raw_basic_block_t bb, const koopa_raw_slice_t &args)
+    {
+        os << name(bb, bb->name);
+        if (args.len == 0)return;
+        os << "(";
+        values(args);
+        os << ")";
+    };
+    for (size_t i = 0; i < program.values.len; i++)
+    {
+        auto global = reinterpret_cast<koopa_raw_value_t>(
+            program.values.buffer[i]);
+        os << "global " << name(global, global->name) << " = alloc ";
+        print_type(os, global->ty->data.pointer.base);
+        os << ", ";
+        value(global->kind.data.global_alloc.init);
+        os << std::endl;
+    }
+    for (size_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(
+            program.funcs.buffer[i]);
+        auto &params = func->ty->data.function.params;
+        if (func->bbs.len)os << std::endl;
+        os << (func->bbs.len ? "fun " : "decl ") << func->name << "(";
+        for (size_t j = 0; j < params.len; j++)
+        {
+            if (j)os << ", ";
+            if (func->bbs.len)
+                os << name(func->params.buffer[j], reinterpret_cast<
+                    koopa_raw_value_t>(func->params.buffer[j])->name) << ": ";
+            print_type(os,
+                reinterpret_cast<koopa_raw_type_t>(params.buffer[j]));
+        }
+        os << ")";
+        if (func->ty->data.function.ret->tag != KOOPA_RTT_UNIT)
+        {
+            os << ": ";
+            print_type(os, func->ty->data.function.ret);
+        }
+        if (!func->bbs.len)
+        {
+            os << std::endl;
+            continue;
+        }
+        os << " {" << std::endl;
+        for (size_t j = 0; j < func->bbs.len; j++)
+        {
+            auto bb = block_at(func, j);
+            os << name(bb, bb->name) << ":" << std::endl;
+            for (size_t k = 0; k < bb->insts.len; k++)
+            {
+                auto inst = inst_at(bb, k);
+                auto &kind = inst->kind;
+                os << "\t";
+                if (inst->ty->tag != KOOPA_RTT_UNIT)
+                    os << name(inst, inst->name) << " = ";
+                switch (kind.tag)
+                {
+                case KOOPA_RVT_ALLOC:
+                    os << "alloc ";
+                    print_type(os, inst->ty->data.pointer.base);
+                    break;
+                case KOOPA_RVT_LOAD:
+                    os << "load ";
+                    value(kind.data.load.src);
+                    break;
+                case KOOPA_RVT_STORE:
+                    os << "store ";
+                    value(kind.data.store.value);
+                    os << ", ";
+                    value(kind.data.store.dest);
+                    break;
+                case KOOPA_RVT_GET_PTR:
+                case KOOPA_RVT_GET_ELEM_PTR:
+                {
+                    bool elem = kind.tag == KOOPA_RVT_GET_ELEM_PTR;
+                    auto &ptr = kind.data.get_ptr;
+                    auto &elem_ptr = kind.data.get_elem_ptr;
+                    os << (elem ? "getelemptr " : "getptr ");
+                    value(elem ? elem_ptr.src : ptr.src);
+                    os << ", ";
+                    value(elem ? elem_ptr.index : ptr.index);
+                    break;
+                }
+                case KOOPA_RVT_BINARY:
+                    os << ops[kind.data.binary.op] << " ";
+                    value(kind.data.binary.lhs);
+                    os << ", ";
+                    value(kind.data.binary.rhs);
+                    break;
+                case KOOPA_RVT_BRANCH:
+                    os << "br ";
+                    value(kind.data.branch.cond);
+                    os << ", ";
+                    target(kind.data.branch.true_bb,
+                        kind.data.branch.true_args);
+                    os << ", ";
+                    target(kind.data.branch.false_bb,
+                        kind.data.branch.false_args);
+                    break;
+                case KOOPA_RVT_JUMP:
+                    os << "jump ";
+                    target(kind.data.jump.target, kind.data.jump.args);
+                    break;
+                case KOOPA_RVT_CALL:
+                    os << "call " << kind.data.call.callee->name << "(";
+                    values(kind.data.call.args);
+                    os << ")";
+                    break;
+                case KOOPA_RVT_RETURN:
+                    os << "ret";
+                    if (kind.data.ret.value)
+                    {
+                        os << " ";
+                        value(kind.data.ret.value);
+                    }
+                    break;
+                default:
+                    assert(false);
+                }
+                os << std::endl;
+            }
+        }
+        os << "}" << std::endl;
+    }
+}
+
+
+// runs the pipeline of the options on raw programs. Analyses are kept per
+// function from one pass to the next and only dropped when a pass says it
+// didn't preserve them. The constants made by the passes live in the manager,
+// so it has to outlive the use of the program
+class PassManager
+{
+public:
+    // IR printed after passes and the pass timings, for stderr
+    std::string log;
+    // why the last run failed
+    std::string error;
+
+    PassManager(const PassOptions &options, const std::string &mode)
+        : options(options)
+    {
+        for (auto &name : pass_pipeline(options, mode))
+        {
+            auto &passes = pass_registry();
+            auto pass = std::find_if(passes.begin(), passes.end(),
+                [&](const PassInfo &info) { return name == info.name; });
+            assert(pass != passes.end() && "unknown pass");
+            pipeline.push_back(&*pass);
+        }
+    }
+
+    bool empty() const { return pipeline.empty(); }
+
+    // with whole_program false the program is only a part of one (see
+    // emit_cached), so passes that look at all functions are left out.
+    // Returns false if a pass found the program broken, error says how
+    bool run(koopa_raw_program_t &program, bool whole_program = true)
+    {
+        std::map<koopa_raw_function_t, std::unique_ptr<FunctionAnalyses>>
+            analyses;
+        std::vector<std::string> order;
+        std::map<std::string, Stat> stats;
+        std::ostringstream os;
+        for (auto pass : pipeline)
+        {
+            if (pass->whole_program && !whole_program)continue;
+            Stat &stat = stats[pass->name];
+            if (stat.runs++ == 0)order.push_back(pass->name);
+            size_t before = ir_size(program);
+            TraceScope scope(pass->name);
+            auto start = std::chrono::steady_clock::now();
+            if (pass->run_module)
+            {
+                // functions may be gone, analyses are cheap to rebuild
+                if (pass->run_module(program))
+                {
+                    for (auto &func : analyses)
+                        analysis_computed += func.second->computed;
+                    analyses.clear();
+                }
+            }
+            else
+                for (size_t i = 0; i < program.funcs.len; i++)
+                {
+                    auto func = reinterpret_cast<koopa_raw_function_t>(
+                        program.funcs.buffer[i]);
+                    if (func->bbs.len == 0)continue;
+                    auto &func_analyses = analyses[func];
+                    if (!func_analyses)
+                        func_analyses.reset(new FunctionAnalyses(func));
+                    func_analyses->invalidate(pass->run_function(func,
+                        *func_analyses, arena));
+                    if (!func_analyses->error.empty())
+                    {
+                        error = std::string(pass->name) + ": " + func->name +
+                            ": " + func_analyses->error;
+                        log += os.str();
+                        return false;
+                    }
+                }
+            stat.seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            stat.delta += long(ir_size(program)) - long(before);
+            if (options.print_all || std::find(options.print_after.begin(),
+                options.print_after.end(), pass->name) !=
+                options.print_after.end())
+            {
+                os << "; IR after " << pass->name << std::endl;
+                print_ir(os, program);
+                os << std::endl;
+            }
+        }
+        if (options.time)
+        {
+            for (auto &func : analyses)
+            {
+                analysis_computed += func.second->computed;
+                analysis_reused += func.second->reused;
+            }
+            os << std::left << std::setw(16) << "pass" << std::right <<
+                std::setw(6) << "runs" << std::setw(12) << "time (ms)" <<
+                std::setw(10) << "insts" << std::endl;
+            os << std::fixed << std::setprecision(3);
+            for (auto &name : order)
+                os << std::left << std::setw(16) << name << std::right <<
+                    std::setw(6) << stats[name].runs << std::setw(12) <<
+                    stats[name].seconds * 1000 << std::setw(10) <<
+                    std::showpos << stats[name].delta << std::noshowpos <<
+                    std::endl;
+            os << "instructions: " << ir_size(program) << ", analyses: " <<
+                analysis_computed << " computed, " << analysis_reused <<
+                " reused" << std::endl;
+        }
+        log += os.str();
+        return true;
+    }
+
+private:
+    struct Stat
+    {
+        int runs = 0;
+        double seconds = 0;
+        long delta = 0;  // change of the instruction count
+    };
+
+    const PassOptions &options;
+    std::vector<const PassInfo *> pipeline;
+    IRArena arena;
+    int analysis_computed = 0, analysis_reused = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+
+
+// profiles for -fprofile-generate and -fprofile-use: the counts of runs of
+// the instrumented code, one "<id> <count>" per line. Ids are made of the
+// names in the IR, which the frontend derives from each function alone, so
+// the counts of a function still apply when others change:
+//   func @f                      calls of @f
+//   edge @f %from %to            times the edge was taken
+//   call @f %block <n> @g        times the n-th call of %block (to @g) ran
+// Counts of the same id are added up, so the profiles of several runs can
+// simply be concatenated; code built with -fprofile-generate appends the
+// lines of the functions it ran to its file when main returns (in the order
+// of their first calls, counts as unsigned 32 bits, see profile_support in
+// RISCV.h), lines starting with '#' are skipped
+class Profile
+{
+public:
+    std::map<std::string, long> counts;
+
+    bool empty() const { return counts.empty(); }
+
+    // adds the counts of text, false if a line is malformed
+    bool parse(const std::string &text)
+    {
+        std::istringstream lines(text);
+        for (std::string line; std::getline(lines, line);)
+        {
+            if (line.empty() || line[0] == '#')continue;
+            size_t space = line.rfind(' ');
+            if (space == std::string::npos || space == 0)return false;
+            char *end;
+            long count = strtol(line.c_str() + space + 1, &end, 10);
+            if (*end != 0)return false;
+            counts[line.substr(0, space)] += count;
+        }
+        return true;
+    }
+
+    // 0 for ids not in the profile
+    long count(const std::string &id) const
+    {
+        auto it = counts.find(id);
+        return it == counts.end() ? 0 : it->second;
+    }
+};
+
+
+inline std::string profile_func_id(const std::string &func)
+{
+    return "func " + func;
+}
+
+
+inline std::string profile_edge_id(const std::string &func,
+    const std::string &from, const std::string &to)
+{
+    return "edge " + func + " " + from + " " + to;
+}
+
+
+inline std::string profile_call_id(const std::string &func,
+    const std::string &block, int n, const std::string &callee)
+{
+    return "call " + func + " " + block + " " + std::to_string(n) + " " +
+        callee;
+}
@@ -3,24 +3,227 @@
 #include <string>
 #include <cassert>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <functional>
 #include "koopa.h"
+#include "Lines.h"
+#include "Output.h"
+#include "Parallel.h"
+#include "Profile.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Type.h"
 
 
 struct Reg { int reg_name; int reg_offset; };
-std::string reg_names[16] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6",
-    "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7", "x0"};
-koopa_raw_value_t registers[16];
-int reg_stats[16] = {0};
-koopa_raw_value_t present_value = 0;
-std::map<const koopa_raw_value_t, Reg> value_map;
-int global_num = 0;
-std::map<const koopa_raw_value_t, std::string> global_values;
-int stack_size = 0, stack_top = 0;
-bool restore_ra = false;
+// value -> its number in the present function: open addressing over a power
+// of two table kept at most half full. Slots of an older epoch are empty, so
+// clear is O(1) and the table is reused from function to function
+class ValueIds
+{
+public:
+    int find(koopa_raw_value_t value) const
+    {
+        if (slots.empty())return -1;
+        for (size_t i = slot_of(value);; i = (i + 1) & (slots.size() - 1))
+        {
+            const Slot &slot = slots[i];
+            if (slot.epoch != epoch)return -1;
+            if (slot.value == value)return slot.id;
+        }
+    }
+
+    void insert(koopa_raw_value_t value, int id)
+    {
+        if ((size + 1) * 2 > slots.size())grow();
+        size_t i = slot_of(value);
+        while (slots[i].epoch == epoch)i = (i + 1) & (slots.size() - 1);
+        slots[i] = {value, id, epoch};
+        size++;
+    }
+
+    void clear()
+    {
+        size = 0;
+        if (++epoch == 0)  // stale slots could look live again
+        {
+            slots.assign(slots.size(), Slot{});
+            epoch = 1;
+        }
+    }
+
+private:
+    struct Slot { koopa_raw_value_t value; int id; unsigned epoch; };
+    std::vector<Slot> slots;
+    size_t size = 0;
+    unsigned epoch = 1;
+
+    size_t slot_of(koopa_raw_value_t value) const
+    {
+        uint64_t hash = reinterpret_cast<uintptr_t>(value) *
+            0x9e3779b97f4a7c15ULL;
+        return (hash >> 32) & (slots.size() - 1);
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(std::max<size_t>(old.size() * 2, 1024), Slot{});
+        unsigned old_epoch = epoch;
+        epoch = 1;
+        size = 0;
+        for (auto &slot : old)
+            if (slot.epoch == old_epoch)insert(slot.value, slot.id);
+    }
+};
+// s1 ~ s10 (16 ~ 25) are never handed out by find_reg, they hold anchors and
+// promoted globals
+std::string reg_names[26] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6",
+    "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7", "x0",
+    "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10"};
+// names of the globals of the program being emitted, set up by
+// emit_program and only read by the threads emitting its functions; they are
+// derived from the IR names, so a function's code doesn't depend on what else
+// is in the program (see Cache.h)
+thread_local std::unordered_map<koopa_raw_value_t, std::string> *global_values;
+// everything below belongs to the function being emitted; functions are
+// emitted in parallel (see Visit(program)), so each thread has its own copy
+// the values of the function are numbered up front (number_values): 0 is no
+// value, then the params and the instructions in the order of the IR. What is
+// kept per value lives in flat arrays indexed by its number: value_regs holds
+// its register and stack slot, value_seen whether it has them yet. Values of
+// other functions (integers, globals) are numbered when first met
+thread_local ValueIds value_ids;
+thread_local std::vector<Reg> value_regs;
+thread_local std::vector<char> value_seen;
+// the number of the last instruction using each value numbered up front;
+// values are only used in their own block, in the order of the IR
+thread_local std::vector<int> value_last_use;
+thread_local int registers[26];  // the number of the value in each register
+// 0: free, 1: holds a value, 2: held for the present instruction, 3: holds a
+// param for the whole function (see param_slots)
+thread_local int reg_stats[26] = {0};
+thread_local koopa_raw_value_t present_value = 0;
+thread_local int present_id = 0;
+// the instruction being emitted, present_id may be one of its operands
+thread_local int present_inst = 0;
+thread_local std::string present_func;
+thread_local int stack_size = 0, stack_top = 0;
+thread_local bool restore_ra = false;
+// ra is stored lazily before the first call on each path (shrink wrapping),
+// ra_saved tells whether the stack slot at ra_offset holds it right now
+thread_local int ra_offset = 0;
+thread_local bool ra_saved = false;
+thread_local std::map<koopa_raw_basic_block_t, bool> ra_saved_in;
+thread_local std::vector<std::streampos> ret_points;
+// arrays live in a far region above all scalars and spill slots; offsets out
+// of the 12-bit range are reached through anchors, s registers holding sp plus
+// a fixed offset, which are set up once in the prologue instead of at every
+// access. The far arrays used most get an anchor at their base up front (see
+// choose_s_regs), other offsets take anchors at sp + 4096 * k from the s
+// registers left, up to last_anchor_reg, when first needed
+struct Anchor
+{
+    int offset;
+    int s_reg;
+    bool used;
+};
+thread_local std::vector<Anchor> anchors;
+thread_local int far_top = 0, anchor_save_offset = 0;
+thread_local int next_anchor_reg = 1, last_anchor_reg = 0;
+// control flow graph of the function being emitted, loops maps the header of
+// each natural loop to its blocks
+thread_local std::map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>>
+    bb_preds, bb_succs;
+thread_local std::map<koopa_raw_basic_block_t, bool> bb_has_call;
+thread_local std::map<koopa_raw_basic_block_t, std::map<koopa_raw_basic_block_t, bool>>
+    loops;
+thread_local std::map<koopa_raw_value_t, bool> addressed_globals;
+thread_local koopa_raw_basic_block_t present_bb = 0;
+// a global scalar used in a loop without calls stays in s_reg over the whole
+// loop: it is loaded on the edges entering the loop and, if the loop stores
+// to it, written back on the edges (and returns) leaving it. A load of it is
+// s_reg itself, so a store moves the loads still used after it (loaded, of
+// present_bb) out of s_reg first
+struct Promotion
+{
+    koopa_raw_value_t global;
+    int s_reg;
+    bool dirty;
+    std::map<koopa_raw_basic_block_t, bool> blocks;
+    std::vector<int> loaded;
+    // s_reg is saved on every path reaching the block (see save_s_regs)
+    std::map<koopa_raw_basic_block_t, bool> saved_in;
+};
+thread_local std::vector<Promotion> promotions;
+// a leaf function keeps a param in its a register when the param is only
+// stored to a local variable whose address is only loaded from and stored
+// to: the variable lives in the register instead of the frame, like a
+// promoted global in an s register (loaded as for promotions)
+struct ParamSlot
+{
+    int reg;
+    std::vector<int> loaded;
+};
+thread_local std::map<koopa_raw_value_t, ParamSlot> param_slots;
+thread_local std::map<koopa_raw_value_t, int> promoted;  // promotions covering present_bb
+thread_local bool s_saved[11] = {false};
+thread_local int edge_num = 0;
+// global -> the value holding it in a register within the present block
+thread_local std::map<koopa_raw_value_t, koopa_raw_value_t> global_cache;
+// koopa type -> its id in type_table, koopa types are made per value so the
+// same type is met under many pointers
+thread_local std::unordered_map<koopa_raw_type_t, TypeId> koopa_types;
+// spill stores and reloads carry a "# spill" / "# reload" comment, for the
+// simulator to count them (-sim); emit_program hands it to its threads
+thread_local bool mark_spills = false;
+// -fprofile-generate: with count_edges, each function counts its calls, the
+// edges taken and its call sites in a table of words after its code, the ids
+// of the words go to profile_ids (see Profile.h). The first call links the
+// table into a list, main appends the counts of the list to profile_path when
+// it returns (profile_support). -fprofile-use: the counts of block_profile
+// decide the order of the blocks (bb_order, a block falls through to next_bb)
+// and which loops get globals promoted. emit_program hands them to its threads
+thread_local bool count_edges = false;
+thread_local std::string profile_path = "sysy.profile";
+thread_local const Profile *block_profile = nullptr;
+thread_local std::vector<std::string> profile_ids;
+thread_local std::vector<koopa_raw_basic_block_t> bb_order;
+thread_local koopa_raw_basic_block_t next_bb = 0;
+thread_local std::map<koopa_raw_basic_block_t, long> bb_counts;
+thread_local std::map<std::pair<koopa_raw_basic_block_t,
+    koopa_raw_basic_block_t>, long> edge_counts;
+thread_local int block_calls = 0;  // calls emitted in present_bb so far
+// -finstrument-functions: each function reads rdcycle and rdinstret on entry
+// and return and adds what it took, with and without its callees, to a record
+// after its code; main prints the records at its return (see
+// instrument_support). The values on entry go to 16 bytes at
+// instrument_offset of the frame; emit_program hands the flag to its threads
+thread_local bool instrument = false;
+thread_local int instrument_offset = 0;
+// -stats: emit_program fills in an entry of program_stats for each function,
+// func_stats is that of the function being emitted
+thread_local std::vector<FunctionStats> *program_stats = nullptr;
+thread_local FunctionStats *func_stats = nullptr;
+// -g and -fverbose-asm: before the code of each instruction whose source line
+// differs from that of the code before it, emit_locs puts a .loc and
+// emit_line_comments a "# line N"; the lines of the IR names are in
+// source_lines (see Lines.h), func_lines are those of the present function.
+// emit_program hands the three to its threads
+thread_local bool emit_locs = false, emit_line_comments = false;
+thread_local const SourceLines *source_lines = nullptr;
+thread_local const std::map<std::string, int> *func_lines = nullptr;
+thread_local int present_line = 0;
 
 
 void Visit(const koopa_raw_program_t &program);
+std::vector<std::string> emit_program(const koopa_raw_program_t &program,
+    const std::function<void(size_t)> &load = nullptr);
 void Visit(const koopa_raw_slice_t &slice);
 void Visit(const koopa_raw_function_t &func);
 void Visit(const koopa_raw_basic_block_t &bb);
@@ -35,17 +238,96 @@ void Visit(const koopa_raw_jump_t &jump);
 Reg Visit(const koopa_raw_call_t &call);
 Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr);
 Reg Visit(const koopa_raw_get_ptr_t &get_ptr);
-std::string Visit(const koopa_raw_global_alloc_t &global);
+void Visit(const koopa_raw_global_alloc_t &global, const std::string &name);
+std::string bb_label(koopa_raw_basic_block_t bb);
+void build_cfg(const koopa_raw_function_t &func);
+void shrink_wrap_ra(const koopa_raw_function_t &func);
+void promote_globals(const koopa_raw_function_t &func, int first_reg);
+void pin_params(const koopa_raw_function_t &func);
+void move_loads_out(std::vector<int> &loaded, int reg);
+long block_weight(koopa_raw_basic_block_t bb);
+int choose_s_regs(const koopa_raw_function_t &func, int far_base);
+void save_s_regs(const koopa_raw_function_t &func);
+void lay_out_blocks(const koopa_raw_function_t &func);
+std::string profile_counter(const std::string &id);
+void profile_link();
+void profile_exit();
+std::string profile_support();
+void instrument_entry();
+void instrument_exit();
+std::string instrument_support();
+const char *ir_opcode(const koopa_raw_value_t &inst);
+int source_line(const char *name);
+int source_line(const koopa_raw_value_t &inst);
+void emit_line(int line);
+std::string edge_code(koopa_raw_basic_block_t from,
+    koopa_raw_basic_block_t to);
+void number_values(const koopa_raw_function_t &func);
+int value_id(const koopa_raw_value_t &value);
+Reg &value_reg(int id);
+bool in_register(const koopa_raw_value_t &value);
+void each_operand(const koopa_raw_value_t &inst,
+    const std::function<void(koopa_raw_value_t)> &f);
+void emit_epilogue();
+std::string stack_base(int &offset);
+const char *spill_mark(bool reload);
 int find_reg(int stat);
 void clear_registers(bool save_temps = true);
+TypeId koopa_type(koopa_raw_type_t ty);
 int cal_size(const koopa_raw_type_t &ty);
 void init_aggregate(const koopa_raw_value_t &aggr);
 
 
 void Visit(const koopa_raw_program_t &program)
 {
+    for (auto &func : emit_program(program))out << func;
+}
+
+
+// prints the globals and returns the code of each function of program.funcs;
+// load(i), if given, is called on the emitting thread before function i is
+// read, so that its body can be loaded lazily (see IRFile.h)
+std::vector<std::string> emit_program(const koopa_raw_program_t &program,
+    const std::function<void(size_t)> &load)
+{
+    std::unordered_map<koopa_raw_value_t, std::string> names;
+    global_values = &names;
+    if (emit_locs && source_lines && !source_lines->file.empty())
+        out << "\t.file\t1 \"" << source_lines->file << "\"" << std::endl;
     Visit(program.values);
-    Visit(program.funcs);
+    koopa_types.clear();
+    // globals are only read from here on, functions are independent
+    std::vector<std::string> funcs(program.funcs.len);
+    bool marks = mark_spills, counts = count_edges, timed = instrument;
+    bool locs = emit_locs, comments = emit_line_comments;
+    const SourceLines *lines = source_lines;
+    const Profile *profile = block_profile;
+    std::string path = profile_path;
+    std::vector<FunctionStats> *stats = program_stats;
+    if (stats)stats->assign(program.funcs.len, FunctionStats());
+    parallel_for(program.funcs.len, [&](size_t i)
+    {
+        global_values = &names;
+        mark_spills = marks;
+        count_edges = counts;
+        block_profile = profile;
+        profile_path = path;
+        instrument = timed;
+        emit_locs = locs;
+        emit_line_comments = comments;
+        source_lines = lines;
+        func_stats = stats ? &(*stats)[i] : nullptr;
+        if (load)load(i);
+        std::stringstream func_out;
+        std::streambuf *out_buf = out.rdbuf(func_out.rdbuf());
+        Visit(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+        out.rdbuf(out_buf);
+        funcs[i] = func_out.str();
+        if (func_stats)stats_count_code(funcs[i], *func_stats);
+        func_stats = nullptr;
+    });
+    global_values = nullptr;
+    return funcs;
 }
 
 
@@ -75,11 +357,28 @@ void Visit(const koopa_raw_slice_t &slice)
 void Visit(const koopa_raw_function_t &func)
 {
     if (func->bbs.len == 0)return;
-    std::cout << "\t.text" << std::endl;
-    std::cout << "\t.globl " << (func->name + 1) << std::endl;
-    std::cout << (func->name + 1) << ":" << std::endl;
+    TraceScope scope("codegen function", func->name + 1);
+    out << "\t.text" << std::endl;
+    present_func = func->name + 1;
+    out << "\t.globl " << present_func << std::endl;
+    out << present_func << ":" << std::endl;
+    func_lines = nullptr;
+    if (source_lines && source_lines->values.count(func->name))
+        func_lines = &source_lines->values.at(func->name);
+    // the prologue belongs to the line of the function
+    present_line = 0;
+    emit_line(source_line(reinterpret_cast<koopa_raw_basic_block_t>(
+        func->bbs.buffer[0])->name));
     assert(stack_size == 0); assert(stack_top == 0);
-    int max_arg_num = 0;
+    number_values(func);
+    build_cfg(func);
+    lay_out_blocks(func);
+    if (func_stats)
+    {
+        func_stats->name = present_func;
+        func_stats->blocks = func->bbs.len;
+    }
+    int max_arg_num = 0, array_size = 0;
     for (size_t i = 0; i < func->bbs.len; i++)
     {
         auto ptr = func->bbs.buffer[i];
@@ -89,11 +388,13 @@ void Visit(const koopa_raw_function_t &func)
         {
             ptr = bb->insts.buffer[j];
             koopa_raw_value_t inst = reinterpret_cast<koopa_raw_value_t>(ptr);
+            if (func_stats)func_stats->ir[ir_opcode(inst)]++;
             if (inst->ty->tag != KOOPA_RTT_UNIT)
             {
-                if (inst->kind.tag == KOOPA_RVT_ALLOC)
-                    stack_size += cal_size(inst->ty->data.pointer.base);
-                else stack_size += 4;
+                if (inst->kind.tag != KOOPA_RVT_ALLOC)stack_size += 4;
+                else if (inst->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+                    array_size += cal_size(inst->ty->data.pointer.base);
+                else stack_size += cal_size(inst->ty->data.pointer.base);
             }
             if (inst->kind.tag == KOOPA_RVT_CALL)
             {
@@ -107,27 +408,36 @@ void Visit(const koopa_raw_function_t &func)
     if (max_arg_num > 8)arg_stack_size = (max_arg_num - 8) * 4;
     stack_size += arg_stack_size;
     stack_top += arg_stack_size;
-    if (restore_ra)stack_size += 4;
-    stack_size = ceil(stack_size / 16.0) * 16;
-    if (stack_size > 0 && stack_size <= 2048)
-        std::cout << "\taddi  sp, sp, -" << stack_size << std::endl;
-    else if (stack_size > 2048)
+    if (restore_ra)
     {
-        std::cout << "\tli    s11, -" << stack_size << std::endl;
-        std::cout << "\tadd   sp, sp, s11" << std::endl;
+        stack_size += 4;
+        ra_offset = stack_top;
+        stack_top += 4;
+        shrink_wrap_ra(func);
     }
-    if (restore_ra)
+    if (instrument)
     {
-        if (stack_size - 4 >= -2048 && stack_size - 4 <= 2047)
-            std::cout << "\tsw    ra, " << stack_size - 4 << "(sp)" <<
-                std::endl;
-        else
-        {
-            std::cout << "\tli    s11, " << stack_size - 4 << std::endl;
-            std::cout << "\tadd   s11, sp, s11" << std::endl;
-            std::cout << "\tsw    ra, (s11)" << std::endl;
-        }
+        instrument_offset = stack_top;
+        stack_top += 16;
+        stack_size += 16;
     }
+    // stack_size is an upper bound of the scalar region here, arrays go
+    // past it and the room for saving all s registers
+    promote_globals(func, 1);
+    int saved_num = choose_s_regs(func, stack_size + 40);
+    save_s_regs(func);
+    int max_window = (stack_size + 40 + array_size + 2048) / 4096;
+    last_anchor_reg = std::min(10, saved_num + max_window);
+    anchor_save_offset = stack_top;
+    stack_top += last_anchor_reg * 4;
+    stack_size += 40;
+    far_top = array_size > 0 ? stack_size : 0;
+    stack_size = ceil((stack_size + array_size) / 16.0) * 16;
+    // incoming stack arguments are addressed past the end of our frame, so
+    // only then the (upper bound) frame size has to be fixed in advance;
+    // otherwise the frame is sized after the body to what it really uses
+    bool fixed_frame = func->params.len > 8;
+    if (!restore_ra)pin_params(func);
     for (size_t i = 0; i < func->params.len; i++)
     {
         auto ptr = func->params.buffer[i];
@@ -135,7 +445,7 @@ void Visit(const koopa_raw_function_t &func)
         if (i < 8)
         {
             struct Reg param_var = { static_cast<int>(i + 7), -1 };
-            value_map[param] = param_var;
+            value_reg(value_id(param)) = param_var;
             // reg_stats[i + 7] = 1;
             // registers[i + 7] = param;
             // for now param will only be used once at the beginning of a
@@ -146,50 +456,183 @@ void Visit(const koopa_raw_function_t &func)
         {
             int offset = stack_size + (i - 8) * 4;
             struct Reg param_var = { -1, offset };
-            value_map[param] = param_var;
+            value_reg(value_id(param)) = param_var;
         }
     }
-    Visit(func->bbs);
-    stack_size = stack_top = 0;
-    for (int i = 0; i < 16; i++)reg_stats[i] = 0;
-    value_map.clear();
+    std::stringstream body;
+    std::streambuf *out_buf = out.rdbuf(body.rdbuf());
+    if (instrument)instrument_entry();
+    if (count_edges)
+    {
+        out << profile_counter(profile_func_id(func->name));
+        profile_link();
+    }
+    // allocs may be in any block, give them their slots in the order of the
+    // IR before a block that uses one is laid out ahead of its own
+    if (block_profile)
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+                func->bbs.buffer[i]);
+            for (size_t j = 0; j < bb->insts.len; j++)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(
+                    bb->insts.buffer[j]);
+                if (inst->kind.tag == KOOPA_RVT_ALLOC)Visit(inst);
+            }
+        }
+    for (size_t i = 0; i < bb_order.size(); i++)
+    {
+        next_bb = i + 1 < bb_order.size() ? bb_order[i + 1] : 0;
+        Visit(bb_order[i]);
+    }
+    out.rdbuf(out_buf);
+    if (!fixed_frame)
+        stack_size = ceil(std::max(stack_top, far_top) / 16.0) * 16;
+    if (stack_size > 0 && stack_size <= 2048)
+        out << "\taddi  sp, sp, -" << stack_size << std::endl;
+    else if (stack_size > 2048)
+    {
+        out << "\tli    s11, -" << stack_size << std::endl;
+        out << "\tadd   sp, sp, s11" << std::endl;
+    }
+    for (auto &anchor : anchors)
+        if (anchor.used)s_saved[anchor.s_reg] = true;
+    for (auto &p : promotions)
+        if (p.saved_in[reinterpret_cast<koopa_raw_basic_block_t>(
+            func->bbs.buffer[0])])s_saved[p.s_reg] = true;
+    for (int i = 1; i < 11; i++)
+        if (s_saved[i])
+            out << "\tsw    s" << i << ", " << anchor_save_offset +
+                (i - 1) * 4 << "(sp)" << std::endl;
+    for (auto &anchor : anchors)
+        if (anchor.used)
+        {
+            out << "\tli    s11, " << anchor.offset << std::endl;
+            out << "\tadd   s" << anchor.s_reg << ", sp, s11" << std::endl;
+        }
+    std::string body_str = body.str();
+    std::streamoff last = 0;
+    for (auto ret_point : ret_points)
+    {
+        std::streamoff pos = ret_point;
+        out << body_str.substr(last, pos - last);
+        emit_epilogue();
+        last = pos;
+    }
+    out << body_str.substr(last);
+    if (!profile_ids.empty())
+    {
+        // the next table of the list, the number of counters, the counters
+        // and their ids in the same order
+        out << "\t.data" << std::endl;
+        out << "\t.align 2" << std::endl;
+        out << "__sysy_prof_" << present_func << ":" << std::endl;
+        out << "\t.word 0, " << profile_ids.size() << std::endl;
+        out << "\t.zero " << profile_ids.size() * 4 << std::endl;
+        for (auto &id : profile_ids)
+            out << "\t.asciz \"" << id << "\"" << std::endl;
+        if (present_func == "main")out << profile_support();
+    }
+    if (instrument)
+    {
+        // calls, cycles, instret, self cycles, self instret (all but calls
+        // in 64 bits), the next record called, the name
+        out << "\t.data" << std::endl;
+        out << "\t.align 2" << std::endl;
+        out << "__sysy_fn_" << present_func << ":" << std::endl;
+        out << "\t.zero 40" << std::endl;
+        out << "\t.asciz \"" << present_func << "\"" << std::endl;
+        if (present_func == "main")out << instrument_support();
+    }
+    if (func_stats)func_stats->frame = stack_size;
+    stack_size = stack_top = far_top = 0;
+    for (int i = 0; i < 11; i++)s_saved[i] = false;
+    anchors.clear();
+    for (int i = 0; i < 26; i++)reg_stats[i] = 0;
+    value_ids.clear();
+    value_regs.clear();
+    value_seen.clear();
+    value_last_use.clear();
+    koopa_types.clear();
     restore_ra = false;
-    std::cout << std::endl;
+    ra_saved = false;
+    ra_saved_in.clear();
+    ret_points.clear();
+    bb_preds.clear();
+    bb_succs.clear();
+    bb_has_call.clear();
+    loops.clear();
+    addressed_globals.clear();
+    promotions.clear();
+    param_slots.clear();
+    edge_num = 0;
+    profile_ids.clear();
+    bb_order.clear();
+    func_lines = nullptr;
+    bb_counts.clear();
+    edge_counts.clear();
+    out << std::endl;
 }
 
 
 void Visit(const koopa_raw_basic_block_t &bb)
 {
-    std::cout << bb->name + 1 << ":" << std::endl;
-    Visit(bb->insts);
+    out << bb_label(bb) << ":" << std::endl;
+    ra_saved = restore_ra && ra_saved_in[bb];
+    present_bb = bb;
+    block_calls = 0;
+    promoted.clear();
+    global_cache.clear();
+    for (auto &slot : param_slots)slot.second.loaded.clear();
+    for (size_t i = 0; i < promotions.size(); i++)
+    {
+        promotions[i].loaded.clear();
+        if (promotions[i].blocks.count(bb))promoted[promotions[i].global] = i;
+    }
+    if (!func_lines)
+    {
+        Visit(bb->insts);
+        return;
+    }
+    // the code falling through to here may be of any line, the entry block
+    // follows the prologue
+    if (bb != bb_order[0])present_line = 0;
+    int label_line = source_line(bb->name);
+    for (size_t i = 0; i < bb->insts.len; i++)
+    {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        int line = source_line(inst);
+        emit_line(line ? line : present_line ? present_line : label_line);
+        Visit(inst);
+    }
 }
 
 
 Reg Visit(const koopa_raw_value_t &value)
 {
     koopa_raw_value_t old_value = present_value;
+    int old_id = present_id, id = value_id(value);
     present_value = value;
-    if (value_map.count(value))
+    present_id = id;
+    if (value_seen[id])
     {
-        if (value_map[value].reg_name == -1)
+        if (value_regs[id].reg_name == -1 &&
+            value->kind.tag != KOOPA_RVT_ALLOC)
         {
             int reg_name = find_reg(1);
-            value_map[value].reg_name = reg_name;
-            int reg_offset = value_map[value].reg_offset;
-            if (reg_offset >= -2048 && reg_offset <= 2047)
-                std::cout << "\tlw    " << reg_names[reg_name] << ", " <<
-                    reg_offset << "(sp)" << std::endl;
-            else
-            {
-                std::cout << "\tli    s11, " << reg_offset << std::endl;
-                std::cout << "\tadd   s11, sp, s11" << std::endl;
-                std::cout << "\tlw    " << reg_names[reg_name] << ", (s11)" <<
-                    std::endl;
-            }
+            value_regs[id].reg_name = reg_name;
+            int reg_offset = value_regs[id].reg_offset;
+            std::string base = stack_base(reg_offset);
+            out << "\tlw    " << reg_names[reg_name] << ", " <<
+                reg_offset << "(" << base << ")" << spill_mark(true) <<
+                std::endl;
         }
         present_value = old_value;
-        return value_map[value];
+        present_id = old_id;
+        return value_regs[id];
     }
+    if (id < (int)value_last_use.size())present_inst = id;
 
     const auto &kind = value->kind;
     struct Reg result_var = {-1, -1};
@@ -203,21 +646,31 @@ Reg Visit(const koopa_raw_value_t &value)
         break;
     case KOOPA_RVT_BINARY:
         result_var = Visit(kind.data.binary);
-        value_map[value] = result_var;
+        value_reg(id) = result_var;
         assert(result_var.reg_name >= 0);
         break;
     case KOOPA_RVT_ALLOC:
-        result_var.reg_offset = stack_top;
         assert(value->ty->tag == KOOPA_RTT_POINTER);
-        stack_top += cal_size(value->ty->data.pointer.base);
-        value_map[value] = result_var;
+        if (value->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+        {
+            result_var.reg_offset = far_top;
+            far_top += cal_size(value->ty->data.pointer.base);
+        }
+        else if (!param_slots.count(value))  // else in a register
+        {
+            result_var.reg_offset = stack_top;
+            stack_top += cal_size(value->ty->data.pointer.base);
+        }
+        value_reg(id) = result_var;
         break;
     case KOOPA_RVT_GLOBAL_ALLOC:
-        global_values[value] = Visit(kind.data.global_alloc);
+        assert(value->name);
+        (*global_values)[value] = "var_" + std::string(value->name + 1);
+        Visit(kind.data.global_alloc, global_values->at(value));
         break;
     case KOOPA_RVT_LOAD:
         result_var = Visit(kind.data.load);
-        value_map[value] = result_var;
+        value_reg(id) = result_var;
         assert(result_var.reg_name >= 0);
         break;
     case KOOPA_RVT_STORE:
@@ -228,12 +681,12 @@ Reg Visit(const koopa_raw_value_t &value)
         break;
     case KOOPA_RVT_GET_ELEM_PTR:
         result_var = Visit(kind.data.get_elem_ptr);
-        value_map[value] = result_var;
+        value_reg(id) = result_var;
         assert(result_var.reg_name >= 0);
         break;
     case KOOPA_RVT_GET_PTR:
         result_var = Visit(kind.data.get_ptr);
-        value_map[value] = result_var;
+        value_reg(id) = result_var;
         assert(result_var.reg_name >= 0);
         break;
     case KOOPA_RVT_JUMP:
@@ -241,10 +694,10 @@ Reg Visit(const koopa_raw_value_t &value)
         break;
     case KOOPA_RVT_CALL:
         result_var = Visit(kind.data.call);
-        value_map[value] = result_var;
+        value_reg(id) = result_var;
         if (value->ty->tag != KOOPA_RTT_UNIT)  // has ret
         {
-            registers[result_var.reg_name] = value;
+            registers[result_var.reg_name] = id;
             reg_stats[result_var.reg_name] = 1;
         }
         assert(result_var.reg_name >= 0);
@@ -253,6 +706,7 @@ Reg Visit(const koopa_raw_value_t &value)
         assert(false);
     }
     present_value = old_value;
+    present_id = old_id;
     return result_var;
 }
 
@@ -265,30 +719,30 @@ void Visit(const koopa_raw_return_t &ret)
         struct Reg result_var = Visit(ret_value);
         assert(result_var.reg_name >= 0);
         if (result_var.reg_name != 7)
-            std::cout << "\tmv    a0, " << reg_names[result_var.reg_name] <<
+            out << "\tmv    a0, " << reg_names[result_var.reg_name] <<
                 std::endl;
     }
     clear_registers(false);
-    if (restore_ra)
-    {
-        if (stack_size - 4 >= -2048 && stack_size - 4 <= 2047)
-            std::cout << "\tlw    ra, " << stack_size - 4 << "(sp)" <<
-                std::endl;
-        else
+    for (auto &global : promoted)
+        if (promotions[global.second].dirty)
         {
-            std::cout << "\tli    t0, " << stack_size - 4 << std::endl;
-            std::cout << "\tadd   t0, sp, t0" << std::endl;
-            std::cout << "\tlw    ra, (t0)" << std::endl;
+            out << "\tlui   s11, %hi(" << global_values->at(global.first) <<
+                ")" << std::endl;
+            out << "\tsw    s" << promotions[global.second].s_reg <<
+                ", %lo(" << global_values->at(global.first) << ")(s11)" <<
+                std::endl;
         }
-    }
-    if (stack_size > 0 && stack_size <= 2047)
-        std::cout << "\taddi  sp, sp, " << stack_size << std::endl;
-    else if (stack_size > 2047)
-    {
-        std::cout << "\tli    t0, " << stack_size << std::endl;
-        std::cout << "\tadd   sp, sp, t0" << std::endl;
-    }
-    std::cout << "\tret" << std::endl;
+    for (auto &p : promotions)
+        if (p.saved_in[present_bb])
+            out << "\tlw    s" << p.s_reg << ", " << anchor_save_offset +
+                (p.s_reg - 1) * 4 << "(sp)" << std::endl;
+    // ra is only clobbered on paths that went through a call
+    if (ra_saved)
+        out << "\tlw    ra, " << ra_offset << "(sp)" << std::endl;
+    if (instrument)instrument_exit();
+    if (count_edges && present_func == "main")profile_exit();
+    // the frame size is not known yet, the epilogue is filled in later
+    ret_points.push_back(out.tellp());
 }
 
 
@@ -298,7 +752,7 @@ Reg Visit(const koopa_raw_integer_t &integer)
     struct Reg result_var = {-1, -1};
     if (int_val == 0) { result_var.reg_name = 15; return result_var; }
     result_var.reg_name = find_reg(0);
-    std::cout << "\tli    " << reg_names[result_var.reg_name] << ", " <<
+    out << "\tli    " << reg_names[result_var.reg_name] << ", " <<
         int_val << std::endl;
     return result_var;
 }
@@ -325,85 +779,85 @@ Reg Visit(const koopa_raw_binary_t &binary)
     case 0:  // ne
         if (right_name == "x0")
         {
-            std::cout << "\tsnez  " << result_name << ", " << left_name <<
+            out << "\tsnez  " << result_name << ", " << left_name <<
                 std::endl;
             break;
         }
         if (left_name == "x0")
         {
-            std::cout << "\tsnez  " << result_name << ", " << right_name <<
+            out << "\tsnez  " << result_name << ", " << right_name <<
                 std::endl;
             break;
         }
-        std::cout << "\txor   " << result_name << ", " << left_name << ", " <<
+        out << "\txor   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
-        std::cout << "\tsnez  " << result_name << ", " << result_name <<
+        out << "\tsnez  " << result_name << ", " << result_name <<
             std::endl;
         break;
     case 1:  // eq
         if (right_name == "x0")
         {
-            std::cout << "\tseqz  " << result_name << ", " << left_name <<
+            out << "\tseqz  " << result_name << ", " << left_name <<
                 std::endl;
             break;
         }
         if (left_name == "x0")
         {
-            std::cout << "\tseqz  " << result_name << ", " << right_name <<
+            out << "\tseqz  " << result_name << ", " << right_name <<
                 std::endl;
             break;
         }
-        std::cout << "\txor   " << result_name << ", " << left_name << ", " <<
+        out << "\txor   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
-        std::cout << "\tseqz  " << result_name << ", " << result_name <<
+        out << "\tseqz  " << result_name << ", " << result_name <<
             std::endl;
         break;
     case 2:  // gt
-        std::cout << "\tsgt   " << result_name << ", " << left_name << ", " <<
+        out << "\tsgt   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 3:  // lt
-        std::cout << "\tslt   " << result_name << ", " << left_name << ", " <<
+        out << "\tslt   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 4:  // ge
-        std::cout << "\tslt   " << result_name << ", " << left_name << ", " <<
+        out << "\tslt   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
-        std::cout << "\txori  " << result_name << ", " << result_name << ", 1"
+        out << "\txori  " << result_name << ", " << result_name << ", 1"
             << std::endl;
         break;
     case 5:  // le
-        std::cout << "\tsgt   " << result_name << ", " << left_name << ", " <<
+        out << "\tsgt   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
-        std::cout << "\txori  " << result_name << ", " << result_name << ", 1"
+        out << "\txori  " << result_name << ", " << result_name << ", 1"
             << std::endl;
         break;
     case 6:  // add
-        std::cout << "\tadd   " << result_name << ", " << left_name << ", " <<
+        out << "\tadd   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 7:  // sub
-        std::cout << "\tsub   " << result_name << ", " << left_name << ", " <<
+        out << "\tsub   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 8:  // mul
-        std::cout << "\tmul   " << result_name << ", " << left_name << ", " <<
+        out << "\tmul   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 9:  // div
-        std::cout << "\tdiv   " << result_name << ", " << left_name << ", " <<
+        out << "\tdiv   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 10:  // mod
-        std::cout << "\trem   " << result_name << ", " << left_name << ", " <<
+        out << "\trem   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 11:  // and
-        std::cout << "\tand   " << result_name << ", " << left_name << ", " <<
+        out << "\tand   " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     case 12:  // or
-        std::cout << "\tor    " << result_name << ", " << left_name << ", " <<
+        out << "\tor    " << result_name << ", " << left_name << ", " <<
             right_name << std::endl;
         break;
     default:
@@ -418,12 +872,32 @@ Reg Visit(const koopa_raw_load_t &load)
     koopa_raw_value_t src = load.src;
     if (src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
     {
+        if (promoted.count(src))
+        {
+            Promotion &promotion = promotions[promoted[src]];
+            promotion.loaded.push_back(present_id);
+            return {15 + promotion.s_reg, -1};
+        }
+        if (global_cache.count(src) && in_register(global_cache[src]))
+        {
+            int cached_reg = value_reg(value_id(global_cache[src])).reg_name;
+            int old_stat = reg_stats[cached_reg];
+            reg_stats[cached_reg] = 2;
+            int reg_name = find_reg(1);
+            reg_stats[cached_reg] = old_stat;
+            out << "\tmv    " << reg_names[reg_name] << ", " <<
+                reg_names[cached_reg] << std::endl;
+            global_cache[src] = present_value;
+            return {reg_name, -1};
+        }
         int reg_name = find_reg(1);
         struct Reg result_var = {reg_name, -1};
-        std::cout << "\tla    " << reg_names[reg_name] << ", " <<
-            global_values[src] << std::endl;
-        std::cout << "\tlw    " << reg_names[reg_name] << ", 0(" <<
-            reg_names[reg_name] << ")" << std::endl;
+        out << "\tlui   " << reg_names[reg_name] << ", %hi(" <<
+            global_values->at(src) << ")" << std::endl;
+        out << "\tlw    " << reg_names[reg_name] << ", %lo(" <<
+            global_values->at(src) << ")(" << reg_names[reg_name] << ")" <<
+            std::endl;
+        if (!addressed_globals[src])global_cache[src] = present_value;
         return result_var;
     }
     else if (src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
@@ -432,24 +906,24 @@ Reg Visit(const koopa_raw_load_t &load)
         struct Reg result_var = {find_reg(2), -1};
         struct Reg src_var = Visit(load.src);
         reg_stats[result_var.reg_name] = 1;
-        std::cout << "\tlw    " << reg_names[result_var.reg_name] << ", (" <<
+        out << "\tlw    " << reg_names[result_var.reg_name] << ", (" <<
             reg_names[src_var.reg_name] << ")" << std::endl;
         return result_var;
     }
-    // we have to make sure one offset is at most loaded to one register
-    if (value_map[src].reg_name >= 0)return value_map[src];
-    int reg_name = find_reg(1), reg_offset = value_map[src].reg_offset;
-    struct Reg result_var = {reg_name, reg_offset};
-    if (reg_offset >= -2048 && reg_offset <= 2047)
-        std::cout << "\tlw    " << reg_names[reg_name] << ", " << reg_offset <<
-            "(sp)" << std::endl;
-    else
+    if (param_slots.count(src))
     {
-        std::cout << "\tli    s11, " << reg_offset << std::endl;
-        std::cout << "\tadd   s11, s11, sp" << std::endl;
-        std::cout << "\tlw    " << reg_names[reg_name] << ", (s11)" <<
-            std::endl;
+        ParamSlot &slot = param_slots[src];
+        slot.loaded.push_back(present_id);
+        return {slot.reg, -1};
     }
+    // we have to make sure one offset is at most loaded to one register
+    int src_id = value_id(src);
+    if (value_reg(src_id).reg_name >= 0)return value_regs[src_id];
+    int reg_name = find_reg(1), reg_offset = value_regs[src_id].reg_offset;
+    struct Reg result_var = {reg_name, reg_offset};
+    std::string base = stack_base(reg_offset);
+    out << "\tlw    " << reg_names[reg_name] << ", " << reg_offset <<
+        "(" << base << ")" << std::endl;
     return result_var;
 }
 
@@ -461,9 +935,26 @@ void Visit(const koopa_raw_store_t &store)
     assert(value.reg_name >= 0);
     if (dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
     {
-        std::cout << "\tla    s11, " << global_values[dest] << std::endl;
-        std::cout << "\tsw    " << reg_names[value.reg_name] << ", 0(s11)" <<
+        if (promoted.count(dest))
+        {
+            Promotion &promotion = promotions[promoted[dest]];
+            int s_reg = promotion.s_reg;
+            if (value.reg_name == 15 + s_reg)return;
+            int old_stat = reg_stats[value.reg_name];
+            reg_stats[value.reg_name] = 2;
+            move_loads_out(promotion.loaded, 15 + s_reg);
+            reg_stats[value.reg_name] = old_stat;
+            out << "\tmv    s" << s_reg << ", " <<
+                reg_names[value.reg_name] << std::endl;
+            return;
+        }
+        out << "\tlui   s11, %hi(" << global_values->at(dest) << ")" <<
             std::endl;
+        out << "\tsw    " << reg_names[value.reg_name] << ", %lo(" <<
+            global_values->at(dest) << ")(s11)" << std::endl;
+        if (in_register(store.value) && !addressed_globals[dest])
+            global_cache[dest] = store.value;
+        else global_cache.erase(dest);
         return;
     }
     else if (dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
@@ -474,56 +965,103 @@ void Visit(const koopa_raw_store_t &store)
         struct Reg dest_var = Visit(dest);
         assert(dest_var.reg_name >= 0);
         reg_stats[value.reg_name] = old_stat;
-        std::cout << "\tsw    " << reg_names[value.reg_name] << ", (" <<
+        out << "\tsw    " << reg_names[value.reg_name] << ", (" <<
             reg_names[dest_var.reg_name] << ")" << std::endl;
         return;
     }
-    assert(value_map.count(dest));
-    if (value_map[dest].reg_offset == -1)
+    if (param_slots.count(dest))
     {
-        value_map[dest].reg_offset = stack_top;
+        ParamSlot &slot = param_slots[dest];
+        if (value.reg_name == slot.reg)return;
+        int old_stat = reg_stats[value.reg_name];
+        reg_stats[value.reg_name] = 2;
+        move_loads_out(slot.loaded, slot.reg);
+        reg_stats[value.reg_name] = old_stat;
+        out << "\tmv    " << reg_names[slot.reg] << ", " <<
+            reg_names[value.reg_name] << std::endl;
+        return;
+    }
+    int dest_id = value_id(dest);
+    assert(value_seen[dest_id]);
+    if (value_regs[dest_id].reg_offset == -1)
+    {
+        value_regs[dest_id].reg_offset = stack_top;
         stack_top += 4;
     }
     else  // old register loaded from reg_offset is outdated ...
         for (int i = 0; i < 16; i++)
             if (i == value.reg_name)continue;
-            else if (reg_stats[i] > 0 && value_map[registers[i]].reg_offset ==
-                value_map[dest].reg_offset)
+            else if (reg_stats[i] > 0 && value_reg(registers[i]).reg_offset ==
+                value_regs[dest_id].reg_offset)
             {
-                reg_stats[i] = 0;  // ... so clear it and update value_map
-                value_map[registers[i]].reg_name = value.reg_name;
+                reg_stats[i] = 0;  // ... so clear it and update its value
+                value_regs[registers[i]].reg_name = value.reg_name;
             }
-    int reg_name = value.reg_name, reg_offset = value_map[dest].reg_offset;
-    if (reg_offset >= -2048 && reg_offset <= 2047)
-        std::cout << "\tsw    " << reg_names[reg_name] << ", " << reg_offset <<
-            "(sp)" << std::endl;
-    else
-    {
-        std::cout << "\tli    s11, " << reg_offset << std::endl;
-        std::cout << "\tadd   s11, s11, sp" << std::endl;
-        std::cout << "\tsw    " << reg_names[reg_name] << ", (s11)" <<
-            std::endl;
-    }
+    int reg_name = value.reg_name, reg_offset = value_regs[dest_id].reg_offset;
+    std::string base = stack_base(reg_offset);
+    out << "\tsw    " << reg_names[reg_name] << ", " << reg_offset <<
+        "(" << base << ")" << std::endl;
 }
 
 
 void Visit(const koopa_raw_branch_t &branch)
 {
-    std::string true_label = branch.true_bb->name + 1;
-    std::string false_label = branch.false_bb->name + 1;
+    std::string true_label = bb_label(branch.true_bb);
+    std::string false_label = bb_label(branch.false_bb);
     int cond_reg = Visit(branch.cond).reg_name;
     clear_registers(false);
-    std::cout << "\tbnez  " << reg_names[cond_reg] << ", " << true_label
-        << std::endl;
-    std::cout << "\tj     " << false_label << std::endl;
+    if (ra_saved && (!ra_saved_in[branch.true_bb] ||
+        !ra_saved_in[branch.false_bb]))
+        out << "\tlw    ra, " << ra_offset << "(sp)" << std::endl;
+    else if (!ra_saved && restore_ra && (ra_saved_in[branch.true_bb] ||
+        ra_saved_in[branch.false_bb]))
+        out << "\tsw    ra, " << ra_offset << "(sp)" << std::endl;
+    // code needed on only one edge goes between the branch and the jump
+    std::string true_code = edge_code(present_bb, branch.true_bb);
+    std::string false_code = edge_code(present_bb, branch.false_bb);
+    // with a profile the blocks are laid out for the hot edges to fall
+    // through to the next block
+    bool true_next = block_profile && branch.true_bb == next_bb;
+    bool false_next = block_profile && branch.false_bb == next_bb;
+    if (true_code.empty() && !(true_next && false_code.empty()))
+    {
+        out << "\tbnez  " << reg_names[cond_reg] << ", " << true_label
+            << std::endl;
+        out << false_code;
+        if (!false_next)out << "\tj     " << false_label << std::endl;
+    }
+    else if (false_code.empty())
+    {
+        out << "\tbeqz  " << reg_names[cond_reg] << ", " << false_label
+            << std::endl;
+        out << true_code;
+        if (!true_next)out << "\tj     " << true_label << std::endl;
+    }
+    else
+    {
+        std::string edge_label = bb_label(present_bb) + "_edge__" +
+            std::to_string(edge_num++);
+        out << "\tbnez  " << reg_names[cond_reg] << ", " << edge_label
+            << std::endl;
+        out << false_code << "\tj     " << false_label << std::endl;
+        out << edge_label << ":" << std::endl;
+        out << true_code;
+        if (!true_next)out << "\tj     " << true_label << std::endl;
+    }
 }
 
 
 void Visit(const koopa_raw_jump_t &jump)
 {
     clear_registers(false);
-    std::string target_label = jump.target->name + 1;
-    std::cout << "\tj     " << target_label << std::endl;
+    if (ra_saved && !ra_saved_in[jump.target])
+        out << "\tlw    ra, " << ra_offset << "(sp)" << std::endl;
+    else if (!ra_saved && restore_ra && ra_saved_in[jump.target])
+        out << "\tsw    ra, " << ra_offset << "(sp)" << std::endl;
+    std::string target_label = bb_label(jump.target);
+    out << edge_code(present_bb, jump.target);
+    if (!block_profile || jump.target != next_bb)
+        out << "\tj     " << target_label << std::endl;
 }
 
 
@@ -541,53 +1079,59 @@ Reg Visit(const koopa_raw_call_t &call)
         if (i < 8)
         {
             if (arg_var.reg_name != i + 7)
-                std::cout << "\tmv    " << reg_names[i + 7] << ", " <<
+                out << "\tmv    " << reg_names[i + 7] << ", " <<
                     reg_names[arg_var.reg_name] << std::endl;
             old_stats.push_back(reg_stats[i + 7]);
             reg_stats[i + 7] = 2;
         }
-        else if ((i - 8) * 4 >= -2048 && (i - 8) * 4 <= 2047)
-            std::cout << "\tsw    " << reg_names[arg_var.reg_name] << ", " <<
-                (i - 8) * 4 << "(sp)" << std::endl;
         else
         {
-            std::cout << "\tli    s11, " << (i - 8) * 4 << std::endl;
-            std::cout << "\tadd   s11, s11, sp" << std::endl;
-            std::cout << "\tsw    " << reg_names[arg_var.reg_name] << ", (s11)"
-                << std::endl;
+            int offset = (i - 8) * 4;
+            std::string base = stack_base(offset);
+            out << "\tsw    " << reg_names[arg_var.reg_name] << ", " <<
+                offset << "(" << base << ")" << std::endl;
         }
     }
     for (int i = 0; i < old_stats.size(); i++)reg_stats[i + 7] = old_stats[i];
-    std::cout << "\tcall  " << call.callee->name + 1 << std::endl;
+    if (!ra_saved)
+    {
+        out << "\tsw    ra, " << ra_offset << "(sp)" << std::endl;
+        ra_saved = true;
+    }
+    if (count_edges)
+        out << profile_counter(profile_call_id("@" + present_func,
+            present_bb->name, block_calls, call.callee->name));
+    block_calls++;
+    out << "\tcall  " << call.callee->name + 1 << std::endl;
     clear_registers(false);
+    global_cache.clear();  // the callee may have changed any global
     return result_var;
 }
 
 
-std::string Visit(const koopa_raw_global_alloc_t &global)
+void Visit(const koopa_raw_global_alloc_t &global, const std::string &name)
 {
-    std::string name = "var_" + std::to_string(global_num++);
-    std::cout << "\t.data" << std::endl;
-    std::cout << "\t.globl " << name << std::endl;
-    std::cout << name << ":" << std::endl;
+    bool zero = global.init->kind.tag == KOOPA_RVT_ZERO_INIT;
+    out << (zero ? "\t.bss" : "\t.data") << std::endl;
+    out << "\t.globl " << name << std::endl;
+    out << name << ":" << std::endl;
     switch (global.init->kind.tag)
     {
     case KOOPA_RVT_ZERO_INIT:
-        std::cout << "\t.zero " << cal_size(global.init->ty) << std::endl <<
+        out << "\t.zero " << cal_size(global.init->ty) << std::endl <<
             std::endl;
         break;
     case KOOPA_RVT_INTEGER:
-        std::cout << "\t.word " << global.init->kind.data.integer.value <<
+        out << "\t.word " << global.init->kind.data.integer.value <<
             std::endl << std::endl;
         break;
     case KOOPA_RVT_AGGREGATE:
         init_aggregate(global.init);
-        std::cout << std::endl;
+        out << std::endl;
         break;
     default:
         assert(false);
     }
-    return name;
 }
 
 
@@ -595,24 +1139,22 @@ Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
 {
     if (get_elem_ptr.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
     {
-        assert(global_values.count(get_elem_ptr.src));
+        assert(global_values->count(get_elem_ptr.src));
         struct Reg result_var = {find_reg(2), -1};
         koopa_raw_type_t arr = get_elem_ptr.src->ty->data.pointer.base;
-        int total_size = cal_size(arr), len = arr->data.array.len;
-        assert(total_size % len == 0);
-        int elem_size = total_size / len;
+        int elem_size = type_table[koopa_type(arr)].stride;
         struct Reg ind_var = Visit(get_elem_ptr.index);
         int ind_reg = ind_var.reg_name;
         reg_stats[result_var.reg_name] = 1;
-        std::cout << "\tla    " << reg_names[result_var.reg_name] << ", " <<
-            global_values[get_elem_ptr.src] << std::endl;
-        std::cout << "\tli    s11, " << elem_size << std::endl;
-        std::cout << "\tmul   s11, s11, " << reg_names[ind_reg] << std::endl;
-        std::cout << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
+        out << "\tla    " << reg_names[result_var.reg_name] << ", " <<
+            global_values->at(get_elem_ptr.src) << std::endl;
+        out << "\tli    s11, " << elem_size << std::endl;
+        out << "\tmul   s11, s11, " << reg_names[ind_reg] << std::endl;
+        out << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
             reg_names[result_var.reg_name] << ", s11" << std::endl;
         return result_var;
     }
-    struct Reg src_var = value_map[get_elem_ptr.src];
+    struct Reg src_var = value_reg(value_id(get_elem_ptr.src));
     koopa_raw_type_t arr = get_elem_ptr.src->ty->data.pointer.base;
     struct Reg result_var = {find_reg(2), -1};
     int src_reg, src_old_stat;
@@ -620,15 +1162,9 @@ Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
     {
         int offset = src_var.reg_offset;
         assert(offset >= 0);  // variables have positive offset
-        if (offset >= -2048 && offset <= 2047)
-            std::cout << "\taddi  " << reg_names[result_var.reg_name] <<
-                ", sp, " << offset << std::endl;
-        else
-        {
-            std::cout << "\tli    s11, " << offset << std::endl;
-            std::cout << "\tadd   " << reg_names[result_var.reg_name] <<
-                ", sp, s11" << std::endl;
-        }
+        std::string base = stack_base(offset);
+        out << "\taddi  " << reg_names[result_var.reg_name] << ", " <<
+            base << ", " << offset << std::endl;
     }
     else
     {
@@ -638,9 +1174,7 @@ Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
         src_old_stat = reg_stats[src_reg];
         reg_stats[src_reg] = 2;
     }
-    int total_size = cal_size(arr), len = arr->data.array.len;
-    assert(total_size % len == 0);
-    int elem_size = total_size / len;
+    int elem_size = type_table[koopa_type(arr)].stride;
     struct Reg ind_var = Visit(get_elem_ptr.index), tmp_var;
     if (elem_size != 0 && ind_var.reg_name != 15)
     {
@@ -649,21 +1183,21 @@ Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
         reg_stats[ind_reg] = 2;
         tmp_var = {find_reg(0), -1};
         reg_stats[ind_reg] = ind_old_stat;
-        std::cout << "\tli    " << reg_names[tmp_var.reg_name] << ", " <<
+        out << "\tli    " << reg_names[tmp_var.reg_name] << ", " <<
             elem_size << std::endl;
-        std::cout << "\tmul   " << reg_names[tmp_var.reg_name] << ", " <<
+        out << "\tmul   " << reg_names[tmp_var.reg_name] << ", " <<
             reg_names[tmp_var.reg_name] << ", " << reg_names[ind_reg] <<
             std::endl;
     }
     else tmp_var = {15, -1};
     reg_stats[result_var.reg_name] = 1;
     if (get_elem_ptr.src->name && get_elem_ptr.src->name[0] == '@')
-        std::cout << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
+        out << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
             reg_names[result_var.reg_name] << ", " <<
             reg_names[tmp_var.reg_name] << std::endl;
     else
     {
-        std::cout << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
+        out << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
             reg_names[src_reg] << ", " << reg_names[tmp_var.reg_name]
             << std::endl;
         reg_stats[src_reg] = src_old_stat;
@@ -674,7 +1208,7 @@ Reg Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
 
 Reg Visit(const koopa_raw_get_ptr_t &get_ptr)
 {
-    struct Reg src_var = value_map[get_ptr.src];
+    struct Reg src_var = value_reg(value_id(get_ptr.src));
     koopa_raw_type_t arr = get_ptr.src->ty->data.pointer.base;
     struct Reg result_var = {find_reg(2), -1};
     int elem_size = cal_size(arr);
@@ -686,27 +1220,1032 @@ Reg Visit(const koopa_raw_get_ptr_t &get_ptr)
         reg_stats[ind_reg] = 2;
         tmp_var = {find_reg(0), -1};
         reg_stats[ind_reg] = ind_old_stat;
-        std::cout << "\tli    " << reg_names[tmp_var.reg_name] << ", " <<
+        out << "\tli    " << reg_names[tmp_var.reg_name] << ", " <<
             elem_size << std::endl;
-        std::cout << "\tmul   " << reg_names[tmp_var.reg_name] << ", " <<
+        out << "\tmul   " << reg_names[tmp_var.reg_name] << ", " <<
             reg_names[tmp_var.reg_name] << ", " << reg_names[ind_reg] <<
             std::endl;
     }
     else tmp_var = {15, -1};
     reg_stats[result_var.reg_name] = 1;
-    std::cout << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
+    out << "\tadd   " << reg_names[result_var.reg_name] << ", " <<
         reg_names[src_var.reg_name] << ", " <<
         reg_names[tmp_var.reg_name] << std::endl;
     return result_var;
 }
 
 
+void build_cfg(const koopa_raw_function_t &func)
+{
+    koopa_raw_basic_block_t entry =
+        reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb =
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            koopa_raw_value_t inst =
+                reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (inst->kind.tag == KOOPA_RVT_CALL)bb_has_call[bb] = true;
+            else if (inst->kind.tag == KOOPA_RVT_BRANCH)
+            {
+                bb_succs[bb].push_back(inst->kind.data.branch.true_bb);
+                bb_succs[bb].push_back(inst->kind.data.branch.false_bb);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_JUMP)
+                bb_succs[bb].push_back(inst->kind.data.jump.target);
+            else if (inst->kind.tag == KOOPA_RVT_GET_PTR)
+                addressed_globals[inst->kind.data.get_ptr.src] = true;
+        }
+        for (auto succ : bb_succs[bb])bb_preds[succ].push_back(bb);
+    }
+    // every back edge bb -> header adds its natural loop to that of header
+    std::map<koopa_raw_basic_block_t, int> dfs_state;  // 1: on stack, 2: done
+    std::vector<std::pair<koopa_raw_basic_block_t, size_t>> dfs_stack;
+    dfs_stack.push_back({entry, 0});
+    dfs_state[entry] = 1;
+    while (!dfs_stack.empty())
+    {
+        koopa_raw_basic_block_t bb = dfs_stack.back().first;
+        size_t next = dfs_stack.back().second++;
+        if (next == bb_succs[bb].size())
+        {
+            dfs_state[bb] = 2;
+            dfs_stack.pop_back();
+            continue;
+        }
+        koopa_raw_basic_block_t header = bb_succs[bb][next];
+        if (dfs_state[header] == 0)
+        {
+            dfs_state[header] = 1;
+            dfs_stack.push_back({header, 0});
+            continue;
+        }
+        if (dfs_state[header] == 2)continue;
+        std::map<koopa_raw_basic_block_t, bool> &in_loop = loops[header];
+        std::vector<koopa_raw_basic_block_t> work = {bb};
+        in_loop[header] = true;
+        while (!work.empty())
+        {
+            koopa_raw_basic_block_t body = work.back();
+            work.pop_back();
+            if (in_loop.count(body))continue;
+            in_loop[body] = true;
+            for (auto pred : bb_preds[body])work.push_back(pred);
+        }
+    }
+}
+
+
+void shrink_wrap_ra(const koopa_raw_function_t &func)
+{
+    // ra_saved_in[bb]: ra is stored on every path reaching bb; blocks where
+    // this does not hold get ra back in the register on their incoming edges
+    // (see Visit(branch) and Visit(jump)), so it can still be stored there
+    std::map<koopa_raw_basic_block_t, bool> save_at_end;
+    koopa_raw_basic_block_t entry =
+        reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb =
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        ra_saved_in[bb] = bb != entry;
+    }
+    // don't save inside a loop that calls: store ra on the edges entering it
+    for (auto &loop : loops)
+    {
+        bool loop_calls = false;
+        for (auto &block : loop.second)
+            if (bb_has_call[block.first])loop_calls = true;
+        if (loop_calls)
+            for (auto pred : bb_preds[loop.first])
+                if (!loop.second.count(pred))save_at_end[pred] = true;
+    }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            koopa_raw_basic_block_t bb =
+                reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+            if (bb == entry)continue;
+            bool saved = true;
+            for (auto pred : bb_preds[bb])
+                saved = saved && (ra_saved_in[pred] || bb_has_call[pred] ||
+                    save_at_end[pred]);
+            if (saved != ra_saved_in[bb])
+            {
+                ra_saved_in[bb] = saved;
+                changed = true;
+            }
+        }
+    }
+}
+
+
+void promote_globals(const koopa_raw_function_t &func, int first_reg)
+{
+    // headers in block order, outer loops first, so that a global gets one
+    // register over the largest loop without calls it is used in
+    std::vector<koopa_raw_basic_block_t> headers;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t bb =
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        if (loops.count(bb))headers.push_back(bb);
+    }
+    std::stable_sort(headers.begin(), headers.end(),
+        [](koopa_raw_basic_block_t a, koopa_raw_basic_block_t b)
+        { return loops[a].size() > loops[b].size(); });
+    // with a profile the hottest loops come first instead, and loops that
+    // don't repeat are left out: they would only get the loads and stores on
+    // their edges
+    if (!bb_counts.empty())
+        std::stable_sort(headers.begin(), headers.end(),
+            [](koopa_raw_basic_block_t a, koopa_raw_basic_block_t b)
+            { return bb_counts[a] > bb_counts[b]; });
+    for (auto header : headers)
+    {
+        std::map<koopa_raw_basic_block_t, bool> &body = loops[header];
+        bool loop_calls = false;
+        for (auto &block : body)
+            if (bb_has_call[block.first])loop_calls = true;
+        if (loop_calls)continue;
+        if (!bb_counts.empty())
+        {
+            long entries = 0;
+            for (auto pred : bb_preds[header])
+                if (!body.count(pred))entries += edge_counts[{pred, header}];
+            if (bb_counts[header] <= entries)continue;
+        }
+        size_t first = promotions.size();
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            koopa_raw_basic_block_t bb =
+                reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+            if (!body.count(bb))continue;
+            for (size_t j = 0; j < bb->insts.len; j++)
+            {
+                koopa_raw_value_t inst =
+                    reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+                koopa_raw_value_t global = 0;
+                if (inst->kind.tag == KOOPA_RVT_LOAD)
+                    global = inst->kind.data.load.src;
+                else if (inst->kind.tag == KOOPA_RVT_STORE)
+                    global = inst->kind.data.store.dest;
+                if (!global || global->kind.tag != KOOPA_RVT_GLOBAL_ALLOC ||
+                    addressed_globals[global])continue;
+                // an inner loop may have the global already (hot loops first)
+                size_t k = 0;
+                bool inner = false;
+                for (; k < promotions.size(); k++)
+                    if (promotions[k].global == global)
+                    {
+                        if (promotions[k].blocks.count(header))break;
+                        for (auto &block : promotions[k].blocks)
+                            inner = inner || body.count(block.first);
+                    }
+                if (k == promotions.size())
+                {
+                    if (inner)continue;
+                    if (first_reg + (int)k > 10)continue;  // out of registers
+                    promotions.push_back({global, first_reg + (int)k, false,
+                        body});
+                }
+                if (inst->kind.tag == KOOPA_RVT_STORE && k >= first)
+                    promotions[k].dirty = true;
+            }
+        }
+    }
+}
+
+
+// finds the param_slots of a leaf function and holds their registers; the
+// store of the param must come before any other store to its variable
+void pin_params(const koopa_raw_function_t &func)
+{
+    std::map<koopa_raw_value_t, int> uses;
+    std::map<koopa_raw_value_t, bool> stored, escaped;
+    std::map<koopa_raw_value_t, koopa_raw_value_t> param_of;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+            func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(
+                bb->insts.buffer[j]);
+            each_operand(inst, [&](koopa_raw_value_t operand)
+            {
+                uses[operand]++;
+            });
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                auto value = inst->kind.data.store.value;
+                auto dest = inst->kind.data.store.dest;
+                escaped[value] = true;
+                if (i == 0 && value->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+                    !stored[dest] && !param_of.count(dest))
+                    param_of[dest] = value;
+                stored[dest] = true;
+            }
+            else if (inst->kind.tag != KOOPA_RVT_LOAD)
+                each_operand(inst, [&](koopa_raw_value_t operand)
+                {
+                    escaped[operand] = true;
+                });
+        }
+    }
+    for (size_t i = 0; i < func->params.len && i < 8; i++)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(
+            func->params.buffer[i]);
+        for (auto &slot : param_of)
+            if (slot.second == param && uses[param] == 1 &&
+                slot.first->kind.tag == KOOPA_RVT_ALLOC &&
+                slot.first->ty->data.pointer.base->tag == KOOPA_RTT_INT32 &&
+                !escaped[slot.first])
+            {
+                param_slots[slot.first] = {static_cast<int>(i + 7), {}};
+                registers[i + 7] = value_id(param);
+                reg_stats[i + 7] = 3;
+            }
+    }
+}
+
+
+// before the register holding a variable gets a new value, moves the loads
+// of it that are still used to registers of their own
+void move_loads_out(std::vector<int> &loaded, int reg)
+{
+    for (int value : loaded)
+        if (value_last_use[value] > present_id &&
+            value_regs[value].reg_name == reg)
+        {
+            int reg_name = find_reg(1);
+            registers[reg_name] = value;
+            value_regs[value].reg_name = reg_name;
+            out << "\tmv    " << reg_names[reg_name] << ", " <<
+                reg_names[reg] << std::endl;
+        }
+    loaded.clear();
+}
+
+
+// how often code in bb runs: its count with a profile, otherwise 8 times for
+// each loop around it
+long block_weight(koopa_raw_basic_block_t bb)
+{
+    if (!bb_counts.empty())return bb_counts[bb];
+    int depth = 0;
+    for (auto &loop : loops)depth += loop.second.count(bb);
+    return 1L << 3 * std::min(depth, 10);
+}
+
+
+// the s registers go to the far arrays, which get an anchor at their base
+// (arrays close to one share it), and to the promotions of promote_globals,
+// those used most first. Anchors take s1 up, the promotions kept follow; the
+// number of registers taken is returned, the arrays are laid out from
+// far_base in the order of the IR as Visit(value) does
+int choose_s_regs(const koopa_raw_function_t &func, int far_base)
+{
+    std::map<koopa_raw_value_t, long> array_uses;
+    std::vector<std::pair<koopa_raw_value_t, int>> arrays;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+            func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(
+                bb->insts.buffer[j]);
+            if (inst->kind.tag == KOOPA_RVT_ALLOC &&
+                inst->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY)
+            {
+                arrays.push_back({inst, far_base});
+                far_base += cal_size(inst->ty->data.pointer.base);
+            }
+            each_operand(inst, [&](koopa_raw_value_t operand)
+            {
+                if (operand->kind.tag == KOOPA_RVT_ALLOC)
+                    array_uses[operand] += block_weight(bb);
+            });
+        }
+    }
+    // weight, the offset of an anchor or -1 - the index of a promotion
+    std::vector<std::pair<long, int>> wanted;
+    std::stable_sort(arrays.begin(), arrays.end(),
+        [&](const std::pair<koopa_raw_value_t, int> &a,
+            const std::pair<koopa_raw_value_t, int> &b)
+        { return array_uses[a.first] > array_uses[b.first]; });
+    for (auto &array : arrays)
+    {
+        if (array.second <= 2047 || !array_uses[array.first])continue;
+        size_t k = 0;
+        while (k < wanted.size() && (array.second - wanted[k].second < -2048 ||
+            array.second - wanted[k].second > 2047))k++;
+        if (k == wanted.size())wanted.push_back({0, array.second});
+        wanted[k].first += array_uses[array.first];
+    }
+    for (size_t k = 0; k < promotions.size(); k++)
+    {
+        long uses = 0;
+        for (auto &block : promotions[k].blocks)
+            for (size_t j = 0; j < block.first->insts.len; j++)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(
+                    block.first->insts.buffer[j]);
+                if ((inst->kind.tag == KOOPA_RVT_LOAD &&
+                    inst->kind.data.load.src == promotions[k].global) ||
+                    (inst->kind.tag == KOOPA_RVT_STORE &&
+                    inst->kind.data.store.dest == promotions[k].global))
+                    uses += block_weight(block.first);
+            }
+        wanted.push_back({uses, -1 - (int)k});
+    }
+    std::stable_sort(wanted.begin(), wanted.end(),
+        [](const std::pair<long, int> &a, const std::pair<long, int> &b)
+        { return a.first > b.first; });
+    if (wanted.size() > 10)wanted.resize(10);
+    int s_reg = 1;
+    std::vector<bool> kept(promotions.size());
+    for (auto &want : wanted)
+        if (want.second >= 0)anchors.push_back({want.second, s_reg++, false});
+        else kept[-1 - want.second] = true;
+    std::vector<Promotion> chosen;
+    for (size_t k = 0; k < promotions.size(); k++)
+        if (kept[k])chosen.push_back(promotions[k]);
+    promotions.swap(chosen);
+    for (auto &promotion : promotions)promotion.s_reg = s_reg++;
+    next_anchor_reg = s_reg;
+    return s_reg - 1;
+}
+
+
+// the s register of a promotion is saved as ra is (see shrink_wrap_ra): on
+// the edges entering the outermost loop around that of the promotion, and
+// restored on the edges to blocks not reached only through them and at the
+// returns after them, so paths that never enter the loop don't pay for it
+void save_s_regs(const koopa_raw_function_t &func)
+{
+    koopa_raw_basic_block_t entry =
+        reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+    for (auto &p : promotions)
+    {
+        const std::map<koopa_raw_basic_block_t, bool> *region = &p.blocks;
+        for (auto &loop : loops)
+            if (loop.second.count(p.blocks.begin()->first) &&
+                loop.second.size() > region->size())
+                region = &loop.second;
+        for (size_t i = 0; i < func->bbs.len; i++)
+            p.saved_in[reinterpret_cast<koopa_raw_basic_block_t>(
+                func->bbs.buffer[i])] = i > 0;
+        // a loop through the entry block has it saved in the prologue
+        if (region->count(entry))
+        {
+            for (auto &saved : p.saved_in)saved.second = true;
+            continue;
+        }
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (size_t i = 0; i < func->bbs.len; i++)
+            {
+                auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+                    func->bbs.buffer[i]);
+                if (bb == entry || region->count(bb))continue;
+                bool saved = !bb_preds[bb].empty();
+                for (auto pred : bb_preds[bb])
+                    saved = saved && p.saved_in[pred];
+                if (saved != p.saved_in[bb])
+                {
+                    p.saved_in[bb] = saved;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+
+// blocks in the order they are emitted: that of the IR, or with a profile
+// of the function, chains of hot edges. A block is followed by its hottest
+// successor not placed yet, or if no edge out of it was taken, by the hottest
+// block not placed yet, so blocks that never ran end up last
+void lay_out_blocks(const koopa_raw_function_t &func)
+{
+    for (size_t i = 0; i < func->bbs.len; i++)
+        bb_order.push_back(
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+    long calls = block_profile ?
+        block_profile->count(profile_func_id(func->name)) : 0;
+    if (calls == 0)return;
+    bb_counts[bb_order[0]] = calls;
+    for (auto bb : bb_order)
+        for (auto succ : bb_succs[bb])
+            if (!edge_counts.count({bb, succ}))
+            {
+                long count = block_profile->count(profile_edge_id(func->name,
+                    bb->name, succ->name));
+                edge_counts[{bb, succ}] = count;
+                bb_counts[succ] += count;
+            }
+    std::vector<koopa_raw_basic_block_t> blocks;
+    blocks.swap(bb_order);
+    std::map<koopa_raw_basic_block_t, bool> placed;
+    koopa_raw_basic_block_t bb = blocks[0];
+    while (bb)
+    {
+        bb_order.push_back(bb);
+        placed[bb] = true;
+        koopa_raw_basic_block_t next = 0;
+        long best = 0;
+        for (auto succ : bb_succs[bb])
+            if (!placed[succ] && edge_counts[{bb, succ}] > best)
+            {
+                next = succ;
+                best = edge_counts[{bb, succ}];
+            }
+        if (!next)
+        {
+            best = -1;
+            for (auto block : blocks)
+                if (!placed[block] && bb_counts[block] > best)
+                {
+                    next = block;
+                    best = bb_counts[block];
+                }
+        }
+        bb = next;
+    }
+}
+
+
+std::string edge_code(koopa_raw_basic_block_t from,
+    koopa_raw_basic_block_t to)
+{
+    std::stringstream code;
+    for (auto &p : promotions)
+        if (p.dirty && p.blocks.count(from) && !p.blocks.count(to))
+        {
+            code << "\tlui   s11, %hi(" << global_values->at(p.global) << ")" <<
+                std::endl;
+            code << "\tsw    s" << p.s_reg << ", %lo(" <<
+                global_values->at(p.global) << ")(s11)" << std::endl;
+        }
+    for (auto &p : promotions)
+        if (p.saved_in[from] != p.saved_in[to])
+            code << (p.saved_in[to] ? "\tsw    s" : "\tlw    s") <<
+                p.s_reg << ", " << anchor_save_offset + (p.s_reg - 1) * 4 <<
+                "(sp)" << std::endl;
+    for (auto &p : promotions)
+        if (!p.blocks.count(from) && p.blocks.count(to))
+        {
+            code << "\tlui   s" << p.s_reg << ", %hi(" <<
+                global_values->at(p.global) << ")" << std::endl;
+            code << "\tlw    s" << p.s_reg << ", %lo(" <<
+                global_values->at(p.global) << ")(s" << p.s_reg << ")" <<
+                std::endl;
+        }
+    if (count_edges)
+        code << profile_counter(profile_edge_id("@" + present_func,
+            from->name, to->name));
+    return code.str();
+}
+
+
+// adds one to a new counter of the table of the present function; the code
+// goes where the temporaries are free (on edges, before calls), it uses t0
+// and s11
+std::string profile_counter(const std::string &id)
+{
+    int offset = 8 + profile_ids.size() * 4;
+    profile_ids.push_back(id);
+    std::stringstream code;
+    code << "\tla    s11, __sysy_prof_" << present_func << std::endl;
+    if (offset >= 2048)
+    {
+        code << "\tli    t0, " << offset << std::endl;
+        code << "\tadd   s11, s11, t0" << std::endl;
+        offset = 0;
+    }
+    code << "\tlw    t0, " << offset << "(s11)" << std::endl;
+    code << "\taddi  t0, t0, 1" << std::endl;
+    code << "\tsw    t0, " << offset << "(s11)" << std::endl;
+    return code.str();
+}
+
+
+// right after the counter of the calls: the first call puts the table in
+// front of __sysy_prof.tables, for profile_support to find
+void profile_link()
+{
+    std::string listed = ".L" + present_func + ".listed";
+    out << "\taddi  t0, t0, -1" << std::endl;
+    out << "\tbnez  t0, " << listed << std::endl;
+    out << "\tla    t0, __sysy_prof.tables" << std::endl;
+    out << "\tlw    t1, 0(t0)" << std::endl;
+    out << "\tsw    t1, 0(s11)" << std::endl;
+    out << "\tsw    s11, 0(t0)" << std::endl;
+    out << listed << ":" << std::endl;
+}
+
+
+// at a return of main, once a0 is set: writes the counts out
+void profile_exit()
+{
+    out << "\taddi  sp, sp, -16" << std::endl;
+    out << "\tsw    ra, 0(sp)" << std::endl;
+    out << "\tsw    a0, 4(sp)" << std::endl;
+    out << "\tcall  __sysy_prof.write" << std::endl;
+    out << "\tlw    a0, 4(sp)" << std::endl;
+    out << "\tlw    ra, 0(sp)" << std::endl;
+    out << "\taddi  sp, sp, 16" << std::endl;
+}
+
+
+// printed after main: the list of the tables that were called, the file name
+// and __sysy_prof.write, which appends "<id> <count>" lines for the counters
+// of the list to the file (openat, write and close system calls, no library),
+// so that the counts of several runs add up under -fprofile-use. The names
+// have a '.' to stay clear of the tables of functions
+std::string profile_support()
+{
+    return
+        "\t.data\n"
+        "\t.align 2\n"
+        "__sysy_prof.tables:\n"
+        "\t.word 0\n"
+        "__sysy_prof.path:\n"
+        "\t.asciz \"" + profile_path + "\"\n"
+        "\t.text\n"
+        "\t.globl __sysy_prof.write\n"
+        "__sysy_prof.write:\n"
+        "\taddi  sp, sp, -48\n"
+        "\tsw    ra, 44(sp)\n"
+        "\tsw    s1, 40(sp)\n"
+        "\tsw    s2, 36(sp)\n"
+        "\tsw    s3, 32(sp)\n"
+        "\tsw    s4, 28(sp)\n"
+        "\tsw    s5, 24(sp)\n"
+        // openat(AT_FDCWD, path, O_WRONLY | O_CREAT | O_APPEND, 0644)
+        "\tli    a0, -100\n"
+        "\tla    a1, __sysy_prof.path\n"
+        "\tli    a2, 1089\n"
+        "\tli    a3, 420\n"
+        "\tli    a7, 56\n"
+        "\tecall\n"
+        "\tbltz  a0, .L__sysy_prof.write.end\n"
+        "\tmv    s5, a0\n"
+        "\tla    s1, __sysy_prof.tables\n"
+        "\tlw    s1, 0(s1)\n"
+        // s1 the table, s2 the counters left, s3 the counter, s4 its id
+        ".L__sysy_prof.write.table:\n"
+        "\tbeqz  s1, .L__sysy_prof.write.close\n"
+        "\tlw    s2, 4(s1)\n"
+        "\taddi  s3, s1, 8\n"
+        "\tslli  s4, s2, 2\n"
+        "\tadd   s4, s4, s3\n"
+        ".L__sysy_prof.write.counter:\n"
+        "\tbeqz  s2, .L__sysy_prof.write.next\n"
+        "\tmv    a1, s4\n"
+        ".L__sysy_prof.write.scan:\n"
+        "\tlbu   t0, 0(s4)\n"
+        "\taddi  s4, s4, 1\n"
+        "\tbnez  t0, .L__sysy_prof.write.scan\n"
+        "\tsub   a2, s4, a1\n"
+        "\taddi  a2, a2, -1\n"
+        "\tmv    a0, s5\n"
+        "\tli    a7, 64\n"
+        "\tecall\n"
+        // " <count>\n", put together backwards below sp + 16
+        "\tlw    t0, 0(s3)\n"
+        "\tli    t2, 10\n"
+        "\taddi  t1, sp, 15\n"
+        "\tsb    t2, 0(t1)\n"
+        ".L__sysy_prof.write.digit:\n"
+        "\tremu  t3, t0, t2\n"
+        "\tdivu  t0, t0, t2\n"
+        "\taddi  t3, t3, 48\n"
+        "\taddi  t1, t1, -1\n"
+        "\tsb    t3, 0(t1)\n"
+        "\tbnez  t0, .L__sysy_prof.write.digit\n"
+        "\tli    t3, 32\n"
+        "\taddi  t1, t1, -1\n"
+        "\tsb    t3, 0(t1)\n"
+        "\tmv    a0, s5\n"
+        "\tmv    a1, t1\n"
+        "\taddi  a2, sp, 16\n"
+        "\tsub   a2, a2, t1\n"
+        "\tli    a7, 64\n"
+        "\tecall\n"
+        "\taddi  s3, s3, 4\n"
+        "\taddi  s2, s2, -1\n"
+        "\tj     .L__sysy_prof.write.counter\n"
+        ".L__sysy_prof.write.next:\n"
+        "\tlw    s1, 0(s1)\n"
+        "\tj     .L__sysy_prof.write.table\n"
+        ".L__sysy_prof.write.close:\n"
+        "\tmv    a0, s5\n"
+        "\tli    a7, 57\n"
+        "\tecall\n"
+        ".L__sysy_prof.write.end:\n"
+        "\tlw    s5, 24(sp)\n"
+        "\tlw    s4, 28(sp)\n"
+        "\tlw    s3, 32(sp)\n"
+        "\tlw    s2, 36(sp)\n"
+        "\tlw    s1, 40(sp)\n"
+        "\tlw    ra, 44(sp)\n"
+        "\taddi  sp, sp, 48\n"
+        "\tret\n";
+}
+
+
+// on entry, where only the arguments are live: keeps rdcycle, rdinstret and
+// the callee time of the caller in the frame and restarts the latter; the
+// first call links the record of the function into __sysy_prof_list
+void instrument_entry()
+{
+    out << "\trdcycle t0" << std::endl;
+    out << "\trdinstret t1" << std::endl;
+    out << "\tla    s11, __sysy_prof_child" << std::endl;
+    out << "\tlw    t2, 0(s11)" << std::endl;
+    out << "\tlw    t3, 4(s11)" << std::endl;
+    out << "\tsw    zero, 0(s11)" << std::endl;
+    out << "\tsw    zero, 4(s11)" << std::endl;
+    for (int i = 0; i < 4; i++)
+    {
+        int offset = instrument_offset + i * 4;
+        std::string base = stack_base(offset);
+        out << "\tsw    t" << i << ", " << offset << "(" << base << ")" <<
+            std::endl;
+    }
+    std::string linked = ".L" + present_func + ".linked";
+    out << "\tla    s11, __sysy_fn_" << present_func << std::endl;
+    out << "\tlw    t0, 0(s11)" << std::endl;
+    out << "\taddi  t1, t0, 1" << std::endl;
+    out << "\tsw    t1, 0(s11)" << std::endl;
+    out << "\tbnez  t0, " << linked << std::endl;
+    out << "\tla    t0, __sysy_prof_list" << std::endl;
+    out << "\tlw    t1, 0(t0)" << std::endl;
+    out << "\tsw    t1, 36(s11)" << std::endl;
+    out << "\tsw    s11, 0(t0)" << std::endl;
+    out << linked << ":" << std::endl;
+}
+
+
+// at a return, once a0 is set: adds the time since the entry to the record,
+// less the time in callees for the self counts, and to the callee time of the
+// caller. Times of a single call are 32 bits, the sums 64. Main then prints
+// the records
+void instrument_exit()
+{
+    out << "\trdcycle t0" << std::endl;
+    out << "\trdinstret t1" << std::endl;
+    for (int i = 0; i < 4; i++)
+    {
+        int offset = instrument_offset + i * 4;
+        std::string base = stack_base(offset);
+        out << "\tlw    t" << i + 2 << ", " << offset << "(" << base << ")" <<
+            std::endl;
+    }
+    out << "\tsub   t0, t0, t2" << std::endl;
+    out << "\tsub   t1, t1, t3" << std::endl;
+    out << "\tla    s11, __sysy_prof_child" << std::endl;
+    out << "\tlw    t2, 0(s11)" << std::endl;
+    out << "\tsub   t2, t0, t2" << std::endl;
+    out << "\tlw    t3, 4(s11)" << std::endl;
+    out << "\tsub   t3, t1, t3" << std::endl;
+    out << "\tadd   t4, t4, t0" << std::endl;
+    out << "\tsw    t4, 0(s11)" << std::endl;
+    out << "\tadd   t5, t5, t1" << std::endl;
+    out << "\tsw    t5, 4(s11)" << std::endl;
+    out << "\tla    s11, __sysy_fn_" << present_func << std::endl;
+    for (int i = 0; i < 4; i++)
+    {
+        // the low word wrapped if it ends up below what was added
+        int offset = 4 + i * 8;
+        out << "\tlw    t4, " << offset << "(s11)" << std::endl;
+        out << "\tadd   t4, t4, t" << i << std::endl;
+        out << "\tsw    t4, " << offset << "(s11)" << std::endl;
+        out << "\tsltu  t4, t4, t" << i << std::endl;
+        out << "\tlw    t5, " << offset + 4 << "(s11)" << std::endl;
+        out << "\tadd   t5, t5, t4" << std::endl;
+        out << "\tsw    t5, " << offset + 4 << "(s11)" << std::endl;
+    }
+    if (present_func != "main")return;
+    out << "\taddi  sp, sp, -16" << std::endl;
+    out << "\tsw    ra, 0(sp)" << std::endl;
+    out << "\tsw    a0, 4(sp)" << std::endl;
+    out << "\tcall  __sysy_prof_dump" << std::endl;
+    out << "\tlw    a0, 4(sp)" << std::endl;
+    out << "\tlw    ra, 0(sp)" << std::endl;
+    out << "\taddi  sp, sp, 16" << std::endl;
+}
+
+
+// what the records need once, printed after main: the list of the records,
+// the callee time of the running function and __sysy_prof_dump, which writes
+// a line per record to stderr with the write system call, so that no library
+// is needed (numbers in decimal, 64 bits divided by 10 in 16 bit steps)
+std::string instrument_support()
+{
+    return
+        "\t.data\n"
+        "\t.align 2\n"
+        "__sysy_prof_list:\n"
+        "\t.word 0\n"
+        "__sysy_prof_child:\n"
+        "\t.word 0, 0\n"
+        "__sysy_prof_title:\n"
+        "\t.asciz \"function calls cycles instret self_cycles self_instret\"\n"
+        "\t.bss\n"
+        "\t.align 2\n"
+        "__sysy_prof_buf:\n"
+        "\t.zero 128\n"
+        "\t.text\n"
+        "\t.globl __sysy_prof_dump\n"
+        "__sysy_prof_dump:\n"
+        "\taddi  sp, sp, -16\n"
+        "\tsw    ra, 12(sp)\n"
+        "\tsw    s1, 8(sp)\n"
+        "\tla    a0, __sysy_prof_title\n"
+        "\tcall  __sysy_prof_puts\n"
+        "\tla    a1, __sysy_prof_buf\n"
+        "\tcall  __sysy_prof_line\n"
+        "\tla    s1, __sysy_prof_list\n"
+        "\tlw    s1, 0(s1)\n"
+        ".L__sysy_prof_dump.next:\n"
+        "\tbeqz  s1, .L__sysy_prof_dump.end\n"
+        "\taddi  a0, s1, 40\n"
+        "\tcall  __sysy_prof_puts\n"
+        "\tla    a1, __sysy_prof_buf\n"
+        "\tlw    a2, 0(s1)\n"
+        "\tli    a3, 0\n"
+        "\tcall  __sysy_prof_number\n"
+        "\tlw    a2, 4(s1)\n"
+        "\tlw    a3, 8(s1)\n"
+        "\tcall  __sysy_prof_number\n"
+        "\tlw    a2, 12(s1)\n"
+        "\tlw    a3, 16(s1)\n"
+        "\tcall  __sysy_prof_number\n"
+        "\tlw    a2, 20(s1)\n"
+        "\tlw    a3, 24(s1)\n"
+        "\tcall  __sysy_prof_number\n"
+        "\tlw    a2, 28(s1)\n"
+        "\tlw    a3, 32(s1)\n"
+        "\tcall  __sysy_prof_number\n"
+        "\tcall  __sysy_prof_line\n"
+        "\tlw    s1, 36(s1)\n"
+        "\tj     .L__sysy_prof_dump.next\n"
+        ".L__sysy_prof_dump.end:\n"
+        "\tlw    s1, 8(sp)\n"
+        "\tlw    ra, 12(sp)\n"
+        "\taddi  sp, sp, 16\n"
+        "\tret\n"
+        // writes the string at a0
+        "__sysy_prof_puts:\n"
+        "\tmv    a1, a0\n"
+        ".L__sysy_prof_puts.scan:\n"
+        "\tlbu   t0, 0(a0)\n"
+        "\tbeqz  t0, .L__sysy_prof_puts.end\n"
+        "\taddi  a0, a0, 1\n"
+        "\tj     .L__sysy_prof_puts.scan\n"
+        ".L__sysy_prof_puts.end:\n"
+        "\tsub   a2, a0, a1\n"
+        "\tli    a0, 2\n"
+        "\tli    a7, 64\n"
+        "\tecall\n"
+        "\tret\n"
+        // puts " " and a3:a2 in decimal at a1, which is moved past them
+        "__sysy_prof_number:\n"
+        "\tli    t0, 32\n"
+        "\tsb    t0, 0(a1)\n"
+        "\taddi  a1, a1, 1\n"
+        "\taddi  sp, sp, -32\n"
+        "\taddi  t1, sp, 32\n"
+        "\tli    t2, 10\n"
+        ".L__sysy_prof_number.digit:\n"
+        "\tremu  t3, a3, t2\n"
+        "\tdivu  a3, a3, t2\n"
+        "\tslli  t3, t3, 16\n"
+        "\tsrli  t4, a2, 16\n"
+        "\tor    t4, t4, t3\n"
+        "\tremu  t3, t4, t2\n"
+        "\tdivu  t4, t4, t2\n"
+        "\tslli  t3, t3, 16\n"
+        "\tslli  t5, a2, 16\n"
+        "\tsrli  t5, t5, 16\n"
+        "\tor    t5, t5, t3\n"
+        "\tremu  t3, t5, t2\n"
+        "\tdivu  t5, t5, t2\n"
+        "\tslli  t4, t4, 16\n"
+        "\tor    a2, t4, t5\n"
+        "\taddi  t3, t3, 48\n"
+        "\taddi  t1, t1, -1\n"
+        "\tsb    t3, 0(t1)\n"
+        "\tor    t3, a2, a3\n"
+        "\tbnez  t3, .L__sysy_prof_number.digit\n"
+        "\taddi  t0, sp, 32\n"
+        ".L__sysy_prof_number.copy:\n"
+        "\tlbu   t3, 0(t1)\n"
+        "\tsb    t3, 0(a1)\n"
+        "\taddi  a1, a1, 1\n"
+        "\taddi  t1, t1, 1\n"
+        "\tbne   t1, t0, .L__sysy_prof_number.copy\n"
+        "\taddi  sp, sp, 32\n"
+        "\tret\n"
+        // ends the line in __sysy_prof_buf at a1 and writes it
+        "__sysy_prof_line:\n"
+        "\tli    t0, 10\n"
+        "\tsb    t0, 0(a1)\n"
+        "\taddi  a1, a1, 1\n"
+        "\tla    t0, __sysy_prof_buf\n"
+        "\tsub   a2, a1, t0\n"
+        "\tmv    a1, t0\n"
+        "\tli    a0, 2\n"
+        "\tli    a7, 64\n"
+        "\tecall\n"
+        "\tret\n";
+}
+
+
+// block names are only unique within their function
+std::string bb_label(koopa_raw_basic_block_t bb)
+{
+    return ".L" + present_func + "_" + (bb->name + 1);
+}
+
+
+void emit_epilogue()
+{
+    for (int i = 1; i < 11; i++)
+        if (s_saved[i])
+            out << "\tlw    s" << i << ", " << anchor_save_offset +
+                (i - 1) * 4 << "(sp)" << std::endl;
+    if (stack_size > 0 && stack_size <= 2047)
+        out << "\taddi  sp, sp, " << stack_size << std::endl;
+    else if (stack_size > 2047)
+    {
+        out << "\tli    t0, " << stack_size << std::endl;
+        out << "\tadd   sp, sp, t0" << std::endl;
+    }
+    out << "\tret" << std::endl;
+}
+
+
+std::string stack_base(int &offset)
+{
+    if (offset >= -2048 && offset <= 2047)return "sp";
+    Anchor *anchor = nullptr;
+    for (auto &candidate : anchors)
+        if (offset - candidate.offset >= -2048 &&
+            offset - candidate.offset <= 2047)
+            anchor = &candidate;
+    if (!anchor && next_anchor_reg <= last_anchor_reg)
+    {
+        anchors.push_back({(offset + 2048) / 4096 * 4096, next_anchor_reg++,
+            false});
+        anchor = &anchors.back();
+    }
+    if (anchor)
+    {
+        anchor->used = true;
+        offset -= anchor->offset;
+        return "s" + std::to_string(anchor->s_reg);
+    }
+    out << "\tli    s11, " << offset << std::endl;
+    out << "\tadd   s11, s11, sp" << std::endl;
+    offset = 0;
+    return "s11";
+}
+
+
+// numbers the values of func, see value_ids
+void number_values(const koopa_raw_function_t &func)
+{
+    value_ids.clear();
+    value_regs.clear();
+    value_seen.clear();
+    value_id(nullptr);
+    for (size_t i = 0; i < func->params.len; i++)
+        value_id(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]));
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+            func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+            value_id(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+    }
+    value_last_use.assign(value_regs.size(), 0);
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(
+            func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->insts.len; j++)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(
+                bb->insts.buffer[j]);
+            int id = value_ids.find(inst);
+            each_operand(inst, [&](koopa_raw_value_t operand)
+            {
+                int used = value_ids.find(operand);
+                if (used >= 0)value_last_use[used] = id;
+            });
+        }
+    }
+    for (int i = 0; i < 26; i++)registers[i] = 0;
+}
+
+
+int value_id(const koopa_raw_value_t &value)
+{
+    int id = value_ids.find(value);
+    if (id >= 0)return id;
+    id = value_regs.size();
+    value_ids.insert(value, id);
+    value_regs.push_back({0, 0});
+    value_seen.push_back(false);
+    return id;
+}
+
+
+// the register and stack slot of value id, from here on it has them
+Reg &value_reg(int id)
+{
+    value_seen[id] = true;
+    return value_regs[id];
+}
+
+
+bool in_register(const koopa_raw_value_t &value)
+{
+    int id = value_id(value);
+    if (!value_seen[id])return false;
+    int reg_name = value_regs[id].reg_name;
+    return reg_name >= 0 && reg_name < 15 && registers[reg_name] == id &&
+        reg_stats[reg_name] > 0;
+}
+
+
+// calls f on the values inst reads
+void each_operand(const koopa_raw_value_t &inst,
+    const std::function<void(koopa_raw_value_t)> &f)
+{
+    const auto &kind = inst->kind;
+    auto each = [&](const koopa_raw_slice_t &slice)
+    {
+        for (size_t i = 0; i < slice.len; i++)
+            f(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+    };
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD: f(kind.data.load.src); break;
+    case KOOPA_RVT_STORE:
+        f(kind.data.store.value);
+        f(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        f(kind.data.get_ptr.src);
+        f(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        f(kind.data.get_elem_ptr.src);
+        f(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        f(kind.data.binary.lhs);
+        f(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH: f(kind.data.branch.cond); break;
+    case KOOPA_RVT_CALL: each(kind.data.call.args); break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)f(kind.data.ret.value);
+        break;
+    default: break;
+    }
+}
+
+
 int find_reg(int stat)
 {
     for (int i = 0; i < 15; i++)
         if (reg_stats[i] == 0)
         {
-            registers[i] = present_value;
+            registers[i] = present_id;
+            reg_stats[i] = stat;
+            return i;
+        }
+    // then one whose value is no longer used, which needs no spill
+    for (int i = 0; i < 15; i++)
+        if (reg_stats[i] == 1 && registers[i] < (int)value_last_use.size() &&
+            value_last_use[registers[i]] < present_inst)
+        {
+            value_regs[registers[i]].reg_name = -1;
+            registers[i] = present_id;
             reg_stats[i] = stat;
             return i;
         }
@@ -714,25 +2253,19 @@ int find_reg(int stat)
     {
         if (reg_stats[i] == 1)
         {
-            value_map[registers[i]].reg_name = -1;
-            int offset = value_map[registers[i]].reg_offset;
+            Reg &reg = value_reg(registers[i]);
+            reg.reg_name = -1;
+            int offset = reg.reg_offset;
             if (offset == -1)
             {
                 offset = stack_top;
                 stack_top += 4;
-                value_map[registers[i]].reg_offset = offset;
-            }
-            if (offset >= -2048 && offset <= 2047)
-                std::cout << "\tsw    " << reg_names[i] << ", " << offset <<
-                    "(sp)" << std::endl;
-            else
-            {
-                std::cout << "\tli    s11, " << offset << std::endl;
-                std::cout << "\tadd   s11, s11, sp" << std::endl;
-                std::cout << "\tsw    " << reg_names[i] << ", (s11)" <<
-                    std::endl;
+                reg.reg_offset = offset;
             }
-            registers[i] = present_value;
+            std::string base = stack_base(offset);
+            out << "\tsw    " << reg_names[i] << ", " << offset << "(" <<
+                base << ")" << spill_mark(false) << std::endl;
+            registers[i] = present_id;
             reg_stats[i] = stat;
             return i;
         }
@@ -742,47 +2275,131 @@ int find_reg(int stat)
 }
 
 
+// without save_temps the values are dead, they get no stack slot
 void clear_registers(bool save_temps)
 {
     for (int i = 0; i < 15; i++)
-        if (reg_stats[i] > 0)
+        if (reg_stats[i] == 1 || reg_stats[i] == 2)
         {
-            value_map[registers[i]].reg_name = -1;
-            int offset = value_map[registers[i]].reg_offset;
-            if (offset == -1)
+            Reg &reg = value_reg(registers[i]);
+            reg.reg_name = -1;
+            if (reg.reg_offset == -1 && save_temps)
             {
-                offset = stack_top;
+                int offset = stack_top;
                 stack_top += 4;
-                value_map[registers[i]].reg_offset = offset;
-                if (save_temps)
-                {
-                    if (offset >= -2048 && offset <= 2047)
-                        std::cout << "\tsw    " << reg_names[i] << ", " <<
-                            offset << "(sp)" << std::endl;
-                    else
-                    {
-                        std::cout << "\tli    s11, " << offset << std::endl;
-                        std::cout << "\tadd   s11, s11, sp" << std::endl;
-                        std::cout << "\tsw    " << reg_names[i] << ", (s11)" <<
-                            std::endl;
-                    }
-                }
+                reg.reg_offset = offset;
+                std::string base = stack_base(offset);
+                out << "\tsw    " << reg_names[i] << ", " <<
+                    offset << "(" << base << ")" << spill_mark(false) <<
+                    std::endl;
             }
             reg_stats[i] = 0;
         }
 }
 
 
-int cal_size(const koopa_raw_type_t &ty)
+// also counts the spill code for -stats
+const char *spill_mark(bool reload)
 {
-    assert(ty->tag != KOOPA_RTT_UNIT);
-    if (ty->tag == KOOPA_RTT_ARRAY)
+    if (func_stats)(reload ? func_stats->reloads : func_stats->spills)++;
+    if (!mark_spills)return "";
+    return reload ? "  # reload" : "  # spill";
+}
+
+
+// the name of the instruction in Koopa IR text, binary ones by operator
+const char *ir_opcode(const koopa_raw_value_t &inst)
+{
+    static const char *ops[] = {"ne", "eq", "gt", "lt", "ge", "le", "add",
+        "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "sar"};
+    switch (inst->kind.tag)
     {
-        int prev = cal_size(ty->data.array.base);
-        int len = ty->data.array.len;
-        return len * prev;
+    case KOOPA_RVT_ALLOC: return "alloc";
+    case KOOPA_RVT_LOAD: return "load";
+    case KOOPA_RVT_STORE: return "store";
+    case KOOPA_RVT_GET_PTR: return "getptr";
+    case KOOPA_RVT_GET_ELEM_PTR: return "getelemptr";
+    case KOOPA_RVT_BINARY: return ops[inst->kind.data.binary.op];
+    case KOOPA_RVT_BRANCH: return "br";
+    case KOOPA_RVT_JUMP: return "jump";
+    case KOOPA_RVT_CALL: return "call";
+    case KOOPA_RVT_RETURN: return "ret";
+    default: return "other";
     }
-    return 4;
+}
+
+
+// the line of a value or label of the present function, 0 if unknown
+int source_line(const char *name)
+{
+    if (!func_lines || !name)return 0;
+    auto it = func_lines->find(name);
+    return it == func_lines->end() ? 0 : it->second;
+}
+
+
+// unnamed instructions (stores, branches, returns, calls without a result)
+// take the line of the value they use, 0 if that isn't named either
+int source_line(const koopa_raw_value_t &inst)
+{
+    if (inst->name)return source_line(inst->name);
+    const auto &kind = inst->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_STORE: return source_line(kind.data.store.value->name);
+    case KOOPA_RVT_BRANCH: return source_line(kind.data.branch.cond->name);
+    case KOOPA_RVT_RETURN:
+        return kind.data.ret.value ? source_line(kind.data.ret.value->name) :
+            0;
+    case KOOPA_RVT_CALL:
+        for (size_t i = 0; i < kind.data.call.args.len; i++)
+        {
+            int line = source_line(reinterpret_cast<koopa_raw_value_t>(
+                kind.data.call.args.buffer[i])->name);
+            if (line)return line;
+        }
+        return 0;
+    default: return 0;
+    }
+}
+
+
+void emit_line(int line)
+{
+    if (line == 0 || line == present_line)return;
+    present_line = line;
+    if (emit_locs)out << "\t.loc\t1 " << line << " 0" << std::endl;
+    if (emit_line_comments)out << "\t# line " << line << std::endl;
+}
+
+
+// the id of a koopa type, made in type_table the first time it is met
+TypeId koopa_type(koopa_raw_type_t ty)
+{
+    auto it = koopa_types.find(ty);
+    if (it != koopa_types.end())return it->second;
+    TypeId id;
+    switch (ty->tag)
+    {
+    case KOOPA_RTT_INT32: id = TypeTable::i32; break;
+    case KOOPA_RTT_UNIT: id = TypeTable::unit; break;
+    case KOOPA_RTT_ARRAY:
+        id = type_table.array(koopa_type(ty->data.array.base),
+            ty->data.array.len);
+        break;
+    case KOOPA_RTT_POINTER:
+        id = type_table.pointer(koopa_type(ty->data.pointer.base));
+        break;
+    default: assert(false); id = TypeTable::unit;
+    }
+    return koopa_types[ty] = id;
+}
+
+
+int cal_size(const koopa_raw_type_t &ty)
+{
+    assert(ty->tag != KOOPA_RTT_UNIT);
+    return type_table[koopa_type(ty)].size;
 }
 
 
@@ -795,7 +2412,7 @@ void init_aggregate(const koopa_raw_value_t &aggr)
         assert(elems.kind == KOOPA_RSIK_VALUE);
         auto value = reinterpret_cast<koopa_raw_value_t>(ptr);
         if (value->kind.tag == KOOPA_RVT_INTEGER)
-            std::cout << "\t.word " << value->kind.data.integer.value <<
+            out << "\t.word " << value->kind.data.integer.value <<
                 std::endl;
         else if (value->kind.tag == KOOPA_RVT_AGGREGATE)
             init_aggregate(value);
@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+
+
+// the SysY runtime library, for the programs run by the compiler itself
+// (-run-koopa, -sim); the machine passes its memory, which has
+//   int32_t load(int32_t array, int32_t i)         element i of array
+//   void store(int32_t array, int32_t i, int32_t value)
+enum RuntimeFunction
+{
+    RT_GETINT, RT_GETCH, RT_GETARRAY, RT_PUTINT, RT_PUTCH, RT_PUTARRAY,
+    RT_STARTTIME, RT_STOPTIME, RT_NONE
+};
+
+
+// the library function named name ("getint", not "@getint"), or RT_NONE
+inline RuntimeFunction runtime_function(const char *name)
+{
+    static const char *names[] = {"getint", "getch", "getarray", "putint",
+        "putch", "putarray", "starttime", "stoptime"};
+    for (int i = 0; i < RT_NONE; i++)
+        if (std::strcmp(name, names[i]) == 0)return RuntimeFunction(i);
+    return RT_NONE;
+}
+
+
+class Runtime
+{
+public:
+    // time between starttime and stoptime calls
+    long timer_calls = 0;
+    std::chrono::steady_clock::duration timer{};
+
+    Runtime(std::istream &in, std::ostream &out) : in(in), out(out) {}
+
+    // the value returned by function on args, 0 for void ones
+    template <class Memory>
+    int32_t call(RuntimeFunction function, const int32_t *args, Memory &memory)
+    {
+        int32_t value = 0;
+        switch (function)
+        {
+        case RT_GETINT:
+            return in >> value ? value : 0;
+        case RT_GETCH:
+            return in.get();
+        case RT_GETARRAY:
+            if (!(in >> value))return 0;
+            for (int32_t i = 0, element; i < value; i++)
+                memory.store(args[0], i, in >> element ? element : 0);
+            return value;
+        case RT_PUTINT:
+            out << args[0];
+            return 0;
+        case RT_PUTCH:
+            out.put(char(args[0]));
+            return 0;
+        case RT_PUTARRAY:
+            out << args[0] << ":";
+            for (int32_t i = 0; i < args[0]; i++)
+                out << " " << memory.load(args[1], i);
+            out << "\n";
+            return 0;
+        case RT_STARTTIME:
+            start = std::chrono::steady_clock::now();
+            return 0;
+        case RT_STOPTIME:
+            timer += std::chrono::steady_clock::now() - start;
+            timer_calls++;
+            return 0;
+        default:
+            return 0;
+        }
+    }
+
+private:
+    std::istream &in;
+    std::ostream &out;
+    std::chrono::steady_clock::time_point start;
+};
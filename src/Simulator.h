@@ -0,0 +1,727 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ELF.h"
+#include "Runtime.h"
+
+
+// -sim: runs the code printed by the backend on a model of an in-order RV32IM
+// core, so that the quality of the code can be measured without hardware.
+// The text goes through the parsing, layout and encoding of ELF.h and is
+// linked at fixed addresses, then the words are decoded again, so what runs
+// is what -obj would give the linker. Calls of the runtime library are made
+// on the host (Runtime.h) and take no cycles of their own.
+// The model issues one instruction per cycle in order, unless an operand is
+// not ready yet: a load result comes load_use cycles later than that of an
+// ALU instruction, products and quotients after the mul and div latencies.
+// Taken branches and jumps add their penalties. Spill stores and reloads are
+// the ones the backend marks under -sim (mark_spills in RISCV.h), code of
+// other modes run from a .S file shows none. Of the system calls there are
+// write to stdout and stderr, for the table of -finstrument-functions, and
+// openat, write and close of one file, which collect what code built with
+// -fprofile-generate writes when it exits in file instead of the host file
+struct CostModel
+{
+    int load_use = 1;  // cycles a load result is later than an ALU one
+    int branch = 2;    // extra cycles of a taken conditional branch
+    int jump = 1;      // ... of jal and jalr
+    int mul = 3;       // latency of mul, mulh*
+    int div = 20;      // latency of div*, rem*
+};
+
+
+// "load_use=2,div=34" and so on; false if a name is unknown
+inline bool cost_model_parse(CostModel &model, const std::string &spec)
+{
+    std::stringstream items(spec);
+    for (std::string item; std::getline(items, item, ',');)
+    {
+        size_t equal = item.find('=');
+        if (equal == std::string::npos)return false;
+        std::string name = item.substr(0, equal);
+        int value = atoi(item.c_str() + equal + 1);
+        if (name == "load_use")model.load_use = value;
+        else if (name == "branch")model.branch = value;
+        else if (name == "jump")model.jump = value;
+        else if (name == "mul")model.mul = value;
+        else if (name == "div")model.div = value;
+        else return false;
+    }
+    return true;
+}
+
+
+class Simulator
+{
+public:
+    // why load() or run() failed
+    std::string error;
+    // what the program wrote to stderr and to the file it opened
+    std::string errors, file;
+
+    Simulator(const CostModel &model, std::istream &in, std::ostream &out) :
+        model(model), runtime(in, out), out(out) {}
+
+    // links the assembly text, false if it refers to unknown symbols or has
+    // instructions outside RV32IM
+    bool load(const std::string &text)
+    {
+        std::vector<AsmLine> lines;
+        std::map<std::string, AsmSymbol> symbols;
+        asm_parse(text, lines, symbols);
+        asm_layout(lines, symbols);
+        uint32_t sizes[SEC_NUM] = {0};
+        for (auto &line : lines)
+            sizes[line.section] = std::max(sizes[line.section],
+                line.offset + line.size);
+        uint32_t bases[SEC_NUM];
+        bases[SEC_TEXT] = text_base;
+        bases[SEC_DATA] = align(text_base + sizes[SEC_TEXT], 4096);
+        bases[SEC_BSS] = align(bases[SEC_DATA] + sizes[SEC_DATA], 16);
+        data_base = bases[SEC_DATA];
+        stack_limit = align(bases[SEC_BSS] + sizes[SEC_BSS], 4096);
+        if (stack_limit >= memory_top)return fail("program too large");
+        memory.reset(static_cast<uint8_t *>(std::calloc(memory_top -
+            data_base, 1)));
+        if (!memory)return fail("out of memory");
+        std::map<std::string, uint32_t> addresses;
+        for (auto &symbol : symbols)
+            if (symbol.second.section >= 0)
+                addresses[symbol.first] = bases[symbol.second.section] +
+                    symbol.second.offset;
+        auto address = [&](const std::string &name, uint32_t &value)
+        {
+            auto symbol = addresses.find(name);
+            if (symbol != addresses.end())value = symbol->second;
+            else
+            {
+                RuntimeFunction function = runtime_function(name.c_str());
+                if (function == RT_NONE)return fail("undefined symbol " +
+                    name);
+                value = host_base + 4 * function;
+            }
+            return true;
+        };
+
+        std::vector<uint32_t> words(sizes[SEC_TEXT] / 4);
+        insts.assign(words.size(), Inst());
+        std::vector<AsmReloc> relocs;
+        std::vector<uint32_t> code;
+        int func = -1;
+        for (auto &line : lines)
+        {
+            if (line.op == ":")
+            {
+                if (line.section == SEC_TEXT && symbols[line.args[0]].global)
+                {
+                    func = funcs.size();
+                    funcs.push_back({line.args[0], line.offset / 4});
+                }
+                continue;
+            }
+            if (line.section != SEC_TEXT)
+            {
+                uint32_t at = bases[line.section] + line.offset;
+                if (line.op == ".asciz")
+                    std::memcpy(&memory[at - data_base], line.args[0].c_str(),
+                        line.size);
+                if (line.op != ".word")continue;
+                for (auto &word : line.args)
+                {
+                    uint32_t value = strtol(word.c_str(), nullptr, 0);
+                    if (!asm_is_int(word) && !address(word, value))
+                        return false;
+                    std::memcpy(&memory[at - data_base], &value, 4);
+                    at += 4;
+                }
+                continue;
+            }
+            if (line.op[0] == '.')
+                code.assign(line.size / 4, 0x13);  // nops
+            else asm_encode(line, symbols, code, relocs);
+            for (size_t i = 0; i < code.size(); i++)
+            {
+                words[line.offset / 4 + i] = code[i];
+                insts[line.offset / 4 + i].func = func;
+            }
+            if (line.comment.find("spill") != std::string::npos)
+                insts[line.offset / 4].mark = MARK_SPILL;
+            else if (line.comment.find("reload") != std::string::npos)
+                insts[line.offset / 4].mark = MARK_RELOAD;
+        }
+        for (auto &reloc : relocs)
+        {
+            uint32_t target;
+            if (!address(reloc.symbol, target))return false;
+            relocate(words, reloc, target);
+        }
+        for (size_t i = 0; i < words.size(); i++)
+            if (!decode(words[i], insts[i]))
+                return fail("unknown instruction at " + hex(text_base +
+                    4 * i));
+        for (auto &f : funcs)
+            if (f.entry < insts.size())insts[f.entry].entry = true;
+        auto main = addresses.find("main");
+        if (main == addresses.end() || main->second < text_base ||
+            main->second >= data_base)
+            return fail("no main");
+        entry = main->second;
+        return true;
+    }
+
+    // runs main, false on errors like accesses out of memory
+    bool run(int32_t &exit_code)
+    {
+        std::fill(std::begin(x), std::end(x), 0);
+        std::fill(std::begin(ready), std::end(ready), 0);
+        x[1] = exit_address;
+        x[2] = memory_top;
+        Memory access{*this};
+        uint32_t pc = entry;
+        while (true)
+        {
+            if (pc - host_base <= 4 * RT_NONE)
+            {
+                if (pc == exit_address)break;
+                host_calls++;
+                int32_t args[3] = {x[10], x[11], x[12]};
+                x[10] = runtime.call(RuntimeFunction((pc - host_base) / 4),
+                    args, access);
+                ready[10] = cycle;
+                if (failed)return false;
+                pc = x[1];
+                continue;
+            }
+            uint32_t index = (pc - text_base) / 4;
+            if (pc % 4 || index >= insts.size())
+                return fail("jump to " + hex(pc));
+            const Inst &inst = insts[index];
+            Counts &counts = inst.func >= 0 ? funcs[inst.func].counts :
+                outside;
+            long start = cycle;
+            long issue = std::max(cycle, std::max(ready[inst.rs1],
+                ready[inst.rs2]));
+            counts.stalls += issue - cycle;
+            cycle = issue + 1;
+            counts.insts++;
+            insts_done++;
+            uint32_t next = pc + 4;
+            int32_t a = x[inst.rs1], b = x[inst.rs2], result = 0;
+            bool write = true;
+            int latency = 1;
+            switch (inst.op)
+            {
+            case LUI: result = inst.imm; counts.alu++; break;
+            case AUIPC: result = pc + inst.imm; counts.alu++; break;
+            case JAL: case JALR:
+                result = next;
+                next = inst.op == JAL ? pc + inst.imm : (a + inst.imm) & ~1;
+                counts.jumps++;
+                cycle += model.jump;
+                if (inst.rd == 1)
+                {
+                    counts.calls++;
+                    uint32_t callee = (next - text_base) / 4;
+                    if (callee < insts.size() && insts[callee].entry)
+                        funcs[insts[callee].func].called++;
+                }
+                break;
+            case BEQ: case BNE: case BLT: case BGE: case BLTU: case BGEU:
+                write = false;
+                counts.branches++;
+                if (taken(inst.op, a, b))
+                {
+                    next = pc + inst.imm;
+                    counts.taken++;
+                    cycle += model.branch;
+                }
+                break;
+            case LB: case LH: case LW: case LBU: case LHU:
+                result = load(inst.op, a + inst.imm);
+                latency += model.load_use;
+                counts.loads++;
+                counts.reloads += inst.mark == MARK_RELOAD;
+                break;
+            case SB: case SH: case SW:
+                write = false;
+                store(inst.op, a + inst.imm, b);
+                counts.stores++;
+                counts.spills += inst.mark == MARK_SPILL;
+                break;
+            case MUL: case MULH: case MULHSU: case MULHU:
+                result = multiply(inst.op, a, b);
+                latency = model.mul;
+                counts.muls++;
+                break;
+            case DIV: case DIVU: case REM: case REMU:
+                result = divide(inst.op, a, b);
+                latency = model.div;
+                counts.divs++;
+                break;
+            case RDCYCLE: result = start; counts.alu++; break;
+            case RDINSTRET: result = insts_done - 1; counts.alu++; break;
+            case ECALL:
+                write = false;
+                system_call();
+                break;
+            default:
+                result = compute(inst.op, a, inst.op >= ADD ? b : inst.imm);
+                counts.alu++;
+                break;
+            }
+            if (write && inst.rd)
+            {
+                x[inst.rd] = result;
+                ready[inst.rd] = issue + latency;
+                if (inst.rd == 2 && uint32_t(x[2]) < stack_limit)
+                    return fail("stack overflow at " + hex(pc));
+            }
+            if (failed)return false;
+            counts.cycles += cycle - start;
+            pc = next;
+        }
+        exit_code = x[10];
+        return true;
+    }
+
+    // cycles and instruction mix of each function, by cycles
+    std::string report() const
+    {
+        std::vector<const Function *> order;
+        for (auto &func : funcs)order.push_back(&func);
+        std::stable_sort(order.begin(), order.end(),
+            [](const Function *a, const Function *b)
+            { return a->counts.cycles > b->counts.cycles; });
+        Counts total = outside;
+        for (auto &func : funcs)total.add(func.counts);
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(2);
+        os << std::left << std::setw(20) << "function" << std::right <<
+            std::setw(10) << "called" << std::setw(14) << "cycles" <<
+            std::setw(14) << "insts" << std::setw(7) << "CPI" <<
+            std::setw(12) << "stalls" << std::setw(12) << "spills" <<
+            std::setw(12) << "reloads" << std::endl;
+        for (auto func : order)
+            print_cycles(os, func->name, func->called, func->counts);
+        if (outside.insts)print_cycles(os, "(outside)", 0, outside);
+        print_cycles(os, "total", 0, total);
+        os << std::left << std::setw(20) << "function" << std::right <<
+            std::setw(12) << "alu" << std::setw(10) << "mul" <<
+            std::setw(10) << "div" << std::setw(12) << "loads" <<
+            std::setw(12) << "stores" << std::setw(12) << "branches" <<
+            std::setw(12) << "taken" << std::setw(10) << "jumps" <<
+            std::setw(10) << "calls" << std::endl;
+        for (auto func : order)print_mix(os, func->name, func->counts);
+        if (outside.insts)print_mix(os, "(outside)", outside);
+        print_mix(os, "total", total);
+        os << "host calls: " << host_calls << std::endl;
+        if (runtime.timer_calls)
+            os << "timer: " << std::chrono::duration<double, std::milli>(
+                runtime.timer).count() << " ms in " << runtime.timer_calls <<
+                " intervals" << std::endl;
+        return os.str();
+    }
+
+private:
+    enum Op
+    {
+        LUI, AUIPC, JAL, JALR, BEQ, BNE, BLT, BGE, BLTU, BGEU, LB, LH, LW, LBU,
+        LHU, SB, SH, SW, RDCYCLE, RDINSTRET, ECALL, MUL, MULH, MULHSU, MULHU, DIV,
+        DIVU, REM, REMU,
+        // compute(): the immediate forms, then the register ones
+        ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI,
+        ADD, SLT, SLTU, XOR, OR, AND, SLL, SRL, SRA, SUB
+    };
+    enum { MARK_NONE, MARK_SPILL, MARK_RELOAD };
+
+    struct Inst
+    {
+        Op op = ADDI;
+        uint8_t rd = 0, rs1 = 0, rs2 = 0;  // x0 for the unused sources
+        uint8_t mark = MARK_NONE;
+        bool entry = false;  // first instruction of a function
+        int32_t imm = 0;
+        int func = -1;
+    };
+
+    struct Counts
+    {
+        long cycles = 0, insts = 0, stalls = 0, alu = 0, muls = 0, divs = 0,
+            loads = 0, stores = 0, branches = 0, taken = 0, jumps = 0,
+            calls = 0, spills = 0, reloads = 0;
+
+        void add(const Counts &counts)
+        {
+            cycles += counts.cycles;
+            insts += counts.insts;
+            stalls += counts.stalls;
+            alu += counts.alu;
+            muls += counts.muls;
+            divs += counts.divs;
+            loads += counts.loads;
+            stores += counts.stores;
+            branches += counts.branches;
+            taken += counts.taken;
+            jumps += counts.jumps;
+            calls += counts.calls;
+            spills += counts.spills;
+            reloads += counts.reloads;
+        }
+    };
+
+    struct Function
+    {
+        std::string name;
+        uint32_t entry;  // index of the first instruction
+        Counts counts;
+        long called = 0;
+    };
+
+    // memory of the program for the runtime
+    struct Memory
+    {
+        Simulator &simulator;
+
+        int32_t load(int32_t array, int32_t i)
+        {
+            return simulator.load(LW, array + 4 * i);
+        }
+        void store(int32_t array, int32_t i, int32_t value)
+        {
+            simulator.store(SW, array + 4 * i, value);
+        }
+    };
+
+    struct FreeDeleter
+    {
+        void operator()(uint8_t *ptr) const { std::free(ptr); }
+    };
+
+    // code from text_base, then data and bss, the stack grows down from
+    // memory_top over the rest of 256 MiB; the runtime functions and the
+    // return address of main live at host_base
+    static constexpr uint32_t host_base = 0x1000, exit_address = host_base +
+        4 * RT_NONE, text_base = 0x10000, memory_top = 0x10000000;
+
+    CostModel model;
+    Runtime runtime;
+    std::ostream &out;
+    std::vector<Inst> insts;
+    std::vector<Function> funcs;
+    Counts outside;  // code before the first function
+    std::unique_ptr<uint8_t[], FreeDeleter> memory;
+    uint32_t data_base = 0, stack_limit = 0, entry = 0;
+    int32_t x[32];
+    long ready[32];  // cycle each register can be read in
+    long cycle = 0, insts_done = 0, host_calls = 0;
+    bool failed = false;
+
+    static uint32_t align(uint32_t value, uint32_t to)
+    {
+        return (value + to - 1) / to * to;
+    }
+
+    static std::string hex(uint32_t value)
+    {
+        std::ostringstream os;
+        os << "0x" << std::hex << value;
+        return os.str();
+    }
+
+    bool fail(const std::string &message)
+    {
+        if (!failed)error = message;
+        failed = true;
+        return false;
+    }
+
+    // the word at the address of a patched instruction, the same patches a
+    // linker makes
+    void relocate(std::vector<uint32_t> &words, const AsmReloc &reloc,
+        uint32_t target)
+    {
+        uint32_t &word = words[reloc.offset / 4];
+        int32_t offset = target - (text_base + reloc.offset);
+        int32_t lo = int32_t(target << 20) >> 20;
+        switch (reloc.type)
+        {
+        case R_RISCV_BRANCH:
+            word = (word & ~0xfe000f80u) | (enc_b(offset, 0, 0, 0) &
+                0xfe000f80u);
+            break;
+        case R_RISCV_JAL:
+            word = (word & 0xfff) | (enc_j(offset, 0) & ~0xfffu);
+            break;
+        case R_RISCV_CALL_PLT:
+        {
+            uint32_t hi = (offset + 0x800) & ~0xfffu;
+            word = (word & 0xfff) | hi;
+            uint32_t &jalr = words[reloc.offset / 4 + 1];
+            jalr = (jalr & 0xfffff) | (uint32_t)(offset - hi) << 20;
+            break;
+        }
+        case R_RISCV_HI20:
+            word = (word & 0xfff) | ((target + 0x800) & ~0xfffu);
+            break;
+        case R_RISCV_LO12_I:
+            word = (word & 0xfffff) | (uint32_t)lo << 20;
+            break;
+        case R_RISCV_LO12_S:
+            word = (word & ~0xfe000f80u) | (enc_s(lo, 0, 0, 0) & 0xfe000f80u);
+            break;
+        default:
+            assert(false);
+        }
+    }
+
+    static bool decode(uint32_t word, Inst &inst)
+    {
+        int opcode = word & 0x7f, f3 = word >> 12 & 7, f7 = word >> 25;
+        inst.rd = word >> 7 & 31;
+        inst.rs1 = word >> 15 & 31;
+        inst.rs2 = word >> 20 & 31;
+        int32_t imm_i = int32_t(word) >> 20;
+        switch (opcode)
+        {
+        case 0x37: case 0x17:
+            inst.op = opcode == 0x37 ? LUI : AUIPC;
+            inst.imm = word & ~0xfffu;
+            inst.rs1 = inst.rs2 = 0;
+            return true;
+        case 0x6f:
+            inst.op = JAL;
+            inst.imm = int32_t(word & 0x80000000u) >> 11 |
+                (word >> 21 & 0x3ff) << 1 | (word >> 20 & 1) << 11 |
+                (word >> 12 & 0xff) << 12;
+            inst.rs1 = inst.rs2 = 0;
+            return true;
+        case 0x67:
+            inst.op = JALR;
+            inst.imm = imm_i;
+            inst.rs2 = 0;
+            return f3 == 0;
+        case 0x63:
+            if (f3 == 2 || f3 == 3)return false;
+            inst.op = Op(BEQ + (f3 < 4 ? f3 : f3 - 2));
+            inst.imm = int32_t(word & 0x80000000u) >> 19 |
+                (word >> 25 & 0x3f) << 5 | (word >> 8 & 0xf) << 1 |
+                (word >> 7 & 1) << 11;
+            inst.rd = 0;
+            return true;
+        case 0x03:
+        {
+            static const int loads[8] = {LB, LH, LW, -1, LBU, LHU, -1, -1};
+            if (loads[f3] < 0)return false;
+            inst.op = Op(loads[f3]);
+            inst.imm = imm_i;
+            inst.rs2 = 0;
+            return true;
+        }
+        case 0x23:
+            if (f3 > 2)return false;
+            inst.op = Op(SB + f3);
+            inst.imm = int32_t(word & 0xfe000000u) >> 20 | (word >> 7 & 31);
+            inst.rd = 0;
+            return true;
+        case 0x13:
+        {
+            static const Op ops[8] = {ADDI, SLLI, SLTI, SLTIU, XORI, SRLI, ORI,
+                ANDI};
+            inst.op = f3 == 5 && f7 == 0x20 ? SRAI : ops[f3];
+            inst.imm = f3 == 1 || f3 == 5 ? imm_i & 31 : imm_i;
+            inst.rs2 = 0;
+            return true;
+        }
+        case 0x33:
+        {
+            static const Op ops[8] = {ADD, SLL, SLT, SLTU, XOR, SRL, OR, AND};
+            static const Op m_ops[8] = {MUL, MULH, MULHSU, MULHU, DIV, DIVU,
+                REM, REMU};
+            if (f7 == 1)inst.op = m_ops[f3];
+            else if (f7 == 0x20 && (f3 == 0 || f3 == 5))
+                inst.op = f3 == 0 ? SUB : SRA;
+            else if (f7 == 0)inst.op = ops[f3];
+            else return false;
+            return true;
+        }
+        case 0x73:
+        {
+            inst.rs2 = 0;
+            if (word == 0x73)
+            {
+                inst.op = ECALL;
+                return true;
+            }
+            // csrrs rd, cycle / time / instret, x0
+            uint32_t csr = word >> 20;
+            if (f3 != 2 || inst.rs1 != 0 || csr < 0xc00 || csr > 0xc02)
+                return false;
+            inst.op = csr == 0xc02 ? RDINSTRET : RDCYCLE;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // the Linux call numbered a7 on a0 ~ a3: write (64) to stdout, stderr or
+    // the file, openat (56) of the file, which is fd 3, and close (57); it
+    // returns in a0 like the runtime functions
+    void system_call()
+    {
+        host_calls++;
+        if (x[17] == 56 || x[17] == 57)
+        {
+            x[10] = x[17] == 56 ? 3 : 0;
+            ready[10] = cycle;
+            return;
+        }
+        if (x[17] != 64 || x[10] < 1 || x[10] > 3)
+        {
+            fail("unknown system call " + std::to_string(x[17]));
+            return;
+        }
+        if (x[12] < 0 || uint32_t(x[12]) > memory_top)
+        {
+            fail("write of " + std::to_string(x[12]) + " bytes");
+            return;
+        }
+        if (uint8_t *bytes = x[12] ? at(x[11], x[12]) : nullptr)
+        {
+            const char *text = reinterpret_cast<const char *>(bytes);
+            if (x[10] == 1)out.write(text, x[12]);
+            else if (x[10] == 2)errors.append(text, x[12]);
+            else file.append(text, x[12]);
+        }
+        x[10] = x[12];
+        ready[10] = cycle;
+    }
+
+    static bool taken(Op op, int32_t a, int32_t b)
+    {
+        switch (op)
+        {
+        case BEQ: return a == b;
+        case BNE: return a != b;
+        case BLT: return a < b;
+        case BGE: return a >= b;
+        case BLTU: return uint32_t(a) < uint32_t(b);
+        default: return uint32_t(a) >= uint32_t(b);
+        }
+    }
+
+    static int32_t compute(Op op, int32_t a, int32_t b)
+    {
+        uint32_t ua = a, ub = b;
+        switch (op)
+        {
+        case ADDI: case ADD: return ua + ub;
+        case SUB: return ua - ub;
+        case SLTI: case SLT: return a < b;
+        case SLTIU: case SLTU: return ua < ub;
+        case XORI: case XOR: return a ^ b;
+        case ORI: case OR: return a | b;
+        case ANDI: case AND: return a & b;
+        case SLLI: case SLL: return ua << (ub & 31);
+        case SRLI: case SRL: return ua >> (ub & 31);
+        default: return a >> (ub & 31);
+        }
+    }
+
+    static int32_t multiply(Op op, int32_t a, int32_t b)
+    {
+        switch (op)
+        {
+        case MUL: return uint32_t(a) * uint32_t(b);
+        case MULH: return (int64_t(a) * b) >> 32;
+        case MULHSU: return (int64_t(a) * int64_t(uint32_t(b))) >> 32;
+        default: return (uint64_t(uint32_t(a)) * uint32_t(b)) >> 32;
+        }
+    }
+
+    // division by zero and overflow as RV32IM defines them
+    static int32_t divide(Op op, int32_t a, int32_t b)
+    {
+        uint32_t ua = a, ub = b;
+        switch (op)
+        {
+        case DIV:
+            if (b == 0)return -1;
+            if (a == INT32_MIN && b == -1)return a;
+            return a / b;
+        case DIVU: return ub ? ua / ub : ~0u;
+        case REM:
+            if (b == 0)return a;
+            if (a == INT32_MIN && b == -1)return 0;
+            return a % b;
+        default: return ub ? ua % ub : ua;
+        }
+    }
+
+    // the byte of memory at address, or null after a failure
+    uint8_t *at(uint32_t address, int size)
+    {
+        if (address < data_base || address > memory_top - size)
+        {
+            fail("access out of memory at " + hex(address));
+            return nullptr;
+        }
+        return &memory[address - data_base];
+    }
+
+    int32_t load(Op op, uint32_t address)
+    {
+        int size = op == LW ? 4 : op == LH || op == LHU ? 2 : 1;
+        uint8_t *byte = at(address, size);
+        if (!byte)return 0;
+        switch (op)
+        {
+        case LB: return int8_t(*byte);
+        case LBU: return *byte;
+        case LH: { int16_t v; std::memcpy(&v, byte, 2); return v; }
+        case LHU: { uint16_t v; std::memcpy(&v, byte, 2); return v; }
+        default: { int32_t v; std::memcpy(&v, byte, 4); return v; }
+        }
+    }
+
+    void store(Op op, uint32_t address, int32_t value)
+    {
+        int size = op == SW ? 4 : op == SH ? 2 : 1;
+        if (uint8_t *byte = at(address, size))std::memcpy(byte, &value, size);
+    }
+
+    void print_cycles(std::ostream &os, const std::string &name, long called,
+        const Counts &counts) const
+    {
+        os << std::left << std::setw(20) << name << std::right <<
+            std::setw(10) << called << std::setw(14) << counts.cycles <<
+            std::setw(14) << counts.insts << std::setw(7) <<
+            (counts.insts ? double(counts.cycles) / counts.insts : 0) <<
+            std::setw(12) << counts.stalls << std::setw(12) << counts.spills <<
+            std::setw(12) << counts.reloads << std::endl;
+    }
+
+    void print_mix(std::ostream &os, const std::string &name,
+        const Counts &counts) const
+    {
+        os << std::left << std::setw(20) << name << std::right <<
+            std::setw(12) << counts.alu << std::setw(10) << counts.muls <<
+            std::setw(10) << counts.divs << std::setw(12) << counts.loads <<
+            std::setw(12) << counts.stores << std::setw(12) <<
+            counts.branches << std::setw(12) << counts.taken <<
+            std::setw(10) << counts.jumps << std::setw(10) << counts.calls <<
+            std::endl;
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// -stats: static counts of the code of each function, to compare the code of
+// two revisions of the compiler without running it. The backend fills in
+// those it knows while emitting (see func_stats in RISCV.h), the rest is
+// counted on the code printed by stats_count_code
+struct FunctionStats
+{
+    std::string name;  // empty for declarations
+    std::map<std::string, int> ir;  // IR instructions by opcode
+    int blocks = 0;
+    int frame = 0;  // bytes
+    int spills = 0, reloads = 0;  // stores and loads of find_reg and co.
+    int far_offsets = 0;  // li s11 of offsets out of the 12 bit range
+    int calls = 0;
+    int insts = 0;  // instructions printed, pseudo ones counted once
+
+    void add(const FunctionStats &stats)
+    {
+        for (auto &op : stats.ir)ir[op.first] += op.second;
+        blocks += stats.blocks;
+        frame += stats.frame;
+        spills += stats.spills;
+        reloads += stats.reloads;
+        far_offsets += stats.far_offsets;
+        calls += stats.calls;
+        insts += stats.insts;
+    }
+};
+
+
+inline void stats_count_code(const std::string &code, FunctionStats &stats)
+{
+    std::istringstream lines(code);
+    for (std::string line; std::getline(lines, line);)
+    {
+        if (line.size() < 2 || line[0] != '\t' || line[1] == '.' ||
+            line[1] == '#')
+            continue;
+        stats.insts++;
+        if (line.compare(1, 5, "call ") == 0)stats.calls++;
+        else if (line.compare(1, 10, "li    s11,") == 0)
+        {
+            long offset = strtol(line.c_str() + 11, nullptr, 0);
+            if (offset < -2048 || offset > 2047)stats.far_offsets++;
+        }
+    }
+}
+
+
+inline void stats_print(std::ostream &os, const FunctionStats &stats)
+{
+    os << "\"blocks\": " << stats.blocks << ", \"frame\": " << stats.frame <<
+        ", \"insts\": " << stats.insts << ", \"calls\": " << stats.calls <<
+        ", \"spills\": " << stats.spills << ", \"reloads\": " <<
+        stats.reloads << ", \"far_offsets\": " << stats.far_offsets <<
+        ", \"ir\": {";
+    bool first = true;
+    for (auto &op : stats.ir)
+    {
+        os << (first ? "" : ", ") << "\"" << op.first << "\": " << op.second;
+        first = false;
+    }
+    os << "}";
+}
+
+
+// {"functions": [{"name": ..., counts}, ...], "total": {counts}}, a function
+// to a line
+inline std::string stats_json(const std::vector<FunctionStats> &funcs)
+{
+    std::ostringstream os;
+    FunctionStats total;
+    os << "{\"functions\": [";
+    bool first = true;
+    for (auto &func : funcs)
+    {
+        if (func.name.empty())continue;
+        os << (first ? "\n" : ",\n") << "  {\"name\": \"" << func.name <<
+            "\", ";
+        stats_print(os, func);
+        os << "}";
+        total.add(func);
+        first = false;
+    }
+    os << "\n], \"total\": {";
+    stats_print(os, total);
+    os << "}}" << std::endl;
+    return os.str();
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Memory.h"
+
+
+// -time-trace: scoped timers around the phases of a compilation, and around
+// each function in IR generation and codegen, recorded as complete events of
+// the Chrome trace format (chrome://tracing, ui.perfetto.dev). Like clang's
+// -ftime-trace, an event is named after its phase and the function is its
+// detail. The trace is shared by all threads and off until enable(), a
+// disabled timer costs one atomic load
+
+
+struct TraceEvent
+{
+    std::string name, detail;
+    double start, duration;  // microseconds since enable()
+    int thread;
+};
+
+
+class TimeTrace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void enable()
+    {
+        begin = Clock::now();
+        on = true;
+    }
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+    void add(const std::string &name, const std::string &detail,
+        Clock::time_point start, Clock::time_point end)
+    {
+        if (!enabled())return;
+        static std::atomic<int> thread_num(0);
+        thread_local int thread = thread_num++;
+        TraceEvent event{name, detail, micros(start), micros(end) -
+            micros(start), thread};
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    }
+
+    std::string json()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(3);
+        os << "{\"traceEvents\":[";
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            auto &event = events[i];
+            os << (i ? ",\n" : "\n") << "{\"name\":\"" << escape(event.name) <<
+                "\",\"cat\":\"" << (event.detail.empty() ? "phase" :
+                "function") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" <<
+                event.thread << ",\"ts\":" << event.start << ",\"dur\":" <<
+                event.duration;
+            if (!event.detail.empty())
+                os << ",\"args\":{\"detail\":\"" << escape(event.detail) <<
+                    "\"}";
+            os << "}";
+        }
+        os << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        return os.str();
+    }
+
+    // the events recorded so far, which are dropped from the trace
+    std::vector<TraceEvent> take()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<TraceEvent> taken;
+        taken.swap(events);
+        return taken;
+    }
+
+    // total time of each phase, then the functions that took the longest
+    std::string summary(size_t top = 10)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        struct Total { int count = 0; double duration = 0; };
+        std::vector<std::string> order;
+        std::map<std::string, Total> totals;
+        std::vector<const TraceEvent *> funcs;
+        for (auto &event : events)
+        {
+            Total &total = totals[event.name];
+            if (total.count++ == 0)order.push_back(event.name);
+            total.duration += event.duration;
+            if (!event.detail.empty())funcs.push_back(&event);
+        }
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(3);
+        os << std::left << std::setw(20) << "phase" << std::right <<
+            std::setw(8) << "count" << std::setw(12) << "time (ms)" <<
+            std::endl;
+        for (auto &name : order)
+            os << std::left << std::setw(20) << name << std::right <<
+                std::setw(8) << totals[name].count << std::setw(12) <<
+                totals[name].duration / 1000 << std::endl;
+        std::stable_sort(funcs.begin(), funcs.end(),
+            [](const TraceEvent *a, const TraceEvent *b)
+            { return a->duration > b->duration; });
+        if (funcs.size() > top)funcs.resize(top);
+        if (!funcs.empty())os << "slowest functions:" << std::endl;
+        for (auto event : funcs)
+            os << std::left << std::setw(20) << event->name << std::setw(20) <<
+                event->detail << std::right << std::setw(12) <<
+                event->duration / 1000 << std::endl;
+        return os.str();
+    }
+
+private:
+    std::atomic<bool> on{false};
+    Clock::time_point begin;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+
+    double micros(Clock::time_point time) const
+    {
+        return std::chrono::duration<double, std::micro>(time - begin).count();
+    }
+
+    static std::string escape(const std::string &s)
+    {
+        std::string escaped;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+
+inline TimeTrace time_trace;
+
+
+// records the time from its construction to its destruction; it is also the
+// phase of the allocations made in between for -mem-report (see Memory.h)
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, const std::string &detail = "")
+        : name(name), active(time_trace.enabled()), memory(mem_enabled())
+    {
+        if (memory)previous_phase = mem_enter(name);
+        if (!active)return;
+        this->detail = detail;
+        start = TimeTrace::Clock::now();
+    }
+
+    // the event is named after what the scope found out, like a cache hit
+    void rename(const char *name) { this->name = name; }
+
+    ~TraceScope()
+    {
+        if (active)
+            time_trace.add(name, detail, start, TimeTrace::Clock::now());
+        if (memory)mem_leave(previous_phase);
+    }
+
+private:
+    const char *name;
+    bool active, memory;
+    int previous_phase = 0;
+    std::string detail;
+    TimeTrace::Clock::time_point start;
+};
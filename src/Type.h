@@ -0,0 +1,92 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// the types of the IR, hash-consed: a type is made once and named by its
+// index in the table, so equal types have equal ids and comparing them is
+// comparing ints. What is asked of a type (its size, the stride of its
+// elements, its IR text) is worked out when it is made
+typedef int TypeId;
+enum TypeTag : uint8_t { TYPE_I32, TYPE_UNIT, TYPE_POINTER, TYPE_ARRAY };
+
+
+struct TypeInfo
+{
+    TypeTag tag;
+    TypeId base;  // of pointers and arrays, -1 otherwise
+    int len;  // of arrays
+    int size;  // bytes, 4 for pointers and 0 for unit
+    int stride;  // bytes between the elements of arrays and pointees of
+                 // pointers, 0 otherwise
+    int dims;  // indices it takes down to i32: 1 for *i32 and [i32, 3]
+    std::string text;  // "i32", "*[i32, 3]" ...
+};
+
+
+class TypeTable
+{
+public:
+    static constexpr TypeId i32 = 0, unit = 1;
+
+    TypeTable()
+    {
+        make({TYPE_I32, -1, 0, 4, 0, 0, "i32"});
+        make({TYPE_UNIT, -1, 0, 0, 0, 0, "unit"});
+    }
+
+    const TypeInfo &operator[](TypeId id) const { return infos[id]; }
+
+    TypeId pointer(TypeId base)
+    {
+        auto it = ids.find(key(TYPE_POINTER, base, 0));
+        if (it != ids.end())return it->second;
+        const TypeInfo &info = infos[base];
+        return make({TYPE_POINTER, base, 0, 4, info.size, info.dims + 1,
+            "*" + info.text});
+    }
+
+    TypeId array(TypeId base, int len)
+    {
+        auto it = ids.find(key(TYPE_ARRAY, base, len));
+        if (it != ids.end())return it->second;
+        const TypeInfo &info = infos[base];
+        return make({TYPE_ARRAY, base, len, info.size * len, info.size,
+            info.dims + 1, "[" + info.text + ", " + std::to_string(len) +
+            "]"});
+    }
+
+    // int a[widths[0]][widths[1]]..., i32 if widths is empty
+    TypeId array(const std::vector<int> &widths, size_t from = 0)
+    {
+        TypeId type = i32;
+        for (size_t i = widths.size(); i-- > from;)
+            type = array(type, widths[i]);
+        return type;
+    }
+
+private:
+    std::vector<TypeInfo> infos;
+    std::unordered_map<uint64_t, TypeId> ids;
+
+    static uint64_t key(TypeTag tag, TypeId base, int len)
+    {
+        return uint64_t(tag) << 62 | uint64_t(uint32_t(base)) << 31 |
+            uint32_t(len);
+    }
+
+    TypeId make(TypeInfo info)
+    {
+        TypeId id = infos.size();
+        ids[key(info.tag, info.base, info.len)] = id;
+        infos.push_back(std::move(info));
+        return id;
+    }
+};
+
+
+// each thread makes its own types, ids don't go from one thread to another
+inline thread_local TypeTable type_table;
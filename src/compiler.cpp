@@ -0,0 +1,673 @@
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "AST.h"
+#include "Cache.h"
+#include "Compiler.h"
+#include "ELF.h"
+#include "IRFile.h"
+#include "Interpreter.h"
+#include "Output.h"
+#include "Pass.h"
+#include "RISCV.h"
+#include "Simulator.h"
+#include "Trace.h"
+#include "koopa.h"
+#include "sysy.tab.hpp"
+using namespace std;
+
+
+// cached code is only valid for the backend that produced it
+static const char *build_id = "sysy " __DATE__ " " __TIME__;
+
+
+// the IR text of a program, counted by -mem-report
+using IRStream = basic_stringstream<char, char_traits<char>,
+    MemAllocator<char, MEM_IR_TEXT>>;
+
+
+// the raw program of the text ir lives as long as builder; false if ir
+// doesn't parse, there is no builder then
+static bool build_raw(const char *ir, koopa_raw_program_builder_t &builder,
+    koopa_raw_program_t &raw)
+{
+    koopa_program_t program;
+    {
+        TraceScope scope("koopa parse");
+        if (koopa_parse_from_string(ir, &program) != KOOPA_EC_SUCCESS)
+            return false;
+    }
+    TraceScope scope("build raw");
+    builder = koopa_new_raw_program_builder();
+    raw = koopa_build_raw_program(builder, program);
+    koopa_delete_program(program);
+    return true;
+}
+
+
+// prints the code of the program ir; with funcs, only its globals are printed
+// and the code of the functions is returned by name instead. False if ir
+// doesn't parse or the passes found it broken, error says which; nothing is
+// printed then
+static bool emit_riscv(const char *ir, PassManager &passes, string &error,
+    map<string, string> *funcs = nullptr)
+{
+    koopa_raw_program_builder_t builder;
+    koopa_raw_program_t raw;
+    if (!build_raw(ir, builder, raw))
+    {
+        error = "the generated IR does not parse";
+        return false;
+    }
+    {
+        TraceScope scope("optimize");
+        if (!passes.run(raw, funcs == nullptr))
+        {
+            error = passes.error;
+            koopa_delete_raw_program_builder(builder);
+            return false;
+        }
+    }
+    TraceScope scope("codegen");
+    if (!funcs)Visit(raw);
+    else
+    {
+        vector<string> code = emit_program(raw);
+        for (size_t i = 0; i < raw.funcs.len; i++)
+        {
+            auto func = reinterpret_cast<koopa_raw_function_t>(
+                raw.funcs.buffer[i]);
+            (*funcs)[func->name] = code[i];
+        }
+    }
+    koopa_delete_raw_program_builder(builder);
+    return true;
+}
+
+
+// "fun @f(@x_0: i32, @a_0: *[i32, 3]): i32 {" ->
+// "decl @f(i32, *[i32, 3]): i32"
+static string declaration(const string &header, string &name)
+{
+    size_t open = header.find('('), close = header.find(')');
+    name = header.substr(4, open - 4);
+    string decl = "decl " + name + "(";
+    size_t colon = header.find(": ", open);
+    while (colon < close)
+    {
+        size_t end = min(header.find(", @", colon), close);
+        decl += header.substr(colon + 2, end - colon - 2);
+        colon = header.find(": ", end);
+        if (colon < close)decl += ", ";
+    }
+    return decl + header.substr(close, header.find(" {") - close);
+}
+
+
+// a function is looked up in the cache by its IR (the frontend numbers
+// everything from zero in each function, so it only changes when the function
+// does), the declarations of the globals and functions it refers to and the
+// options; only the functions not found go through the backend, and so
+// through the passes that look at one function at a time. -time-trace shows
+// each lookup as a cache hit or miss
+bool CompilerContext::emit_cached(const Node *comp_unit)
+{
+    string pipeline;
+    for (auto &name : pass_pipeline(passes, mode))pipeline += name + " ";
+    vector<string> parts;
+    {
+        TraceScope scope("irgen");
+        parts = dump_ir_parts(comp_unit);
+    }
+    map<string, string> decls;
+    istringstream globals(parts[0]);
+    for (string line; getline(globals, line);)
+        if (line.compare(0, 8, "global @") == 0)
+            decls[line.substr(7, line.find(' ', 7) - 7)] = line;
+        else if (line.compare(0, 6, "decl @") == 0)
+            decls[line.substr(5, line.find('(') - 5)] = line;
+    vector<string> names(parts.size());
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        string decl = declaration(parts[i].substr(0, parts[i].find('\n')),
+            names[i]);
+        decls[names[i]] = decl;
+    }
+    string ir = parts[0];
+    vector<string> keys(parts.size()), code(parts.size());
+    vector<bool> hit(parts.size());
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        TraceScope scope("cache lookup", names[i].substr(1));
+        string key = string(build_id) + "\n" + mode + "\n" + pipeline +
+            "\n" + parts[i];
+        for (size_t at = parts[i].find('@'); at != string::npos;
+            at = parts[i].find('@', at + 1))
+        {
+            size_t end = parts[i].find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_", at + 1);
+            auto decl = decls.find(parts[i].substr(at, end - at));
+            if (decl != decls.end())key += decl->second + "\n";
+        }
+        keys[i] = cache_hash(key);
+        string cached_ir;
+        hit[i] = cache_load(cache_dir, keys[i], cached_ir, code[i]) &&
+            cached_ir == parts[i];
+        scope.rename(hit[i] ? "cache hit" : "cache miss");
+        ir += hit[i] ? decls[names[i]] + "\n" : parts[i];
+    }
+    map<string, string> funcs;
+    PassManager pass_manager(passes, mode);
+    string error;
+    bool ok = emit_riscv(ir.c_str(), pass_manager, error, &funcs);
+    log += pass_manager.log;
+    if (!ok)
+    {
+        log += "error: " + error + "\n";
+        return false;
+    }
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        if (!hit[i])
+        {
+            code[i] = funcs[names[i]];
+            cache_store(cache_dir, keys[i], parts[i], code[i]);
+        }
+        out << code[i];
+    }
+    return true;
+}
+
+
+// "global @a_0 = alloc [i32, 2], {1, 2}" ->
+// "global @a_0 = alloc [i32, 2], zeroinit", which is all a function using it
+// needs to know of it
+static string global_declaration(const string &line)
+{
+    size_t end = line.find("alloc ") + 6;
+    for (int depth = 0; depth > 0 || line[end] != ','; end++)
+        if (line[end] == '[')depth++;
+        else if (line[end] == ']')depth--;
+    return line.substr(0, end) + ", zeroinit";
+}
+
+
+// the declarations in decls of the globals and functions ir refers to
+static string used_declarations(const string &ir,
+    const map<string, string> &decls)
+{
+    set<string> used;
+    for (size_t at = ir.find('@'); at != string::npos;
+        at = ir.find('@', at + 1))
+    {
+        size_t end = ir.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_", at + 1);
+        used.insert(ir.substr(at, end - at));
+    }
+    string result;
+    for (auto &name : used)
+    {
+        auto decl = decls.find(name);
+        if (decl != decls.end())result += decl->second + "\n";
+    }
+    return result;
+}
+
+
+// -stream: each global declaration and function is lowered and compiled as
+// soon as the parser has it, and its AST, IR and raw program go before the
+// parser goes on, so they never take more memory than the largest item. A
+// function is compiled in IR of its own with declarations of the globals and
+// functions it uses, which are those declared before it; passes that look
+// at the whole program are left out, as with the cache. -koopa prints the
+// IR of each item as it comes instead
+bool CompilerContext::compile_stream(const char *source, size_t size,
+    string &output)
+{
+    bool riscv = mode != "-koopa";
+    // the text modes may write their code out as it comes
+    bool text_mode = mode != "-obj" && mode != "-sim";
+    stringstream ss;
+    streambuf *code = text_mode && stream_out ? stream_out->rdbuf() : ss.rdbuf();
+    streambuf *out_buf = out.rdbuf(code);
+    mark_lines = riscv && (debug_lines || line_comments);
+    map<string, string> decls;  // what the functions parsed so far may use
+    {
+        IRStream ir;
+        out.rdbuf(ir.rdbuf());
+        dump_ir_begin();
+        out.rdbuf(code);
+        istringstream library(ir.str().c_str());
+        for (string line; getline(library, line);)
+            if (!riscv)out << line << endl;
+            else if (line.compare(0, 6, "decl @") == 0)
+                decls[line.substr(5, line.find('(') - 5)] = line;
+    }
+    if (emit_locs && !this->source.empty())
+        out << "\t.file\t1 \"" << this->source << "\"" << endl;
+    vector<FunctionStats> func_stats;
+    bool broken = false;  // the passes found an item broken
+    AST ast;
+    ast.on_item = [&](Node *item)
+    {
+        IRStream ir;
+        out.rdbuf(ir.rdbuf());
+        {
+            TraceScope scope("irgen");
+            dump_ir_item(item);
+        }
+        out.rdbuf(code);
+        if (!riscv)
+        {
+            out << ir.str().c_str();
+            if (item->kind != NodeKind::func_def)out << endl;
+            return;
+        }
+        string text = ir.str().c_str(), chunk;
+        if (item->kind == NodeKind::func_def)
+        {
+            string name;
+            chunk = used_declarations(text, decls) + text;
+            decls["@" + string(item->ident)] = declaration(
+                text.substr(0, text.find('\n')), name);
+        }
+        else
+        {
+            istringstream globals(text);
+            for (string line; getline(globals, line);)
+                if (line.compare(0, 8, "global @") == 0)
+                    decls[line.substr(7, line.find(' ', 7) - 7)] =
+                        global_declaration(line);
+            chunk = text;
+        }
+        SourceLines lines;
+        if (mark_lines)
+        {
+            source_lines = &lines;
+            chunk = ir_take_lines(chunk, lines);
+        }
+        if (program_stats)program_stats = &func_stats;
+        PassManager pass_manager(passes, mode);
+        map<string, string> funcs;
+        // the code of the globals a function declares is not wanted
+        stringstream globals;
+        if (item->kind == NodeKind::func_def)out.rdbuf(globals.rdbuf());
+        string error;
+        bool ok = emit_riscv(chunk.c_str(), pass_manager, error, &funcs);
+        out.rdbuf(code);
+        log += pass_manager.log;
+        if (!ok)
+        {
+            log += "error: " + error + "\n";
+            broken = true;
+        }
+        for (auto &func : funcs)out << func.second;
+        for (auto &func : func_stats)
+            if (!func.name.empty())stats.push_back(func);
+        source_lines = nullptr;
+    };
+    bool ok;
+    {
+        TraceScope scope("parse");
+        Lexer lexer(source, size);
+        ok = yyparse(ast, lexer) == 0;
+    }
+    ast_nodes = ast.nodes;
+    dump_ir_end();
+    mark_lines = false;
+    program_stats = report_stats ? &stats : nullptr;
+    out << endl;
+    out.rdbuf(out_buf);
+    if (!ok || broken)return false;
+    if (mode == "-obj")
+    {
+        TraceScope scope("assemble");
+        output = assemble(ss.str());
+    }
+    else if (mode == "-sim")
+    {
+        TraceScope scope("run");
+        return simulate(ss.str(), output);
+    }
+    else output = ss.str();
+    return true;
+}
+
+
+// -run-koopa: output is what the program prints, the dynamic counts go to log
+static void run_koopa(const koopa_raw_program_t &raw, string &output,
+    string &log, int &exit_code)
+{
+    stringstream printed;
+    Interpreter interpreter(raw, cin, printed);
+    int32_t result = 0;
+    if (interpreter.run(result))exit_code = result;
+    else
+    {
+        log += "error: " + interpreter.error + "\n";
+        exit_code = -1;
+    }
+    output = printed.str();
+    log += interpreter.report();
+}
+
+
+// -sim: output is what the program prints, the cycles go to log
+bool CompilerContext::simulate(const string &code, string &output)
+{
+    CostModel model;
+    if (!cost_model_parse(model, sim_model))
+    {
+        log += "error: bad -sim-model " + sim_model + "\n";
+        return false;
+    }
+    stringstream printed;
+    Simulator simulator(model, cin, printed);
+    if (!simulator.load(code))
+    {
+        log += "error: " + simulator.error + "\n";
+        return false;
+    }
+    int32_t result = 0;
+    if (simulator.run(result))exit_code = result;
+    else
+    {
+        log += "error: " + simulator.error + "\n";
+        exit_code = -1;
+    }
+    output = printed.str();
+    log += simulator.errors;
+    log += simulator.report();
+    if (profile_generate)profile = simulator.file;
+    return true;
+}
+
+
+// options of the backend, which it keeps in thread locals
+void CompilerContext::backend_options()
+{
+    mark_spills = mode == "-sim";
+    count_edges = profile_generate;
+    profile_path = profile_file;
+    block_profile = profile_use.empty() ? nullptr : &profile_use;
+    instrument = instrument_functions;
+    stats.clear();
+    program_stats = report_stats ? &stats : nullptr;
+    emit_locs = debug_lines;
+    emit_line_comments = line_comments;
+    source_lines = nullptr;
+}
+
+
+bool CompilerContext::compile(const char *source, size_t size,
+    string &output)
+{
+    if (ir_is_binary(source, size))return compile_ir(source, size, output);
+    reset_frontend();
+    bool riscv = mode == "-riscv" || mode == "-perf" || mode == "-obj" ||
+        mode == "-sim";
+    if (stream && (riscv || mode == "-koopa"))
+    {
+        log.clear();
+        backend_options();
+        return compile_stream(source, size, output);
+    }
+    // idents of the AST are views of the source, and all its nodes go at once
+    AST ast;
+    {
+        TraceScope scope("parse");
+        Lexer lexer(source, size);
+        if (yyparse(ast, lexer))return false;
+    }
+    ast_nodes = ast.nodes;
+
+    log.clear();
+    stringstream ss;
+    streambuf *out_buf = out.rdbuf(ss.rdbuf());
+    backend_options();
+    SourceLines lines;
+    lines.file = this->source;
+    mark_lines = riscv && (debug_lines || line_comments);
+    // the cache only holds code built without profiles, instrumentation or
+    // lines, and -stats needs the IR of every function
+    bool cached = !cache_dir.empty() && !profile_generate &&
+        profile_use.empty() && !instrument_functions && !report_stats &&
+        !mark_lines;
+    bool ok = true;
+    if (mode == "-koopa")
+    {
+        TraceScope scope("irgen");
+        dump_ir(ast.root);
+    }
+    else if (riscv && cached)
+        ok = emit_cached(ast.root);
+    else if (riscv)
+    {
+        IRStream ir;
+        out.rdbuf(ir.rdbuf());
+        {
+            TraceScope scope("irgen");
+            dump_ir(ast.root);
+        }
+        out.rdbuf(ss.rdbuf());
+        PassManager pass_manager(passes, mode);
+        string error;
+        if (mark_lines)
+        {
+            source_lines = &lines;
+            ok = emit_riscv(ir_take_lines(ir.str().c_str(), lines).c_str(),
+                pass_manager, error);
+            source_lines = nullptr;
+            mark_lines = false;
+        }
+        else ok = emit_riscv(ir.str().c_str(), pass_manager, error);
+        log += pass_manager.log;
+        if (!ok)log += "error: " + error + "\n";
+    }
+    else if (mode == "-kir" || mode == "-run-koopa")
+    {
+        IRStream ir;
+        out.rdbuf(ir.rdbuf());
+        {
+            TraceScope scope("irgen");
+            dump_ir(ast.root);
+        }
+        out.rdbuf(out_buf);
+        koopa_raw_program_builder_t builder;
+        koopa_raw_program_t raw;
+        if (!build_raw(ir.str().c_str(), builder, raw))
+        {
+            log += "error: the generated IR does not parse\n";
+            return false;
+        }
+        PassManager pass_manager(passes, mode);
+        {
+            TraceScope scope("optimize");
+            ok = pass_manager.run(raw);
+        }
+        log += pass_manager.log;
+        if (!ok)
+        {
+            log += "error: " + pass_manager.error + "\n";
+            koopa_delete_raw_program_builder(builder);
+            return false;
+        }
+        if (mode == "-run-koopa")
+        {
+            TraceScope scope("run");
+            run_koopa(raw, output, log, exit_code);
+        }
+        else
+        {
+            TraceScope scope("write");
+            output = ir_write(raw);
+        }
+        koopa_delete_raw_program_builder(builder);
+        return true;
+    }
+    else if (mode == "-test")dump(ast.root);
+    else out << "NotImplementedError" << endl;
+    out << endl;
+    out.rdbuf(out_buf);
+    if (!ok)return false;
+    if (mode == "-obj")
+    {
+        TraceScope scope("assemble");
+        output = assemble(ss.str());
+    }
+    else if (mode == "-sim")
+    {
+        TraceScope scope("run");
+        return simulate(ss.str(), output);
+    }
+    else output = ss.str();
+    return true;
+}
+
+
+// records the phase that took from start to now, in timings and in the time
+// trace; start is moved to now
+static void lap(vector<pair<string, double>> &timings, const char *phase,
+    chrono::steady_clock::time_point &start)
+{
+    auto now = chrono::steady_clock::now();
+    timings.emplace_back(phase, chrono::duration<double>(now - start).count());
+    time_trace.add(phase, "", start, now);
+    // the allocations were made outside of a phase, only the RSS is sampled
+    if (mem_enabled())mem_leave(mem_enter(phase));
+    start = now;
+}
+
+
+// the backend modes on a raw program, load is passed on to emit_program;
+// -sim gets the code to run
+static string emit_backend(const string &mode, const koopa_raw_program_t &raw,
+    const function<void(size_t)> &load,
+    vector<pair<string, double>> &timings)
+{
+    auto start = chrono::steady_clock::now();
+    stringstream ss;
+    streambuf *out_buf = out.rdbuf(ss.rdbuf());
+    for (auto &func : emit_program(raw, load))out << func;
+    out << endl;
+    out.rdbuf(out_buf);
+    lap(timings, "codegen", start);
+    if (mode != "-obj")return ss.str();
+    string object = assemble(ss.str());
+    lap(timings, "assemble", start);
+    return object;
+}
+
+
+// function bodies are decoded by the threads emitting them, unless there are
+// passes to run first
+bool CompilerContext::compile_ir(const char *data, size_t size, string &output)
+{
+    bool run = mode == "-run-koopa", sim = mode == "-sim";
+    if (mode != "-riscv" && mode != "-perf" && mode != "-obj" && !run && !sim)
+        return false;
+    timings.clear();
+    log.clear();
+    backend_options();
+    auto start = chrono::steady_clock::now();
+    IRReader reader(data, size);
+    koopa_raw_program_t raw = reader.program();
+    lap(timings, "read headers", start);
+    PassManager pass_manager(passes, mode);
+    if (pass_manager.empty() && !run)
+    {
+        output = emit_backend(mode, raw, [&](size_t i) { reader.load(i); },
+            timings);
+        return !sim || run_code(output);
+    }
+    for (size_t i = 0; i < raw.funcs.len; i++)reader.load(i);
+    lap(timings, "read bodies", start);
+    bool ok = pass_manager.run(raw);
+    log += pass_manager.log;
+    if (!ok)
+    {
+        log += "error: " + pass_manager.error + "\n";
+        return false;
+    }
+    lap(timings, "optimize", start);
+    if (run)
+    {
+        run_koopa(raw, output, log, exit_code);
+        lap(timings, "run", start);
+    }
+    else output = emit_backend(mode, raw, nullptr, timings);
+    return !sim || run_code(output);
+}
+
+
+bool CompilerContext::compile_koopa(const char *ir, string &output)
+{
+    bool riscv = mode == "-riscv" || mode == "-perf" || mode == "-obj" ||
+        mode == "-sim";
+    if (!riscv && mode != "-kir" && mode != "-run-koopa")return false;
+    timings.clear();
+    log.clear();
+    backend_options();
+    auto start = chrono::steady_clock::now();
+    koopa_program_t program;
+    if (koopa_parse_from_string(ir, &program) != KOOPA_EC_SUCCESS)return false;
+    lap(timings, "koopa parse", start);
+    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
+    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
+    koopa_delete_program(program);
+    lap(timings, "build raw", start);
+    PassManager pass_manager(passes, mode);
+    bool ok = pass_manager.run(raw);
+    log += pass_manager.log;
+    if (!ok)
+    {
+        log += "error: " + pass_manager.error + "\n";
+        koopa_delete_raw_program_builder(builder);
+        return false;
+    }
+    if (!pass_manager.empty())lap(timings, "optimize", start);
+    if (riscv)
+    {
+        output = emit_backend(mode, raw, nullptr, timings);
+        if (mode == "-sim")ok = run_code(output);
+    }
+    else if (mode == "-run-koopa")
+    {
+        run_koopa(raw, output, log, exit_code);
+        lap(timings, "run", start);
+    }
+    else
+    {
+        output = ir_write(raw);
+        lap(timings, "write", start);
+    }
+    koopa_delete_raw_program_builder(builder);
+    return ok;
+}
+
+
+bool CompilerContext::compile_asm(const string &code, string &output)
+{
+    if (mode != "-sim")return false;
+    timings.clear();
+    log.clear();
+    output = code;
+    return run_code(output);
+}
+
+
+// -sim on the code the backend left in output, which gets what the program
+// prints instead
+bool CompilerContext::run_code(string &output)
+{
+    auto start = chrono::steady_clock::now();
+    string code = move(output);
+    bool ok = simulate(code, output);
+    lap(timings, "run", start);
+    return ok;
+}
@@ -1,59 +1,350 @@
-#include <cassert>
-#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
-#include <memory>
 #include <string>
-#include "AST.h"
-#include "RISCV.h"
-#include "koopa.h"
-#define _SUB_MODE
+#include <vector>
+#include <unistd.h>
+#include "Compiler.h"
+#include "IRFile.h"
+#include "Memory.h"
+#include "Parallel.h"
+#include "Trace.h"
 using namespace std;
+namespace fs = std::filesystem;
 
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
+static bool read_file(const string &path, string &content)
+{
+    ifstream file(path, ios::binary);
+    if (!file)return false;
+    stringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+
+static bool write_file(const string &path, const string &content,
+    bool append = false)
+{
+    ofstream file(path, append ? ios::binary | ios::app : ios::binary);
+    file << content;
+    return bool(file);
+}
+
+
+// SYSY_CACHE_DIR turns on the per-function code cache
+static string cache_dir()
+{
+    const char *dir = getenv("SYSY_CACHE_DIR");
+    return dir ? dir : "";
+}
+
+
+static void print_timings(const CompilerContext &context)
+{
+    double total = 0;
+    cerr << fixed << setprecision(3);
+    for (auto &phase : context.timings)
+    {
+        cerr << left << setw(16) << phase.first << phase.second * 1000 <<
+            " ms" << endl;
+        total += phase.second;
+    }
+    cerr << left << setw(16) << "backend total" << total * 1000 << " ms" <<
+        endl;
+}
+
+
+// -enable-pass=a,b style lists
+static void add_names(vector<string> &names, const string &list)
+{
+    stringstream ss(list);
+    for (string name; getline(ss, name, ',');)
+        if (!name.empty())names.push_back(name);
+}
+
+
+// options of the optimization passes, false if arg is none of them
+static bool pass_option(PassOptions &options, const string &arg)
+{
+    auto value = [&](const string &prefix, vector<string> &names)
+    {
+        if (arg.compare(0, prefix.size(), prefix) != 0)return false;
+        add_names(names, arg.substr(prefix.size()));
+        return true;
+    };
+    if (arg.size() == 3 && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '2')
+        options.level = arg[2] - '0';
+    else if (arg == "-print-after-all")options.print_all = true;
+    else if (arg == "-time-passes")options.time = true;
+    else return value("-enable-pass=", options.enable) ||
+        value("-disable-pass=", options.disable) ||
+        value("-print-after=", options.print_after);
+    return true;
+}
+
+
+static int fail(const string &message)
+{
+    cerr << "error: " << message << endl;
+    return 1;
+}
+
+
+// what the options say beyond the context
+struct Options
+{
+    string input, output, trace_file, stats_file;
+    bool from_koopa = false;
+};
+
+
+// reads argv[first..] into context and options, false after printing what is
+// wrong with them
+static bool parse_options(int argc, const char *argv[], int first,
+    CompilerContext &context, Options &options)
+{
+    auto bad = [](const string &message) { fail(message); return false; };
+    for (int i = first; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)options.output = argv[++i];
+        else if (arg == "-from-koopa")options.from_koopa = true;
+        else if (arg == "-mem-report")mem_enable();
+        else if (arg.compare(0, 12, "-time-trace=") == 0)
+            options.trace_file = arg.substr(12);
+        else if (arg.compare(0, 11, "-sim-model=") == 0)
+            context.sim_model = arg.substr(11);
+        else if (arg == "-fprofile-generate")context.profile_generate = true;
+        else if (arg.compare(0, 19, "-fprofile-generate=") == 0)
+        {
+            context.profile_generate = true;
+            context.profile_file = arg.substr(19);
+            // the name goes into the code as an .asciz string
+            if (context.profile_file.find_first_of("\"\\#") != string::npos)
+                return bad("bad profile file " + context.profile_file);
+        }
+        else if (arg == "-finstrument-functions")
+            context.instrument_functions = true;
+        else if (arg == "-g")context.debug_lines = true;
+        else if (arg == "-stream")context.stream = true;
+        else if (arg == "-fverbose-asm")context.line_comments = true;
+        else if (arg == "-stats")context.report_stats = true;
+        else if (arg.compare(0, 7, "-stats=") == 0)
+        {
+            context.report_stats = true;
+            options.stats_file = arg.substr(7);
+        }
+        else if (arg.compare(0, 14, "-fprofile-use=") == 0)
+        {
+            string profile, path = arg.substr(14);
+            if (!read_file(path, profile))return bad("cannot read " + path);
+            if (!context.profile_use.parse(profile))
+                return bad(path + " is not a profile");
+        }
+        else if (pass_option(context.passes, arg))continue;
+        else if (arg[0] != '-' && options.input.empty())options.input = arg;
+        else return bad("unknown option " + arg);
+    }
+    if (options.input.empty())return bad("no input file");
+    if (options.output.empty())return bad("no output file (-o)");
+    return true;
+}
+
+
+// compiler -batch <mode> <directory | list file> -o <output directory>
+// [options]
+// compiles every .sy file in the directory (or every path listed in the file,
+// one per line) in parallel, output files are named after the inputs. .koopa
+// and .kir inputs only go through the backend. The options are those of
+// single files, except the ones writing a file of their own
+static int batch(int argc, const char *argv[])
+{
+    if (argc < 3)return fail("no mode");
+    string mode = argv[2];
+    CompilerContext base(mode);
+    base.cache_dir = cache_dir();
+    Options options;
+    if (!parse_options(argc, argv, 3, base, options))return 1;
+    if (base.profile_generate || base.report_stats ||
+        !options.trace_file.empty())
+        return fail("-fprofile-generate, -stats and -time-trace are for "
+            "single files");
+    string input = options.input, output_dir = options.output;
+    vector<string> inputs;
+    if (fs::is_directory(input))
+    {
+        for (auto &entry : fs::directory_iterator(input))
+            if (entry.path().extension() == ".sy" ||
+                entry.path().extension() == ".koopa" ||
+                entry.path().extension() == ".kir")
+                inputs.push_back(entry.path().string());
+        sort(inputs.begin(), inputs.end());
+    }
+    else
+    {
+        ifstream list(input);
+        if (!list)return fail("cannot read " + input);
+        for (string line; getline(list, line);)
+            if (!line.empty())inputs.push_back(line);
+    }
+    fs::create_directories(output_dir);
+    string ext = mode == "-koopa" ? ".koopa" : mode == "-test" ? ".ast" :
+        mode == "-obj" ? ".o" : mode == "-kir" ? ".kir" : ".S";
+    atomic<int> failed(0);
+    parallel_for(inputs.size(), [&](size_t i)
+    {
+        string source, result;
+        fs::path output = fs::path(output_dir) /
+            fs::path(inputs[i]).stem().concat(ext);
+        CompilerContext context = base;
+        context.source = inputs[i];
+        bool koopa = options.from_koopa ||
+            fs::path(inputs[i]).extension() == ".koopa";
+        if (!read_file(inputs[i], source) ||
+            !(koopa ? context.compile_koopa(source.c_str(), result) :
+            context.compile(source, result)) ||
+            !write_file(output.string(), result))
+        {
+            cerr << context.log << "failed: " << inputs[i] << endl;
+            failed++;
+        }
+    });
+    cerr << inputs.size() - failed << "/" << inputs.size() << " compiled" <<
+        endl;
+    if (mem_enabled())cerr << mem_report();
+    return failed > 0;
+}
 
 
+// compiler <mode> <input> -o <output> [options]
+// with -run-koopa and -sim, the program is run on stdin, output gets what it
+// prints and the exit status is what its main returned; -sim runs the code of
+// -perf on a cycle model of an RV32IM core and reports cycles, instruction mix
+// and spill code of each function. It also runs .s / .S files
+//   -from-koopa           read Koopa IR text instead of SysY, only run the
+//                         backend
+//   -O0, -O1, -O2         optimization level, -perf defaults to -O2
+//   -enable-pass=a,b      add passes to the pipeline of the level
+//   -disable-pass=a,b     take passes out of it
+//   -print-after=a,b      print the IR after these passes
+//   -print-after-all      ... after every pass
+//   -time-passes          time of each pass and its change of the IR size
+//   -time-trace=<file>    write the time of each phase, and of each function
+//                         in IR generation and codegen, to file as a Chrome
+//                         trace (chrome://tracing, ui.perfetto.dev) and print
+//                         a summary
+//   -mem-report           allocations and RSS of each phase and the largest
+//                         consumers of memory
+//   -sim-model=load_use=1,branch=2,jump=1,mul=3,div=20
+//                         costs of the -sim model: load-use stall, taken
+//                         branch and jump penalties, mul and div latencies
+//   -fprofile-generate[=<file>]
+//                         count the calls, edges and call sites of each
+//                         function in the code; the program appends
+//                         "<id> <count>" lines to file (sysy.profile by
+//                         default) when main returns, under -sim the
+//                         compiler does; counts of the same id add up
+//   -fprofile-use=<file>  lay out blocks and promote globals after counts of
+//                         earlier runs
+//   -finstrument-functions
+//                         time each function with rdcycle and rdinstret, with
+//                         and without its callees; main prints the table to
+//                         stderr when it returns
+//   -stats[=<file>]       counts of the code of each function as JSON: IR
+//                         instructions by opcode, blocks, frame size, spill
+//                         stores and reloads, li s11 sequences, calls and
+//                         instructions, to file or stderr
+//   -g                    .file and .loc directives of the SysY lines, for an
+//                         external assembler's .debug_line
+//   -fverbose-asm         "# line N" before the code of each SysY line
+//   -stream               lower and compile each function as soon as it is
+//                         parsed and free it before going on, so memory
+//                         follows the largest function rather than the
+//                         program; functions only see what is declared before
+//                         them and whole program passes are left out
 int main(int argc, const char *argv[])
 {
-    assert(argc == 5);
-    auto mode = argv[1];
-    auto input = argv[2];
-    auto output = argv[4];
-
-    yyin = fopen(input, "r");
-    #ifdef  _SUB_MODE
-    freopen(output, "w", stdout); 
-    #endif
-    assert(yyin);
-
-    unique_ptr<BaseAST> ast;
-    auto ret = yyparse(ast);
-    assert(!ret);
-
-    if (string(mode) == "-koopa")ast->dumpIR();
-    else if (string(mode) == "-riscv" || string(mode) == "-perf")
-    {
-        stringstream ss;
-        streambuf* cout_buf = cout.rdbuf();
-        cout.rdbuf(ss.rdbuf());
-        ast->dumpIR();
-        string ir_str = ss.str();
-        const char *ir = ir_str.data();
-        cout.rdbuf(cout_buf);
-        koopa_program_t program;
-        koopa_error_code_t ret = koopa_parse_from_string(ir, &program);
-        assert(ret == KOOPA_EC_SUCCESS);
-        koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-        koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-        koopa_delete_program(program);
-        freopen(output, "w", stdout);
-        Visit(raw);
-        koopa_delete_raw_program_builder(builder);
-    }
-    else if (string(mode) == "-test")ast->dump();
-    else cout << "NotImplementedError" << endl;
-    cout << endl;
-    return 0;
+    if (argc > 1 && string(argv[1]) == "-batch")return batch(argc, argv);
+    if (argc < 2)return fail("no mode");
+    string mode = argv[1];
+    CompilerContext context(mode);
+    context.cache_dir = cache_dir();
+    Options options;
+    if (!parse_options(argc, argv, 2, context, options))return 1;
+    string input = options.input, output = options.output;
+    context.source = input;
+    if (!options.trace_file.empty())time_trace.enable();
+    auto start = TimeTrace::Clock::now();
+
+    // SysY and binary IR are used straight from the mapping, the bodies of
+    // binary IR are read on demand
+    MappedFile file(input);
+    if (!file.ok())return fail("cannot read " + input);
+    string result;
+    bool ok;
+    // -stream writes the code of the text modes out as it is made
+    ofstream stream_file;
+    if (context.stream && (mode == "-riscv" || mode == "-perf" ||
+        mode == "-koopa"))
+    {
+        stream_file.open(output, ios::binary);
+        if (!stream_file)return fail("cannot write " + output);
+        context.stream_out = &stream_file;
+    }
+    string ext = fs::path(input).extension().string();
+    if (ir_is_binary(file.data(), file.size()))
+        ok = context.compile_ir(file.data(), file.size(), result);
+    else if (mode == "-sim" && (ext == ".s" || ext == ".S"))
+        ok = context.compile_asm(string(file.data(), file.size()), result);
+    else if (options.from_koopa)
+    {
+        // the mapping is zero filled to the end of its last page, so unless
+        // the file ends on a page boundary it is a C string already
+        string copy;
+        const char *ir = file.data();
+        if (file.size() % sysconf(_SC_PAGESIZE) == 0)
+        {
+            copy.assign(file.data(), file.size());
+            ir = copy.c_str();
+        }
+        ok = context.compile_koopa(ir, result);
+    }
+    else ok = context.compile(file.data(), file.size(), result);
+    time_trace.add("total", "", start, TimeTrace::Clock::now());
+    cerr << context.log;
+    if (!ok)
+    {
+        if (context.stream_out)
+        {
+            stream_file.close();
+            fs::remove(output);
+        }
+        return fail("cannot compile " + input);
+    }
+    if (!context.timings.empty())print_timings(context);
+    if (!options.trace_file.empty())
+    {
+        if (!write_file(options.trace_file, time_trace.json()))
+            return fail("cannot write " + options.trace_file);
+        cerr << time_trace.summary();
+    }
+    if (mem_enabled())cerr << mem_report();
+    if (!context.profile.empty() &&
+        !write_file(context.profile_file, context.profile, true))
+        return fail("cannot write " + context.profile_file);
+    if (context.report_stats && options.stats_file.empty())
+        cerr << stats_json(context.stats);
+    else if (context.report_stats &&
+        !write_file(options.stats_file, stats_json(context.stats)))
+        return fail("cannot write " + options.stats_file);
+    if (context.stream_out ? !stream_file.flush() : !write_file(output, result))
+        return fail("cannot write " + output);
+    return context.exit_code;
 }
@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include <new>
+#include "Memory.h"
+
+
+// the global allocation functions count for -mem-report (see Memory.h); the
+// aligned ones are left to the library
+
+
+void *operator new(size_t size) { return mem_alloc(size, MEM_OTHER); }
+void *operator new[](size_t size) { return mem_alloc(size, MEM_OTHER); }
+
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    void *ptr = std::malloc(size ? size : 1);
+    mem_count_alloc(ptr, MEM_OTHER);
+    return ptr;
+}
+
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+
+void operator delete(void *ptr) noexcept { mem_free(ptr, MEM_OTHER); }
+void operator delete[](void *ptr) noexcept { mem_free(ptr, MEM_OTHER); }
+void operator delete(void *ptr, size_t) noexcept { mem_free(ptr, MEM_OTHER); }
+void operator delete[](void *ptr, size_t) noexcept
+{
+    mem_free(ptr, MEM_OTHER);
+}
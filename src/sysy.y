@@ -2,6 +2,7 @@
     #include <memory>
     #include <string>
     #include "AST.h"
+    #include "Lexer.h"
 }
 
 %{
@@ -12,804 +13,528 @@
 #include <vector>
 #include "AST.h"
 
-int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
-
 using namespace std;
 
+// the stacks of the parser grow on the heap, nesting of blocks, statements
+// and parentheses is only limited by this
+#define YYMAXDEPTH (1 << 24)
+
 %}
 
-%parse-param { std::unique_ptr<BaseAST> &ast }
+%define api.pure full
+%locations
+%lex-param { Lexer &lexer }
+%parse-param { AST &ast } { Lexer &lexer }
 
+// nodes are allocated in the arena of ast, lists collect in chains there
 %union {
-    std::string *str_val;
+    const std::string_view *ident;  // in the string table of the lexer
     int int_val;
-    BaseAST *ast_val;
-    std::vector<std::unique_ptr<BaseAST>> *vec_val;
+    Op op;
+    BType type;
+    Node *node;
+    NodeChain chain;
 }
 
 %token INT VOID RETURN CONST IF ELSE WHILE BREAK CONTINUE
-%token <str_val> IDENT
+%token <ident> IDENT
 %token <int_val> INT_CONST
-%token <str_val> LE GE EQ NE AND OR
-
-%type <str_val> UNARYOP MULOP ADDOP RELOP EQOP ANDOP OROP
-%type <ast_val> FuncDef Block Stmt Exp PrimaryExp UnaryExp AddExp
-%type <ast_val> MulExp RelExp EqExp LAndExp LOrExp Decl ConstDecl ConstDef
-%type <ast_val> ConstInitVal BlockItem ConstExp VarDecl VarDef InitVal
-%type <ast_val> SimpleStmt OpenStmt ClosedStmt CompUnitList FuncFParam
-%type <vec_val> BlockItemList ConstDefList VarDefList FuncFParams FuncRParams
-%type <vec_val> ConstExpList ConstInitValList InitValList ExpList
+%token LE GE EQ NE AND OR
+
+%type <op> UNARYOP MULOP ADDOP RELOP EQOP ANDOP OROP
+%type <node> FuncDef Block Stmt Exp PrimaryExp UnaryExp AddExp
+%type <node> MulExp RelExp EqExp LAndExp LOrExp Decl ConstDecl ConstDef
+%type <node> ConstInitVal BlockItem ConstExp VarDecl VarDef InitVal
+%type <node> SimpleStmt OpenStmt ClosedStmt FuncFParam
+%type <chain> CompUnitList BlockItemList ConstDefList VarDefList FuncFParams
+%type <chain> FuncRParams ConstExpList ConstInitValList InitValList ExpList
 %type <int_val> Number
-%type <str_val> LVal Type
+%type <ident> LVal
+%type <type> Type
+
+%code {
+    int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, Lexer &lexer);
+    void yyerror(YYLTYPE *yylloc, AST &ast, Lexer &lexer, const char *s);
+}
 
 %%
 
 CompUnit
     : CompUnitList {
-        auto comp_unit = unique_ptr<BaseAST>($1);
-        ast = move(comp_unit);
+        ast.root = ast.node(NodeKind::comp_unit);
+        ast.root->list = ast.list($1);
     }
     ;
 
 CompUnitList
-    : FuncDef {
-        auto comp_unit = new CompUnitAST();
-        auto func_def = unique_ptr<BaseAST>($1);
-        comp_unit->func_def_list.push_back(move(func_def));
-        $$ = comp_unit;
-    }
-    | Decl {
-        auto comp_unit = new CompUnitAST();
-        auto decl = unique_ptr<BaseAST>($1);
-        comp_unit->decl_list.push_back(move(decl));
-        $$ = comp_unit;
-    }
-    | CompUnitList FuncDef {
-        auto comp_unit = (CompUnitAST*)($1);
-        auto func_def = unique_ptr<BaseAST>($2);
-        comp_unit->func_def_list.push_back(move(func_def));
-        $$ = comp_unit;
-    }
-    | CompUnitList Decl {
-        auto comp_unit = (CompUnitAST*)($1);
-        auto decl = unique_ptr<BaseAST>($2);
-        comp_unit->decl_list.push_back(move(decl));
-        $$ = comp_unit;
-    }
+    : FuncDef { $$ = ast.item(ast.chain(), $1); }
+    | Decl { $$ = ast.item(ast.chain(), $1); }
+    | CompUnitList FuncDef { $$ = ast.item($1, $2); }
+    | CompUnitList Decl { $$ = ast.item($1, $2); }
     ;
 
 FuncDef
     : Type IDENT '(' ')' Block {
-        auto func_def = new FuncDefAST();
-        func_def->func_type = *unique_ptr<string>($1);
-        func_def->ident = *unique_ptr<string>($2);
-        func_def->block = unique_ptr<BaseAST>($5);
+        auto func_def = ast.node(NodeKind::func_def, @1.first_line);
+        func_def->type = $1;
+        func_def->ident = *$2;
+        func_def->a = $5;
         $$ = func_def;
     }
     | Type IDENT '(' FuncFParams ')' Block {
-        auto func_def = new FuncDefAST();
-        func_def->func_type = *unique_ptr<string>($1);
-        func_def->ident = *unique_ptr<string>($2);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($4);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            func_def->params.push_back(move(*it));
-        func_def->block = unique_ptr<BaseAST>($6);
-        ((BlockAST*)(func_def->block).get())->func = func_def->ident;
+        auto func_def = ast.node(NodeKind::func_def, @1.first_line);
+        func_def->type = $1;
+        func_def->ident = *$2;
+        func_def->list = ast.list($4);
+        func_def->a = $6;
+        func_def->a->ident = func_def->ident;
         $$ = func_def;
     }
     ;
 
 FuncFParams
-    : FuncFParam {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | FuncFParams ',' FuncFParam {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : FuncFParam { $$ = ast.chain($1); }
+    | FuncFParams ',' FuncFParam { $$ = ast.append($1, $3); }
     ;
 
 FuncFParam
     : Type IDENT {
-        auto param = new FuncFParamAST();
-        param->type = FuncFParamType::var;
-        param->b_type = *unique_ptr<string>($1);
-        param->ident = *unique_ptr<string>($2);
+        auto param = ast.node(NodeKind::func_fparam);
+        param->type = $1;
+        param->ident = *$2;
         $$ = param;
     }
     | Type IDENT '[' ']' {
-        auto param = new FuncFParamAST();
-        param->type = FuncFParamType::list;
-        param->b_type = *unique_ptr<string>($1);
-        param->ident = *unique_ptr<string>($2);
+        auto param = ast.node(NodeKind::func_fparam);
+        param->type = $1;
+        param->ident = *$2;
+        param->value = 1;
         $$ = param;
     }
     | Type IDENT '[' ']' ConstExpList {
-        auto param = new FuncFParamAST();
-        param->type = FuncFParamType::list;
-        param->b_type = *unique_ptr<string>($1);
-        param->ident = *unique_ptr<string>($2);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($5);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            param->const_exp_list.push_back(move(*it));
+        auto param = ast.node(NodeKind::func_fparam);
+        param->type = $1;
+        param->ident = *$2;
+        param->value = 1;
+        param->list = ast.list($5);
         $$ = param;
     }
     ;
 
 FuncRParams
-    : Exp {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | FuncRParams ',' Exp {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : Exp { $$ = ast.chain($1); }
+    | FuncRParams ',' Exp { $$ = ast.append($1, $3); }
     ;
 
 Block
     : '{' BlockItemList '}' {
-        auto block = new BlockAST();
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            block->block_item_list.push_back(move(*it));
+        auto block = ast.node(NodeKind::block);
+        block->list = ast.list($2);
         $$ = block;
     }
     ;
 
 Stmt
-    : OpenStmt {
-        auto stmt = ($1);
-        $$ = stmt;
-    }
-    | ClosedStmt {
-        auto stmt = ($1);
-        $$ = stmt;
-    }
+    : OpenStmt { $$ = $1; }
+    | ClosedStmt { $$ = $1; }
     ;
 
 ClosedStmt
     : SimpleStmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::simple;
-        stmt->exp_simple = unique_ptr<BaseAST>($1);
+        auto stmt = ast.node(NodeKind::stmt, @1.first_line);
+        stmt->a = $1;
         $$ = stmt;
     }
     | IF '(' Exp ')' ClosedStmt ELSE ClosedStmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::ifelse;
-        stmt->exp_simple = unique_ptr<BaseAST>($3);
-        stmt->if_stmt = unique_ptr<BaseAST>($5);
-        stmt->else_stmt = unique_ptr<BaseAST>($7);
+        auto stmt = ast.node(NodeKind::if_else, @1.first_line);
+        stmt->a = $3;
+        stmt->b = $5;
+        stmt->c = $7;
         $$ = stmt;
     }
     | WHILE '(' Exp ')' ClosedStmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::while_;
-        stmt->exp_simple = unique_ptr<BaseAST>($3);
-        stmt->while_stmt = unique_ptr<BaseAST>($5);
+        auto stmt = ast.node(NodeKind::while_, @1.first_line);
+        stmt->a = $3;
+        stmt->b = $5;
         $$ = stmt;
     }
     ;
 
 OpenStmt
     : IF '(' Exp ')' Stmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::if_;
-        stmt->exp_simple = unique_ptr<BaseAST>($3);
-        stmt->if_stmt = unique_ptr<BaseAST>($5);
+        auto stmt = ast.node(NodeKind::if_, @1.first_line);
+        stmt->a = $3;
+        stmt->b = $5;
         $$ = stmt;
     }
     | IF '(' Exp ')' ClosedStmt ELSE OpenStmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::ifelse;
-        stmt->exp_simple = unique_ptr<BaseAST>($3);
-        stmt->if_stmt = unique_ptr<BaseAST>($5);
-        stmt->else_stmt = unique_ptr<BaseAST>($7);
+        auto stmt = ast.node(NodeKind::if_else, @1.first_line);
+        stmt->a = $3;
+        stmt->b = $5;
+        stmt->c = $7;
         $$ = stmt;
     }
     | WHILE '(' Exp ')' OpenStmt {
-        auto stmt = new StmtAST();
-        stmt->type = StmtType::while_;
-        stmt->exp_simple = unique_ptr<BaseAST>($3);
-        stmt->while_stmt = unique_ptr<BaseAST>($5);
+        auto stmt = ast.node(NodeKind::while_, @1.first_line);
+        stmt->a = $3;
+        stmt->b = $5;
         $$ = stmt;
     }
     ;
 
 SimpleStmt
     : RETURN Exp ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::ret;
-        stmt->block_exp = unique_ptr<BaseAST>($2);
-        $$ = stmt;
-    }
-    | RETURN ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::ret;
-        stmt->block_exp = nullptr;
+        auto stmt = ast.node(NodeKind::ret, @1.first_line);
+        stmt->a = $2;
         $$ = stmt;
     }
+    | RETURN ';' { $$ = ast.node(NodeKind::ret, @1.first_line); }
     | LVal '=' Exp ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::lval;
-        stmt->lval = *unique_ptr<string>($1);
-        stmt->block_exp = unique_ptr<BaseAST>($3);
+        auto stmt = ast.node(NodeKind::assign, @1.first_line);
+        stmt->ident = *$1;
+        stmt->a = $3;
         $$ = stmt;
     }
     | IDENT ExpList '=' Exp ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::list;
-        stmt->lval = *unique_ptr<string>($1);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            stmt->exp_list.push_back(move(*it));
-        stmt->block_exp = unique_ptr<BaseAST>($4);
+        auto stmt = ast.node(NodeKind::assign_list, @1.first_line);
+        stmt->ident = *$1;
+        stmt->list = ast.list($2);
+        stmt->a = $4;
         $$ = stmt;
     }
     | Block {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::block;
-        stmt->block_exp = unique_ptr<BaseAST>($1);
+        auto stmt = ast.node(NodeKind::block_stmt, @1.first_line);
+        stmt->a = $1;
         $$ = stmt;
     }
     | Exp ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::exp;
-        stmt->block_exp = unique_ptr<BaseAST>($1);
-        $$ = stmt;
-    }
-    | ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::exp;
-        stmt->block_exp = nullptr;
-        $$ = stmt;
-    }
-    | BREAK ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::break_;
-        $$ = stmt;
-    }
-    | CONTINUE ';' {
-        auto stmt = new SimpleStmtAST();
-        stmt->type = SimpleStmtType::continue_;
+        auto stmt = ast.node(NodeKind::exp_stmt, @1.first_line);
+        stmt->a = $1;
         $$ = stmt;
     }
+    | ';' { $$ = ast.node(NodeKind::exp_stmt, @1.first_line); }
+    | BREAK ';' { $$ = ast.node(NodeKind::break_, @1.first_line); }
+    | CONTINUE ';' { $$ = ast.node(NodeKind::continue_, @1.first_line); }
     ;
 
 Exp
     : LOrExp {
-        auto exp = new ExpAST();
-        exp->l_or_exp = unique_ptr<BaseAST>($1);
+        auto exp = ast.node(NodeKind::exp);
+        exp->a = $1;
         $$ = exp;
     }
     ;
 
 LOrExp
-    : LAndExp {
-        auto l_or_exp = new LOrExpAST();
-        l_or_exp->op = "";
-        l_or_exp->l_and_exp = unique_ptr<BaseAST>($1);
-        $$ = l_or_exp;
-    }
+    : LAndExp { $$ = $1; }
     | LOrExp OROP LAndExp {
-        auto l_or_exp = new LOrExpAST();
-        l_or_exp->l_or_exp = unique_ptr<BaseAST>($1);
-        l_or_exp->op = *unique_ptr<string>($2);
-        l_or_exp->l_and_exp = unique_ptr<BaseAST>($3);
-        $$ = l_or_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 LAndExp
-    : EqExp {
-        auto l_and_exp = new LAndExpAST();
-        l_and_exp->op = "";
-        l_and_exp->eq_exp = unique_ptr<BaseAST>($1);
-        $$ = l_and_exp;
-    }
+    : EqExp { $$ = $1; }
     | LAndExp ANDOP EqExp {
-        auto l_and_exp = new LAndExpAST();
-        l_and_exp->l_and_exp = unique_ptr<BaseAST>($1);
-        l_and_exp->op = *unique_ptr<string>($2);
-        l_and_exp->eq_exp = unique_ptr<BaseAST>($3);
-        $$ = l_and_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 EqExp
-    : RelExp {
-        auto eq_exp = new EqExpAST();
-        eq_exp->op = "";
-        eq_exp->rel_exp = unique_ptr<BaseAST>($1);
-        $$ = eq_exp;
-    }
+    : RelExp { $$ = $1; }
     | EqExp EQOP RelExp {
-        auto eq_exp = new EqExpAST();
-        eq_exp->eq_exp = unique_ptr<BaseAST>($1);
-        eq_exp->op = *unique_ptr<string>($2);
-        eq_exp->rel_exp = unique_ptr<BaseAST>($3);
-        $$ = eq_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 RelExp
-    : AddExp {
-        auto rel_exp = new RelExpAST();
-        rel_exp->op = "";
-        rel_exp->add_exp = unique_ptr<BaseAST>($1);
-        $$ = rel_exp;
-    }
+    : AddExp { $$ = $1; }
     | RelExp RELOP AddExp {
-        auto rel_exp = new RelExpAST();
-        rel_exp->rel_exp = unique_ptr<BaseAST>($1);
-        rel_exp->op = *unique_ptr<string>($2);
-        rel_exp->add_exp = unique_ptr<BaseAST>($3);
-        $$ = rel_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 AddExp
-    : MulExp {
-        auto add_exp = new AddExpAST();
-        add_exp->op = "";
-        add_exp->mul_exp = unique_ptr<BaseAST>($1);
-        $$ = add_exp;
-    }
+    : MulExp { $$ = $1; }
     | AddExp ADDOP MulExp {
-        auto add_exp = new AddExpAST();
-        add_exp->add_exp = unique_ptr<BaseAST>($1);
-        add_exp->op = *unique_ptr<string>($2);
-        add_exp->mul_exp = unique_ptr<BaseAST>($3);
-        $$ = add_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 MulExp
-    : UnaryExp {
-        auto mul_exp = new MulExpAST();
-        mul_exp->op = "";
-        mul_exp->unary_exp = unique_ptr<BaseAST>($1);
-        $$ = mul_exp;
-    }
+    : UnaryExp { $$ = $1; }
     | MulExp MULOP UnaryExp {
-        auto mul_exp = new MulExpAST();
-        mul_exp->mul_exp = unique_ptr<BaseAST>($1);
-        mul_exp->op = *unique_ptr<string>($2);
-        mul_exp->unary_exp = unique_ptr<BaseAST>($3);
-        $$ = mul_exp;
+        auto exp = ast.node(NodeKind::binary);
+        exp->op = $2;
+        exp->a = $1;
+        exp->b = $3;
+        $$ = exp;
     }
     ;
 
 UnaryExp
-    : PrimaryExp {
-        auto unary_exp = new UnaryExpAST();
-        unary_exp->type = UnaryExpType::primary;
-        unary_exp->exp = unique_ptr<BaseAST>($1);
-        $$ = unary_exp;
-    }
+    : PrimaryExp { $$ = $1; }
     | UNARYOP UnaryExp {
-        auto unary_exp = new UnaryExpAST();
-        unary_exp->type = UnaryExpType::unary;
-        unary_exp->op = *unique_ptr<string>($1);
-        unary_exp->exp = unique_ptr<BaseAST>($2);
-        $$ = unary_exp;
+        auto exp = ast.node(NodeKind::unary);
+        exp->op = $1;
+        exp->a = $2;
+        $$ = exp;
     }
     | IDENT '(' ')' {
-        auto unary_exp = new UnaryExpAST();
-        unary_exp->type = UnaryExpType::func_call;
-        unary_exp->ident = *unique_ptr<string>($1);
-        $$ = unary_exp;
+        auto call = ast.node(NodeKind::call);
+        call->ident = *$1;
+        $$ = call;
     }
     | IDENT '(' FuncRParams ')' {
-        auto unary_exp = new UnaryExpAST();
-        unary_exp->type = UnaryExpType::func_call;
-        unary_exp->ident = *unique_ptr<string>($1);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($3);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            unary_exp->params.push_back(move(*it));
-        $$ = unary_exp;
+        auto call = ast.node(NodeKind::call);
+        call->ident = *$1;
+        call->list = ast.list($3);
+        $$ = call;
     }
     ;
 
 PrimaryExp
-    : '(' Exp ')' {
-        auto primary_exp = new PrimaryExpAST();
-        primary_exp->type = PrimaryExpType::exp;
-        primary_exp->exp = unique_ptr<BaseAST>($2);
-        $$ = primary_exp;
-    }
+    : '(' Exp ')' { $$ = $2; }
     | Number {
-        auto primary_exp = new PrimaryExpAST();
-        primary_exp->type = PrimaryExpType::number;
-        primary_exp->number = ($1);
-        $$ = primary_exp;
+        auto number = ast.node(NodeKind::number);
+        number->value = $1;
+        $$ = number;
     }
     | LVal {
-        auto primary_exp = new PrimaryExpAST();
-        primary_exp->type = PrimaryExpType::lval;
-        primary_exp->lval = *unique_ptr<string>($1);
-        $$ = primary_exp;
+        auto lval = ast.node(NodeKind::lval);
+        lval->ident = *$1;
+        $$ = lval;
     }
     | IDENT ExpList {
-        auto primary_exp = new PrimaryExpAST();
-        primary_exp->type = PrimaryExpType::list;
-        primary_exp->lval = *unique_ptr<string>($1);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            primary_exp->exp_list.push_back(move(*it));
-        $$ = primary_exp;
+        auto index = ast.node(NodeKind::index);
+        index->ident = *$1;
+        index->list = ast.list($2);
+        $$ = index;
     }
     ;
 
 Decl
-    : ConstDecl {
-        auto decl = new DeclAST();
-        decl->type = DeclType::const_decl;
-        decl->decl = unique_ptr<BaseAST>($1);
-        $$ = decl;
-    }
-    | VarDecl {
-        auto decl = new DeclAST();
-        decl->type = DeclType::var_decl;
-        decl->decl = unique_ptr<BaseAST>($1);
-        $$ = decl;
-    }
+    : ConstDecl { $$ = $1; }
+    | VarDecl { $$ = $1; }
     ;
 
 ConstDecl
     : CONST Type ConstDefList ';' {
-        auto const_decl = new ConstDeclAST();
-        const_decl->b_type = *unique_ptr<string>($2);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($3);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            const_decl->const_def_list.push_back(move(*it));
-        $$ = const_decl;
+        auto decl = ast.node(NodeKind::const_decl);
+        decl->type = $2;
+        decl->list = ast.list($3);
+        $$ = decl;
     }
     ;
 
 ConstDef
     : IDENT '=' ConstInitVal {
-        auto const_def = new ConstDefAST();
-        const_def->ident = *unique_ptr<string>($1);
-        const_def->const_init_val = unique_ptr<BaseAST>($3);
-        $$ = const_def;
+        auto def = ast.node(NodeKind::const_def, @1.first_line);
+        def->ident = *$1;
+        def->a = $3;
+        $$ = def;
     }
     | IDENT ConstExpList '=' ConstInitVal {
-        auto const_def = new ConstDefAST();
-        const_def->ident = *unique_ptr<string>($1);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            const_def->const_exp_list.push_back(move(*it));
-        const_def->const_init_val = unique_ptr<BaseAST>($4);
-        $$ = const_def;
+        auto def = ast.node(NodeKind::const_def, @1.first_line);
+        def->ident = *$1;
+        def->list = ast.list($2);
+        def->a = $4;
+        $$ = def;
     }
     ;
 
 ConstInitVal
-    : ConstExp {
-        auto const_init_val = new ConstInitValAST();
-        const_init_val->type = ConstInitValType::const_exp;
-        const_init_val->const_exp = unique_ptr<BaseAST>($1);
-        $$ = const_init_val;
-    }
+    : ConstExp { $$ = $1; }
     | '{' '}' {
-        auto const_init_val = new ConstInitValAST();
-        const_init_val->type = ConstInitValType::list;
-        $$ = const_init_val;
+        auto init = ast.node(NodeKind::init_list);
+        init->value = 1;
+        $$ = init;
     }
     | '{' ConstInitValList '}' {
-        auto const_init_val = new ConstInitValAST();
-        const_init_val->type = ConstInitValType::list;
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            const_init_val->const_init_val_list.push_back(move(*it));
-        $$ = const_init_val;
+        auto init = ast.node(NodeKind::init_list);
+        init->value = 1;
+        init->list = ast.list($2);
+        $$ = init;
     }
     ;
 
 BlockItem
-    : Decl {
-        auto block_item = new BlockItemAST();
-        block_item->type = BlockItemType::decl;
-        block_item->content = unique_ptr<BaseAST>($1);
-        $$ = block_item;
-    }
-    | Stmt {
-        auto block_item = new BlockItemAST();
-        block_item->type = BlockItemType::stmt;
-        block_item->content = unique_ptr<BaseAST>($1);
-        $$ = block_item;
-    }
+    : Decl { $$ = $1; }
+    | Stmt { $$ = $1; }
     ;
 
 ConstExp
-    : Exp {
-        auto const_exp = new ConstExpAST();
-        const_exp->exp = unique_ptr<BaseAST>($1);
-        $$ = const_exp;
-    }
+    : Exp { $$ = $1; }
     ;
 
 VarDecl
     : Type VarDefList ';' {
-        auto var_decl = new VarDeclAST();
-        var_decl->b_type = *unique_ptr<string>($1);
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            var_decl->var_def_list.push_back(move(*it));
-        $$ = var_decl;
+        auto decl = ast.node(NodeKind::var_decl);
+        decl->type = $1;
+        decl->list = ast.list($2);
+        $$ = decl;
     }
     ;
 
 VarDef
     : IDENT {
-        auto var_def = new VarDefAST();
-        var_def->ident = *unique_ptr<string>($1);
-        var_def->has_init_val = false;
-        $$ = var_def;
+        auto def = ast.node(NodeKind::var_def, @1.first_line);
+        def->ident = *$1;
+        $$ = def;
     }
     | IDENT '=' InitVal {
-        auto var_def = new VarDefAST();
-        var_def->ident = *unique_ptr<string>($1);
-        var_def->has_init_val = true;
-        var_def->init_val = unique_ptr<BaseAST>($3);
-        $$ = var_def;
+        auto def = ast.node(NodeKind::var_def, @1.first_line);
+        def->ident = *$1;
+        def->a = $3;
+        $$ = def;
     }
     | IDENT ConstExpList {
-        auto var_def = new VarDefAST();
-        var_def->ident = *unique_ptr<string>($1);
-        var_def->has_init_val = false;
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            var_def->exp_list.push_back(move(*it));
-        $$ = var_def;
+        auto def = ast.node(NodeKind::var_def, @1.first_line);
+        def->ident = *$1;
+        def->list = ast.list($2);
+        $$ = def;
     }
     | IDENT ConstExpList '=' InitVal {
-        auto var_def = new VarDefAST();
-        var_def->ident = *unique_ptr<string>($1);
-        var_def->has_init_val = true;
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            var_def->exp_list.push_back(move(*it));
-        var_def->init_val = unique_ptr<BaseAST>($4);
-        $$ = var_def;
+        auto def = ast.node(NodeKind::var_def, @1.first_line);
+        def->ident = *$1;
+        def->list = ast.list($2);
+        def->a = $4;
+        $$ = def;
     }
     ;
 
 InitVal
-    : Exp {
-        auto init_val = new InitValAST();
-        init_val->type = InitValType::exp;
-        init_val->exp = unique_ptr<BaseAST>($1);
-        $$ = init_val;
-    }
-    | '{' '}' {
-        auto init_val = new InitValAST();
-        init_val->type = InitValType::list;
-        $$ = init_val;
-    }
+    : Exp { $$ = $1; }
+    | '{' '}' { $$ = ast.node(NodeKind::init_list); }
     | '{' InitValList '}' {
-        auto init_val = new InitValAST();
-        init_val->type = InitValType::list;
-        vector<unique_ptr<BaseAST>> *v_ptr = ($2);
-        for (auto it = v_ptr->begin(); it != v_ptr->end(); it++)
-            init_val->init_val_list.push_back(move(*it));
-        $$ = init_val;
+        auto init = ast.node(NodeKind::init_list);
+        init->list = ast.list($2);
+        $$ = init;
     }
     ;
 
 BlockItemList
-    : {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        $$ = v;
-    }
-    | BlockItemList BlockItem {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($2));
-        $$ = v;
-    }
+    : { $$ = ast.chain(); }
+    | BlockItemList BlockItem { $$ = ast.append($1, $2); }
     ;
 
 ConstDefList
-    : ConstDef {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | ConstDefList ',' ConstDef {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : ConstDef { $$ = ast.chain($1); }
+    | ConstDefList ',' ConstDef { $$ = ast.append($1, $3); }
     ;
 
 VarDefList
-    : VarDef {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | VarDefList ',' VarDef {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : VarDef { $$ = ast.chain($1); }
+    | VarDefList ',' VarDef { $$ = ast.append($1, $3); }
     ;
 
 ConstExpList
-    : '[' ConstExp ']' {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($2));
-        $$ = v;
-    }
-    | ConstExpList '[' ConstExp ']' {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : '[' ConstExp ']' { $$ = ast.chain($2); }
+    | ConstExpList '[' ConstExp ']' { $$ = ast.append($1, $3); }
     ;
 
 ExpList
-    : '[' Exp ']' {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($2));
-        $$ = v;
-    }
-    | ExpList '[' Exp ']' {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : '[' Exp ']' { $$ = ast.chain($2); }
+    | ExpList '[' Exp ']' { $$ = ast.append($1, $3); }
     ;
 
 ConstInitValList
-    : ConstInitVal {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | ConstInitValList ',' ConstInitVal {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : ConstInitVal { $$ = ast.chain($1); }
+    | ConstInitValList ',' ConstInitVal { $$ = ast.append($1, $3); }
     ;
 
 InitValList
-    : InitVal {
-        vector<unique_ptr<BaseAST>> *v = new vector<unique_ptr<BaseAST>>;
-        v->push_back(unique_ptr<BaseAST>($1));
-        $$ = v;
-    }
-    | InitValList ',' InitVal {
-        vector<unique_ptr<BaseAST>> *v = ($1);
-        v->push_back(unique_ptr<BaseAST>($3));
-        $$ = v;
-    }
+    : InitVal { $$ = ast.chain($1); }
+    | InitValList ',' InitVal { $$ = ast.append($1, $3); }
     ;
 
 Number
-    : INT_CONST {
-        $$ = ($1);
-    }
+    : INT_CONST { $$ = $1; }
     ;
 
 LVal
-    : IDENT {
-        string *lval = new string(*unique_ptr<string>($1));
-        $$ = lval;
-    }
+    : IDENT { $$ = $1; }
     ;
 
 Type
-    : INT {
-        string *type = new string("int");
-        $$ = type;
-    }
-    | VOID {
-        string *type = new string("void");
-        $$ = type;
-    }
+    : INT { $$ = BType::int_; }
+    | VOID { $$ = BType::void_; }
     ;
 
 UNARYOP
-    : '+' {
-        string *op = new string("+");
-        $$ = op;
-    }
-    | '-' {
-        string *op = new string("-");
-        $$ = op;
-    }
-    | '!' {
-        string *op = new string("!");
-        $$ = op;
-    }
+    : '+' { $$ = Op::add; }
+    | '-' { $$ = Op::sub; }
+    | '!' { $$ = Op::not_; }
     ;
 
 MULOP
-    : '*' {
-        string *op = new string("*");
-        $$ = op;
-    }
-    | '/' {
-        string *op = new string("/");
-        $$ = op;
-    }
-    | '%' {
-        string *op = new string("%");
-        $$ = op;
-    }
+    : '*' { $$ = Op::mul; }
+    | '/' { $$ = Op::div; }
+    | '%' { $$ = Op::mod; }
     ;
 
 ADDOP
-    : '+' {
-        string *op = new string("+");
-        $$ = op;
-    }
-    | '-' {
-        string *op = new string("-");
-        $$ = op;
-    }
+    : '+' { $$ = Op::add; }
+    | '-' { $$ = Op::sub; }
     ;
 
 RELOP
-    : LE {
-        string *op = new string("<=");
-        $$ = op;
-    }
-    | GE {
-        string *op = new string(">=");
-        $$ = op;
-    }
-    | '<' {
-        string *op = new string("<");
-        $$ = op;
-    }
-    | '>' {
-        string *op = new string(">");
-        $$ = op;
-    }
+    : LE { $$ = Op::le; }
+    | GE { $$ = Op::ge; }
+    | '<' { $$ = Op::lt; }
+    | '>' { $$ = Op::gt; }
     ;
 
 EQOP
-    : EQ {
-        string *op = new string("==");
-        $$ = op;
-    }
-    | NE {
-        string *op = new string("!=");
-        $$ = op;
-    }
+    : EQ { $$ = Op::eq; }
+    | NE { $$ = Op::ne; }
     ;
 
 ANDOP
-    : AND {
-        string *op = new string("&&");
-        $$ = op;
-    }
+    : AND { $$ = Op::and_; }
     ;
 
 OROP
-    : OR {
-        string *op = new string("||");
-        $$ = op;
-    }
+    : OR { $$ = Op::or_; }
     ;
 
 %%
 
-void yyerror(unique_ptr<BaseAST> &ast, const char *s)
+// the tokens of the lexer are those of the grammar
+int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, Lexer &lexer)
+{
+    static const int kinds[] = {0, INT, VOID, RETURN, CONST, IF, ELSE, WHILE,
+        BREAK, CONTINUE, IDENT, INT_CONST, LE, GE, EQ, NE, AND, OR};
+    Token token = lexer.next();
+    yylloc->first_line = yylloc->last_line = token.line;
+    if (token.kind == TOK_CHAR)return token.value;
+    if (token.kind == TOK_IDENT)yylval->ident = &lexer.names.name(token.value);
+    else if (token.kind == TOK_INT_CONST)yylval->int_val = token.value;
+    return kinds[token.kind];
+}
+
+
+void yyerror(YYLTYPE *yylloc, AST &ast, Lexer &lexer, const char *s)
 {
-    extern int yylineno;
-    extern char *yytext;
-    cerr << "ERROR: " << s << " at symbol '" << yytext << "' on line "
-        << yylineno << endl;
+    cerr << "ERROR: " << s << " at symbol '" << lexer.text() <<
+        "' on line " << yylloc->first_line << endl;
 }
@@ -0,0 +1,81 @@
+# runs one test: cmake -DNAME=<test> -DCOMPILER=<compiler> -DSOURCE=<file.sy>
+# -DARGS=<list> [-DEXPECT=<file>] [-DMATCH=<regex list>] [-DFAIL=ON]
+# [-DCREATES=<file>] [-DSAME=<list>] [-DCACHE=ON] [-DPRIOR=<file.sy>]
+# [-DFILTER=<command list>] -P check.cmake
+# compiles SOURCE with the mode and options in ARGS, then compares the output
+# file with EXPECT and looks for each regex of the list MATCH in the output
+# file and what the compiler printed to stderr; with FAIL the compile must
+# fail instead, and only stderr is searched. CREATES is a file the compile
+# writes besides the output, removed before and searched after it. With SAME
+# SOURCE is compiled with those options as well, and the outputs must be the
+# same. CACHE runs the compiles of ARGS on a cache of their own, empty at
+# first, and PRIOR is compiled with ARGS before SOURCE. FILTER is run on the
+# output file, what it prints stands for the output
+set(output ${CMAKE_CURRENT_BINARY_DIR}/${NAME}.result)
+if(DEFINED CREATES)
+  file(REMOVE ${CREATES})
+endif()
+if(DEFINED SAME)
+  set(same_output ${CMAKE_CURRENT_BINARY_DIR}/${NAME}.same)
+  execute_process(COMMAND ${COMPILER} ${SAME} ${SOURCE} -o ${same_output}
+                  RESULT_VARIABLE result ERROR_VARIABLE errors
+                  INPUT_FILE /dev/null)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${COMPILER} ${SAME} failed on ${SOURCE}: ${errors}")
+  endif()
+  file(READ ${same_output} same)
+endif()
+if(CACHE)
+  set(cache ${CMAKE_CURRENT_BINARY_DIR}/${NAME}.cache)
+  file(REMOVE_RECURSE ${cache})
+  set(ENV{SYSY_CACHE_DIR} ${cache})
+endif()
+if(DEFINED PRIOR)
+  execute_process(COMMAND ${COMPILER} ${ARGS} ${PRIOR} -o ${output}
+                  RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE errors
+                  INPUT_FILE /dev/null)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${COMPILER} ${ARGS} failed on ${PRIOR}: ${errors}")
+  endif()
+endif()
+execute_process(COMMAND ${COMPILER} ${ARGS} ${SOURCE} -o ${output}
+                RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE errors
+                INPUT_FILE /dev/null)
+if(FAIL)
+  if(result EQUAL 0)
+    message(FATAL_ERROR "${COMPILER} ${ARGS} accepted ${SOURCE}")
+  endif()
+  set(actual "")
+elseif(NOT result EQUAL 0)
+  message(FATAL_ERROR "${COMPILER} ${ARGS} failed on ${SOURCE}: ${errors}")
+else()
+  file(READ ${output} actual)
+endif()
+if(DEFINED FILTER AND NOT FAIL)
+  execute_process(COMMAND ${FILTER} ${output} RESULT_VARIABLE result
+                  OUTPUT_VARIABLE actual ERROR_VARIABLE errors)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${FILTER} failed on ${output}: ${errors}")
+  endif()
+endif()
+if(DEFINED SAME AND NOT actual STREQUAL same)
+  message(FATAL_ERROR "${NAME}: ${ARGS} and ${SAME} differ on ${SOURCE}")
+endif()
+if(DEFINED CREATES AND NOT FAIL)
+  if(NOT EXISTS ${CREATES})
+    message(FATAL_ERROR "${NAME}: ${CREATES} was not written")
+  endif()
+  file(READ ${CREATES} created)
+  string(APPEND actual "${created}")
+endif()
+if(DEFINED EXPECT)
+  file(READ ${EXPECT} expected)
+  if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "${NAME} gave \"${actual}\", not \"${expected}\"")
+  endif()
+endif()
+foreach(regex ${MATCH})
+  if(NOT actual MATCHES "${regex}" AND NOT errors MATCHES "${regex}")
+    message(FATAL_ERROR "${NAME}: no \"${regex}\" in \"${actual}${errors}\"")
+  endif()
+endforeach()